@@ -0,0 +1,197 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <leaf3d/L3DAssetRegistry.h>
+
+using namespace l3d;
+
+bool L3DAssetRegistry::acquire(
+    const std::string &key,
+    L3DHandleList &handles,
+    unsigned long long hash)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    L3DAssetMap::iterator it = m_assets.find(key);
+
+    if (it == m_assets.end() && hash)
+    {
+        L3DAssetHashMap::iterator hashIt = m_hashes.find(hash);
+        if (hashIt != m_hashes.end())
+            it = m_assets.find(hashIt->second);
+    }
+
+    if (it == m_assets.end())
+        return false;
+
+    it->second.refCount++;
+    it->second.hitCount++;
+    handles = it->second.handles;
+
+    return true;
+}
+
+void L3DAssetRegistry::add(
+    const std::string &key,
+    const L3DHandleList &handles,
+    unsigned int size,
+    unsigned long long hash)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    L3DAsset &asset = m_assets[key];
+    asset.handles = handles;
+    asset.hash = hash;
+    asset.size = size;
+    asset.refCount = 1;
+    asset.hitCount = 0;
+
+    if (hash)
+        m_hashes[hash] = key;
+}
+
+void L3DAssetRegistry::setSize(const std::string &key, unsigned int size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    L3DAssetMap::iterator it = m_assets.find(key);
+    if (it != m_assets.end())
+        it->second.size = size;
+}
+
+bool L3DAssetRegistry::release(const L3DHandle &handle)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (L3DAssetMap::iterator it = m_assets.begin(); it != m_assets.end(); ++it)
+    {
+        const L3DHandleList &handles = it->second.handles;
+
+        for (L3DHandleList::const_iterator h = handles.begin(); h != handles.end(); ++h)
+        {
+            if (h->repr != handle.repr)
+                continue;
+
+            if (--it->second.refCount == 0)
+            {
+                if (it->second.hash)
+                    m_hashes.erase(it->second.hash);
+                m_assets.erase(it);
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void L3DAssetRegistry::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_assets.clear();
+    m_hashes.clear();
+}
+
+unsigned int L3DAssetRegistry::refCount(const std::string &key) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    L3DAssetMap::const_iterator it = m_assets.find(key);
+
+    return (it != m_assets.end()) ? it->second.refCount : 0;
+}
+
+L3DAssetStats L3DAssetRegistry::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    L3DAssetStats stats;
+    stats.assetCount = m_assets.size();
+    stats.hitCount = 0;
+    stats.bytesSaved = 0;
+
+    for (L3DAssetMap::const_iterator it = m_assets.begin(); it != m_assets.end(); ++it)
+    {
+        stats.hitCount += it->second.hitCount;
+        stats.bytesSaved += (unsigned long long)it->second.size * it->second.hitCount;
+    }
+
+    return stats;
+}
+
+std::string L3DAssetRegistry::normalizePath(const std::string &path)
+{
+    std::vector<std::string> parts;
+    std::string part;
+    bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+
+    for (unsigned int i = 0; i <= path.size(); ++i)
+    {
+        char c = (i < path.size()) ? path[i] : '/';
+
+        if (c != '/' && c != '\\')
+        {
+            part += c;
+            continue;
+        }
+
+        if (part == "..")
+        {
+            if (!parts.empty() && parts.back() != "..")
+                parts.pop_back();
+            else if (!absolute)
+                parts.push_back(part);
+        }
+        else if (!part.empty() && part != ".")
+        {
+            parts.push_back(part);
+        }
+
+        part.clear();
+    }
+
+    std::string normalized = absolute ? "/" : "";
+
+    for (unsigned int i = 0; i < parts.size(); ++i)
+    {
+        if (i > 0)
+            normalized += '/';
+        normalized += parts[i];
+    }
+
+    return normalized;
+}
+
+unsigned long long L3DAssetRegistry::hash(const void *data, unsigned int size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    unsigned long long hash = 14695981039346656037ULL;
+
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
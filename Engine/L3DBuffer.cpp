@@ -21,6 +21,7 @@
 
 #include <leaf3d/L3DRenderer.h>
 #include <leaf3d/L3DBuffer.h>
+#include <leaf3d/L3DMemory.h>
 
 using namespace l3d;
 
@@ -30,21 +31,64 @@ L3DBuffer::L3DBuffer(
     void *data,
     unsigned int size,
     unsigned int stride,
-    const L3DDrawType &drawType) : L3DResource(L3D_BUFFER, renderer),
+    const L3DDrawType &drawType,
+    L3DReleaseCallback release,
+    void *releaseData) : L3DResource(L3D_BUFFER, renderer),
                                    m_type(type),
                                    m_data(0),
                                    m_size(size),
                                    m_stride(stride),
-                                   m_drawType(drawType)
+                                   m_drawType(drawType),
+                                   m_residency(renderer ? renderer->residencyPolicy() : L3D_RESIDENCY_KEEP),
+                                   m_release(L3D_NULLPTR),
+                                   m_releaseData(L3D_NULLPTR)
 {
-    if (data)
-        m_data = memcpy(malloc(size), data, size);
+    // Without a copy to keep, upload straight from the caller data.
+    if (data && release)
+    {
+        m_data = data;
+        m_release = release;
+        m_releaseData = releaseData;
+    }
+    else if (data && m_residency == L3D_RESIDENCY_KEEP)
+        m_data = L3DMemory::duplicate(data, size, L3D_MEMORY_GEOMETRY);
+    else if (renderer)
+        m_data = data;
 
     if (renderer)
         renderer->addBuffer(this);
+
+    if (m_residency != L3D_RESIDENCY_KEEP && m_release)
+        this->discardData();
+    else if (m_residency != L3D_RESIDENCY_KEEP)
+        m_data = L3D_NULLPTR;
 }
 
 L3DBuffer::~L3DBuffer()
 {
-    free(m_data);
+    this->freeData();
+}
+
+void L3DBuffer::freeData()
+{
+    if (m_release && m_data)
+        m_release(m_data, m_releaseData);
+    else
+        L3DMemory::deallocate(m_data);
+
+    m_release = L3D_NULLPTR;
+    m_releaseData = L3D_NULLPTR;
+}
+
+void L3DBuffer::setData(void *data)
+{
+    if (data != m_data)
+        this->freeData();
+
+    m_data = data;
+}
+
+void L3DBuffer::discardData()
+{
+    this->setData(L3D_NULLPTR);
 }
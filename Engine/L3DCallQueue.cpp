@@ -0,0 +1,123 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <thread>
+#include <leaf3d/L3DCallQueue.h>
+
+using namespace l3d;
+
+L3DCallQueue::L3DCallQueue(unsigned int capacity) : m_tail(0),
+                                                     m_head(0)
+{
+    unsigned int size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    m_mask = size - 1;
+    m_slots = new Slot[size];
+
+    for (unsigned int i = 0; i < size; ++i)
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+L3DCallQueue::~L3DCallQueue()
+{
+    delete[] m_slots;
+}
+
+bool L3DCallQueue::tryPush(const L3DCall &call)
+{
+    unsigned int pos = m_tail.load(std::memory_order_relaxed);
+    Slot *slot = L3D_NULLPTR;
+
+    while (true)
+    {
+        slot = &m_slots[pos & m_mask];
+        unsigned int sequence = slot->sequence.load(std::memory_order_acquire);
+        int diff = (int)(sequence - pos);
+
+        if (diff == 0)
+        {
+            // Slot is free: try to claim it.
+            if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // Ring is full.
+            return false;
+        }
+        else
+        {
+            pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->call = call;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    return true;
+}
+
+void L3DCallQueue::push(const L3DCall &call)
+{
+    // Wait for the consumer to make room.
+    while (!this->tryPush(call))
+        std::this_thread::yield();
+}
+
+bool L3DCallQueue::pop(L3DCall &call)
+{
+    Slot *slot = &m_slots[m_head & m_mask];
+    unsigned int sequence = slot->sequence.load(std::memory_order_acquire);
+
+    if ((int)(sequence - (m_head + 1)) < 0)
+        return false;
+
+    call.swap(slot->call);
+    slot->call = L3D_NULLPTR;
+    slot->sequence.store(m_head + m_mask + 1, std::memory_order_release);
+    ++m_head;
+
+    return true;
+}
+
+bool L3DCallQueue::isEmpty() const
+{
+    const Slot *slot = &m_slots[m_head & m_mask];
+
+    return (int)(slot->sequence.load(std::memory_order_acquire) - (m_head + 1)) < 0;
+}
+
+unsigned int L3DCallQueue::drain()
+{
+    unsigned int count = 0;
+    L3DCall call;
+
+    while (this->pop(call))
+    {
+        if (call)
+            call();
+        ++count;
+    }
+
+    return count;
+}
@@ -0,0 +1,137 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <atomic>
+#include <mutex>
+#include "leaf3d/L3DContext.h"
+#include "leaf3d/L3DRenderer.h"
+
+using namespace l3d;
+
+static thread_local L3DContext *s_currentContext = L3D_NULLPTR;
+static std::atomic<L3DContext *> s_defaultContext(L3D_NULLPTR);
+
+// Loader pool shared by all the contexts, alive while one of them uses it:
+// one pool per context would spawn a worker per core for each of them.
+static std::mutex s_loaderMutex;
+static L3DJobSystem *s_loader = L3D_NULLPTR;
+static unsigned int s_loaderUsers = 0;
+
+static L3DJobSystem *acquireLoader()
+{
+    std::lock_guard<std::mutex> lock(s_loaderMutex);
+
+    if (!s_loader)
+        s_loader = new L3DJobSystem(L3DJobSystem::defaultWorkerCount());
+
+    ++s_loaderUsers;
+
+    return s_loader;
+}
+
+static void releaseLoader()
+{
+    std::lock_guard<std::mutex> lock(s_loaderMutex);
+
+    if (--s_loaderUsers == 0)
+    {
+        delete s_loader;
+        s_loader = L3D_NULLPTR;
+    }
+}
+
+L3DContext::L3DContext() : m_renderer(L3D_NULLPTR),
+                           m_rootPath(L3D_DEFAULT_ROOT_PATH),
+                           m_loader(L3D_NULLPTR)
+{
+}
+
+L3DContext::~L3DContext()
+{
+    setRenderer(L3D_NULLPTR);
+
+    // Other contexts may still use the pool.
+    if (m_loader)
+    {
+        this->finishLoads();
+        releaseLoader();
+    }
+
+    if (s_currentContext == this)
+        s_currentContext = L3D_NULLPTR;
+
+    L3DContext *self = this;
+    s_defaultContext.compare_exchange_strong(self, L3D_NULLPTR);
+}
+
+void L3DContext::setRenderer(L3DRenderer *renderer)
+{
+    if (m_renderer == renderer)
+        return;
+
+    // Pending loads target the current renderer.
+    this->finishLoads();
+
+    // Its resources are gone.
+    m_assets.clear();
+
+    delete m_renderer;
+
+    m_renderer = renderer;
+}
+
+L3DJobSystem *L3DContext::loader()
+{
+    std::call_once(m_loaderCreated, [this]() {
+        m_loader = acquireLoader();
+    });
+
+    return m_loader;
+}
+
+void L3DContext::finishLoads()
+{
+    if (m_loader)
+        m_loader->wait(&m_pendingLoads);
+}
+
+L3DContext *L3DContext::current()
+{
+    if (s_currentContext)
+        return s_currentContext;
+
+    return s_defaultContext.load();
+}
+
+void L3DContext::makeCurrent(L3DContext *context)
+{
+    s_currentContext = context;
+}
+
+L3DContext *L3DContext::defaultContext()
+{
+    return s_defaultContext.load();
+}
+
+void L3DContext::setDefaultContext(L3DContext *context)
+{
+    s_defaultContext = context;
+}
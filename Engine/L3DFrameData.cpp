@@ -0,0 +1,88 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <string.h>
+#include <leaf3d/L3DShaderProgram.h>
+#include <leaf3d/L3DFrameData.h>
+
+using namespace l3d;
+
+L3DPackedUniform::L3DPackedUniform(const std::string &name, float value) : name(name),
+                                                                            type(L3D_UNIFORM_FLOAT)
+{
+    this->valueF[0] = value;
+}
+
+L3DPackedUniform::L3DPackedUniform(const std::string &name, int value) : name(name),
+                                                                          type(L3D_UNIFORM_INT)
+{
+    this->valueI = value;
+}
+
+L3DPackedUniform::L3DPackedUniform(const std::string &name, const L3DVec3 &value) : name(name),
+                                                                                     type(L3D_UNIFORM_VEC3)
+{
+    memcpy(this->valueF, glm::value_ptr(value), sizeof(L3DVec3));
+}
+
+L3DPackedUniform::L3DPackedUniform(const std::string &name, const L3DVec4 &value) : name(name),
+                                                                                     type(L3D_UNIFORM_VEC4)
+{
+    memcpy(this->valueF, glm::value_ptr(value), sizeof(L3DVec4));
+}
+
+L3DPackedUniform::L3DPackedUniform(const std::string &name, const L3DUniform &value) : name(name),
+                                                                                        type(value.type)
+{
+    switch (value.type)
+    {
+    case L3D_UNIFORM_FLOAT:
+        this->valueF[0] = value.value.valueF;
+        break;
+    case L3D_UNIFORM_INT:
+        this->valueI = value.value.valueI;
+        break;
+    case L3D_UNIFORM_UINT:
+        this->valueUI = value.value.valueUI;
+        break;
+    case L3D_UNIFORM_BOOL:
+        this->valueUI = value.value.valueB;
+        break;
+    case L3D_UNIFORM_VEC2:
+        memcpy(this->valueF, value.value.valueVec2, sizeof(L3DVec2));
+        break;
+    case L3D_UNIFORM_VEC3:
+        memcpy(this->valueF, value.value.valueVec3, sizeof(L3DVec3));
+        break;
+    case L3D_UNIFORM_VEC4:
+        memcpy(this->valueF, value.value.valueVec4, sizeof(L3DVec4));
+        break;
+    case L3D_UNIFORM_MAT3:
+        memcpy(this->valueF, value.value.valueMat3, sizeof(L3DMat3));
+        break;
+    case L3D_UNIFORM_MAT4:
+        memcpy(this->valueF, value.value.valueMat4, sizeof(L3DMat4));
+        break;
+    default:
+        this->valueUI = 0;
+        break;
+    }
+}
@@ -0,0 +1,259 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <stdio.h>
+#include <leaf3d/L3DJobSystem.h>
+#include <leaf3d/L3DTrace.h>
+
+using namespace l3d;
+
+// Identifies the pool (and the queue inside it) owned by the current thread.
+static thread_local L3DJobSystem *s_currentJobSystem = L3D_NULLPTR;
+static thread_local unsigned int s_currentQueueIndex = 0;
+
+L3DJobSystem::L3DJobSystem(unsigned int workerCount) : m_queuedJobs(0),
+                                                       m_stop(false)
+{
+    // Queue 0 collects jobs submitted by threads outside the pool.
+    for (unsigned int i = 0; i <= workerCount; ++i)
+        m_queues.push_back(new L3DWorkQueue());
+
+    for (unsigned int i = 1; i <= workerCount; ++i)
+        m_workers.push_back(std::thread(&L3DJobSystem::workerLoop, this, i));
+}
+
+L3DJobSystem::~L3DJobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_stop = true;
+    }
+    m_wakeCondition.notify_all();
+
+    for (L3DWorkerList::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+        it->join();
+    m_workers.clear();
+
+    for (L3DWorkQueueList::reverse_iterator it = m_queues.rbegin(); it != m_queues.rend(); ++it)
+        delete *it;
+    m_queues.clear();
+}
+
+void L3DJobSystem::run(
+    const L3DJob &job,
+    L3DJobCounter *counter,
+    L3DJobCounter *dependency)
+{
+    L3DScheduledJob scheduled;
+    scheduled.job = job;
+    scheduled.counter = counter;
+
+    if (counter)
+        counter->m_pending++;
+
+    // Defer the job until its dependency completes.
+    if (dependency)
+    {
+        std::lock_guard<std::mutex> lock(dependency->m_mutex);
+        if (!dependency->isDone())
+        {
+            dependency->m_continuations.push_back(scheduled);
+            return;
+        }
+    }
+
+    this->push(scheduled);
+}
+
+void L3DJobSystem::wait(L3DJobCounter *counter)
+{
+    if (!counter)
+        return;
+
+    // Help executing pending jobs instead of blocking.
+    while (!counter->isDone())
+    {
+        if (!this->runPending())
+            std::this_thread::yield();
+    }
+
+    // Make sure the thread that completed the counter released it.
+    std::lock_guard<std::mutex> lock(counter->m_mutex);
+}
+
+void L3DJobSystem::parallelFor(
+    unsigned int count,
+    unsigned int grainSize,
+    const L3DRangeJob &job)
+{
+    if (!count)
+        return;
+
+    if (!grainSize)
+        grainSize = 1;
+
+    if (m_workers.empty() || count <= grainSize)
+    {
+        job(0, count);
+        return;
+    }
+
+    L3DJobCounter counter;
+
+    for (unsigned int begin = 0; begin < count; begin += grainSize)
+    {
+        unsigned int end = (begin + grainSize < count) ? begin + grainSize : count;
+        this->run([&job, begin, end]() { job(begin, end); }, &counter);
+    }
+
+    this->wait(&counter);
+}
+
+unsigned int L3DJobSystem::defaultWorkerCount()
+{
+    // Leave one core to the thread owning the OpenGL context.
+    unsigned int cores = std::thread::hardware_concurrency();
+
+    return (cores > 1) ? cores - 1 : 0;
+}
+
+void L3DJobSystem::push(const L3DScheduledJob &job)
+{
+    if (m_workers.empty())
+    {
+        L3DScheduledJob inlineJob = job;
+        this->execute(inlineJob);
+        return;
+    }
+
+    unsigned int queueIndex = (s_currentJobSystem == this) ? s_currentQueueIndex : 0;
+    L3DWorkQueue *queue = m_queues[queueIndex];
+
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->jobs.push_back(job);
+    }
+
+    m_queuedJobs++;
+
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+    }
+    m_wakeCondition.notify_one();
+}
+
+bool L3DJobSystem::pop(L3DScheduledJob &job)
+{
+    unsigned int queueCount = m_queues.size();
+    unsigned int queueIndex = (s_currentJobSystem == this) ? s_currentQueueIndex : 0;
+
+    // 1. Newest job of our own queue.
+    {
+        L3DWorkQueue *queue = m_queues[queueIndex];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (!queue->jobs.empty())
+        {
+            job = queue->jobs.back();
+            queue->jobs.pop_back();
+            m_queuedJobs--;
+            return true;
+        }
+    }
+
+    // 2. Oldest job stolen from another queue.
+    for (unsigned int i = 1; i < queueCount; ++i)
+    {
+        L3DWorkQueue *queue = m_queues[(queueIndex + i) % queueCount];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (!queue->jobs.empty())
+        {
+            job = queue->jobs.front();
+            queue->jobs.pop_front();
+            m_queuedJobs--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool L3DJobSystem::runPending()
+{
+    L3DScheduledJob job;
+
+    if (!this->pop(job))
+        return false;
+
+    this->execute(job);
+
+    return true;
+}
+
+void L3DJobSystem::execute(L3DScheduledJob &job)
+{
+    if (job.job)
+    {
+        L3D_TRACE_SCOPE("Job");
+        job.job();
+    }
+
+    this->finish(job.counter);
+}
+
+void L3DJobSystem::finish(L3DJobCounter *counter)
+{
+    if (!counter)
+        return;
+
+    L3DScheduledJobList continuations;
+
+    {
+        std::lock_guard<std::mutex> lock(counter->m_mutex);
+        if (--counter->m_pending > 0)
+            return;
+        continuations.swap(counter->m_continuations);
+    }
+
+    for (L3DScheduledJobList::iterator it = continuations.begin(); it != continuations.end(); ++it)
+        this->push(*it);
+}
+
+void L3DJobSystem::workerLoop(unsigned int queueIndex)
+{
+    s_currentJobSystem = this;
+    s_currentQueueIndex = queueIndex;
+
+    char threadName[32];
+    snprintf(threadName, sizeof(threadName), "Worker %u", queueIndex);
+    L3DTrace::setThreadName(threadName);
+
+    while (true)
+    {
+        if (this->runPending())
+            continue;
+
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        m_wakeCondition.wait(lock, [this]() { return m_stop || m_queuedJobs > 0; });
+
+        if (m_stop && m_queuedJobs == 0)
+            return;
+    }
+}
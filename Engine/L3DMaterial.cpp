@@ -32,7 +32,7 @@ L3DMaterial::L3DMaterial(
     const L3DColorRegistry &colors,
     const L3DParameterRegistry &params,
     const L3DTextureRegistry &textures) : L3DResource(L3D_MATERIAL, renderer),
-                                          m_name(name),
+                                          m_name(name ? name : ""),
                                           m_shaderProgram(shaderProgram),
                                           colors(colors),
                                           params(params),
@@ -0,0 +1,198 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <leaf3d/L3DMemory.h>
+
+using namespace l3d;
+
+// Room for the block header, keeping blocks aligned as malloc() does.
+#define L3D_MEMORY_HEADER_SIZE 16
+
+struct L3DMemoryHeader
+{
+    size_t size;
+    unsigned int tag;
+};
+
+static_assert(sizeof(L3DMemoryHeader) <= L3D_MEMORY_HEADER_SIZE, "Memory block header too large");
+
+static void *defaultAllocate(size_t size, L3DMemoryTag, void *)
+{
+    return malloc(size);
+}
+
+static void defaultDeallocate(void *ptr, size_t, L3DMemoryTag, void *)
+{
+    free(ptr);
+}
+
+static const char *s_tagNames[L3D_MEMORY_TAG_COUNT] = {"geometry", "textures", "shaders", "commands", "loader"};
+
+static L3DAllocator s_allocator = {defaultAllocate, defaultDeallocate, L3D_NULLPTR};
+static std::atomic<unsigned long long> s_bytes[L3D_MEMORY_TAG_COUNT];
+static std::atomic<unsigned int> s_counts[L3D_MEMORY_TAG_COUNT];
+static std::atomic<unsigned long long> s_totalBytes(0);
+static std::atomic<unsigned long long> s_peakBytes(0);
+
+bool L3DMemory::setAllocator(const L3DAllocator *allocator)
+{
+    if (allocator && (!allocator->allocate || !allocator->deallocate))
+    {
+        fprintf(stderr, "Invalid allocator\n");
+        return false;
+    }
+
+    // Blocks must be released by the allocator which allocated them.
+    if (L3DMemory::stats().totalCount > 0)
+    {
+        fprintf(stderr, "Can't replace the allocator while memory is allocated\n");
+        return false;
+    }
+
+    if (allocator)
+    {
+        s_allocator = *allocator;
+    }
+    else
+    {
+        s_allocator.allocate = defaultAllocate;
+        s_allocator.deallocate = defaultDeallocate;
+        s_allocator.userData = L3D_NULLPTR;
+    }
+
+    return true;
+}
+
+void *L3DMemory::allocate(size_t size, L3DMemoryTag tag)
+{
+    unsigned char *block = (unsigned char *)s_allocator.allocate(size + L3D_MEMORY_HEADER_SIZE, tag, s_allocator.userData);
+
+    if (!block)
+    {
+        fprintf(stderr, "Failed to allocate %lu bytes of %s memory\n", (unsigned long)size, s_tagNames[tag]);
+        return L3D_NULLPTR;
+    }
+
+    L3DMemoryHeader *header = (L3DMemoryHeader *)block;
+    header->size = size;
+    header->tag = tag;
+
+    s_bytes[tag] += size;
+    ++s_counts[tag];
+
+    unsigned long long total = (s_totalBytes += size);
+    unsigned long long peak = s_peakBytes.load();
+    while (total > peak && !s_peakBytes.compare_exchange_weak(peak, total))
+        ;
+
+    return block + L3D_MEMORY_HEADER_SIZE;
+}
+
+void *L3DMemory::duplicate(const void *data, size_t size, L3DMemoryTag tag)
+{
+    void *ptr = L3DMemory::allocate(size, tag);
+
+    if (ptr && data)
+        memcpy(ptr, data, size);
+
+    return ptr;
+}
+
+void *L3DMemory::reallocate(void *ptr, size_t size, L3DMemoryTag tag)
+{
+    if (!ptr)
+        return L3DMemory::allocate(size, tag);
+
+    if (!size)
+    {
+        L3DMemory::deallocate(ptr);
+        return L3D_NULLPTR;
+    }
+
+    const L3DMemoryHeader *header = (const L3DMemoryHeader *)((unsigned char *)ptr - L3D_MEMORY_HEADER_SIZE);
+    void *newPtr = L3DMemory::allocate(size, tag);
+
+    // Like realloc(), the old block survives a failure.
+    if (!newPtr)
+        return L3D_NULLPTR;
+
+    memcpy(newPtr, ptr, header->size < size ? header->size : size);
+    L3DMemory::deallocate(ptr);
+
+    return newPtr;
+}
+
+void L3DMemory::deallocate(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    unsigned char *block = (unsigned char *)ptr - L3D_MEMORY_HEADER_SIZE;
+    const L3DMemoryHeader *header = (const L3DMemoryHeader *)block;
+    size_t size = header->size;
+    L3DMemoryTag tag = (L3DMemoryTag)header->tag;
+
+    s_bytes[tag] -= size;
+    --s_counts[tag];
+    s_totalBytes -= size;
+
+    s_allocator.deallocate(block, size + L3D_MEMORY_HEADER_SIZE, tag, s_allocator.userData);
+}
+
+L3DAllocationStats L3DMemory::stats()
+{
+    L3DAllocationStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    for (unsigned int tag = 0; tag < L3D_MEMORY_TAG_COUNT; ++tag)
+    {
+        stats.bytes[tag] = s_bytes[tag];
+        stats.counts[tag] = s_counts[tag];
+        stats.totalBytes += stats.bytes[tag];
+        stats.totalCount += stats.counts[tag];
+    }
+
+    stats.peakBytes = s_peakBytes;
+
+    return stats;
+}
+
+unsigned int L3DMemory::reportLeaks()
+{
+    L3DAllocationStats stats = L3DMemory::stats();
+
+    if (!stats.totalCount)
+        return 0;
+
+    fprintf(stderr, "Memory leaks: %u blocks, %llu bytes\n", stats.totalCount, stats.totalBytes);
+
+    for (unsigned int tag = 0; tag < L3D_MEMORY_TAG_COUNT; ++tag)
+    {
+        if (stats.counts[tag])
+            fprintf(stderr, "  %s: %u blocks, %llu bytes\n", s_tagNames[tag], stats.counts[tag], stats.bytes[tag]);
+    }
+
+    return stats.totalCount;
+}
@@ -19,13 +19,24 @@
  * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
  */
 
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <glm/gtc/packing.hpp>
 #include <leaf3d/L3DBuffer.h>
 #include <leaf3d/L3DTexture.h>
 #include <leaf3d/L3DMaterial.h>
 #include <leaf3d/L3DShaderProgram.h>
 #include <leaf3d/L3DRenderer.h>
+#include <leaf3d/L3DJobSystem.h>
 #include <leaf3d/L3DMesh.h>
 
+// Margin around the error threshold to switch levels of detail.
+#define L3D_LOD_HYSTERESIS 0.25f
+// Triangles processed by a single tangent job.
+#define L3D_TANGENT_GRAIN_SIZE 4096
+
 using namespace l3d;
 
 L3DMesh::L3DMesh(
@@ -49,13 +60,44 @@ L3DMesh::L3DMesh(
                                  m_instanceFormat(L3D_INVALID_INSTANCE_FORMAT),
                                  m_drawPrimitive(drawPrimitive),
                                  m_renderLayer(renderLayer),
-                                 m_sortKey(0)
+                                 m_sortKey(0),
+                                 m_lodCount(0),
+                                 m_lod(0),
+                                 m_boundsRadius(0.0f)
 {
-    if (vertices && vertexCount)
-        m_vertexBuffer = new L3DBuffer(renderer, L3D_BUFFER_VERTEX, vertices, vertexCount * vertexFormat * sizeof(float), vertexFormat * sizeof(float), drawType);
+    unsigned int vertexSize = L3DMesh::vertexSize(vertexFormat);
+
+    if (vertices)
+        this->computeBounds(vertices, vertexCount, L3DMesh::unpackedFormat(vertexFormat));
+
+    if (vertices && vertexCount && L3DMesh::isPacked(vertexFormat))
+    {
+        std::vector<unsigned char> packed(vertexCount * vertexSize);
+        L3DMesh::packVertices(vertices, vertexCount, vertexFormat, &packed[0], m_decodeMatrix);
+        m_vertexBuffer = new L3DBuffer(renderer, L3D_BUFFER_VERTEX, &packed[0], packed.size(), vertexSize, drawType);
+    }
+    else if (vertices && vertexCount)
+    {
+        m_vertexBuffer = new L3DBuffer(renderer, L3D_BUFFER_VERTEX, vertices, vertexCount * vertexSize, vertexSize, drawType);
+    }
 
     if (indices && indexCount)
-        m_indexBuffer = new L3DBuffer(renderer, L3D_BUFFER_INDEX, indices, indexCount * sizeof(unsigned int), sizeof(unsigned int), drawType);
+    {
+        unsigned int maxIndex = 0;
+        for (unsigned int i = 0; i < indexCount; ++i)
+            maxIndex = (indices[i] > maxIndex) ? indices[i] : maxIndex;
+
+        // Use 16-bit indices whenever they can address all the vertices.
+        if (maxIndex <= 0xffff)
+        {
+            std::vector<unsigned short> shortIndices(indices, indices + indexCount);
+            m_indexBuffer = new L3DBuffer(renderer, L3D_BUFFER_INDEX, &shortIndices[0], indexCount * sizeof(unsigned short), sizeof(unsigned short), drawType);
+        }
+        else
+        {
+            m_indexBuffer = new L3DBuffer(renderer, L3D_BUFFER_INDEX, indices, indexCount * sizeof(unsigned int), sizeof(unsigned int), drawType);
+        }
+    }
 
     this->updateSortKey();
 
@@ -82,14 +124,20 @@ L3DMesh::L3DMesh(
                                  m_instanceFormat(L3D_INVALID_INSTANCE_FORMAT),
                                  m_drawPrimitive(drawPrimitive),
                                  m_renderLayer(renderLayer),
-                                 m_sortKey(0)
+                                 m_sortKey(0),
+                                 m_lodCount(0),
+                                 m_lod(0),
+                                 m_boundsRadius(0.0f)
 {
-    if (vertexBuffer && vertexBuffer->stride() == vertexFormat * sizeof(float) && vertexBuffer->drawType() == drawType)
+    if (vertexBuffer && vertexBuffer->stride() == L3DMesh::vertexSize(vertexFormat) && vertexBuffer->drawType() == drawType)
         m_vertexBuffer = vertexBuffer;
 
-    if (indexBuffer && indexBuffer->stride() == sizeof(unsigned int) && indexBuffer->drawType() == drawType)
+    if (indexBuffer && (indexBuffer->stride() == sizeof(unsigned short) || indexBuffer->stride() == sizeof(unsigned int)) && indexBuffer->drawType() == drawType)
         m_indexBuffer = indexBuffer;
 
+    if (m_vertexBuffer && m_vertexBuffer->data() && !L3DMesh::isPacked(vertexFormat))
+        this->computeBounds(m_vertexBuffer->data<float>(), m_vertexBuffer->count(), vertexFormat);
+
     this->updateSortKey();
 
     if (renderer)
@@ -108,9 +156,20 @@ unsigned int L3DMesh::vertexCount() const
 
 unsigned int L3DMesh::indexCount() const
 {
+    if (m_lodCount)
+        return m_lods[0].indexCount;
+
     return m_indexBuffer ? m_indexBuffer->count() : 0;
 }
 
+unsigned int L3DMesh::index(unsigned int i) const
+{
+    if (m_indexBuffer->indexType() == L3D_INDEX_UNSIGNED_SHORT)
+        return m_indexBuffer->data<unsigned short>()[i];
+
+    return m_indexBuffer->data<unsigned int>()[i];
+}
+
 unsigned int L3DMesh::instanceCount() const
 {
     return m_instanceBuffer ? m_instanceBuffer->count() : 1;
@@ -121,69 +180,44 @@ unsigned int L3DMesh::primitiveCount() const
     return m_indexBuffer ? m_indexBuffer->count() / m_drawPrimitive : 0;
 }
 
-void L3DMesh::recalculateTangents()
+void L3DMesh::recalculateTangents(const L3DTangentMode &mode)
 {
-    if (this->vertexFormat() < L3D_VERTEX_POS3_NOR3_TAN3_UV2)
+    if (!m_vertexBuffer || L3DMesh::isPacked(this->vertexFormat()) || m_drawPrimitive != L3D_DRAW_TRIANGLES)
         return;
 
-    std::map<unsigned int, L3DVec3> tans;
-
-    unsigned int *indices = m_indexBuffer->data<unsigned int>();
-    float *vertices = m_vertexBuffer->data<float>();
+    L3DRenderer *renderer = this->renderer();
 
-    for (unsigned int a = 0; a < this->primitiveCount(); ++a)
+    // Discarded copies are fetched back for the time of the computation.
+    if (renderer)
     {
-        unsigned int primitiveOffset = a * m_drawPrimitive;
-
-        unsigned int i1 = indices[primitiveOffset + 0];
-        unsigned int i2 = indices[primitiveOffset + 1];
-        unsigned int i3 = indices[primitiveOffset + 2];
-
-        unsigned i1Offset = i1 * m_vertexFormat;
-        unsigned i2Offset = i2 * m_vertexFormat;
-        unsigned i3Offset = i3 * m_vertexFormat;
-
-        // Position.
-        const L3DVec3 v1(vertices[i1Offset + 0], vertices[i1Offset + 1], vertices[i1Offset + 2]);
-        const L3DVec3 v2(vertices[i2Offset + 0], vertices[i2Offset + 1], vertices[i2Offset + 2]);
-        const L3DVec3 v3(vertices[i3Offset + 0], vertices[i3Offset + 1], vertices[i3Offset + 2]);
-
-        // UV.
-        const L3DVec2 w1(vertices[i1Offset + 9], vertices[i1Offset + 10]);
-        const L3DVec2 w2(vertices[i2Offset + 9], vertices[i2Offset + 10]);
-        const L3DVec2 w3(vertices[i3Offset + 9], vertices[i3Offset + 10]);
-
-        // Calculate tangent.
-        glm::vec3 tangent1;
-
-        glm::vec3 edge1 = v2 - v1;
-        glm::vec3 edge2 = v3 - v1;
-        glm::vec2 deltaUV1 = w2 - w1;
-        glm::vec2 deltaUV2 = w3 - w1;
-
-        GLfloat f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-        tangent1.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-        tangent1.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-        tangent1.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-        tangent1 = glm::normalize(tangent1);
-
-        tans[i1] += tangent1;
-        tans[i2] += tangent1;
-        tans[i3] += tangent1;
+        if (!renderer->acquireData(m_vertexBuffer))
+            return;
+
+        if (m_indexBuffer && !renderer->acquireData(m_indexBuffer))
+        {
+            renderer->releaseData(m_vertexBuffer);
+            return;
+        }
     }
 
-    for (unsigned int v = 0; v < this->vertexCount(); ++v)
-    {
-        unsigned int vertexOffset = v * m_vertexFormat;
+    std::vector<unsigned int> indices(this->indexCount());
+    for (unsigned int i = 0; i < indices.size(); ++i)
+        indices[i] = this->index(i);
 
-        L3DVec3 norm(vertices[vertexOffset + 3], vertices[vertexOffset + 4], vertices[vertexOffset + 5]);
-        L3DVec3 tan = glm::normalize(tans[v] - glm::dot(tans[v], norm) * norm);
+    L3DMesh::computeTangents(
+        m_vertexBuffer->data<float>(),
+        this->vertexCount(),
+        indices.empty() ? L3D_NULLPTR : &indices[0],
+        indices.size(),
+        this->vertexFormat(),
+        mode,
+        renderer ? renderer->jobSystem() : L3D_NULLPTR);
 
-        // Updates vertex tangent (XYZ).
-        vertices[vertexOffset + 6] = tan.x;
-        vertices[vertexOffset + 7] = tan.y;
-        vertices[vertexOffset + 8] = tan.z;
+    if (renderer)
+    {
+        renderer->updateBuffer(m_vertexBuffer);
+        renderer->releaseData(m_vertexBuffer);
+        renderer->releaseData(m_indexBuffer);
     }
 }
 
@@ -223,6 +257,86 @@ void L3DMesh::setRenderLayer(unsigned char renderLayer)
     }
 }
 
+bool L3DMesh::setLods(
+    const L3DMeshLod *lods,
+    unsigned int lodCount)
+{
+    unsigned int available = m_indexBuffer ? m_indexBuffer->count() : 0;
+    lodCount = std::min(lodCount, (unsigned int)L3D_MAX_MESH_LODS);
+
+    for (unsigned int i = 0; i < lodCount; ++i)
+    {
+        if (lods[i].indexOffset + lods[i].indexCount > available)
+        {
+            fprintf(stderr, "Mesh %d: LOD %d is out of the index buffer\n", this->id(), i);
+            return false;
+        }
+    }
+
+    memcpy(m_lods, lods, lodCount * sizeof(L3DMeshLod));
+    m_lodCount = lodCount;
+    m_lod = 0;
+
+    return true;
+}
+
+void L3DMesh::setBounds(const L3DVec3 &boundsMin, const L3DVec3 &boundsMax)
+{
+    m_boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    m_boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+}
+
+void L3DMesh::computeBounds(const float *vertices, unsigned int vertexCount, const L3DVertexFormat &format)
+{
+    if (!vertexCount)
+        return;
+
+    // 2D positions for the POS2 formats, 3D otherwise.
+    unsigned int components = (format == L3D_VERTEX_POS2 || format == L3D_VERTEX_POS2_UV2) ? 2 : 3;
+    L3DVec3 boundsMin(vertices[0], vertices[1], components == 3 ? vertices[2] : 0.0f);
+    L3DVec3 boundsMax = boundsMin;
+
+    for (unsigned int v = 1; v < vertexCount; ++v)
+    {
+        const float *position = vertices + v * format;
+
+        for (unsigned int c = 0; c < components; ++c)
+        {
+            boundsMin[c] = std::min(boundsMin[c], position[c]);
+            boundsMax[c] = std::max(boundsMax[c], position[c]);
+        }
+    }
+
+    this->setBounds(boundsMin, boundsMax);
+}
+
+unsigned int L3DMesh::selectLod(
+    const L3DVec3 &eye,
+    float projectionScale,
+    float maxError)
+{
+    if (m_lodCount < 2)
+        return 0;
+
+    // Errors grow with the scale of the mesh.
+    L3DMat3 rotationScale(this->transMatrix);
+    float scale = std::max(glm::length(rotationScale[0]), std::max(glm::length(rotationScale[1]), glm::length(rotationScale[2])));
+    // From the eye to the bounds, which it may be inside of.
+    L3DVec3 center(this->transMatrix * L3DVec4(m_boundsCenter, 1.0f));
+    float distance = glm::length(center - eye) - m_boundsRadius * scale;
+    float errorScale = scale * projectionScale / std::max(distance, 1e-4f);
+
+    unsigned int lod = m_lod;
+    while (lod + 1 < m_lodCount && m_lods[lod + 1].error * errorScale <= maxError * (1.0f - L3D_LOD_HYSTERESIS))
+        ++lod;
+    while (lod > 0 && m_lods[lod].error * errorScale > maxError * (1.0f + L3D_LOD_HYSTERESIS))
+        --lod;
+
+    m_lod = lod;
+
+    return lod;
+}
+
 void L3DMesh::setInstances(
     L3DBuffer *instanceBuffer,
     const L3DInstanceFormat &instanceFormat)
@@ -234,8 +348,11 @@ void L3DMesh::setInstances(
         m_instanceFormat = instanceFormat;
         this->updateSortKey();
 
+        // Rebuild the vertex array, keeping the mesh handle.
         L3DRenderer *renderer = this->renderer();
+        unsigned short int id = this->id();
         renderer->removeMesh(this);
+        this->setId(id);
         renderer->addMesh(this);
     }
 }
@@ -263,5 +380,241 @@ void L3DMesh::updateSortKey()
 {
     m_sortKey = (m_renderLayer << 24) | ((m_material ? m_material->id() : 0) << 8);
 
-    this->renderer()->recomputeRenderBucket();
+    if (this->renderer())
+        this->renderer()->recomputeRenderBucket();
+}
+
+// Attributes of a vertex format besides the position.
+static void vertexLayout(const L3DVertexFormat &format, unsigned int &directions, unsigned int &uvs)
+{
+    L3DVertexFormat unpacked = L3DMesh::unpackedFormat(format);
+
+    directions = (unpacked >= L3D_VERTEX_POS3_NOR3_UV2) + (unpacked >= L3D_VERTEX_POS3_NOR3_TAN3_UV2);
+    uvs = (unpacked - 3 - directions * 3) / 2;
+}
+
+bool L3DMesh::isPacked(const L3DVertexFormat &format)
+{
+    switch (format)
+    {
+    case L3D_VERTEX_PACKED_POS3_UV2:
+    case L3D_VERTEX_PACKED_POS3_NOR3_UV2:
+    case L3D_VERTEX_PACKED_POS3_NOR3_TAN3_UV2:
+    case L3D_VERTEX_PACKED_POS3_NOR3_TAN3_UV2_UV2:
+        return true;
+    default:
+        break;
+    }
+
+    return false;
+}
+
+L3DVertexFormat L3DMesh::unpackedFormat(const L3DVertexFormat &format)
+{
+    return (L3DVertexFormat)(format & ~L3D_VERTEX_PACKED);
+}
+
+unsigned int L3DMesh::vertexSize(const L3DVertexFormat &format)
+{
+    if (!L3DMesh::isPacked(format))
+        return format * sizeof(float);
+
+    unsigned int directions, uvs;
+    vertexLayout(format, directions, uvs);
+
+    // Position (4 shorts, the last one is padding), normal and tangent
+    // (10:10:10:2 each) and UVs (2 halves each).
+
+    return 8 + directions * 4 + uvs * 4;
+}
+
+bool L3DMesh::computeTangents(
+    float *vertices,
+    unsigned int vertexCount,
+    const unsigned int *indices,
+    unsigned int indexCount,
+    const L3DVertexFormat &format,
+    const L3DTangentMode &mode,
+    L3DJobSystem *jobSystem)
+{
+    unsigned int directions, uvs;
+    vertexLayout(format, directions, uvs);
+
+    if (L3DMesh::isPacked(format) || directions < 2 || uvs == 0 || !vertices || !indices)
+        return false;
+
+    // Normal, tangent and the first UV set follow the position.
+    const unsigned int stride = format;
+    const unsigned int uvOffset = 3 + directions * 3;
+    const unsigned int triangleCount = indexCount / 3;
+
+    // 1. Contribution of each triangle corner, computed in parallel.
+    std::vector<L3DVec3> corners(triangleCount * 3, L3DVec3(0.0f));
+
+    L3DRangeJob cornerJob = [=, &corners](unsigned int begin, unsigned int end) {
+        for (unsigned int t = begin; t < end; ++t)
+        {
+            const float *v[3];
+            bool valid = true;
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                valid = valid && indices[t * 3 + k] < vertexCount;
+                v[k] = vertices + (valid ? indices[t * 3 + k] : 0) * stride;
+            }
+
+            if (!valid)
+                continue;
+
+            const L3DVec3 p0(v[0][0], v[0][1], v[0][2]);
+            const L3DVec3 edge1 = L3DVec3(v[1][0], v[1][1], v[1][2]) - p0;
+            const L3DVec3 edge2 = L3DVec3(v[2][0], v[2][1], v[2][2]) - p0;
+            const L3DVec2 deltaUV1 = L3DVec2(v[1][uvOffset], v[1][uvOffset + 1]) - L3DVec2(v[0][uvOffset], v[0][uvOffset + 1]);
+            const L3DVec2 deltaUV2 = L3DVec2(v[2][uvOffset], v[2][uvOffset + 1]) - L3DVec2(v[0][uvOffset], v[0][uvOffset + 1]);
+
+            // Degenerate UVs define no tangent.
+            float det = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+            if (det == 0.0f)
+                continue;
+
+            L3DVec3 tangent = (edge1 * deltaUV2.y - edge2 * deltaUV1.y) / det;
+            if (glm::dot(tangent, tangent) <= 0.0f)
+                continue;
+
+            if (mode == L3D_TANGENTS_FAST)
+            {
+                tangent = glm::normalize(tangent);
+                for (unsigned int k = 0; k < 3; ++k)
+                    corners[t * 3 + k] = tangent;
+                continue;
+            }
+
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                const float *a = v[k];
+                const float *b = v[(k + 1) % 3];
+                const float *c = v[(k + 2) % 3];
+                const L3DVec3 normal(a[3], a[4], a[5]);
+
+                // Tangent and edges projected on the plane of the normal.
+                L3DVec3 projected = tangent - normal * glm::dot(normal, tangent);
+                L3DVec3 side1 = L3DVec3(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+                L3DVec3 side2 = L3DVec3(c[0] - a[0], c[1] - a[1], c[2] - a[2]);
+                side1 -= normal * glm::dot(normal, side1);
+                side2 -= normal * glm::dot(normal, side2);
+
+                float length = glm::length(projected);
+                float lengths = glm::length(side1) * glm::length(side2);
+                if (length <= 0.0f || lengths <= 0.0f)
+                    continue;
+
+                float angle = acosf(glm::clamp(glm::dot(side1, side2) / lengths, -1.0f, 1.0f));
+                corners[t * 3 + k] = projected * (angle / length);
+            }
+        }
+    };
+
+    if (jobSystem)
+        jobSystem->parallelFor(triangleCount, L3D_TANGENT_GRAIN_SIZE, cornerJob);
+    else
+        cornerJob(0, triangleCount);
+
+    // 2. Flat per-vertex accumulation.
+    std::vector<L3DVec3> tangents(vertexCount, L3DVec3(0.0f));
+    for (unsigned int i = 0; i < triangleCount * 3; ++i)
+    {
+        if (indices[i] < vertexCount)
+            tangents[indices[i]] += corners[i];
+    }
+
+    // 3. Orthogonalize against normals (Gram-Schmidt).
+    L3DRangeJob vertexJob = [=, &tangents](unsigned int begin, unsigned int end) {
+        for (unsigned int v = begin; v < end; ++v)
+        {
+            float *vertex = vertices + v * stride;
+            const L3DVec3 normal(vertex[3], vertex[4], vertex[5]);
+            L3DVec3 tangent = tangents[v] - normal * glm::dot(normal, tangents[v]);
+
+            // Vertices without a tangent get any direction along the surface.
+            if (glm::dot(tangent, tangent) <= 1e-12f)
+            {
+                L3DVec3 axis = fabsf(normal.x) < 0.9f ? L3DVec3(1, 0, 0) : L3DVec3(0, 1, 0);
+                tangent = glm::cross(normal, axis);
+                if (glm::dot(tangent, tangent) <= 1e-12f)
+                    tangent = axis;
+            }
+
+            tangent = glm::normalize(tangent);
+            vertex[6] = tangent.x;
+            vertex[7] = tangent.y;
+            vertex[8] = tangent.z;
+        }
+    };
+
+    if (jobSystem)
+        jobSystem->parallelFor(vertexCount, L3D_TANGENT_GRAIN_SIZE, vertexJob);
+    else
+        vertexJob(0, vertexCount);
+
+    return true;
+}
+
+void L3DMesh::packVertices(
+    const float *vertices,
+    unsigned int vertexCount,
+    const L3DVertexFormat &format,
+    unsigned char *packed,
+    L3DMat4 &decodeMatrix)
+{
+    L3DVertexFormat unpacked = L3DMesh::unpackedFormat(format);
+    unsigned int directions, uvs;
+    vertexLayout(format, directions, uvs);
+
+    // Bounds of positions.
+    L3DVec3 minBound(vertices[0], vertices[1], vertices[2]);
+    L3DVec3 maxBound = minBound;
+
+    for (unsigned int v = 1; v < vertexCount; ++v)
+    {
+        const L3DVec3 position(vertices[v * unpacked + 0], vertices[v * unpacked + 1], vertices[v * unpacked + 2]);
+        minBound = glm::min(minBound, position);
+        maxBound = glm::max(maxBound, position);
+    }
+
+    L3DVec3 center = (minBound + maxBound) * 0.5f;
+    L3DVec3 extent = (maxBound - minBound) * 0.5f;
+
+    for (unsigned int c = 0; c < 3; ++c)
+    {
+        if (extent[c] <= 0.0f)
+            extent[c] = 1.0f;
+    }
+
+    decodeMatrix = glm::scale(glm::translate(L3DMat4(), center), extent);
+
+    for (unsigned int v = 0; v < vertexCount; ++v)
+    {
+        const float *src = vertices + v * unpacked;
+
+        glm::uint16 position[4] = {0, 0, 0, 0};
+        for (unsigned int c = 0; c < 3; ++c)
+            position[c] = glm::packSnorm1x16((src[c] - center[c]) / extent[c]);
+
+        memcpy(packed, position, sizeof(position));
+        packed += sizeof(position);
+        src += 3;
+
+        for (unsigned int n = 0; n < directions; ++n, src += 3)
+        {
+            glm::uint32 normal = glm::packSnorm3x10_1x2(L3DVec4(src[0], src[1], src[2], 0.0f));
+            memcpy(packed, &normal, sizeof(normal));
+            packed += sizeof(normal);
+        }
+
+        for (unsigned int t = 0; t < uvs; ++t, src += 2)
+        {
+            glm::uint16 uv[2] = {glm::packHalf1x16(src[0]), glm::packHalf1x16(src[1])};
+            memcpy(packed, uv, sizeof(uv));
+            packed += sizeof(uv);
+        }
+    }
 }
@@ -0,0 +1,343 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <leaf3d/L3DMeshFile.h>
+
+#ifdef L3D_PLATFORM_WIN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace l3d;
+
+L3DMappedFile::L3DMappedFile() : m_data(L3D_NULLPTR),
+                                 m_size(0)
+#ifdef L3D_PLATFORM_WIN
+                                 ,
+                                 m_file(L3D_NULLPTR),
+                                 m_mapping(L3D_NULLPTR)
+#endif
+{
+}
+
+L3DMappedFile::~L3DMappedFile()
+{
+    this->close();
+}
+
+bool L3DMappedFile::open(const std::string &path)
+{
+    this->close();
+
+#ifdef L3D_PLATFORM_WIN
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    DWORD size = GetFileSize(file, NULL);
+    HANDLE mapping = size ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    void *data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+
+    if (!data)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file = file;
+    m_mapping = mapping;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    void *data = MAP_FAILED;
+
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+        data = mmap(L3D_NULLPTR, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping stays valid after closing the descriptor.
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    unsigned int size = info.st_size;
+#endif
+
+    m_data = data;
+    m_size = size;
+
+    return true;
+}
+
+void L3DMappedFile::close()
+{
+    if (!m_data)
+        return;
+
+#ifdef L3D_PLATFORM_WIN
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+    m_file = L3D_NULLPTR;
+    m_mapping = L3D_NULLPTR;
+#else
+    munmap(m_data, m_size);
+#endif
+
+    m_data = L3D_NULLPTR;
+    m_size = 0;
+}
+
+L3DMeshFile::L3DMeshFile() : m_header(L3D_NULLPTR)
+{
+}
+
+// Names are used as C strings, straight from the mapping.
+static bool isValidName(const char *name)
+{
+    return memchr(name, '\0', L3D_MESH_FILE_NAME_SIZE) != L3D_NULLPTR;
+}
+
+bool L3DMeshFile::open(const std::string &path)
+{
+    this->close();
+
+#ifdef L3D_PLATFORM_BIG_ENDIAN
+    fprintf(stderr, "Mesh file %s: big-endian platforms are not supported\n", path.c_str());
+    return false;
+#endif
+
+    if (!m_file.open(path))
+        return false;
+
+    const unsigned char *data = m_file.data();
+    unsigned long long size = m_file.size();
+    const L3DMeshFileHeader *header = reinterpret_cast<const L3DMeshFileHeader *>(data);
+
+    bool valid = size >= sizeof(L3DMeshFileHeader) &&
+                 header->magic == L3D_MESH_FILE_MAGIC &&
+                 header->version == L3D_MESH_FILE_VERSION &&
+                 sizeof(L3DMeshFileHeader) +
+                         (unsigned long long)header->materialCount * sizeof(L3DMeshFileMaterial) +
+                         (unsigned long long)header->meshCount * sizeof(L3DMeshFileMesh) <=
+                     size;
+
+    if (valid)
+    {
+        m_header = header;
+
+        const L3DMeshFileMaterial *materials = this->materials();
+        for (unsigned int i = 0; valid && i < header->materialCount; ++i)
+        {
+            valid = isValidName(materials[i].name);
+
+            for (unsigned int t = 0; valid && t < L3D_MESH_FILE_TEXTURE_COUNT; ++t)
+                valid = isValidName(materials[i].textures[t]);
+        }
+
+        // Blocks must lie in the file, aligned for their type.
+        const L3DMeshFileMesh *meshes = this->meshes();
+        for (unsigned int i = 0; valid && i < header->meshCount; ++i)
+        {
+            const L3DMeshFileMesh &mesh = meshes[i];
+            unsigned long long vertexSize = (unsigned long long)mesh.vertexCount * mesh.vertexFormat * sizeof(float);
+            unsigned long long indexSize = (unsigned long long)mesh.indexCount * sizeof(unsigned int);
+
+            valid = mesh.vertexFormat > L3D_INVALID_VERTEX_FORMAT && mesh.vertexFormat < L3D_MAX_VERTEX_FORMAT &&
+                    mesh.vertexOffset % sizeof(float) == 0 && mesh.vertexOffset + vertexSize <= size &&
+                    mesh.indexOffset % sizeof(unsigned int) == 0 && mesh.indexOffset + indexSize <= size &&
+                    mesh.material >= -1 && mesh.material < (int32_t)header->materialCount &&
+                    mesh.lodCount <= L3D_MAX_MESH_LODS;
+
+            for (unsigned int l = 0; valid && l < mesh.lodCount; ++l)
+                valid = (unsigned long long)mesh.lods[l].indexOffset + mesh.lods[l].indexCount <= mesh.indexCount;
+
+            // Indices are uploaded as they are: the GPU would read past the
+            // vertices.
+            const unsigned int *indices = reinterpret_cast<const unsigned int *>(data + mesh.indexOffset);
+            for (unsigned int j = 0; valid && j < mesh.indexCount; ++j)
+                valid = indices[j] < mesh.vertexCount;
+        }
+    }
+
+    if (!valid)
+    {
+        fprintf(stderr, "Mesh file %s: invalid or outdated\n", path.c_str());
+        this->close();
+        return false;
+    }
+
+    return true;
+}
+
+void L3DMeshFile::close()
+{
+    m_header = L3D_NULLPTR;
+    m_file.close();
+}
+
+const L3DMeshFileMaterial *L3DMeshFile::materials() const
+{
+    if (!m_header)
+        return L3D_NULLPTR;
+
+    return reinterpret_cast<const L3DMeshFileMaterial *>(m_file.data() + sizeof(L3DMeshFileHeader));
+}
+
+const L3DMeshFileMesh *L3DMeshFile::meshes() const
+{
+    if (!m_header)
+        return L3D_NULLPTR;
+
+    return reinterpret_cast<const L3DMeshFileMesh *>(
+        m_file.data() + sizeof(L3DMeshFileHeader) + m_header->materialCount * sizeof(L3DMeshFileMaterial));
+}
+
+const float *L3DMeshFile::vertices(unsigned int mesh) const
+{
+    if (mesh >= this->meshCount() || !this->meshes()[mesh].vertexCount)
+        return L3D_NULLPTR;
+
+    return reinterpret_cast<const float *>(m_file.data() + this->meshes()[mesh].vertexOffset);
+}
+
+const unsigned int *L3DMeshFile::indices(unsigned int mesh) const
+{
+    if (mesh >= this->meshCount() || !this->meshes()[mesh].indexCount)
+        return L3D_NULLPTR;
+
+    return reinterpret_cast<const unsigned int *>(m_file.data() + this->meshes()[mesh].indexOffset);
+}
+
+void L3DMeshFile::computeBounds(L3DMeshFileMesh &mesh, const float *vertices)
+{
+    // 2D positions for the POS2 formats, 3D otherwise.
+    unsigned int components = (mesh.vertexFormat == L3D_VERTEX_POS2 || mesh.vertexFormat == L3D_VERTEX_POS2_UV2) ? 2 : 3;
+
+    for (unsigned int c = 0; c < 3; ++c)
+    {
+        mesh.boundsMin[c] = 0;
+        mesh.boundsMax[c] = 0;
+    }
+
+    for (unsigned int v = 0; vertices && v < mesh.vertexCount; ++v)
+    {
+        const float *position = vertices + v * mesh.vertexFormat;
+
+        for (unsigned int c = 0; c < components; ++c)
+        {
+            if (v == 0 || position[c] < mesh.boundsMin[c])
+                mesh.boundsMin[c] = position[c];
+            if (v == 0 || position[c] > mesh.boundsMax[c])
+                mesh.boundsMax[c] = position[c];
+        }
+    }
+}
+
+bool L3DMeshFile::write(
+    const std::string &path,
+    const L3DMeshFileMaterialList &materials,
+    const L3DMeshFileSourceList &meshes)
+{
+#ifdef L3D_PLATFORM_BIG_ENDIAN
+    fprintf(stderr, "Mesh file %s: big-endian platforms are not supported\n", path.c_str());
+    return false;
+#endif
+
+    L3DMeshFileHeader header;
+    header.magic = L3D_MESH_FILE_MAGIC;
+    header.version = L3D_MESH_FILE_VERSION;
+    header.materialCount = materials.size();
+    header.meshCount = meshes.size();
+
+    // Lay out the data blocks after the tables.
+    std::vector<L3DMeshFileMesh> table(meshes.size());
+    unsigned long long offset = sizeof(L3DMeshFileHeader) +
+                                materials.size() * sizeof(L3DMeshFileMaterial) +
+                                meshes.size() * sizeof(L3DMeshFileMesh);
+
+    for (unsigned int i = 0; i < meshes.size(); ++i)
+    {
+        table[i] = meshes[i].info;
+        table[i].vertexOffset = offset;
+        offset += (unsigned long long)table[i].vertexCount * table[i].vertexFormat * sizeof(float);
+        table[i].indexOffset = offset;
+        offset += (unsigned long long)table[i].indexCount * sizeof(unsigned int);
+    }
+
+    if (offset > 0xffffffffULL)
+    {
+        fprintf(stderr, "Mesh file %s: too big\n", path.c_str());
+        return false;
+    }
+
+    // Write aside and rename, so that readers never map a partial file.
+    std::string tmpPath = path + ".tmp";
+    FILE *file = fopen(tmpPath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    if (ok && !materials.empty())
+        ok = fwrite(&materials[0], sizeof(L3DMeshFileMaterial), materials.size(), file) == materials.size();
+
+    if (ok && !table.empty())
+        ok = fwrite(&table[0], sizeof(L3DMeshFileMesh), table.size(), file) == table.size();
+
+    for (unsigned int i = 0; ok && i < meshes.size(); ++i)
+    {
+        unsigned int vertexFloats = table[i].vertexCount * table[i].vertexFormat;
+
+        if (vertexFloats)
+            ok = fwrite(meshes[i].vertices, sizeof(float), vertexFloats, file) == vertexFloats;
+
+        if (ok && table[i].indexCount)
+            ok = fwrite(meshes[i].indices, sizeof(unsigned int), table[i].indexCount, file) == table[i].indexCount;
+    }
+
+    ok = (fclose(file) == 0) && ok;
+
+    if (ok)
+    {
+        remove(path.c_str());
+        ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+
+    if (!ok)
+    {
+        fprintf(stderr, "Mesh file %s: write failed\n", path.c_str());
+        remove(tmpPath.c_str());
+    }
+
+    return ok;
+}
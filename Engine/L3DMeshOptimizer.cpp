@@ -0,0 +1,741 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <leaf3d/L3DMeshOptimizer.h>
+
+using namespace l3d;
+
+#define L3D_FORSYTH_CACHE_SIZE 32
+
+namespace
+{
+    struct VertexKey
+    {
+        const float *data;
+        unsigned int size;
+    };
+
+    struct VertexKeyHash
+    {
+        size_t operator()(const VertexKey &key) const
+        {
+            // FNV-1a over the raw bits.
+            size_t hash = 2166136261u;
+            const unsigned char *bytes = (const unsigned char *)key.data;
+            for (unsigned int i = 0; i < key.size * sizeof(float); ++i)
+                hash = (hash ^ bytes[i]) * 16777619u;
+            return hash;
+        }
+    };
+
+    struct VertexKeyEqual
+    {
+        bool operator()(const VertexKey &a, const VertexKey &b) const
+        {
+            return memcmp(a.data, b.data, a.size * sizeof(float)) == 0;
+        }
+    };
+
+    // Symmetric 4x4 matrix: sum of squared distances from a set of planes.
+    struct Quadric
+    {
+        double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+    };
+
+    void addPlane(Quadric &q, double a, double b, double c, double d)
+    {
+        q.xx += a * a;
+        q.xy += a * b;
+        q.xz += a * c;
+        q.xw += a * d;
+        q.yy += b * b;
+        q.yz += b * c;
+        q.yw += b * d;
+        q.zz += c * c;
+        q.zw += c * d;
+        q.ww += d * d;
+    }
+
+    void addQuadric(Quadric &q, const Quadric &other)
+    {
+        q.xx += other.xx;
+        q.xy += other.xy;
+        q.xz += other.xz;
+        q.xw += other.xw;
+        q.yy += other.yy;
+        q.yz += other.yz;
+        q.yw += other.yw;
+        q.zz += other.zz;
+        q.zw += other.zw;
+        q.ww += other.ww;
+    }
+
+    double evaluate(const Quadric &q, const Quadric &other, const float *p)
+    {
+        double x = p[0], y = p[1], z = p[2];
+
+        return (q.xx + other.xx) * x * x + (q.yy + other.yy) * y * y + (q.zz + other.zz) * z * z +
+               2 * ((q.xy + other.xy) * x * y + (q.xz + other.xz) * x * z + (q.yz + other.yz) * y * z) +
+               2 * ((q.xw + other.xw) * x + (q.yw + other.yw) * y + (q.zw + other.zw) * z) +
+               (q.ww + other.ww);
+    }
+
+    void triangleNormal(const float *p0, const float *p1, const float *p2, float *n)
+    {
+        float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+
+    struct Collapse
+    {
+        unsigned int from;
+        unsigned int to;
+        double cost;
+    };
+
+    bool sortCollapses(const Collapse &a, const Collapse &b)
+    {
+        return a.cost < b.cost;
+    }
+
+    struct Cluster
+    {
+        unsigned int begin;
+        unsigned int end;
+        float sortKey;
+    };
+
+    bool sortClusters(const Cluster &a, const Cluster &b)
+    {
+        return a.sortKey > b.sortKey;
+    }
+
+    float vertexScore(int cachePosition, unsigned int remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+
+        if (cachePosition >= 0)
+        {
+            // Vertices of the last triangle get a fixed score, so that
+            // strips are not preferred over fans.
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = powf(1.0f - (cachePosition - 3) / (float)(L3D_FORSYTH_CACHE_SIZE - 3), 1.5f);
+        }
+
+        // Favour vertices with few triangles left, to avoid leaving
+        // isolated triangles behind.
+        return score + 2.0f / sqrtf((float)remainingTriangles);
+    }
+}
+
+L3DMeshOptimizerStats L3DMeshOptimizer::optimize(
+    std::vector<float> &vertices,
+    std::vector<unsigned int> &indices,
+    unsigned int vertexSize)
+{
+    L3DMeshOptimizerStats stats;
+    stats.vertexCountBefore = vertexSize ? vertices.size() / vertexSize : 0;
+    stats.before = analyzeVertexCache(indices, stats.vertexCountBefore);
+
+    unsigned int vertexCount = weldVertices(vertices, indices, vertexSize);
+    optimizeVertexCache(indices, vertexCount);
+    optimizeOverdraw(indices, vertices, vertexSize);
+
+    stats.vertexCountAfter = optimizeVertexFetch(vertices, indices, vertexSize);
+    stats.after = analyzeVertexCache(indices, stats.vertexCountAfter);
+
+    return stats;
+}
+
+unsigned int L3DMeshOptimizer::weldVertices(
+    std::vector<float> &vertices,
+    std::vector<unsigned int> &indices,
+    unsigned int vertexSize)
+{
+    if (vertexSize == 0)
+        return 0;
+
+    unsigned int vertexCount = vertices.size() / vertexSize;
+    std::vector<unsigned int> remap(vertexCount);
+    std::unordered_map<VertexKey, unsigned int, VertexKeyHash, VertexKeyEqual> unique;
+    unique.reserve(vertexCount);
+
+    // Vertices are compacted in place: the write position never overtakes
+    // the read one, and keys always point to already written vertices.
+    unsigned int uniqueCount = 0;
+    for (unsigned int i = 0; i < vertexCount; ++i)
+    {
+        float *vertex = &vertices[i * vertexSize];
+        float *target = &vertices[uniqueCount * vertexSize];
+
+        VertexKey key = {vertex, vertexSize};
+        auto found = unique.find(key);
+        if (found != unique.end())
+        {
+            remap[i] = found->second;
+            continue;
+        }
+
+        if (target != vertex)
+            memcpy(target, vertex, vertexSize * sizeof(float));
+
+        key.data = target;
+        unique[key] = uniqueCount;
+        remap[i] = uniqueCount++;
+    }
+
+    vertices.resize(uniqueCount * vertexSize);
+
+    for (unsigned int i = 0; i < indices.size(); ++i)
+        indices[i] = remap[indices[i]];
+
+    return uniqueCount;
+}
+
+void L3DMeshOptimizer::optimizeVertexCache(
+    std::vector<unsigned int> &indices,
+    unsigned int vertexCount)
+{
+    unsigned int triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles adjacent to each vertex.
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int i = 0; i < triangleCount * 3; ++i)
+        ++remaining[indices[i]];
+
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+    for (unsigned int v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+
+    std::vector<unsigned int> adjacency(triangleCount * 3);
+    std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (unsigned int t = 0; t < triangleCount; ++t)
+        for (unsigned int k = 0; k < 3; ++k)
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+
+    std::vector<float> vertexScores(vertexCount);
+    for (unsigned int v = 0; v < vertexCount; ++v)
+        vertexScores[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (unsigned int t = 0; t < triangleCount; ++t)
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+
+    unsigned int cache[L3D_FORSYTH_CACHE_SIZE + 3];
+    unsigned int cacheSize = 0;
+    unsigned int nextCandidate = 0;
+
+    int best = 0;
+    for (unsigned int t = 1; t < triangleCount; ++t)
+        if (triangleScores[t] > triangleScores[best])
+            best = t;
+
+    while (best >= 0)
+    {
+        emitted[best] = true;
+
+        const unsigned int *triangle = &indices[best * 3];
+        result.insert(result.end(), triangle, triangle + 3);
+
+        // Move the triangle's vertices at the front of the cache.
+        unsigned int newCache[L3D_FORSYTH_CACHE_SIZE + 3];
+        unsigned int newCacheSize = 0;
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+            unsigned int v = triangle[k];
+            newCache[newCacheSize++] = v;
+
+            // Detach the triangle from its vertices.
+            unsigned int *begin = &adjacency[adjacencyOffsets[v]];
+            unsigned int *end = begin + remaining[v];
+            *std::find(begin, end, (unsigned int)best) = *(end - 1);
+            --remaining[v];
+        }
+
+        for (unsigned int c = 0; c < cacheSize; ++c)
+        {
+            unsigned int v = cache[c];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                newCache[newCacheSize++] = v;
+        }
+
+        // Rescore the cached vertices and their triangles, picking the
+        // best one on the way; evicted vertices leave the cache.
+        best = -1;
+        float bestScore = -1.0f;
+
+        for (unsigned int c = 0; c < newCacheSize; ++c)
+        {
+            unsigned int v = newCache[c];
+            int position = c < L3D_FORSYTH_CACHE_SIZE ? (int)c : -1;
+
+            float score = vertexScore(position, remaining[v]);
+            float delta = score - vertexScores[v];
+            vertexScores[v] = score;
+
+            for (unsigned int a = 0; a < remaining[v]; ++a)
+            {
+                unsigned int t = adjacency[adjacencyOffsets[v] + a];
+                triangleScores[t] += delta;
+            }
+        }
+
+        for (unsigned int c = 0; c < newCacheSize && c < L3D_FORSYTH_CACHE_SIZE; ++c)
+        {
+            unsigned int v = newCache[c];
+            for (unsigned int a = 0; a < remaining[v]; ++a)
+            {
+                unsigned int t = adjacency[adjacencyOffsets[v] + a];
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+
+        cacheSize = std::min(newCacheSize, (unsigned int)L3D_FORSYTH_CACHE_SIZE);
+        memcpy(cache, newCache, cacheSize * sizeof(unsigned int));
+
+        // Nothing left around the cache: restart from the next triangle.
+        if (best < 0)
+        {
+            while (nextCandidate < triangleCount && emitted[nextCandidate])
+                ++nextCandidate;
+            if (nextCandidate < triangleCount)
+                best = nextCandidate;
+        }
+    }
+
+    indices.swap(result);
+}
+
+void L3DMeshOptimizer::optimizeOverdraw(
+    std::vector<unsigned int> &indices,
+    const std::vector<float> &vertices,
+    unsigned int vertexSize)
+{
+    unsigned int triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || vertexSize < 3)
+        return;
+
+    // Split at hard cache boundaries: triangles missing all of their
+    // vertices start a new cluster, so moving clusters around keeps the
+    // cache efficiency almost untouched.
+    std::vector<Cluster> clusters;
+    std::vector<unsigned int> cache;
+    const unsigned int cacheSize = 16;
+
+    for (unsigned int t = 0; t < triangleCount; ++t)
+    {
+        unsigned int misses = 0;
+        for (unsigned int k = 0; k < 3; ++k)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if (std::find(cache.begin(), cache.end(), v) == cache.end())
+            {
+                ++misses;
+                cache.insert(cache.begin(), v);
+                if (cache.size() > cacheSize)
+                    cache.pop_back();
+            }
+        }
+
+        if (misses == 3 || clusters.empty())
+        {
+            Cluster cluster = {t, t, 0.0f};
+            clusters.push_back(cluster);
+        }
+
+        clusters.back().end = t + 1;
+    }
+
+    if (clusters.size() < 2)
+        return;
+
+    // Sort clusters by occlusion potential: the further a cluster is from
+    // the mesh centroid along its normal, the likelier it occludes others.
+    float meshCentroid[3] = {0.0f, 0.0f, 0.0f};
+    for (unsigned int i = 0; i < indices.size(); ++i)
+        for (unsigned int k = 0; k < 3; ++k)
+            meshCentroid[k] += vertices[indices[i] * vertexSize + k];
+    for (unsigned int k = 0; k < 3; ++k)
+        meshCentroid[k] /= indices.size();
+
+    for (unsigned int c = 0; c < clusters.size(); ++c)
+    {
+        Cluster &cluster = clusters[c];
+
+        float centroid[3] = {0.0f, 0.0f, 0.0f};
+        float normal[3] = {0.0f, 0.0f, 0.0f};
+        float area = 0.0f;
+
+        for (unsigned int t = cluster.begin; t < cluster.end; ++t)
+        {
+            const float *p0 = &vertices[indices[t * 3] * vertexSize];
+            const float *p1 = &vertices[indices[t * 3 + 1] * vertexSize];
+            const float *p2 = &vertices[indices[t * 3 + 2] * vertexSize];
+
+            float n[3];
+            triangleNormal(p0, p1, p2, n);
+            float a = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                centroid[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * a;
+                normal[k] += n[k];
+            }
+            area += a;
+        }
+
+        float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (area <= 0.0f || length <= 0.0f)
+            continue;
+
+        for (unsigned int k = 0; k < 3; ++k)
+            cluster.sortKey += (centroid[k] / area - meshCentroid[k]) * normal[k] / length;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), sortClusters);
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (unsigned int c = 0; c < clusters.size(); ++c)
+        result.insert(result.end(), indices.begin() + clusters[c].begin * 3, indices.begin() + clusters[c].end * 3);
+
+    indices.swap(result);
+}
+
+unsigned int L3DMeshOptimizer::optimizeVertexFetch(
+    std::vector<float> &vertices,
+    std::vector<unsigned int> &indices,
+    unsigned int vertexSize)
+{
+    if (vertexSize == 0)
+        return 0;
+
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size() / vertexSize, unused);
+    std::vector<float> result;
+    result.reserve(vertices.size());
+
+    unsigned int vertexCount = 0;
+    for (unsigned int i = 0; i < indices.size(); ++i)
+    {
+        unsigned int &target = remap[indices[i]];
+        if (target == unused)
+        {
+            const float *vertex = &vertices[indices[i] * vertexSize];
+            result.insert(result.end(), vertex, vertex + vertexSize);
+            target = vertexCount++;
+        }
+        indices[i] = target;
+    }
+
+    vertices.swap(result);
+
+    return vertexCount;
+}
+
+float L3DMeshOptimizer::simplify(
+    const std::vector<float> &vertices,
+    unsigned int vertexSize,
+    const std::vector<unsigned int> &indices,
+    unsigned int targetIndexCount,
+    std::vector<unsigned int> &result)
+{
+    result = indices;
+
+    if (vertexSize < 3 || indices.size() <= targetIndexCount)
+        return 0.0f;
+
+    unsigned int vertexCount = vertices.size() / vertexSize;
+    std::vector<bool> locked(vertexCount, false);
+
+    // Vertices sharing their position with others lie on attribute seams:
+    // moving one of them would open a crack.
+    std::unordered_map<VertexKey, unsigned int, VertexKeyHash, VertexKeyEqual> positions;
+    positions.reserve(vertexCount);
+    for (unsigned int v = 0; v < vertexCount; ++v)
+    {
+        VertexKey key = {&vertices[v * vertexSize], 3};
+        auto found = positions.find(key);
+        if (found != positions.end())
+            locked[v] = locked[found->second] = true;
+        else
+            positions[key] = v;
+    }
+
+    // Border edges belong to a single triangle: their vertices are locked
+    // too, so that open meshes keep their outline.
+    std::unordered_map<unsigned long long, unsigned int> edges;
+    edges.reserve(indices.size());
+    for (unsigned int i = 0; i < indices.size(); ++i)
+    {
+        unsigned int a = indices[i];
+        unsigned int b = indices[i - i % 3 + (i + 1) % 3];
+        ++edges[((unsigned long long)std::min(a, b) << 32) | std::max(a, b)];
+    }
+
+    for (auto it = edges.begin(); it != edges.end(); ++it)
+    {
+        if (it->second == 1)
+        {
+            locked[(unsigned int)(it->first >> 32)] = true;
+            locked[(unsigned int)(it->first & 0xffffffff)] = true;
+        }
+    }
+
+    Quadric zero = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    std::vector<Quadric> quadrics(vertexCount, zero);
+    for (unsigned int t = 0; t < indices.size() / 3; ++t)
+    {
+        const float *p0 = &vertices[indices[t * 3] * vertexSize];
+        const float *p1 = &vertices[indices[t * 3 + 1] * vertexSize];
+        const float *p2 = &vertices[indices[t * 3 + 2] * vertexSize];
+
+        float n[3];
+        triangleNormal(p0, p1, p2, n);
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length <= 0.0f)
+            continue;
+
+        double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+        double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+
+        for (unsigned int k = 0; k < 3; ++k)
+            addPlane(quadrics[indices[t * 3 + k]], a, b, c, d);
+    }
+
+    double maxCost = 0.0;
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+    std::vector<unsigned int> adjacency;
+    std::vector<bool> touched(vertexCount);
+    std::vector<Collapse> collapses;
+
+    // Every pass collapses the cheapest independent edges.
+    while (result.size() > targetIndexCount)
+    {
+        unsigned int triangleCount = result.size() / 3;
+
+        collapses.clear();
+        for (unsigned int i = 0; i < result.size(); ++i)
+        {
+            unsigned int a = result[i];
+            unsigned int b = result[i - i % 3 + (i + 1) % 3];
+
+            if (!locked[a])
+            {
+                Collapse collapse = {a, b, evaluate(quadrics[a], quadrics[b], &vertices[b * vertexSize])};
+                collapses.push_back(collapse);
+            }
+            if (!locked[b])
+            {
+                Collapse collapse = {b, a, evaluate(quadrics[a], quadrics[b], &vertices[a * vertexSize])};
+                collapses.push_back(collapse);
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), sortCollapses);
+
+        // Triangles around each vertex.
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (unsigned int i = 0; i < result.size(); ++i)
+            ++adjacencyOffsets[result[i] + 1];
+        for (unsigned int v = 0; v < vertexCount; ++v)
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+        adjacency.resize(result.size());
+        std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (unsigned int i = 0; i < result.size(); ++i)
+            adjacency[fill[result[i]]++] = i / 3;
+
+        for (unsigned int v = 0; v < vertexCount; ++v)
+            remap[v] = v;
+        std::fill(touched.begin(), touched.end(), false);
+
+        unsigned int removableTriangles = (result.size() - targetIndexCount + 2) / 3;
+        unsigned int removedTriangles = 0;
+
+        for (unsigned int c = 0; c < collapses.size() && removedTriangles < removableTriangles; ++c)
+        {
+            const Collapse &collapse = collapses[c];
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            // Reject collapses flipping the triangles left around.
+            bool flips = false;
+            unsigned int collapsed = 0;
+            const float *target = &vertices[collapse.to * vertexSize];
+
+            for (unsigned int a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && !flips; ++a)
+            {
+                const unsigned int *triangle = &result[adjacency[a] * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                {
+                    ++collapsed;
+                    continue;
+                }
+
+                const float *p[3];
+                const float *moved[3];
+                for (unsigned int k = 0; k < 3; ++k)
+                {
+                    p[k] = &vertices[triangle[k] * vertexSize];
+                    moved[k] = triangle[k] == collapse.from ? target : p[k];
+                }
+
+                float before[3], after[3];
+                triangleNormal(p[0], p[1], p[2], before);
+                triangleNormal(moved[0], moved[1], moved[2], after);
+                flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0f;
+            }
+
+            if (flips)
+                continue;
+
+            remap[collapse.from] = collapse.to;
+            addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+            maxCost = std::max(maxCost, collapse.cost);
+            removedTriangles += collapsed;
+
+            // The triangles around the collapsed vertex changed: their
+            // vertices wait for the next pass.
+            for (unsigned int a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; ++a)
+                for (unsigned int k = 0; k < 3; ++k)
+                    touched[result[adjacency[a] * 3 + k]] = true;
+        }
+
+        if (removedTriangles == 0)
+            break;
+
+        // Drop the triangles degenerated by the collapses.
+        unsigned int write = 0;
+        for (unsigned int t = 0; t < triangleCount; ++t)
+        {
+            unsigned int a = remap[result[t * 3]];
+            unsigned int b = remap[result[t * 3 + 1]];
+            unsigned int c = remap[result[t * 3 + 2]];
+
+            if (a != b && b != c && a != c)
+            {
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+        }
+        result.resize(write);
+    }
+
+    return (float)sqrt(maxCost);
+}
+
+unsigned int L3DMeshOptimizer::buildLods(
+    const std::vector<float> &vertices,
+    unsigned int vertexSize,
+    std::vector<unsigned int> &indices,
+    L3DMeshLod *lods,
+    unsigned int lodCount)
+{
+    if (lodCount == 0)
+        return 0;
+
+    const std::vector<unsigned int> full(indices);
+    lods[0].indexOffset = 0;
+    lods[0].indexCount = full.size();
+    lods[0].error = 0.0f;
+
+    // Levels are simplified from the full mesh, not from the previous
+    // level, so that their errors are measured against the original.
+    unsigned int count = 1;
+    for (; count < lodCount; ++count)
+    {
+        unsigned int targetIndexCount = (full.size() >> count) / 3 * 3;
+        if (targetIndexCount < 3)
+            break;
+
+        std::vector<unsigned int> lod;
+        float error = L3DMeshOptimizer::simplify(vertices, vertexSize, full, targetIndexCount, lod);
+
+        // Stop once simplification stalls, e.g. on locked seams.
+        if (lod.empty() || lod.size() * 10 > lods[count - 1].indexCount * 9)
+            break;
+
+        L3DMeshOptimizer::optimizeVertexCache(lod, vertices.size() / vertexSize);
+
+        lods[count].indexOffset = indices.size();
+        lods[count].indexCount = lod.size();
+        lods[count].error = std::max(error, lods[count - 1].error);
+        indices.insert(indices.end(), lod.begin(), lod.end());
+    }
+
+    return count;
+}
+
+L3DVertexCacheStats L3DMeshOptimizer::analyzeVertexCache(
+    const std::vector<unsigned int> &indices,
+    unsigned int vertexCount,
+    unsigned int cacheSize)
+{
+    L3DVertexCacheStats stats = {0.0f, 0.0f};
+    if (indices.empty() || vertexCount == 0)
+        return stats;
+
+    // FIFO cache of the last cacheSize transformed vertices.
+    std::vector<unsigned int> timestamps(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    unsigned int misses = 0;
+
+    for (unsigned int i = 0; i < indices.size(); ++i)
+    {
+        unsigned int v = indices[i];
+        if (time - timestamps[v] > cacheSize)
+        {
+            timestamps[v] = time++;
+            ++misses;
+        }
+    }
+
+    stats.acmr = misses / (float)(indices.size() / 3);
+    stats.atvr = misses / (float)vertexCount;
+
+    return stats;
+}
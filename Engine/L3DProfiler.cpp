@@ -0,0 +1,303 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <string.h>
+#include <chrono>
+#include <leaf3d/L3DProfiler.h>
+
+using namespace l3d;
+
+static double now()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double smooth(double average, double value, bool first)
+{
+    return first ? value : average + (value - average) * L3D_PROFILER_SMOOTHING;
+}
+
+L3DProfiler::L3DProfiler() : m_enabled(false),
+                             m_gpuTimers(false),
+                             m_debugGroups(false),
+                             m_frame(0),
+                             m_gpuFrame(0)
+{
+}
+
+L3DProfiler::~L3DProfiler()
+{
+    // Queries are left to the context, which may be gone already.
+}
+
+void L3DProfiler::setGpuFeatures(bool timers, bool debugGroups)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_gpuTimers = timers;
+    m_debugGroups = debugGroups;
+}
+
+void L3DProfiler::beginScope(const char *name, bool gpu)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    L3DProfileStack &stack = m_stacks[std::this_thread::get_id()];
+    int parent = stack.nodes.empty() ? -1 : stack.nodes.back();
+    int node = this->findNode(name, parent, stack.nodes.size());
+    int sample = -1;
+
+    if (gpu && m_debugGroups)
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+
+    if (gpu && m_gpuTimers)
+    {
+        L3DGpuSampleList &samples = m_gpuSamples[m_frame % L3D_PROFILER_FRAMES];
+        L3DGpuSample gpuSample;
+        gpuSample.node = node;
+        gpuSample.queries[0] = this->acquireQuery();
+        gpuSample.queries[1] = this->acquireQuery();
+        glQueryCounter(gpuSample.queries[0], GL_TIMESTAMP);
+
+        sample = samples.size();
+        samples.push_back(gpuSample);
+    }
+
+    stack.nodes.push_back(node);
+    stack.samples.push_back(sample);
+    stack.starts.push_back(now());
+}
+
+void L3DProfiler::endScope(bool gpu)
+{
+    double end = now();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    L3DProfileStack &stack = m_stacks[std::this_thread::get_id()];
+
+    // Scopes begun before a clear() are dropped.
+    if (stack.nodes.empty())
+        return;
+
+    L3DProfileNode &node = m_nodes[stack.nodes.back()];
+    node.frameCpuTime += end - stack.starts.back();
+    node.frameCalls++;
+
+    int sample = stack.samples.back();
+    if (sample >= 0)
+        glQueryCounter(m_gpuSamples[m_frame % L3D_PROFILER_FRAMES][sample].queries[1], GL_TIMESTAMP);
+
+    if (gpu && m_debugGroups)
+        glPopDebugGroup();
+
+    stack.nodes.pop_back();
+    stack.samples.pop_back();
+    stack.starts.pop_back();
+}
+
+void L3DProfiler::endFrame()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Previous frames, oldest first: a frame with pending queries is kept
+    // for later, with the ones after it.
+    while (m_gpuFrame != m_frame && this->readGpuSamples(m_gpuSamples[m_gpuFrame % L3D_PROFILER_FRAMES]))
+        ++m_gpuFrame;
+
+    for (L3DProfileNodeList::iterator it = m_nodes.begin(); it != m_nodes.end(); ++it)
+    {
+        L3DProfileNode &node = *it;
+
+        // Scopes skipped by a frame count as free.
+        node.cpuTime = smooth(node.cpuTime, node.frameCpuTime, !node.sampled);
+        node.calls = node.frameCalls;
+        node.sampled = true;
+
+        node.frameCpuTime = 0.0;
+        node.frameCalls = 0;
+    }
+
+    ++m_frame;
+
+    // The ring wraps: the next frame reuses the slot of the oldest one.
+    if (m_frame - m_gpuFrame == L3D_PROFILER_FRAMES)
+    {
+        this->releaseGpuSamples(m_gpuSamples[m_gpuFrame % L3D_PROFILER_FRAMES]);
+        ++m_gpuFrame;
+    }
+}
+
+bool L3DProfiler::readGpuSamples(L3DGpuSampleList &samples)
+{
+    for (L3DGpuSampleList::const_iterator it = samples.begin(); it != samples.end(); ++it)
+    {
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(it->queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (!available)
+            return false;
+    }
+
+    for (L3DGpuSampleList::const_iterator it = samples.begin(); it != samples.end(); ++it)
+    {
+        if (it->node >= (int)m_nodes.size())
+            continue;
+
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(it->queries[0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(it->queries[1], GL_QUERY_RESULT, &end);
+
+        L3DProfileNode &node = m_nodes[it->node];
+        node.frameGpuTime += (end - begin) / 1000000.0;
+        node.gpuSampled = true;
+    }
+
+    // Each frame is averaged on its own, even when several complete at once.
+    for (L3DProfileNodeList::iterator it = m_nodes.begin(); it != m_nodes.end(); ++it)
+    {
+        L3DProfileNode &node = *it;
+
+        if (node.gpuSampled)
+        {
+            node.gpuTime = smooth(node.gpuTime, node.frameGpuTime, !node.gpuAveraged);
+            node.gpuAveraged = true;
+        }
+
+        node.frameGpuTime = 0.0;
+        node.gpuSampled = false;
+    }
+
+    this->releaseGpuSamples(samples);
+
+    return true;
+}
+
+void L3DProfiler::releaseGpuSamples(L3DGpuSampleList &samples)
+{
+    for (L3DGpuSampleList::const_iterator it = samples.begin(); it != samples.end(); ++it)
+    {
+        m_freeQueries.push_back(it->queries[0]);
+        m_freeQueries.push_back(it->queries[1]);
+    }
+    samples.clear();
+}
+
+static void collectEntries(
+    const L3DProfileNodeList &nodes,
+    int parent,
+    L3DProfileEntry *entries,
+    unsigned int maxCount,
+    unsigned int &count)
+{
+    for (unsigned int i = 0; i < nodes.size(); ++i)
+    {
+        const L3DProfileNode &node = nodes[i];
+
+        if (node.parent != parent)
+            continue;
+
+        if (count < maxCount && entries)
+        {
+            L3DProfileEntry &entry = entries[count];
+            strncpy(entry.name, node.name.c_str(), L3D_PROFILE_NAME_SIZE - 1);
+            entry.name[L3D_PROFILE_NAME_SIZE - 1] = '\0';
+            entry.depth = node.depth;
+            entry.cpuTime = node.cpuTime;
+            entry.gpuTime = node.gpuTime;
+            entry.calls = node.calls;
+        }
+
+        ++count;
+
+        collectEntries(nodes, i, entries, maxCount, count);
+    }
+}
+
+unsigned int L3DProfiler::profile(L3DProfileEntry *entries, unsigned int maxCount)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    unsigned int count = 0;
+    collectEntries(m_nodes, -1, entries, maxCount, count);
+
+    return count;
+}
+
+void L3DProfiler::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (unsigned int i = 0; i < L3D_PROFILER_FRAMES; ++i)
+        this->releaseGpuSamples(m_gpuSamples[i]);
+    m_gpuFrame = m_frame;
+
+    if (!m_freeQueries.empty())
+        glDeleteQueries(m_freeQueries.size(), &m_freeQueries[0]);
+
+    m_freeQueries.clear();
+    m_nodes.clear();
+    m_stacks.clear();
+}
+
+int L3DProfiler::findNode(const char *name, int parent, unsigned int depth)
+{
+    for (unsigned int i = 0; i < m_nodes.size(); ++i)
+    {
+        if (m_nodes[i].parent == parent && m_nodes[i].name == name)
+            return i;
+    }
+
+    L3DProfileNode node;
+    node.name = name;
+    node.parent = parent;
+    node.depth = depth;
+    node.frameCpuTime = 0.0;
+    node.frameGpuTime = 0.0;
+    node.frameCalls = 0;
+    node.cpuTime = 0.0;
+    node.gpuTime = 0.0;
+    node.calls = 0;
+    node.sampled = false;
+    node.gpuSampled = false;
+    node.gpuAveraged = false;
+    m_nodes.push_back(node);
+
+    return m_nodes.size() - 1;
+}
+
+unsigned int L3DProfiler::acquireQuery()
+{
+    GLuint query = 0;
+
+    if (m_freeQueries.empty())
+    {
+        glGenQueries(1, &query);
+    }
+    else
+    {
+        query = m_freeQueries.back();
+        m_freeQueries.pop_back();
+    }
+
+    return query;
+}
@@ -0,0 +1,148 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <leaf3d/L3DProgramCache.h>
+
+#ifdef L3D_PLATFORM_WIN
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace l3d;
+
+struct L3DProgramCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t size;
+};
+
+bool L3DProgramCache::setPath(const std::string &path)
+{
+    m_path = path;
+
+    if (m_path.empty())
+        return true;
+
+    if (m_path[m_path.size() - 1] != '/' && m_path[m_path.size() - 1] != '\\')
+        m_path += '/';
+
+#ifdef L3D_PLATFORM_WIN
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+
+    return true;
+}
+
+std::string L3DProgramCache::filename(unsigned long long key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", key);
+
+    return m_path + name;
+}
+
+bool L3DProgramCache::load(
+    unsigned long long key,
+    unsigned int &format,
+    std::vector<unsigned char> &binary) const
+{
+    if (!this->isEnabled())
+        return false;
+
+    FILE *file = fopen(this->filename(key).c_str(), "rb");
+    if (!file)
+        return false;
+
+    L3DProgramCacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              header.magic == L3D_PROGRAM_CACHE_MAGIC &&
+              header.version == L3D_PROGRAM_CACHE_VERSION &&
+              header.key == key &&
+              header.size > 0;
+
+    if (ok)
+    {
+        binary.resize(header.size);
+        ok = fread(&binary[0], 1, header.size, file) == header.size;
+        format = header.format;
+    }
+
+    fclose(file);
+
+    return ok;
+}
+
+bool L3DProgramCache::store(
+    unsigned long long key,
+    unsigned int format,
+    const std::vector<unsigned char> &binary) const
+{
+    if (!this->isEnabled() || binary.empty())
+        return false;
+
+    L3DProgramCacheHeader header;
+    header.magic = L3D_PROGRAM_CACHE_MAGIC;
+    header.version = L3D_PROGRAM_CACHE_VERSION;
+    header.key = key;
+    header.format = format;
+    header.size = binary.size();
+
+    // Write aside and rename, so that other processes never read a
+    // partial binary.
+    std::string path = this->filename(key);
+    std::string tmpPath = path + ".tmp";
+    FILE *file = fopen(tmpPath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(&binary[0], 1, binary.size(), file) == binary.size();
+
+    ok = (fclose(file) == 0) && ok;
+
+    if (ok)
+    {
+        ::remove(path.c_str());
+        ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+
+    if (!ok)
+    {
+        fprintf(stderr, "Program cache %s: write failed\n", path.c_str());
+        ::remove(tmpPath.c_str());
+    }
+
+    return ok;
+}
+
+void L3DProgramCache::remove(unsigned long long key) const
+{
+    if (this->isEnabled())
+        ::remove(this->filename(key).c_str());
+}
@@ -0,0 +1,157 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <leaf3d/L3DRenderer.h>
+#include <leaf3d/L3DRenderPipeline.h>
+#include <leaf3d/L3DTrace.h>
+
+using namespace l3d;
+
+L3DRenderPipeline::L3DRenderPipeline(
+    L3DRenderer *renderer,
+    unsigned int queueDepth,
+    L3DContextCallback acquireContext,
+    L3DContextCallback releaseContext,
+    L3DContextCallback presentFrame,
+    void *userData) : m_renderer(renderer),
+                      m_acquireContext(acquireContext),
+                      m_releaseContext(releaseContext),
+                      m_presentFrame(presentFrame),
+                      m_userData(userData),
+                      m_executeCalls(false),
+                      m_executedCalls(0),
+                      m_stop(false)
+{
+    for (unsigned int i = 0; i < queueDepth; ++i)
+    {
+        L3DFrameData *frame = new L3DFrameData();
+        m_frames.push_back(frame);
+        m_freeFrames.push_back(frame);
+    }
+
+    m_thread = std::thread(&L3DRenderPipeline::renderLoop, this);
+}
+
+L3DRenderPipeline::~L3DRenderPipeline()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+
+    if (m_thread.joinable())
+        m_thread.join();
+
+    for (L3DFrameDataList::reverse_iterator it = m_frames.rbegin(); it != m_frames.rend(); ++it)
+        delete *it;
+    m_frames.clear();
+}
+
+L3DFrameData *L3DRenderPipeline::acquireFrame()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() { return !m_freeFrames.empty(); });
+
+    L3DFrameData *frame = m_freeFrames.front();
+    m_freeFrames.pop_front();
+
+    return frame;
+}
+
+void L3DRenderPipeline::submitFrame(L3DFrameData *frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queuedFrames.push_back(frame);
+    }
+    m_condition.notify_all();
+}
+
+void L3DRenderPipeline::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() { return m_freeFrames.size() == m_frames.size(); });
+}
+
+unsigned int L3DRenderPipeline::executeCalls()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_executeCalls = true;
+    m_condition.notify_all();
+    m_condition.wait(lock, [this]() { return !m_executeCalls; });
+
+    return m_executedCalls;
+}
+
+void L3DRenderPipeline::renderLoop()
+{
+    L3DTrace::setThreadName("Render pipeline");
+    m_acquireContext(m_userData);
+
+    while (true)
+    {
+        L3DFrameData *frame = L3D_NULLPTR;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stop || m_executeCalls || !m_queuedFrames.empty(); });
+
+            // Queued frames are always rendered first, and before stopping.
+            if (!m_queuedFrames.empty())
+            {
+                frame = m_queuedFrames.front();
+                m_queuedFrames.pop_front();
+            }
+            else if (!m_executeCalls)
+            {
+                break;
+            }
+        }
+
+        if (!frame)
+        {
+            unsigned int count = m_renderer->executeCallsAsRenderThread();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_executeCalls = false;
+                m_executedCalls = count;
+            }
+            m_condition.notify_all();
+
+            continue;
+        }
+
+        m_renderer->submitFrame(*frame);
+
+        if (m_presentFrame)
+            m_presentFrame(m_userData);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_freeFrames.push_back(frame);
+        }
+        m_condition.notify_all();
+    }
+
+    m_releaseContext(m_userData);
+}
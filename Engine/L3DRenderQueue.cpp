@@ -42,7 +42,8 @@ L3DRenderQueue::~L3DRenderQueue()
 
 void L3DRenderQueue::appendCommand(L3DRenderCommand *command)
 {
-    m_commands.push_back(command);
+    if (command)
+        m_commands.push_back(command);
 }
 
 void L3DRenderQueue::appendCommands(const L3DRenderCommandList &commands)
@@ -54,5 +55,9 @@ void L3DRenderQueue::appendCommands(const L3DRenderCommandList &commands)
 void L3DRenderQueue::execute(L3DRenderer *renderer, L3DCamera *camera)
 {
     for (L3DRenderCommandList::const_iterator it = m_commands.begin(); it != m_commands.end(); ++it)
+    {
+        L3DProfileScope scope(renderer->profiler(), (*it)->name(), true);
+        L3D_COUNT(renderer->renderStats(), renderCommands, 1);
         (*it)->execute(renderer, camera);
+    }
 }
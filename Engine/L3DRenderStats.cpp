@@ -0,0 +1,94 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <leaf3d/L3DRenderStats.h>
+
+using namespace l3d;
+
+static unsigned int L3DRenderCounters::*const counterFields[] = {
+    &L3DRenderCounters::drawCalls,
+    &L3DRenderCounters::primitives,
+    &L3DRenderCounters::programBinds,
+    &L3DRenderCounters::textureBinds,
+    &L3DRenderCounters::uniformUploads,
+    &L3DRenderCounters::frameBufferSwitches,
+    &L3DRenderCounters::clears,
+    &L3DRenderCounters::stateChanges,
+    &L3DRenderCounters::renderCommands};
+
+static const unsigned int counterFieldCount = sizeof(counterFields) / sizeof(counterFields[0]);
+
+L3DRenderStats::L3DRenderStats() : m_layer(-1),
+                                   m_next(0)
+{
+    memset(&m_frame, 0, sizeof(m_frame));
+    memset(m_layers, 0, sizeof(m_layers));
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void L3DRenderStats::endFrame()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Sliding window of the last frames.
+    if (m_window.size() < L3D_FRAME_STATS_WINDOW)
+        m_window.push_back(m_frame);
+    else
+        m_window[m_next] = m_frame;
+    m_next = (m_next + 1) % L3D_FRAME_STATS_WINDOW;
+
+    m_stats.frame = m_frame;
+    memcpy(m_stats.layers, m_layers, sizeof(m_layers));
+    m_stats.frameCount = m_window.size();
+
+    for (unsigned int i = 0; i < counterFieldCount; ++i)
+    {
+        unsigned int L3DRenderCounters::*field = counterFields[i];
+        unsigned int minValue = m_window[0].*field;
+        unsigned int maxValue = minValue;
+        unsigned long long sum = 0;
+
+        for (L3DRenderCountersList::const_iterator it = m_window.begin(); it != m_window.end(); ++it)
+        {
+            unsigned int value = (*it).*field;
+            minValue = std::min(minValue, value);
+            maxValue = std::max(maxValue, value);
+            sum += value;
+        }
+
+        m_stats.min.*field = minValue;
+        m_stats.max.*field = maxValue;
+        m_stats.average.*field = (unsigned int)((sum + m_window.size() / 2) / m_window.size());
+    }
+
+    memset(&m_frame, 0, sizeof(m_frame));
+    memset(m_layers, 0, sizeof(m_layers));
+    m_layer = -1;
+}
+
+L3DFrameStats L3DRenderStats::stats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_stats;
+}
@@ -19,8 +19,11 @@
  * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
  */
 
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include <sstream>
+#include <algorithm>
 #include <leaf3d/L3DBuffer.h>
 #include <leaf3d/L3DTexture.h>
 #include <leaf3d/L3DShader.h>
@@ -31,13 +34,40 @@
 #include <leaf3d/L3DLight.h>
 #include <leaf3d/L3DMesh.h>
 #include <leaf3d/L3DRenderQueue.h>
+#include <leaf3d/L3DJobSystem.h>
+#include <leaf3d/L3DRenderPipeline.h>
+#include <leaf3d/L3DAssetRegistry.h>
+#include <leaf3d/L3DShaderPreprocessor.h>
+#include <leaf3d/L3DTrace.h>
 #include <leaf3d/L3DRenderer.h>
 
 using namespace l3d;
 
-struct l3dMeshSortFunctor
-{
-    bool operator()(L3DMesh *i, L3DMesh *j) { return i->sortKey() < j->sortKey(); }
+// Meshes processed by a single frame preparation job.
+#define L3D_PREPARE_GRAIN_SIZE 64
+// Draw packets recorded by a single recording job.
+#define L3D_RECORD_SLICE_SIZE 256
+// Geometric error allowed by mesh LOD selection, as a fraction of the
+// viewport height (about a pixel at 1080p), before the LOD bias.
+#define L3D_LOD_MAX_SCREEN_ERROR (1.0f / 1080.0f)
+
+// S3TC formats come from an extension, missing in the core profile loader
+// (supported by every desktop driver anyway).
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Non-blocking status query of GL_KHR_parallel_shader_compile.
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+struct l3dDrawItemSortFunctor
+{
+    bool operator()(const L3DDrawItem &i, const L3DDrawItem &j) const { return i.sortKey < j.sortKey; }
 };
 
 static GLenum toOpenGL(const L3DBufferType &orig)
@@ -100,6 +130,47 @@ static GLenum toOpenGL(const L3DImageFormat &orig)
         return GL_RGBA;
     case L3D_DEPTH24_STENCIL8:
         return GL_DEPTH24_STENCIL8;
+    case L3D_BC1:
+        return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case L3D_BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case L3D_BC4:
+        return GL_COMPRESSED_RED_RGTC1;
+    case L3D_BC5:
+        return GL_COMPRESSED_RG_RGTC2;
+    case L3D_BC7:
+        return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+// Sized internal formats, required by immutable texture storage.
+static GLenum toOpenGLStorage(const L3DImageFormat &orig)
+{
+    switch (orig)
+    {
+    case L3D_RGB:
+        return GL_RGB8;
+    case L3D_RGBA:
+        return GL_RGBA8;
+    default:
+        break;
+    }
+
+    return toOpenGL(orig);
+}
+
+static GLenum toOpenGL(const L3DIndexType &orig)
+{
+    switch (orig)
+    {
+    case L3D_INDEX_UNSIGNED_SHORT:
+        return GL_UNSIGNED_SHORT;
+    case L3D_INDEX_UNSIGNED_INT:
+        return GL_UNSIGNED_INT;
     default:
         break;
     }
@@ -363,6 +434,113 @@ static GLenum toOpenGL(const L3DShaderType &orig)
     return 0;
 }
 
+// Allocate immutable storage for all the levels of the bound 2D texture
+// or cube map, when supported (OpenGL 4.2). Return false otherwise: each
+// level is then allocated by its upload.
+static bool allocateTextureStorage(
+    GLenum type,
+    const L3DImageFormat &format,
+    unsigned int width,
+    unsigned int height,
+    unsigned int levelCount)
+{
+    if (!GLAD_GL_VERSION_4_2)
+        return false;
+
+    glTexStorage2D(type, levelCount, toOpenGLStorage(format), width, height);
+
+    return true;
+}
+
+// Upload the mip chain of a 2D image (or cube map face) to the bound
+// texture, into its allocated storage if any. Return the size of the data
+// consumed.
+static unsigned int uploadTextureLevels(
+    GLenum target,
+    const L3DImageFormat &format,
+    GLenum pixelFormat,
+    const unsigned char *data,
+    unsigned int width,
+    unsigned int height,
+    unsigned int mipCount,
+    bool allocated = false)
+{
+    GLenum gl_format = toOpenGL(format);
+    GLenum gl_internal_format = (gl_format == GL_DEPTH24_STENCIL8) ? GL_DEPTH_STENCIL : gl_format;
+    unsigned int offset = 0;
+
+    for (unsigned int level = 0; level < mipCount; ++level)
+    {
+        unsigned int levelWidth = (width >> level) ? (width >> level) : 1;
+        unsigned int levelHeight = (height >> level) ? (height >> level) : 1;
+        unsigned int levelSize = L3DTexture::levelSize(format, width, height, level);
+        const unsigned char *levelData = data ? data + offset : L3D_NULLPTR;
+
+        if (allocated && !levelData)
+            break;
+        else if (allocated && L3DTexture::isCompressed(format))
+            glCompressedTexSubImage2D(target, level, 0, 0, levelWidth, levelHeight, gl_format, levelSize, levelData);
+        else if (allocated)
+            glTexSubImage2D(target, level, 0, 0, levelWidth, levelHeight, gl_internal_format, pixelFormat, levelData);
+        else if (L3DTexture::isCompressed(format))
+            glCompressedTexImage2D(target, level, gl_format, levelWidth, levelHeight, 0, levelSize, levelData);
+        else
+            glTexImage2D(target, level, gl_format, levelWidth, levelHeight, 0, gl_internal_format, pixelFormat, levelData);
+
+        offset += levelSize;
+    }
+
+    return offset;
+}
+
+// Set wrap modes and filters of the bound texture.
+static void setTextureParameters(L3DTexture *texture, GLenum gl_type, bool useMipmaps)
+{
+    GLenum gl_wrap_s = toOpenGL(texture->wrapS());
+    GLenum gl_wrap_t = toOpenGL(texture->wrapT());
+    GLenum gl_wrap_r = toOpenGL(texture->wrapR());
+    GLenum gl_min_filter = toOpenGL(texture->minFilter());
+    GLenum gl_mag_filter = toOpenGL(texture->magFilter());
+
+    // Wrap mode for S, T, R coordinates.
+    glTexParameteri(gl_type, GL_TEXTURE_WRAP_S, gl_wrap_s);
+
+    if (gl_type > GL_TEXTURE_1D)
+        glTexParameteri(gl_type, GL_TEXTURE_WRAP_T, gl_wrap_t);
+
+    if (gl_type > GL_TEXTURE_2D)
+        glTexParameteri(gl_type, GL_TEXTURE_WRAP_R, gl_wrap_r);
+
+    // Min and mag filters.
+    if (!useMipmaps)
+    {
+        if (gl_min_filter == GL_NEAREST_MIPMAP_LINEAR)
+            gl_min_filter = GL_LINEAR;
+        else if (gl_min_filter == GL_NEAREST_MIPMAP_NEAREST)
+            gl_min_filter = GL_NEAREST;
+    }
+
+    glTexParameteri(gl_type, GL_TEXTURE_MIN_FILTER, gl_min_filter);
+    glTexParameteri(gl_type, GL_TEXTURE_MAG_FILTER, gl_mag_filter);
+}
+
+// Number of levels of a full mip chain.
+static unsigned int fullMipCount(unsigned int width, unsigned int height)
+{
+    unsigned int count = 1;
+    for (unsigned int size = (width > height) ? width : height; size > 1; size /= 2)
+        ++count;
+
+    return count;
+}
+
+// Attribute locations are bound before linking (see linkShaderProgram()),
+// so that every variant of a program reads the same vertex arrays.
+static GLint attributeLocation(const L3DAttributeMap &attributes, int attribute)
+{
+    return attributes.count(attribute) ? attribute : -1;
+}
+
 static void enableVertexAttribute(
     GLint attrib,
     GLint size,
@@ -381,49 +559,306 @@ static void enableVertexAttribute(
     }
 }
 
+// Packed vertices: normalized shorts for the position, 10:10:10:2 normal
+// and tangent, half-float UVs (see L3DMesh::packVertices()).
+static void enablePackedVertexAttributes(
+    const L3DVertexFormat &format,
+    GLint posAttrib,
+    const GLint *directionAttribs,
+    const GLint *texAttribs)
+{
+    L3DVertexFormat unpacked = L3DMesh::unpackedFormat(format);
+    unsigned int directions = (unpacked >= L3D_VERTEX_POS3_NOR3_UV2) + (unpacked >= L3D_VERTEX_POS3_NOR3_TAN3_UV2);
+    unsigned int uvs = (unpacked - 3 - directions * 3) / 2;
+    GLsizei stride = L3DMesh::vertexSize(format);
+    size_t offset = 0;
+
+    enableVertexAttribute(posAttrib, 3, GL_SHORT, stride, (void *)offset, GL_TRUE);
+    offset += 4 * sizeof(GLshort);
+
+    for (unsigned int i = 0; i < directions; ++i, offset += sizeof(GLuint))
+        enableVertexAttribute(directionAttribs[i], 4, GL_INT_2_10_10_10_REV, stride, (void *)offset, GL_TRUE);
+
+    for (unsigned int i = 0; i < uvs; ++i, offset += 2 * sizeof(GLhalf))
+        enableVertexAttribute(texAttribs[i], 2, GL_HALF_FLOAT, stride, (void *)offset);
+}
+
+// Binds and uploads of a frame are counted here, where they are issued.
+static void bindProgram(L3DRenderStats &stats, GLuint program)
+{
+    glUseProgram(program);
+    L3D_COUNT(stats, programBinds, 1);
+}
+
+static void bindTexture(L3DRenderStats &stats, GLenum target, GLuint texture)
+{
+    glBindTexture(target, texture);
+    L3D_COUNT(stats, textureBinds, 1);
+}
+
+static void setUniform(L3DRenderStats &stats, GLint location, GLint value)
+{
+    glUniform1i(location, value);
+    L3D_COUNT(stats, uniformUploads, 1);
+}
+
+static void setUniform(L3DRenderStats &stats, GLint location, const L3DVec3 &value)
+{
+    glUniform3fv(location, 1, glm::value_ptr(value));
+    L3D_COUNT(stats, uniformUploads, 1);
+}
+
+static void setUniform(L3DRenderStats &stats, GLint location, const L3DMat3 &value)
+{
+    glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    L3D_COUNT(stats, uniformUploads, 1);
+}
+
+static void setUniform(L3DRenderStats &stats, GLint location, const L3DMat4 &value)
+{
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    L3D_COUNT(stats, uniformUploads, 1);
+}
+
 static void setUniform(
-    GLuint shaderProgram,
-    const char *name,
-    const L3DUniform &uniform)
+    L3DRenderStats &stats,
+    GLint location,
+    const L3DPackedUniform &uniform)
 {
-    GLint gl_location = glGetUniformLocation(shaderProgram, name);
+    L3D_COUNT(stats, uniformUploads, 1);
 
     switch (uniform.type)
     {
     case L3D_UNIFORM_FLOAT:
-        glUniform1f(gl_location, uniform.value.valueF);
+        glUniform1f(location, uniform.valueF[0]);
         break;
     case L3D_UNIFORM_INT:
-        glUniform1i(gl_location, uniform.value.valueI);
+        glUniform1i(location, uniform.valueI);
         break;
     case L3D_UNIFORM_UINT:
-        glUniform1ui(gl_location, uniform.value.valueUI);
-        break;
     case L3D_UNIFORM_BOOL:
-        glUniform1ui(gl_location, uniform.value.valueB);
+        glUniform1ui(location, uniform.valueUI);
         break;
     case L3D_UNIFORM_VEC2:
-        glUniform2fv(gl_location, 1, uniform.value.valueVec2);
+        glUniform2fv(location, 1, uniform.valueF);
         break;
     case L3D_UNIFORM_VEC3:
-        glUniform3fv(gl_location, 1, uniform.value.valueVec3);
+        glUniform3fv(location, 1, uniform.valueF);
         break;
     case L3D_UNIFORM_VEC4:
-        glUniform4fv(gl_location, 1, uniform.value.valueVec4);
+        glUniform4fv(location, 1, uniform.valueF);
         break;
     case L3D_UNIFORM_MAT3:
-        glUniformMatrix3fv(gl_location, 1, GL_FALSE, uniform.value.valueMat3);
+        glUniformMatrix3fv(location, 1, GL_FALSE, uniform.valueF);
         break;
     case L3D_UNIFORM_MAT4:
-        glUniformMatrix4fv(gl_location, 1, GL_FALSE, uniform.value.valueMat4);
+        glUniformMatrix4fv(location, 1, GL_FALSE, uniform.valueF);
         break;
     default:
         break;
     }
 }
 
-L3DRenderer::L3DRenderer()
+static void packLightUniforms(
+    const L3DLightPool &lights,
+    unsigned int renderLayer,
+    L3DPackedUniformList &uniforms)
+{
+    uniforms.clear();
+
+    int activeLightCount = 0;
+    for (L3DLightPool::const_iterator it = lights.begin(); it != lights.end(); ++it)
+    {
+        L3DLight *light = it->second;
+
+        if (light && light->isOn() && L3D_TEST_BIT(light->renderLayerMask(), renderLayer))
+        {
+            std::ostringstream sstream;
+            sstream << "u_light[" << activeLightCount << "]";
+            std::string lightName = sstream.str();
+
+            uniforms.push_back(L3DPackedUniform(lightName + ".type", (int)light->type));
+            uniforms.push_back(L3DPackedUniform(lightName + ".position", light->position));
+            uniforms.push_back(L3DPackedUniform(lightName + ".direction", light->direction));
+            uniforms.push_back(L3DPackedUniform(lightName + ".color", light->color));
+            uniforms.push_back(L3DPackedUniform(lightName + ".kc", light->attenuation.kc));
+            uniforms.push_back(L3DPackedUniform(lightName + ".kl", light->attenuation.kl));
+            uniforms.push_back(L3DPackedUniform(lightName + ".kq", light->attenuation.kq));
+
+            ++activeLightCount;
+        }
+    }
+
+    // Passes count of active lights.
+    uniforms.push_back(L3DPackedUniform("u_lightNr", activeLightCount));
+}
+
+struct L3DMaterialMapFeature
+{
+    const char *name;
+    unsigned int feature;
+};
+
+static const L3DMaterialMapFeature materialMapFeatures[] = {
+    {"diffuseMap", L3D_SHADER_DIFFUSE_MAP},
+    {"specularMap", L3D_SHADER_SPECULAR_MAP},
+    {"normalMap", L3D_SHADER_NORMAL_MAP},
+    {"alphaMap", L3D_SHADER_ALPHA_MAP}};
+
+static void packMaterialData(
+    L3DMaterial *material,
+    L3DMaterialData &data)
+{
+    std::string materialName = "u_material.";
+    std::string samplerName = "u_";
+
+    data.uniforms.clear();
+    data.textures.clear();
+    data.shaderFeatures = 0;
+
+    // 1. Colors.
+    for (L3DColorRegistry::const_iterator it = material->colors.begin(); it != material->colors.end(); ++it)
+        data.uniforms.push_back(L3DPackedUniform(materialName + it->first, it->second));
+
+    // 2. Parameters.
+    for (L3DParameterRegistry::const_iterator it = material->params.begin(); it != material->params.end(); ++it)
+        data.uniforms.push_back(L3DPackedUniform(materialName + it->first, it->second));
+
+    // 3. Textures.
+    for (L3DTextureRegistry::const_iterator it = material->textures.begin(); it != material->textures.end(); ++it)
+    {
+        L3DTexture *texture = it->second;
+
+        if (texture)
+        {
+            L3DTextureBinding binding;
+            binding.samplerName = samplerName + it->first;
+            binding.enabledName = binding.samplerName + "Enabled";
+            binding.type = texture->type();
+            binding.texture = texture->glName();
+            data.textures.push_back(binding);
+
+            for (unsigned int i = 0; i < sizeof(materialMapFeatures) / sizeof(materialMapFeatures[0]); ++i)
+            {
+                if (it->first == materialMapFeatures[i].name)
+                    data.shaderFeatures |= materialMapFeatures[i].feature;
+            }
+        }
+    }
+}
+
+static void packProgramUniforms(
+    L3DShaderProgram *shaderProgram,
+    L3DPackedUniformList &uniforms)
+{
+    const L3DUniformMap &programUniforms = shaderProgram->uniforms();
+
+    uniforms.clear();
+
+    for (L3DUniformMap::const_iterator it = programUniforms.begin(); it != programUniforms.end(); ++it)
+        uniforms.push_back(L3DPackedUniform(it->first, it->second));
+}
+
+static void recordDrawPackets(
+    const L3DDrawItemList &drawItems,
+    unsigned int begin,
+    unsigned int end,
+    const L3DFrameData &frame,
+    L3DCommandBuffer &commandBuffer)
+{
+    commandBuffer.clear();
+
+    for (unsigned int i = begin; i < end; ++i)
+    {
+        const L3DDrawItem &item = drawItems[i];
+        L3DMesh *mesh = item.mesh;
+        L3DMaterial *material = mesh->material();
+        L3DShaderProgram *shaderProgram = material->shaderProgram();
+
+        L3DDrawPacket packet;
+        packet.sortKey = item.sortKey;
+        packet.vertexArray = mesh->glName();
+        packet.shaderProgram = shaderProgram->glName();
+        packet.shaderFeatures = 0;
+        if (shaderProgram->hasVariants())
+            packet.shaderFeatures = L3D_SHADER_VARIANTS | (mesh->instanceBuffer() ? L3D_SHADER_INSTANCING : 0);
+        packet.material = material->id();
+        packet.drawPrimitive = mesh->drawPrimitive();
+        packet.vertexCount = mesh->vertexCount();
+        packet.indexCount = mesh->indexCount();
+        packet.indexType = mesh->indexBuffer() ? mesh->indexBuffer()->indexType() : L3D_INDEX_UNSIGNED_INT;
+        packet.indexOffset = 0;
+        if (mesh->lodCount())
+        {
+            const L3DMeshLod &lod = mesh->lodLevel(item.lod);
+            packet.indexCount = lod.indexCount;
+            packet.indexOffset = lod.indexOffset * packet.indexType;
+        }
+        packet.instanceCount = mesh->instanceCount();
+        packet.modelMatrix = mesh->modelMatrix();
+        packet.normalMatrix = item.normalMatrix;
+        packet.programUniforms = &frame.programUniforms.at(shaderProgram->id());
+        packet.materialData = &frame.materials.at(packet.material);
+
+        commandBuffer.push_back(packet);
+    }
+}
+
+// Profiler scope of each render layer, named once.
+static const char *layerScopeName(unsigned char renderLayer)
+{
+    struct L3DLayerScopeNames
+    {
+        char names[L3D_MAX_RENDER_LAYERS][L3D_PROFILE_NAME_SIZE];
+
+        L3DLayerScopeNames()
+        {
+            for (unsigned int i = 0; i < L3D_MAX_RENDER_LAYERS; ++i)
+                snprintf(names[i], L3D_PROFILE_NAME_SIZE, "Layer %u", i);
+        }
+    };
+
+    static const L3DLayerScopeNames scopeNames;
+
+    return scopeNames.names[renderLayer];
+}
+
+template <typename T>
+static T *findResource(const std::map<unsigned int, T *> &pool, unsigned int id)
+{
+    typename std::map<unsigned int, T *>::const_iterator it = pool.find(id);
+
+    return (it != pool.end()) ? it->second : L3D_NULLPTR;
+}
+
+template <typename T>
+static bool rebindResource(std::map<unsigned int, T *> &pool, unsigned int id, unsigned int reservedId)
 {
+    typename std::map<unsigned int, T *>::iterator it = pool.find(id);
+
+    if (it == pool.end() || !it->second || pool.count(reservedId))
+        return false;
+
+    T *resource = it->second;
+    pool.erase(it);
+    pool[reservedId] = resource;
+
+    return true;
+}
+
+L3DRenderer::L3DRenderer() : m_jobSystem(new L3DJobSystem()),
+                             m_pipeline(L3D_NULLPTR),
+                             m_frame(L3D_NULLPTR),
+                             m_programBinaries(false),
+                             m_parallelShaderCompile(false),
+                             m_lodBias(0.0f),
+                             m_textureBudget(0),
+                             m_residency(L3D_RESIDENCY_KEEP),
+                             m_frameIndex(0),
+                             m_renderThread(std::this_thread::get_id())
+{
+    for (unsigned int i = 0; i <= L3D_RENDER_QUEUE; ++i)
+        m_nextIds[i] = 0;
 }
 
 L3DRenderer::~L3DRenderer()
@@ -431,7 +866,7 @@ L3DRenderer::~L3DRenderer()
     this->terminate();
 }
 
-int L3DRenderer::init()
+int L3DRenderer::init(int workerCount)
 {
     // Load OpenGL extensions.
     if (!gladLoadGL())
@@ -440,277 +875,869 @@ int L3DRenderer::init()
         return -1;
     }
 
+    m_renderThread = std::this_thread::get_id();
+
+    // Texture rows are tightly packed (RGB texels take 3 bytes).
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // Program binaries are only valid for the driver which produced them.
+    const char *vendor = (const char *)glGetString(GL_VENDOR);
+    const char *renderer = (const char *)glGetString(GL_RENDERER);
+    const char *version = (const char *)glGetString(GL_VERSION);
+    m_driverId = std::string(vendor ? vendor : "") + "\n" + (renderer ? renderer : "") + "\n" + (version ? version : "");
+
+    GLint binaryFormats = 0;
+    if (GLAD_GL_VERSION_4_1)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    m_programBinaries = binaryFormats > 0;
+
+    // Without parallel compilation, status queries wait for the driver.
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    m_parallelShaderCompile = false;
+    for (GLint i = 0; i < extensionCount && !m_parallelShaderCompile; ++i)
+    {
+        const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        m_parallelShaderCompile = extension && (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 || strcmp(extension, "GL_ARB_parallel_shader_compile") == 0);
+    }
+
+    // Timer queries are core since OpenGL 3.3, debug groups since 4.3.
+    m_profiler.setGpuFeatures(GLAD_GL_VERSION_3_3 != 0, GLAD_GL_VERSION_4_3 != 0);
+
+    // Spawn the workers used for frame preparation.
+    delete m_jobSystem;
+    m_jobSystem = new L3DJobSystem(workerCount < 0 ? L3DJobSystem::defaultWorkerCount() : workerCount);
+
     return L3D_TRUE;
 }
 
 int L3DRenderer::terminate()
 {
-    for (L3DCameraPool::reverse_iterator it = m_cameras.rbegin(); it != m_cameras.rend(); ++it)
+    this->endPipelinedRendering();
+
+    L3DCameraPool cameras;
+    cameras.swap(m_cameras);
+    for (L3DCameraPool::reverse_iterator it = cameras.rbegin(); it != cameras.rend(); ++it)
         delete it->second;
-    m_cameras.clear();
 
-    for (L3DRenderQueuePool::reverse_iterator it = m_renderQueues.rbegin(); it != m_renderQueues.rend(); ++it)
+    L3DRenderQueuePool renderQueues;
+    renderQueues.swap(m_renderQueues);
+    for (L3DRenderQueuePool::reverse_iterator it = renderQueues.rbegin(); it != renderQueues.rend(); ++it)
         delete it->second;
-    m_renderQueues.clear();
 
-    for (L3DFrameBufferPool::reverse_iterator it = m_frameBuffers.rbegin(); it != m_frameBuffers.rend(); ++it)
+    L3DFrameBufferPool frameBuffers;
+    frameBuffers.swap(m_frameBuffers);
+    for (L3DFrameBufferPool::reverse_iterator it = frameBuffers.rbegin(); it != frameBuffers.rend(); ++it)
         delete it->second;
-    m_frameBuffers.clear();
 
-    for (L3DMeshPool::reverse_iterator it = m_meshes.rbegin(); it != m_meshes.rend(); ++it)
+    L3DMeshPool meshes;
+    meshes.swap(m_meshes);
+    for (L3DMeshPool::reverse_iterator it = meshes.rbegin(); it != meshes.rend(); ++it)
         delete it->second;
-    m_meshes.clear();
 
-    for (L3DMaterialPool::reverse_iterator it = m_materials.rbegin(); it != m_materials.rend(); ++it)
+    L3DMaterialPool materials;
+    materials.swap(m_materials);
+    for (L3DMaterialPool::reverse_iterator it = materials.rbegin(); it != materials.rend(); ++it)
         delete it->second;
-    m_materials.clear();
 
-    for (L3DShaderProgramPool::reverse_iterator it = m_shaderPrograms.rbegin(); it != m_shaderPrograms.rend(); ++it)
+    // Variants are in the pool too.
+    m_shaderVariants.clear();
+
+    L3DShaderProgramPool shaderPrograms;
+    shaderPrograms.swap(m_shaderPrograms);
+    for (L3DShaderProgramPool::reverse_iterator it = shaderPrograms.rbegin(); it != shaderPrograms.rend(); ++it)
         delete it->second;
-    m_shaderPrograms.clear();
 
-    for (L3DShaderPool::reverse_iterator it = m_shaders.rbegin(); it != m_shaders.rend(); ++it)
+    L3DShaderPool shaders;
+    shaders.swap(m_shaders);
+    for (L3DShaderPool::reverse_iterator it = shaders.rbegin(); it != shaders.rend(); ++it)
         delete it->second;
-    m_shaders.clear();
+    m_shaderSources.clear();
+    m_aliases.clear();
 
-    for (L3DTexturePool::reverse_iterator it = m_textures.rbegin(); it != m_textures.rend(); ++it)
+    L3DTexturePool textures;
+    textures.swap(m_textures);
+    for (L3DTexturePool::reverse_iterator it = textures.rbegin(); it != textures.rend(); ++it)
         delete it->second;
-    m_textures.clear();
 
-    for (L3DLightPool::reverse_iterator it = m_lights.rbegin(); it != m_lights.rend(); ++it)
+    L3DLightPool lights;
+    lights.swap(m_lights);
+    for (L3DLightPool::reverse_iterator it = lights.rbegin(); it != lights.rend(); ++it)
         delete it->second;
-    m_lights.clear();
 
-    for (L3DBufferPool::reverse_iterator it = m_buffers.rbegin(); it != m_buffers.rend(); ++it)
+    L3DBufferPool buffers;
+    buffers.swap(m_buffers);
+    for (L3DBufferPool::reverse_iterator it = buffers.rbegin(); it != buffers.rend(); ++it)
         delete it->second;
-    m_buffers.clear();
+
+    m_renderBucket.clear();
+    m_frameData = L3DFrameData();
+    m_cameraFrameData = L3DFrameData();
+    m_uniformLocations.clear();
+    m_pendingPrograms.clear();
+    m_profiler.clear();
+
+    delete m_jobSystem;
+    m_jobSystem = L3D_NULLPTR;
 
     return L3D_TRUE;
 }
 
 void L3DRenderer::renderFrame(L3DCamera *camera, L3DRenderQueue *renderQueue)
 {
-    if (renderQueue)
-        renderQueue->execute(this, camera);
-}
+    // Apply calls deferred by other threads.
+    this->executeCalls();
 
-void L3DRenderer::addResource(L3DResource *resource)
-{
-    if (resource)
+    if (!renderQueue)
+        return;
+
+    ++m_frameIndex;
+
+    if (m_pipeline)
     {
-        switch (resource->resourceType())
+        // Snapshot the frame and hand it over to the render thread.
+        L3DFrameData *frame = m_pipeline->acquireFrame();
         {
-        case L3D_BUFFER:
-            this->addBuffer(static_cast<L3DBuffer *>(resource));
-            break;
-        case L3D_TEXTURE:
-            this->addTexture(static_cast<L3DTexture *>(resource));
-            break;
-        case L3D_SHADER:
-            this->addShader(static_cast<L3DShader *>(resource));
-            break;
-        case L3D_SHADER_PROGRAM:
-            this->addShaderProgram(static_cast<L3DShaderProgram *>(resource));
-            break;
-        case L3D_FRAME_BUFFER:
-            this->addFrameBuffer(static_cast<L3DFrameBuffer *>(resource));
-            break;
-        case L3D_MATERIAL:
-            this->addMaterial(static_cast<L3DMaterial *>(resource));
-            break;
-        case L3D_CAMERA:
-            this->addCamera(static_cast<L3DCamera *>(resource));
-            break;
-        case L3D_LIGHT:
-            this->addLight(static_cast<L3DLight *>(resource));
-            break;
-        case L3D_MESH:
-            this->addMesh(static_cast<L3DMesh *>(resource));
-            break;
-        case L3D_RENDER_QUEUE:
-            this->addRenderQueue(static_cast<L3DRenderQueue *>(resource));
-            break;
-        default:
-            break;
+            L3DProfileScope scope(&m_profiler, "Prepare");
+            this->prepareFrame(*frame, camera, renderQueue);
         }
+        m_pipeline->submitFrame(frame);
     }
-}
-
-void L3DRenderer::addBuffer(L3DBuffer *buffer)
-{
-    if (buffer && m_buffers.find(buffer->id()) == m_buffers.end())
+    else
     {
-        GLuint id = 0;
-        glGenBuffers(1, &id);
-
-        if (buffer->count())
         {
-            GLenum gl_type = toOpenGL(buffer->type());
-            GLenum gl_draw_type = toOpenGL(buffer->drawType());
-
-            glBindBuffer(gl_type, id);
-            glBufferData(gl_type, buffer->size(), buffer->data(), gl_draw_type);
-            glBindBuffer(gl_type, 0);
+            L3DProfileScope scope(&m_profiler, "Prepare");
+            this->prepareFrame(m_frameData, camera, renderQueue);
         }
+        this->submitFrame(m_frameData);
 
-        buffer->setId((unsigned short int)id);
-
-        m_buffers[id] = buffer;
-
-        printf("Add buffer: %d\n", id);
+        this->enforceTextureBudget();
     }
 }
 
-void L3DRenderer::addTexture(L3DTexture *texture)
+void L3DRenderer::submitFrame(L3DFrameData &frame)
 {
-    if (texture && m_textures.find(texture->id()) == m_textures.end())
+    m_frame = &frame;
+
+    if (frame.renderQueue)
     {
-        GLuint id = 0;
-        glGenTextures(1, &id);
+        L3DProfileScope scope(&m_profiler, "Submit", true);
+        frame.renderQueue->execute(this, frame.camera);
+    }
 
-        GLenum gl_format = toOpenGL(texture->format());
-        GLenum gl_internal_format = gl_format;
-        GLenum gl_type = toOpenGL(texture->type());
-        GLenum gl_pixel_format = toOpenGL(texture->pixelFormat());
-        GLenum gl_wrap_s = toOpenGL(texture->wrapS());
-        GLenum gl_wrap_t = toOpenGL(texture->wrapT());
-        GLenum gl_wrap_r = toOpenGL(texture->wrapR());
-        GLenum gl_min_filter = toOpenGL(texture->minFilter());
-        GLenum gl_mag_filter = toOpenGL(texture->magFilter());
-        bool use_mipmaps = texture->useMipmap();
+    m_frame = L3D_NULLPTR;
 
-        if (gl_format == GL_DEPTH24_STENCIL8)
-            gl_internal_format = GL_DEPTH_STENCIL;
+    if (m_profiler.isEnabled())
+        m_profiler.endFrame();
 
-        glBindTexture(gl_type, id);
+#ifdef L3D_ENABLE_FRAME_STATS
+    m_renderStats.endFrame();
+#endif
+}
 
-        switch (texture->type())
-        {
-        case L3D_TEXTURE_1D:
-            glTexImage1D(gl_type, 0, gl_format, texture->width(), 0, gl_internal_format, gl_pixel_format, texture->data());
-            break;
-        case L3D_TEXTURE_2D:
-            glTexImage2D(gl_type, 0, gl_format, texture->width(), texture->height(), 0, gl_internal_format, gl_pixel_format, texture->data());
-            break;
-        case L3D_TEXTURE_3D:
-            glTexImage3D(gl_type, 0, gl_format, texture->width(), texture->height(), texture->depth(), 0, gl_internal_format, gl_pixel_format, texture->data());
-            break;
-        case L3D_TEXTURE_CUBE_MAP:
-        {
-            unsigned int faceSize = texture->size() / 6;
-            unsigned int faceWidth = texture->width();
-            unsigned int faceHeight = texture->height();
-            unsigned char *data = texture->data();
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, gl_format, faceWidth, faceHeight, 0, gl_internal_format, gl_pixel_format, data);
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, gl_format, faceWidth, faceHeight, 0, gl_internal_format, gl_pixel_format, data + faceSize);
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, gl_format, faceWidth, faceHeight, 0, gl_internal_format, gl_pixel_format, data + faceSize * 2);
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, gl_format, faceWidth, faceHeight, 0, gl_internal_format, gl_pixel_format, data + faceSize * 3);
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, gl_format, faceWidth, faceHeight, 0, gl_internal_format, gl_pixel_format, data + faceSize * 4);
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, gl_format, faceWidth, faceHeight, 0, gl_internal_format, gl_pixel_format, data + faceSize * 5);
-        }
-        break;
-        default:
-            // Don't store id. Free resource.
-            glBindTexture(gl_type, 0);
-            glDeleteTextures(1, &id);
-            return;
-        }
+void L3DRenderer::enqueueCall(const L3DCall &call)
+{
+    m_calls.push(call);
+}
 
-        // Wrap mode for S, T, R coordinates.
-        glTexParameteri(gl_type, GL_TEXTURE_WRAP_S, gl_wrap_s);
+unsigned int L3DRenderer::executeCalls()
+{
+    L3D_ASSERT(this->isRenderThread());
 
-        if (gl_type > GL_TEXTURE_1D)
-            glTexParameteri(gl_type, GL_TEXTURE_WRAP_T, gl_wrap_t);
+    // Calls may use OpenGL, whose context belongs to the pipeline thread.
+    if (m_pipeline)
+        return m_calls.isEmpty() ? 0 : m_pipeline->executeCalls();
 
-        if (gl_type > GL_TEXTURE_2D)
-            glTexParameteri(gl_type, GL_TEXTURE_WRAP_R, gl_wrap_r);
+    L3D_TRACE_SCOPE("Deferred calls");
 
-        // Min and mag filters.
-        if (!use_mipmaps)
-        {
-            if (gl_min_filter == GL_NEAREST_MIPMAP_LINEAR)
-                gl_min_filter = GL_LINEAR;
-            else if (gl_min_filter == GL_NEAREST_MIPMAP_NEAREST)
-                gl_min_filter = GL_NEAREST;
-        }
+    return m_calls.drain();
+}
 
-        glTexParameteri(gl_type, GL_TEXTURE_MIN_FILTER, gl_min_filter);
-        glTexParameteri(gl_type, GL_TEXTURE_MAG_FILTER, gl_mag_filter);
+unsigned int L3DRenderer::executeCallsAsRenderThread()
+{
+    std::thread::id renderThread = m_renderThread.load();
+    m_renderThread = std::this_thread::get_id();
 
-        // Generate mipmaps.
-        if (use_mipmaps)
-            glGenerateMipmap(gl_type);
+    unsigned int count = 0;
+    {
+        L3D_TRACE_SCOPE("Deferred calls");
+        count = m_calls.drain();
+    }
 
-        glBindTexture(gl_type, 0);
+    m_renderThread = renderThread;
 
-        texture->setId((unsigned short int)id);
+    return count;
+}
 
-        m_textures[id] = texture;
+int L3DRenderer::beginPipelinedRendering(
+    unsigned int queueDepth,
+    L3DContextCallback acquireContext,
+    L3DContextCallback releaseContext,
+    L3DContextCallback presentFrame,
+    void *userData)
+{
+    if (m_pipeline)
+    {
+        fprintf(stderr, "Pipelined rendering already started\n");
+        return -1;
+    }
 
-        printf("Add texture: %d\n", id);
+    if (!queueDepth || !acquireContext || !releaseContext)
+    {
+        fprintf(stderr, "Invalid pipelined rendering parameters\n");
+        return -1;
     }
+
+    m_pipeline = new L3DRenderPipeline(this, queueDepth, acquireContext, releaseContext, presentFrame, userData);
+
+    return L3D_TRUE;
 }
 
-void L3DRenderer::addShader(L3DShader *shader)
+int L3DRenderer::endPipelinedRendering()
 {
-    if (shader && m_shaders.find(shader->id()) == m_shaders.end())
+    // Drains queued frames and releases the context.
+    delete m_pipeline;
+    m_pipeline = L3D_NULLPTR;
+
+    return L3D_TRUE;
+}
+
+L3DMemoryStats L3DRenderer::memoryStats() const
+{
+    L3DMemoryStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    std::set<unsigned int> renderTargets;
+    this->collectRenderTargets(renderTargets);
+
+    for (L3DTexturePool::const_iterator it = m_textures.begin(); it != m_textures.end(); ++it)
     {
-        GLuint gl_type = toOpenGL(shader->type());
+        L3DTexture *texture = it->second;
 
-        const char *code = shader->code();
+        if (renderTargets.count(texture->id()))
+        {
+            stats.renderTargets += texture->gpuSize();
+            ++stats.renderTargetCount;
+        }
+        else
+        {
+            stats.textures += texture->gpuSize();
+            ++stats.textureCount;
+
+            if (texture->evictedLevels())
+                ++stats.evictedTextureCount;
+        }
+    }
 
-        GLuint id = glCreateShader(gl_type);
-        glShaderSource(id, 1, &code, L3D_NULLPTR);
-        glCompileShader(id);
+    for (L3DBufferPool::const_iterator it = m_buffers.begin(); it != m_buffers.end(); ++it)
+    {
+        L3DBuffer *buffer = it->second;
 
-        GLint status;
-        glGetShaderiv(id, GL_COMPILE_STATUS, &status);
-        if (status == GL_FALSE)
+        switch (buffer->type())
         {
-            GLchar infoLog[512];
-            glGetShaderInfoLog(id, 512, NULL, infoLog);
-            fprintf(stderr, "%s", infoLog);
+        case L3D_BUFFER_VERTEX:
+            stats.vertexBuffers += buffer->size();
+            break;
+        case L3D_BUFFER_INDEX:
+            stats.indexBuffers += buffer->size();
+            break;
+        case L3D_BUFFER_INSTANCE:
+            stats.instanceBuffers += buffer->size();
+            break;
+        default:
+            break;
         }
 
-        shader->setId((unsigned short int)id);
+        ++stats.bufferCount;
+    }
+
+    stats.total = stats.textures + stats.renderTargets + stats.vertexBuffers + stats.indexBuffers + stats.instanceBuffers;
+    stats.textureBudget = m_textureBudget;
+
+    return stats;
+}
+
+unsigned int L3DRenderer::enforceTextureBudget()
+{
+    // Evicting moves textures to new names: in flight frames would miss them.
+    if (!m_textureBudget || m_pipeline)
+        return 0;
+
+    unsigned long long used = this->memoryStats().textures;
+
+    if (used <= m_textureBudget)
+        return 0;
 
-        m_shaders[id] = shader;
+    std::set<unsigned int> renderTargets;
+    this->collectRenderTargets(renderTargets);
 
-        printf("Add shader: %d\n", id);
+    // Textures not drawn by the last frame, least recently used first.
+    std::vector<std::pair<unsigned int, L3DTexture *> > candidates;
+    for (L3DTexturePool::const_iterator it = m_textures.begin(); it != m_textures.end(); ++it)
+    {
+        L3DTexture *texture = it->second;
+
+        if (texture->type() == L3D_TEXTURE_2D && (texture->data() || texture->source()) && texture->lastUsedFrame() != m_frameIndex && !renderTargets.count(texture->id()))
+            candidates.push_back(std::make_pair(texture->lastUsedFrame(), texture));
     }
+
+    std::stable_sort(candidates.begin(), candidates.end(), [](const std::pair<unsigned int, L3DTexture *> &a, const std::pair<unsigned int, L3DTexture *> &b) {
+        return a.first < b.first;
+    });
+
+    unsigned int evicted = 0;
+
+    for (unsigned int i = 0; i < candidates.size() && used > m_textureBudget; ++i)
+    {
+        L3DTexture *texture = candidates[i].second;
+        unsigned int extent = std::max(texture->width(), texture->height());
+        unsigned int size = texture->gpuSize();
+        unsigned int level = texture->evictedLevels();
+
+        // Levels to evict to fit the budget, reuploaded only once.
+        while (used - (size - texture->gpuSize(level)) > m_textureBudget)
+        {
+            if (level + 1 >= texture->levelCount() || (extent >> (level + 1)) < L3D_TEXTURE_MIN_EVICTED_SIZE)
+                break;
+
+            ++level;
+        }
+
+        unsigned int evictedLevels = texture->evictedLevels();
+
+        if (level > evictedLevels && this->reuploadTexture(texture, level))
+        {
+            used -= size - texture->gpuSize();
+            evicted += level - evictedLevels;
+        }
+    }
+
+    return evicted;
 }
 
-void L3DRenderer::addShaderProgram(L3DShaderProgram *shaderProgram)
+bool L3DRenderer::acquireData(L3DBuffer *buffer)
 {
-    if (shaderProgram && m_shaderPrograms.find(shaderProgram->id()) == m_shaderPrograms.end())
+    if (!buffer)
+        return false;
+
+    if (buffer->data() || !buffer->size())
+        return true;
+
+    // Read back from video memory, which owns the contents.
+    if (buffer->residency() != L3D_RESIDENCY_RELOAD || !buffer->glName() || m_pipeline || !this->isRenderThread())
     {
-        GLuint id = glCreateProgram();
+        fprintf(stderr, "Buffer %d: data was discarded\n", buffer->id());
+        return false;
+    }
+
+    void *data = L3DMemory::allocate(buffer->size(), L3D_MEMORY_GEOMETRY);
+
+    if (!data)
+        return false;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer->glName());
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, buffer->size(), data);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    buffer->setData(data);
 
-        if (shaderProgram->vertexShader())
-            glAttachShader(id, shaderProgram->vertexShader()->id());
+    return true;
+}
+
+bool L3DRenderer::acquireData(L3DTexture *texture)
+{
+    if (!texture)
+        return false;
+
+    unsigned int size = texture->size();
+
+    if (texture->data() || !size)
+        return true;
+
+    bool readBack = texture->residency() == L3D_RESIDENCY_RELOAD && !texture->evictedLevels() && texture->format() != L3D_DEPTH24_STENCIL8 && texture->glName() && !m_pipeline && this->isRenderThread();
 
-        if (shaderProgram->fragmentShader())
-            glAttachShader(id, shaderProgram->fragmentShader()->id());
+    if (!texture->source() && !readBack)
+    {
+        fprintf(stderr, "Texture %d: data was discarded\n", texture->id());
+        return false;
+    }
 
-        if (shaderProgram->geometryShader())
-            glAttachShader(id, shaderProgram->geometryShader()->id());
+    unsigned char *data = (unsigned char *)L3DMemory::allocate(size, L3D_MEMORY_TEXTURES);
 
-        glLinkProgram(id);
+    if (!data)
+        return false;
 
-        GLint status;
-        glGetProgramiv(id, GL_LINK_STATUS, &status);
-        if (status == GL_FALSE)
+    // The application knows where the image came from.
+    if (texture->source())
+    {
+        if (!texture->source()(texture->handle(), data, size, texture->sourceData()))
         {
-            GLchar infoLog[512];
-            glGetProgramInfoLog(id, 512, NULL, infoLog);
-            fprintf(stderr, "%s", infoLog);
+            fprintf(stderr, "Texture %d: failed to reload data\n", texture->id());
+            L3DMemory::deallocate(data);
+            return false;
         }
 
-        shaderProgram->setId((unsigned short int)id);
+        texture->setData(data);
+
+        return true;
+    }
+
+    GLenum gl_type = toOpenGL(texture->type());
+    GLenum gl_format = toOpenGL(texture->format());
+    GLenum gl_pixel_format = toOpenGL(texture->pixelFormat());
+    bool compressed = L3DTexture::isCompressed(texture->format());
+    unsigned int faceCount = texture->type() == L3D_TEXTURE_CUBE_MAP ? 6 : 1;
+    unsigned int mipCount = (texture->type() == L3D_TEXTURE_2D || faceCount == 6) ? texture->mipCount() : 1;
+    unsigned int offset = 0;
+
+    glBindTexture(gl_type, texture->glName());
+
+    for (unsigned int face = 0; face < faceCount; ++face)
+    {
+        GLenum gl_target = faceCount == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : gl_type;
 
-        m_shaderPrograms[id] = shaderProgram;
+        for (unsigned int level = 0; level < mipCount; ++level)
+        {
+            if (compressed)
+                glGetCompressedTexImage(gl_target, level, data + offset);
+            else
+                glGetTexImage(gl_target, level, gl_format, gl_pixel_format, data + offset);
 
-        printf("Add shader program: %d\n", id);
+            offset += L3DTexture::levelSize(texture->format(), texture->width(), texture->height(), level);
+        }
+    }
+
+    glBindTexture(gl_type, 0);
+
+    texture->setData(data);
+
+    return true;
+}
+
+void L3DRenderer::releaseData(L3DBuffer *buffer)
+{
+    if (buffer && buffer->residency() != L3D_RESIDENCY_KEEP)
+        buffer->discardData();
+}
+
+void L3DRenderer::releaseData(L3DTexture *texture)
+{
+    if (texture && texture->residency() != L3D_RESIDENCY_KEEP)
+        texture->discardData();
+}
+
+void L3DRenderer::updateBuffer(L3DBuffer *buffer)
+{
+    if (!buffer || !buffer->data() || !buffer->glName())
+        return;
+
+    L3D_TRACE_SCOPE("Update buffer");
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->glName());
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, buffer->size(), buffer->data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void *L3DRenderer::mapBuffer(L3DBuffer *buffer)
+{
+    if (!buffer || !buffer->glName() || !buffer->size())
+        return L3D_NULLPTR;
+
+    // Previous contents are discarded: the driver needs no sync.
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->glName());
+    void *data = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, buffer->size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (!data)
+        fprintf(stderr, "Buffer %d: failed to map\n", buffer->id());
+
+    return data;
+}
+
+bool L3DRenderer::unmapBuffer(L3DBuffer *buffer)
+{
+    if (!buffer || !buffer->glName())
+        return false;
+
+    GLint mapped = GL_FALSE;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->glName());
+    glGetBufferParameteriv(GL_COPY_WRITE_BUFFER, GL_BUFFER_MAPPED, &mapped);
+    bool unmapped = mapped && glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // Contents are lost e.g. on a display mode change.
+    if (mapped && !unmapped)
+        fprintf(stderr, "Buffer %d: contents lost while mapped\n", buffer->id());
+
+    return unmapped;
+}
+
+void L3DRenderer::prepareFrame(
+    L3DFrameData &frame,
+    L3DCamera *camera,
+    L3DRenderQueue *renderQueue)
+{
+    frame.camera = camera;
+    frame.renderQueue = renderQueue;
+
+    // Camera state used by this frame.
+    if (camera)
+    {
+        frame.cameraSnapshot.view = camera->view;
+        frame.cameraSnapshot.proj = camera->proj;
+        frame.cameraSnapshot.position = camera->position();
+    }
+
+    if (!m_jobSystem)
+        return;
+
+    // Drop data of render layers which are now empty.
+    for (L3DRenderLayerDataMap::iterator it = frame.layers.begin(); it != frame.layers.end();)
+    {
+        if (m_renderBucket.count(it->first))
+            ++it;
+        else
+            frame.layers.erase(it++);
+    }
+
+    // Containers are filled here so that jobs never touch their structure.
+    std::vector<L3DMaterial *> materials;
+    std::vector<L3DShaderProgram *> shaderPrograms;
+    frame.materials.clear();
+    frame.programUniforms.clear();
+    for (L3DRenderBucket::const_iterator it = m_renderBucket.begin(); it != m_renderBucket.end(); ++it)
+    {
+        unsigned int meshCount = it->second.size();
+        L3DRenderLayerData &layer = frame.layers[it->first];
+        layer.drawItems.resize(meshCount);
+        layer.commandBuffers.resize((meshCount + L3D_RECORD_SLICE_SIZE - 1) / L3D_RECORD_SLICE_SIZE);
+
+        for (L3DMeshList::const_iterator mesh_it = it->second.begin(); mesh_it != it->second.end(); ++mesh_it)
+        {
+            L3DMaterial *material = (*mesh_it)->material();
+            L3DShaderProgram *shaderProgram = material->shaderProgram();
+
+            if (!frame.materials.count(material->id()))
+            {
+                frame.materials[material->id()];
+                materials.push_back(material);
+            }
+
+            if (!frame.programUniforms.count(shaderProgram->id()))
+            {
+                frame.programUniforms[shaderProgram->id()];
+                shaderPrograms.push_back(shaderProgram);
+            }
+        }
+    }
+
+    // Textures drawn again get their evicted mip levels back (see
+    // enforceTextureBudget()), before materials capture their names.
+    for (std::vector<L3DMaterial *>::const_iterator it = materials.begin(); it != materials.end(); ++it)
+    {
+        for (L3DTextureRegistry::const_iterator tex_it = (*it)->textures.begin(); tex_it != (*it)->textures.end(); ++tex_it)
+        {
+            L3DTexture *texture = tex_it->second;
+
+            if (!texture)
+                continue;
+
+            texture->setLastUsedFrame(m_frameIndex);
+
+            if (texture->evictedLevels() && !m_pipeline)
+                this->reuploadTexture(texture, 0);
+        }
+    }
+
+    // A mesh error of maxError (in viewport heights) is about as visible
+    // as L3D_LOD_MAX_SCREEN_ERROR: each LOD bias step doubles it.
+    bool selectLods = camera != L3D_NULLPTR;
+    L3DVec3 eye = frame.cameraSnapshot.position;
+    float projectionScale = 0.5f * frame.cameraSnapshot.proj[1][1];
+    float maxError = L3D_LOD_MAX_SCREEN_ERROR * powf(2.0f, m_lodBias);
+
+    L3DJobCounter done;
+    std::vector<L3DJobCounter> built(m_renderBucket.size());
+    std::vector<L3DJobCounter> sorted(m_renderBucket.size());
+    const L3DFrameData *frameData = &frame;
+    unsigned int layerIndex = 0;
+
+    for (L3DRenderBucket::const_iterator it = m_renderBucket.begin(); it != m_renderBucket.end(); ++it, ++layerIndex)
+    {
+        unsigned int renderLayer = it->first;
+        const L3DMeshList *meshList = &it->second;
+        L3DRenderLayerData *layer = &frame.layers[renderLayer];
+        L3DJobCounter *layerBuilt = &built[layerIndex];
+        L3DJobCounter *layerSorted = &sorted[layerIndex];
+        unsigned int meshCount = meshList->size();
+
+        // 1. Sort keys, normal matrices and levels of detail.
+        for (unsigned int begin = 0; begin < meshCount; begin += L3D_PREPARE_GRAIN_SIZE)
+        {
+            unsigned int end = std::min(begin + L3D_PREPARE_GRAIN_SIZE, meshCount);
+
+            m_jobSystem->run([meshList, layer, begin, end, selectLods, eye, projectionScale, maxError]() {
+                for (unsigned int i = begin; i < end; ++i)
+                {
+                    L3DMesh *mesh = (*meshList)[i];
+                    L3DDrawItem &item = layer->drawItems[i];
+                    item.mesh = mesh;
+                    item.sortKey = mesh->sortKey();
+                    item.normalMatrix = mesh->normalMatrix();
+                    item.lod = selectLods ? mesh->selectLod(eye, projectionScale, maxError) : mesh->lod();
+                }
+            },
+                             layerBuilt);
+        }
+
+        // 2. Order by sort key once the whole layer is built.
+        m_jobSystem->run([layer]() {
+            std::stable_sort(layer->drawItems.begin(), layer->drawItems.end(), l3dDrawItemSortFunctor());
+        },
+                         layerSorted, layerBuilt);
+
+        // 3. Draw packets, one command buffer per slice of the sorted layer.
+        for (unsigned int slice = 0; slice < layer->commandBuffers.size(); ++slice)
+        {
+            unsigned int begin = slice * L3D_RECORD_SLICE_SIZE;
+            unsigned int end = std::min(begin + L3D_RECORD_SLICE_SIZE, meshCount);
+
+            m_jobSystem->run([frameData, layer, slice, begin, end]() {
+                recordDrawPackets(layer->drawItems, begin, end, *frameData, layer->commandBuffers[slice]);
+            },
+                             &done, layerSorted);
+        }
+
+        // 4. Lights affecting the layer.
+        const L3DLightPool *lights = &m_lights;
+        m_jobSystem->run([lights, layer, renderLayer]() {
+            packLightUniforms(*lights, renderLayer, layer->lightUniforms);
+        },
+                         &done);
+    }
+
+    // 5. Material data.
+    for (std::vector<L3DMaterial *>::const_iterator it = materials.begin(); it != materials.end(); ++it)
+    {
+        L3DMaterial *material = *it;
+        L3DMaterialData *data = &frame.materials[material->id()];
+
+        m_jobSystem->run([material, data]() {
+            packMaterialData(material, *data);
+        },
+                         &done);
+    }
+
+    // 6. Shader program uniforms.
+    for (std::vector<L3DShaderProgram *>::const_iterator it = shaderPrograms.begin(); it != shaderPrograms.end(); ++it)
+    {
+        L3DShaderProgram *shaderProgram = *it;
+        L3DPackedUniformList *uniforms = &frame.programUniforms[shaderProgram->id()];
+
+        m_jobSystem->run([shaderProgram, uniforms]() {
+            packProgramUniforms(shaderProgram, *uniforms);
+        },
+                         &done);
+    }
+
+    m_jobSystem->wait(&done);
+}
+
+void L3DRenderer::addResource(L3DResource *resource)
+{
+    if (resource)
+    {
+        switch (resource->resourceType())
+        {
+        case L3D_BUFFER:
+            this->addBuffer(static_cast<L3DBuffer *>(resource));
+            break;
+        case L3D_TEXTURE:
+            this->addTexture(static_cast<L3DTexture *>(resource));
+            break;
+        case L3D_SHADER:
+            this->addShader(static_cast<L3DShader *>(resource));
+            break;
+        case L3D_SHADER_PROGRAM:
+            this->addShaderProgram(static_cast<L3DShaderProgram *>(resource));
+            break;
+        case L3D_FRAME_BUFFER:
+            this->addFrameBuffer(static_cast<L3DFrameBuffer *>(resource));
+            break;
+        case L3D_MATERIAL:
+            this->addMaterial(static_cast<L3DMaterial *>(resource));
+            break;
+        case L3D_CAMERA:
+            this->addCamera(static_cast<L3DCamera *>(resource));
+            break;
+        case L3D_LIGHT:
+            this->addLight(static_cast<L3DLight *>(resource));
+            break;
+        case L3D_MESH:
+            this->addMesh(static_cast<L3DMesh *>(resource));
+            break;
+        case L3D_RENDER_QUEUE:
+            this->addRenderQueue(static_cast<L3DRenderQueue *>(resource));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void L3DRenderer::addBuffer(L3DBuffer *buffer)
+{
+    if (buffer && m_buffers.find(buffer->id()) == m_buffers.end())
+    {
+        L3D_TRACE_SCOPE("Upload buffer");
+
+        GLuint id = 0;
+        glGenBuffers(1, &id);
+
+        if (buffer->count())
+        {
+            GLenum gl_type = toOpenGL(buffer->type());
+            GLenum gl_draw_type = toOpenGL(buffer->drawType());
+
+            glBindBuffer(gl_type, id);
+            glBufferData(gl_type, buffer->size(), buffer->data(), gl_draw_type);
+            glBindBuffer(gl_type, 0);
+        }
+
+        buffer->setGlName(id);
+        this->registerResource(buffer);
+
+        m_buffers[buffer->id()] = buffer;
+
+        printf("Add buffer: %d\n", buffer->id());
+    }
+}
+
+void L3DRenderer::addTexture(L3DTexture *texture)
+{
+    if (texture && m_textures.find(texture->id()) == m_textures.end())
+    {
+        L3D_TRACE_SCOPE("Upload texture");
+
+        GLuint id = 0;
+        glGenTextures(1, &id);
+
+        GLenum gl_format = toOpenGL(texture->format());
+        GLenum gl_internal_format = gl_format;
+        GLenum gl_type = toOpenGL(texture->type());
+        GLenum gl_pixel_format = toOpenGL(texture->pixelFormat());
+        unsigned int mip_count = texture->mipCount();
+        bool use_mipmaps = texture->useMipmap() && (mip_count > 1 || !L3DTexture::isCompressed(texture->format()));
+        bool generate_mipmaps = use_mipmaps && mip_count == 1;
+        unsigned int level_count = generate_mipmaps ? fullMipCount(texture->width(), texture->height()) : mip_count;
+        bool allocated = false;
+
+        if (gl_format == GL_DEPTH24_STENCIL8)
+            gl_internal_format = GL_DEPTH_STENCIL;
+
+        glBindTexture(gl_type, id);
+
+        switch (texture->type())
+        {
+        case L3D_TEXTURE_1D:
+            glTexImage1D(gl_type, 0, gl_format, texture->width(), 0, gl_internal_format, gl_pixel_format, texture->data());
+            break;
+        case L3D_TEXTURE_2D:
+            allocated = allocateTextureStorage(gl_type, texture->format(), texture->width(), texture->height(), level_count);
+            uploadTextureLevels(gl_type, texture->format(), gl_pixel_format, texture->data(), texture->width(), texture->height(), mip_count, allocated);
+            break;
+        case L3D_TEXTURE_3D:
+            glTexImage3D(gl_type, 0, gl_format, texture->width(), texture->height(), texture->depth(), 0, gl_internal_format, gl_pixel_format, texture->data());
+            break;
+        case L3D_TEXTURE_CUBE_MAP:
+        {
+            unsigned int faceSize = texture->size() / 6;
+            unsigned char *data = texture->data();
+            allocated = allocateTextureStorage(gl_type, texture->format(), texture->width(), texture->height(), level_count);
+            for (unsigned int face = 0; face < 6; ++face)
+                uploadTextureLevels(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, texture->format(), gl_pixel_format, data ? data + faceSize * face : L3D_NULLPTR, texture->width(), texture->height(), mip_count, allocated);
+        }
+        break;
+        default:
+            // Don't store id. Free resource.
+            glBindTexture(gl_type, 0);
+            glDeleteTextures(1, &id);
+            return;
+        }
+
+        setTextureParameters(texture, gl_type, use_mipmaps);
+
+        // Generate mipmaps, unless provided.
+        if (generate_mipmaps)
+            glGenerateMipmap(gl_type);
+        else
+            glTexParameteri(gl_type, GL_TEXTURE_MAX_LEVEL, mip_count - 1);
+
+        glBindTexture(gl_type, 0);
+
+        texture->setGlName(id);
+        this->registerResource(texture);
+
+        m_textures[texture->id()] = texture;
+
+        printf("Add texture: %d\n", texture->id());
+    }
+}
+
+void L3DRenderer::addShader(L3DShader *shader)
+{
+    if (shader && m_shaders.find(shader->id()) == m_shaders.end())
+    {
+        // Compilation waits for the first program linked from source:
+        // programs found in the binary cache don't need it.
+        this->registerResource(shader);
+
+        m_shaders[shader->id()] = shader;
+
+        if (shader->code())
+            m_shaderSources.insert(std::make_pair(L3DAssetRegistry::hash(shader->code(), strlen(shader->code())), shader->id()));
+
+        printf("Add shader: %d\n", shader->id());
+    }
+}
+
+void L3DRenderer::addShaderProgram(L3DShaderProgram *shaderProgram)
+{
+    if (shaderProgram && m_shaderPrograms.find(shaderProgram->id()) == m_shaderPrograms.end())
+    {
+        GLuint id = glCreateProgram();
+        bool useCache = m_programBinaries && m_programCache.isEnabled();
+        unsigned long long key = useCache ? this->programKey(shaderProgram) : 0;
+        bool fromBinary = false;
+
+        if (useCache)
+        {
+            unsigned int format = 0;
+            std::vector<unsigned char> binary;
+
+            if (m_programCache.load(key, format, binary))
+            {
+                L3D_TRACE_SCOPE("Load program binary");
+                glProgramBinary(id, format, &binary[0], binary.size());
+                fromBinary = true;
+            }
+        }
+
+        // Nothing waits for the driver here: the status is checked when
+        // the program is first drawn.
+        if (!fromBinary)
+            this->linkShaderProgram(shaderProgram, id);
+
+        L3DPendingProgram pending = {shaderProgram, key, fromBinary, false};
+        m_pendingPrograms[id] = pending;
+
+        shaderProgram->setGlName(id);
+        this->registerResource(shaderProgram);
+
+        m_shaderPrograms[shaderProgram->id()] = shaderProgram;
+
+        printf("Add shader program: %d\n", shaderProgram->id());
     }
 }
 
@@ -733,7 +1760,7 @@ void L3DRenderer::addFrameBuffer(L3DFrameBuffer *frameBuffer)
             {
                 this->addTexture(texture);
 
-                GLuint id = texture->id();
+                GLuint id = texture->glName();
                 GLenum gl_type = toOpenGL(texture->type());
 
                 switch (texture->type())
@@ -765,11 +1792,12 @@ void L3DRenderer::addFrameBuffer(L3DFrameBuffer *frameBuffer)
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-        frameBuffer->setId((unsigned short int)id);
+        frameBuffer->setGlName(id);
+        this->registerResource(frameBuffer);
 
-        m_frameBuffers[id] = frameBuffer;
+        m_frameBuffers[frameBuffer->id()] = frameBuffer;
 
-        printf("Add frame buffer: %d\n", id);
+        printf("Add frame buffer: %d\n", frameBuffer->id());
     }
 }
 
@@ -777,15 +1805,11 @@ void L3DRenderer::addMaterial(L3DMaterial *material)
 {
     if (material && m_materials.find(material->id()) == m_materials.end())
     {
-        GLuint id = 1;
-        if (m_materials.size() > 0)
-            id = m_materials.rbegin()->second->id() + 1;
-
-        material->setId((unsigned short int)id);
+        this->registerResource(material);
 
-        m_materials[id] = material;
+        m_materials[material->id()] = material;
 
-        printf("Add material: %d\n", id);
+        printf("Add material: %d\n", material->id());
     }
 }
 
@@ -793,15 +1817,11 @@ void L3DRenderer::addCamera(L3DCamera *camera)
 {
     if (camera && m_cameras.find(camera->id()) == m_cameras.end())
     {
-        GLuint id = 1;
-        if (m_cameras.size() > 0)
-            id = m_cameras.rbegin()->second->id() + 1;
+        this->registerResource(camera);
 
-        camera->setId((unsigned short int)id);
+        m_cameras[camera->id()] = camera;
 
-        m_cameras[id] = camera;
-
-        printf("Add camera: %d\n", id);
+        printf("Add camera: %d\n", camera->id());
     }
 }
 
@@ -809,15 +1829,11 @@ void L3DRenderer::addLight(L3DLight *light)
 {
     if (light && m_lights.find(light->id()) == m_lights.end())
     {
-        GLuint id = 1;
-        if (m_lights.size() > 0)
-            id = m_lights.rbegin()->second->id() + 1;
-
-        light->setId((unsigned short int)id);
+        this->registerResource(light);
 
-        m_lights[id] = light;
+        m_lights[light->id()] = light;
 
-        printf("Add light: %d\n", id);
+        printf("Add light: %d\n", light->id());
     }
 }
 
@@ -825,6 +1841,8 @@ void L3DRenderer::addMesh(L3DMesh *mesh)
 {
     if (mesh && m_meshes.find(mesh->id()) == m_meshes.end())
     {
+        L3D_TRACE_SCOPE("Upload mesh");
+
         GLuint id;
         glGenVertexArrays(1, &id);
         glBindVertexArray(id);
@@ -834,7 +1852,7 @@ void L3DRenderer::addMesh(L3DMesh *mesh)
             this->addBuffer(mesh->vertexBuffer());
 
             // Binds vertex buffer.
-            glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer()->id());
+            glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer()->glName());
 
             if (mesh->material() && mesh->material()->shaderProgram())
             {
@@ -843,13 +1861,13 @@ void L3DRenderer::addMesh(L3DMesh *mesh)
                 L3DAttributeMap shaderAttributes = shaderProgram->attributes();
 
                 // Enables vertex attributes.
-                GLint posAttrib = glGetAttribLocation(shaderProgram->id(), shaderAttributes[L3D_VERTEX_POSITION].c_str());
-                GLint norAttrib = glGetAttribLocation(shaderProgram->id(), shaderAttributes[L3D_VERTEX_NORMAL].c_str());
-                GLint tanAttrib = glGetAttribLocation(shaderProgram->id(), shaderAttributes[L3D_VERTEX_TANGENT].c_str());
-                GLint tex0Attrib = glGetAttribLocation(shaderProgram->id(), shaderAttributes[L3D_VERTEX_UV0].c_str());
-                GLint tex1Attrib = glGetAttribLocation(shaderProgram->id(), shaderAttributes[L3D_VERTEX_UV1].c_str());
-                GLint tex2Attrib = glGetAttribLocation(shaderProgram->id(), shaderAttributes[L3D_VERTEX_UV2].c_str());
-                GLint tex3Attrib = glGetAttribLocation(shaderProgram->id(), shaderAttributes[L3D_VERTEX_UV3].c_str());
+                GLint posAttrib = attributeLocation(shaderAttributes, L3D_VERTEX_POSITION);
+                GLint norAttrib = attributeLocation(shaderAttributes, L3D_VERTEX_NORMAL);
+                GLint tanAttrib = attributeLocation(shaderAttributes, L3D_VERTEX_TANGENT);
+                GLint tex0Attrib = attributeLocation(shaderAttributes, L3D_VERTEX_UV0);
+                GLint tex1Attrib = attributeLocation(shaderAttributes, L3D_VERTEX_UV1);
+                GLint tex2Attrib = attributeLocation(shaderAttributes, L3D_VERTEX_UV2);
+                GLint tex3Attrib = attributeLocation(shaderAttributes, L3D_VERTEX_UV3);
 
                 switch (mesh->vertexFormat())
                 {
@@ -923,6 +1941,16 @@ void L3DRenderer::addMesh(L3DMesh *mesh)
                     enableVertexAttribute(tex2Attrib, 2, GL_FLOAT, 17 * sizeof(GLfloat), (void *)(13 * sizeof(GLfloat)));
                     enableVertexAttribute(tex3Attrib, 2, GL_FLOAT, 17 * sizeof(GLfloat), (void *)(15 * sizeof(GLfloat)));
                     break;
+                case L3D_VERTEX_PACKED_POS3_UV2:
+                case L3D_VERTEX_PACKED_POS3_NOR3_UV2:
+                case L3D_VERTEX_PACKED_POS3_NOR3_TAN3_UV2:
+                case L3D_VERTEX_PACKED_POS3_NOR3_TAN3_UV2_UV2:
+                {
+                    GLint directionAttribs[] = {norAttrib, tanAttrib};
+                    GLint texAttribs[] = {tex0Attrib, tex1Attrib};
+                    enablePackedVertexAttributes(mesh->vertexFormat(), posAttrib, directionAttribs, texAttribs);
+                }
+                break;
                 default:
                     glDeleteVertexArrays(1, &id);
                     glBindVertexArray(0);
@@ -935,7 +1963,7 @@ void L3DRenderer::addMesh(L3DMesh *mesh)
         {
             this->addBuffer(mesh->indexBuffer());
 
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer()->id());
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer()->glName());
         }
 
         if (mesh->instanceBuffer() && mesh->instanceFormat())
@@ -943,7 +1971,7 @@ void L3DRenderer::addMesh(L3DMesh *mesh)
             this->addBuffer(mesh->instanceBuffer());
 
             // Binds instance buffer.
-            glBindBuffer(GL_ARRAY_BUFFER, mesh->instanceBuffer()->id());
+            glBindBuffer(GL_ARRAY_BUFFER, mesh->instanceBuffer()->glName());
 
             if (mesh->material() && mesh->material()->shaderProgram())
             {
@@ -952,9 +1980,9 @@ void L3DRenderer::addMesh(L3DMesh *mesh)
                 L3DAttributeMap shaderAttributes = shaderProgram->attributes();
 
                 // Enables instanced attributes.
-                GLint iposAttrib = glGetAttribLocation(shaderProgram->id(), shaderAttributes[L3D_INSTANCE_POSITION].c_str());
-                GLint itexAttrib = glGetAttribLocation(shaderProgram->id(), shaderAttributes[L3D_INSTANCE_UV].c_str());
-                GLint itransAttrib = glGetAttribLocation(shaderProgram->id(), shaderAttributes[L3D_INSTANCE_MATRIX].c_str());
+                GLint iposAttrib = attributeLocation(shaderAttributes, L3D_INSTANCE_POSITION);
+                GLint itexAttrib = attributeLocation(shaderAttributes, L3D_INSTANCE_UV);
+                GLint itransAttrib = attributeLocation(shaderAttributes, L3D_INSTANCE_MATRIX);
 
                 switch (mesh->instanceFormat())
                 {
@@ -993,13 +2021,14 @@ void L3DRenderer::addMesh(L3DMesh *mesh)
 
         glBindVertexArray(0);
 
-        mesh->setId((unsigned short int)id);
+        mesh->setGlName(id);
+        this->registerResource(mesh);
 
-        m_meshes[id] = mesh;
+        m_meshes[mesh->id()] = mesh;
 
         this->recomputeRenderBucket();
 
-        printf("Add mesh: %d\n", id);
+        printf("Add mesh: %d\n", mesh->id());
     }
 }
 
@@ -1007,22 +2036,29 @@ void L3DRenderer::addRenderQueue(L3DRenderQueue *renderQueue)
 {
     if (renderQueue && m_renderQueues.find(renderQueue->id()) == m_renderQueues.end())
     {
-        GLuint id = 1;
-        if (m_renderQueues.size() > 0)
-            id = m_renderQueues.rbegin()->second->id() + 1;
+        this->registerResource(renderQueue);
 
-        renderQueue->setId((unsigned short int)id);
+        m_renderQueues[renderQueue->id()] = renderQueue;
 
-        m_renderQueues[id] = renderQueue;
-
-        printf("Add render queue: %d\n", id);
+        printf("Add render queue: %d\n", renderQueue->id());
     }
 }
 
 void L3DRenderer::removeResource(L3DResource *resource)
 {
+    L3D_ASSERT(!m_pipeline);
+
     if (resource)
     {
+        // Handles aliasing the resource are gone too.
+        for (std::map<unsigned int, unsigned int>::iterator it = m_aliases.begin(); it != m_aliases.end();)
+        {
+            if (it->second == resource->handle().repr)
+                m_aliases.erase(it++);
+            else
+                ++it;
+        }
+
         switch (resource->resourceType())
         {
         case L3D_BUFFER:
@@ -1065,22 +2101,100 @@ void L3DRenderer::removeBuffer(L3DBuffer *buffer)
 {
     if (buffer)
     {
-        GLuint id = buffer->id();
-        m_buffers[id] = L3D_NULLPTR;
-        glDeleteBuffers(1, &id);
+        unsigned short int id = buffer->id();
+        GLuint gl_name = buffer->glName();
+        m_buffers.erase(id);
+        glDeleteBuffers(1, &gl_name);
+        buffer->setGlName(0);
         buffer->setId(0);
 
         printf("Remove buffer: %d\n", id);
     }
 }
 
+void L3DRenderer::updateTexture(
+    L3DTexture *texture,
+    const L3DImageFormat &format,
+    const unsigned char *data,
+    unsigned int width,
+    unsigned int height,
+    unsigned int face,
+    bool updateMipmaps,
+    unsigned int mipCount)
+{
+    if (!texture)
+        return;
+
+    L3D_TRACE_SCOPE("Update texture");
+
+    GLenum gl_type = toOpenGL(texture->type());
+    GLenum gl_target = gl_type;
+
+    switch (texture->type())
+    {
+    case L3D_TEXTURE_2D:
+        break;
+    case L3D_TEXTURE_CUBE_MAP:
+        gl_target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + (face % 6);
+        break;
+    default:
+        fprintf(stderr, "Texture %d: only 2D and cube map textures can be updated\n", texture->id());
+        return;
+    }
+
+    if (!mipCount)
+        mipCount = 1;
+
+    bool use_mipmaps = texture->useMipmap() && (mipCount > 1 || !L3DTexture::isCompressed(format));
+    bool resized = format != texture->format() || width != texture->width() || height != texture->height() || mipCount != texture->mipCount() || texture->evictedLevels();
+    bool allocated = GLAD_GL_VERSION_4_2 != 0;
+
+    // Immutable storage can't be resized: move the texture to a new name.
+    if (allocated && resized)
+    {
+        GLuint id = texture->glName();
+        glDeleteTextures(1, &id);
+        glGenTextures(1, &id);
+        texture->setGlName(id);
+
+        glBindTexture(gl_type, id);
+        allocateTextureStorage(gl_type, format, width, height, (use_mipmaps && mipCount == 1) ? fullMipCount(width, height) : mipCount);
+        setTextureParameters(texture, gl_type, use_mipmaps);
+    }
+    else
+    {
+        glBindTexture(gl_type, texture->glName());
+    }
+
+    uploadTextureLevels(gl_target, format, toOpenGL(texture->pixelFormat()), data, width, height, mipCount, allocated);
+
+    // Compressed images can't be mipmapped by the driver.
+    if (mipCount == 1 && use_mipmaps)
+    {
+        glTexParameteri(gl_type, GL_TEXTURE_MAX_LEVEL, 1000);
+
+        if (updateMipmaps)
+            glGenerateMipmap(gl_type);
+    }
+    else
+    {
+        glTexParameteri(gl_type, GL_TEXTURE_MAX_LEVEL, mipCount - 1);
+    }
+
+    glBindTexture(gl_type, 0);
+
+    texture->setImage(format, width, height, mipCount);
+}
+
 void L3DRenderer::removeTexture(L3DTexture *texture)
 {
     if (texture)
     {
-        GLuint id = texture->id();
-        m_textures[id] = L3D_NULLPTR;
-        glDeleteTextures(1, &id);
+        unsigned short int id = texture->id();
+        GLuint gl_name = texture->glName();
+        m_textures.erase(id);
+        glDeleteTextures(1, &gl_name);
+        texture->setGlName(0);
         texture->setId(0);
 
         printf("Remove texture: %d\n", id);
@@ -1091,9 +2205,21 @@ void L3DRenderer::removeShader(L3DShader *shader)
 {
     if (shader)
     {
-        GLuint id = shader->id();
-        m_shaders[id] = L3D_NULLPTR;
-        glDeleteShader(id);
+        unsigned short int id = shader->id();
+        GLuint gl_name = shader->glName();
+        m_shaders.erase(id);
+        if (gl_name)
+            glDeleteShader(gl_name);
+
+        for (L3DShaderSourceMap::iterator it = m_shaderSources.begin(); it != m_shaderSources.end(); ++it)
+        {
+            if (it->second == id)
+            {
+                m_shaderSources.erase(it);
+                break;
+            }
+        }
+        shader->setGlName(0);
         shader->setId(0);
 
         printf("Remove shader: %d\n", id);
@@ -1104,12 +2230,27 @@ void L3DRenderer::removeShaderProgram(L3DShaderProgram *shaderProgram)
 {
     if (shaderProgram)
     {
-        GLuint id = shaderProgram->id();
-        m_shaderPrograms[id] = L3D_NULLPTR;
-        glDeleteProgram(id);
+        unsigned short int id = shaderProgram->id();
+        GLuint gl_name = shaderProgram->glName();
+        m_shaderPrograms.erase(id);
+        m_pendingPrograms.erase(gl_name);
+        m_uniformLocations.erase(gl_name);
+        glDeleteProgram(gl_name);
+        shaderProgram->setGlName(0);
         shaderProgram->setId(0);
 
-        printf("Remove shader program: %d\n", id);
+        printf("Remove shader program: %d\n", id);
+
+        // Variants go with their program (their shaders stay shared).
+        L3DShaderVariantMap::iterator begin = m_shaderVariants.lower_bound((unsigned long long)gl_name << 32);
+        L3DShaderVariantMap::iterator end = m_shaderVariants.lower_bound((unsigned long long)(gl_name + 1) << 32);
+        std::vector<L3DShaderProgram *> variants;
+        for (L3DShaderVariantMap::iterator it = begin; it != end; ++it)
+            variants.push_back(it->second);
+        m_shaderVariants.erase(begin, end);
+
+        for (unsigned int i = 0; i < variants.size(); ++i)
+            delete variants[i];
     }
 }
 
@@ -1117,9 +2258,11 @@ void L3DRenderer::removeFrameBuffer(L3DFrameBuffer *frameBuffer)
 {
     if (frameBuffer)
     {
-        GLuint id = frameBuffer->id();
-        m_frameBuffers[id] = L3D_NULLPTR;
-        glDeleteFramebuffers(1, &id);
+        unsigned short int id = frameBuffer->id();
+        GLuint gl_name = frameBuffer->glName();
+        m_frameBuffers.erase(id);
+        glDeleteFramebuffers(1, &gl_name);
+        frameBuffer->setGlName(0);
         // TODO: clean frame buffer attachments.
         frameBuffer->setId(0);
 
@@ -1131,8 +2274,8 @@ void L3DRenderer::removeMaterial(L3DMaterial *material)
 {
     if (material)
     {
-        GLuint id = material->id();
-        m_materials[id] = L3D_NULLPTR;
+        unsigned short int id = material->id();
+        m_materials.erase(id);
         // TODO: clean material resources.
         material->setId(0);
 
@@ -1144,8 +2287,8 @@ void L3DRenderer::removeCamera(L3DCamera *camera)
 {
     if (camera)
     {
-        GLuint id = camera->id();
-        m_cameras[id] = L3D_NULLPTR;
+        unsigned short int id = camera->id();
+        m_cameras.erase(id);
         // TODO: clean camera resources.
         camera->setId(0);
 
@@ -1157,8 +2300,8 @@ void L3DRenderer::removeLight(L3DLight *light)
 {
     if (light)
     {
-        GLuint id = light->id();
-        m_lights[id] = L3D_NULLPTR;
+        unsigned short int id = light->id();
+        m_lights.erase(id);
         // TODO: clean light resources.
         light->setId(0);
 
@@ -1168,11 +2311,15 @@ void L3DRenderer::removeLight(L3DLight *light)
 
 void L3DRenderer::removeMesh(L3DMesh *mesh)
 {
+    L3D_ASSERT(!m_pipeline);
+
     if (mesh)
     {
-        GLuint id = mesh->id();
-        m_meshes[id] = L3D_NULLPTR;
-        glDeleteVertexArrays(1, &id);
+        unsigned short int id = mesh->id();
+        GLuint gl_name = mesh->glName();
+        m_meshes.erase(id);
+        glDeleteVertexArrays(1, &gl_name);
+        mesh->setGlName(0);
         mesh->setId(0);
 
         this->recomputeRenderBucket();
@@ -1185,8 +2332,8 @@ void L3DRenderer::removeRenderQueue(L3DRenderQueue *renderQueue)
 {
     if (renderQueue)
     {
-        GLuint id = renderQueue->id();
-        m_renderQueues[id] = L3D_NULLPTR;
+        unsigned short int id = renderQueue->id();
+        m_renderQueues.erase(id);
         // TODO: clean render queue resources.
         renderQueue->setId(0);
 
@@ -1194,30 +2341,173 @@ void L3DRenderer::removeRenderQueue(L3DRenderQueue *renderQueue)
     }
 }
 
+L3DShader *L3DRenderer::findShader(const L3DShaderType &type, const char *code) const
+{
+    if (!code)
+        return L3D_NULLPTR;
+
+    unsigned long long hash = L3DAssetRegistry::hash(code, strlen(code));
+
+    std::pair<L3DShaderSourceMap::const_iterator, L3DShaderSourceMap::const_iterator> range = m_shaderSources.equal_range(hash);
+    for (L3DShaderSourceMap::const_iterator it = range.first; it != range.second; ++it)
+    {
+        L3DShader *shader = findResource(m_shaders, it->second);
+
+        if (shader && shader->type() == type && strcmp(shader->code(), code) == 0)
+            return shader;
+    }
+
+    return L3D_NULLPTR;
+}
+
+L3DHandle L3DRenderer::reserveHandle(const L3DResourceType &type)
+{
+    L3DHandle handle = L3D_INVALID_HANDLE;
+
+    if (type > L3D_RENDER_QUEUE)
+        return handle;
+
+    // Ids are 16 bits: skip 0, which marks unregistered resources.
+    unsigned short int id = 0;
+    while (!id)
+        id = (unsigned short int)(++m_nextIds[type]);
+
+    handle.data.type = type;
+    handle.data.id = id;
+
+    return handle;
+}
+
+bool L3DRenderer::rebindResource(const L3DHandle &handle, const L3DHandle &reserved)
+{
+    if (handle.data.type != reserved.data.type)
+        return false;
+
+    L3DResource *resource = this->getResource(handle);
+    bool rebound = false;
+
+    switch (handle.data.type)
+    {
+    case L3D_BUFFER:
+        rebound = ::rebindResource(m_buffers, handle.data.id, reserved.data.id);
+        break;
+    case L3D_TEXTURE:
+        rebound = ::rebindResource(m_textures, handle.data.id, reserved.data.id);
+        break;
+    case L3D_SHADER:
+        rebound = ::rebindResource(m_shaders, handle.data.id, reserved.data.id);
+        break;
+    case L3D_SHADER_PROGRAM:
+        rebound = ::rebindResource(m_shaderPrograms, handle.data.id, reserved.data.id);
+        break;
+    case L3D_FRAME_BUFFER:
+        rebound = ::rebindResource(m_frameBuffers, handle.data.id, reserved.data.id);
+        break;
+    case L3D_MATERIAL:
+        rebound = ::rebindResource(m_materials, handle.data.id, reserved.data.id);
+        break;
+    case L3D_CAMERA:
+        rebound = ::rebindResource(m_cameras, handle.data.id, reserved.data.id);
+        break;
+    case L3D_LIGHT:
+        rebound = ::rebindResource(m_lights, handle.data.id, reserved.data.id);
+        break;
+    case L3D_MESH:
+        rebound = ::rebindResource(m_meshes, handle.data.id, reserved.data.id);
+        break;
+    case L3D_RENDER_QUEUE:
+        rebound = ::rebindResource(m_renderQueues, handle.data.id, reserved.data.id);
+        break;
+    default:
+        break;
+    }
+
+    if (!rebound)
+    {
+        fprintf(stderr, "Failed to rebind resource %d to %d\n", handle.data.id, reserved.data.id);
+        return false;
+    }
+
+    resource->setId(reserved.data.id);
+
+    if (handle.data.type == L3D_MESH)
+        this->recomputeRenderBucket();
+
+    // Keep shaders found by their source.
+    if (handle.data.type == L3D_SHADER)
+    {
+        for (L3DShaderSourceMap::iterator it = m_shaderSources.begin(); it != m_shaderSources.end(); ++it)
+        {
+            if (it->second == handle.data.id)
+                it->second = reserved.data.id;
+        }
+    }
+
+    return true;
+}
+
+bool L3DRenderer::aliasResource(const L3DHandle &handle, const L3DHandle &reserved)
+{
+    if (handle.data.type != reserved.data.type || !this->getResource(handle) || this->getResource(reserved))
+    {
+        fprintf(stderr, "Failed to alias resource %d to %d\n", handle.data.id, reserved.data.id);
+        return false;
+    }
+
+    m_aliases[reserved.repr] = this->resolveHandle(handle).repr;
+
+    return true;
+}
+
+L3DHandle L3DRenderer::resolveHandle(const L3DHandle &handle) const
+{
+    if (m_aliases.empty())
+        return handle;
+
+    std::map<unsigned int, unsigned int>::const_iterator it = m_aliases.find(handle.repr);
+    if (it == m_aliases.end())
+        return handle;
+
+    L3DHandle resolved;
+    resolved.repr = it->second;
+
+    return resolved;
+}
+
+void L3DRenderer::registerResource(L3DResource *resource)
+{
+    // Pools are read by the render thread while pipelined.
+    L3D_ASSERT(!m_pipeline);
+
+    // Keep ids already assigned (e.g. when a resource is re-added).
+    if (!resource->id())
+        resource->setId(this->reserveHandle(resource->resourceType()).data.id);
+}
+
 L3DResource *L3DRenderer::getResource(const L3DHandle &handle) const
 {
     switch (handle.data.type)
     {
     case L3D_BUFFER:
-        return m_buffers.find(handle.data.id)->second;
+        return findResource(m_buffers, this->resolveHandle(handle).data.id);
     case L3D_TEXTURE:
-        return m_textures.find(handle.data.id)->second;
+        return findResource(m_textures, this->resolveHandle(handle).data.id);
     case L3D_SHADER:
-        return m_shaders.find(handle.data.id)->second;
+        return findResource(m_shaders, this->resolveHandle(handle).data.id);
     case L3D_SHADER_PROGRAM:
-        return m_shaderPrograms.find(handle.data.id)->second;
+        return findResource(m_shaderPrograms, this->resolveHandle(handle).data.id);
     case L3D_FRAME_BUFFER:
-        return m_frameBuffers.find(handle.data.id)->second;
+        return findResource(m_frameBuffers, this->resolveHandle(handle).data.id);
     case L3D_MATERIAL:
-        return m_materials.find(handle.data.id)->second;
+        return findResource(m_materials, this->resolveHandle(handle).data.id);
     case L3D_CAMERA:
-        return m_cameras.find(handle.data.id)->second;
+        return findResource(m_cameras, this->resolveHandle(handle).data.id);
     case L3D_LIGHT:
-        return m_lights.find(handle.data.id)->second;
+        return findResource(m_lights, this->resolveHandle(handle).data.id);
     case L3D_MESH:
-        return m_meshes.find(handle.data.id)->second;
+        return findResource(m_meshes, this->resolveHandle(handle).data.id);
     case L3D_RENDER_QUEUE:
-        return m_renderQueues.find(handle.data.id)->second;
+        return findResource(m_renderQueues, this->resolveHandle(handle).data.id);
     default:
         return L3D_NULLPTR;
     }
@@ -1226,7 +2516,7 @@ L3DResource *L3DRenderer::getResource(const L3DHandle &handle) const
 L3DBuffer *L3DRenderer::getBuffer(const L3DHandle &handle) const
 {
     if (handle.data.type == L3D_BUFFER)
-        return m_buffers.find(handle.data.id)->second;
+        return findResource(m_buffers, this->resolveHandle(handle).data.id);
 
     return L3D_NULLPTR;
 }
@@ -1234,7 +2524,7 @@ L3DBuffer *L3DRenderer::getBuffer(const L3DHandle &handle) const
 L3DTexture *L3DRenderer::getTexture(const L3DHandle &handle) const
 {
     if (handle.data.type == L3D_TEXTURE)
-        return m_textures.find(handle.data.id)->second;
+        return findResource(m_textures, this->resolveHandle(handle).data.id);
 
     return L3D_NULLPTR;
 }
@@ -1242,7 +2532,7 @@ L3DTexture *L3DRenderer::getTexture(const L3DHandle &handle) const
 L3DShader *L3DRenderer::getShader(const L3DHandle &handle) const
 {
     if (handle.data.type == L3D_SHADER)
-        return m_shaders.find(handle.data.id)->second;
+        return findResource(m_shaders, this->resolveHandle(handle).data.id);
 
     return L3D_NULLPTR;
 }
@@ -1250,7 +2540,7 @@ L3DShader *L3DRenderer::getShader(const L3DHandle &handle) const
 L3DShaderProgram *L3DRenderer::getShaderProgram(const L3DHandle &handle) const
 {
     if (handle.data.type == L3D_SHADER_PROGRAM)
-        return m_shaderPrograms.find(handle.data.id)->second;
+        return findResource(m_shaderPrograms, this->resolveHandle(handle).data.id);
 
     return L3D_NULLPTR;
 }
@@ -1258,7 +2548,7 @@ L3DShaderProgram *L3DRenderer::getShaderProgram(const L3DHandle &handle) const
 L3DFrameBuffer *L3DRenderer::getFrameBuffer(const L3DHandle &handle) const
 {
     if (handle.data.type == L3D_FRAME_BUFFER)
-        return m_frameBuffers.find(handle.data.id)->second;
+        return findResource(m_frameBuffers, this->resolveHandle(handle).data.id);
 
     return L3D_NULLPTR;
 }
@@ -1266,7 +2556,7 @@ L3DFrameBuffer *L3DRenderer::getFrameBuffer(const L3DHandle &handle) const
 L3DMaterial *L3DRenderer::getMaterial(const L3DHandle &handle) const
 {
     if (handle.data.type == L3D_MATERIAL)
-        return m_materials.find(handle.data.id)->second;
+        return findResource(m_materials, this->resolveHandle(handle).data.id);
 
     return L3D_NULLPTR;
 }
@@ -1274,7 +2564,7 @@ L3DMaterial *L3DRenderer::getMaterial(const L3DHandle &handle) const
 L3DCamera *L3DRenderer::getCamera(const L3DHandle &handle) const
 {
     if (handle.data.type == L3D_CAMERA)
-        return m_cameras.find(handle.data.id)->second;
+        return findResource(m_cameras, this->resolveHandle(handle).data.id);
 
     return L3D_NULLPTR;
 }
@@ -1282,7 +2572,7 @@ L3DCamera *L3DRenderer::getCamera(const L3DHandle &handle) const
 L3DLight *L3DRenderer::getLight(const L3DHandle &handle) const
 {
     if (handle.data.type == L3D_LIGHT)
-        return m_lights.find(handle.data.id)->second;
+        return findResource(m_lights, this->resolveHandle(handle).data.id);
 
     return L3D_NULLPTR;
 }
@@ -1290,7 +2580,7 @@ L3DLight *L3DRenderer::getLight(const L3DHandle &handle) const
 L3DMesh *L3DRenderer::getMesh(const L3DHandle &handle) const
 {
     if (handle.data.type == L3D_MESH)
-        return m_meshes.find(handle.data.id)->second;
+        return findResource(m_meshes, this->resolveHandle(handle).data.id);
 
     return L3D_NULLPTR;
 }
@@ -1298,7 +2588,7 @@ L3DMesh *L3DRenderer::getMesh(const L3DHandle &handle) const
 L3DRenderQueue *L3DRenderer::getRenderQueue(const L3DHandle &handle) const
 {
     if (handle.data.type == L3D_RENDER_QUEUE)
-        return m_renderQueues.find(handle.data.id)->second;
+        return findResource(m_renderQueues, this->resolveHandle(handle).data.id);
 
     return L3D_NULLPTR;
 }
@@ -1316,17 +2606,18 @@ void L3DRenderer::switchFrameBuffer(L3DFrameBuffer *frameBuffer)
             if (texture && texture->useMipmap())
             {
                 GLenum gl_type = toOpenGL(texture->type());
-                glBindTexture(gl_type, texture->id());
+                bindTexture(m_renderStats, gl_type, texture->glName());
                 glGenerateMipmap(gl_type);
-                glBindTexture(gl_type, 0);
+                bindTexture(m_renderStats, gl_type, 0);
             }
         }
     }
 
     // Switch to new framebuffer.
-    GLuint frameBufferId = frameBuffer ? frameBuffer->id() : 0;
+    GLuint frameBufferId = frameBuffer ? frameBuffer->glName() : 0;
 
     glBindFramebuffer(GL_FRAMEBUFFER, frameBufferId);
+    L3D_COUNT(m_renderStats, frameBufferSwitches, 1);
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
     {
@@ -1350,6 +2641,7 @@ void L3DRenderer::clearBuffers(
 
     glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
     glClear(clearMask);
+    L3D_COUNT(m_renderStats, clears, 1);
 }
 
 void L3DRenderer::setDepthTest(
@@ -1359,16 +2651,19 @@ void L3DRenderer::setDepthTest(
     enable ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
     if (enable)
         glDepthFunc(toOpenGL(factor));
+    L3D_COUNT(m_renderStats, stateChanges, 1);
 }
 
 void L3DRenderer::setDepthMask(bool enable)
 {
     glDepthMask(enable ? GL_TRUE : GL_FALSE);
+    L3D_COUNT(m_renderStats, stateChanges, 1);
 }
 
 void L3DRenderer::setStencilTest(bool enable)
 {
     enable ? glEnable(GL_STENCIL_TEST) : glDisable(GL_STENCIL_TEST);
+    L3D_COUNT(m_renderStats, stateChanges, 1);
 }
 
 void L3DRenderer::setBlend(
@@ -1379,6 +2674,7 @@ void L3DRenderer::setBlend(
     enable ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
     if (enable)
         glBlendFunc(toOpenGL(srcFactor), toOpenGL(dstFactor));
+    L3D_COUNT(m_renderStats, stateChanges, 1);
 }
 
 void L3DRenderer::setCullFace(
@@ -1388,6 +2684,7 @@ void L3DRenderer::setCullFace(
     enable ? glEnable(GL_CULL_FACE) : glDisable(GL_CULL_FACE);
     if (enable)
         glCullFace(toOpenGL(cullFace));
+    L3D_COUNT(m_renderStats, stateChanges, 1);
 }
 
 void L3DRenderer::drawMeshes(
@@ -1397,143 +2694,474 @@ void L3DRenderer::drawMeshes(
     if (!camera)
         return;
 
-    if (!m_renderBucket.count(renderLayer))
-        return;
+    // Draws issued outside renderFrame() prepare their own data.
+    L3DFrameData *frame = m_frame;
+    if (!frame || frame->camera != camera)
+    {
+        frame = &m_cameraFrameData;
+        this->prepareFrame(*frame, camera, L3D_NULLPTR);
+    }
+
+    L3DRenderLayerDataMap::const_iterator layer_it = frame->layers.find(renderLayer);
+    if (layer_it != frame->layers.end())
+    {
+        const L3DRenderLayerData &layer = layer_it->second;
+
+        L3DProfileScope scope(&m_profiler, layerScopeName(renderLayer), true);
+        m_renderStats.beginLayer(renderLayer);
+
+        // Replays recorded command buffers in sort key order.
+        for (L3DCommandBufferList::const_iterator it = layer.commandBuffers.begin(); it != layer.commandBuffers.end(); ++it)
+            this->submitCommandBuffer(*it, frame->cameraSnapshot, layer.lightUniforms);
 
-    L3DVec3 cameraPos = camera->position();
-    L3DMat4 vpMat = camera->proj * camera->view;
-    L3DMeshList meshList = m_renderBucket.at(renderLayer);
+        m_renderStats.endLayer();
+    }
+
+    glBindVertexArray(0);
+}
 
-    // Iterate over render bucket and render each collected mesh.
-    // Meshes in bucket are ordered now by material to reduce context changes.
-    for (L3DMeshList::const_iterator it = meshList.begin(); it != meshList.end(); ++it)
+void L3DRenderer::submitCommandBuffer(
+    const L3DCommandBuffer &commandBuffer,
+    const L3DCameraSnapshot &camera,
+    const L3DPackedUniformList &lightUniforms)
+{
+    L3DMat4 vpMat = camera.proj * camera.view;
+
+    // Light count bucket of variants (u_lightNr comes last).
+    unsigned int lightCount = lightUniforms.empty() ? 0 : lightUniforms.back().valueI;
+    unsigned int lightFeatures = L3DShaderPreprocessor::lightFeatures(lightCount);
+    GLuint lastProgram = 0;
+    unsigned int lastFeatures = 0;
+    GLuint lastVariant = 0;
+
+    for (L3DCommandBuffer::const_iterator it = commandBuffer.begin(); it != commandBuffer.end(); ++it)
     {
-        L3DMesh *mesh = *it;
-        L3DMaterial *material = mesh->material();
-        L3DShaderProgram *shaderProgram = material->shaderProgram();
-        GLenum gl_draw_primitive = toOpenGL(mesh->drawPrimitive());
-        unsigned int index_count = mesh->indexCount();
-        unsigned int instance_count = mesh->instanceCount();
+        const L3DDrawPacket &packet = *it;
+        GLuint gl_program = packet.shaderProgram;
+        GLenum gl_draw_primitive = toOpenGL(packet.drawPrimitive);
+        bool specialized = false;
+
+        // Selects the variant for the material, lights and instancing.
+        // The generic program stands in while the variant is linking.
+        if (packet.shaderFeatures)
+        {
+            unsigned int features = packet.shaderFeatures | packet.materialData->shaderFeatures | lightFeatures;
+
+            if (gl_program != lastProgram || features != lastFeatures)
+            {
+                lastProgram = gl_program;
+                lastFeatures = features;
+                lastVariant = this->shaderVariantName(gl_program, features);
+            }
+
+            if (lastVariant && this->checkProgramStatus(lastVariant))
+            {
+                gl_program = lastVariant;
+                specialized = true;
+            }
+        }
+
+        // Skips programs still linking.
+        if (!m_pendingPrograms.empty() && !this->checkProgramStatus(gl_program))
+            continue;
 
         // Binds VAO.
-        glBindVertexArray(mesh->id());
+        glBindVertexArray(packet.vertexArray);
 
         // Binds shaders.
-        glUseProgram(shaderProgram->id());
+        bindProgram(m_renderStats, gl_program);
 
         // Binds uniforms.
-        L3DUniformMap uniforms = shaderProgram->uniforms();
-        for (L3DUniformMap::iterator unif_it = uniforms.begin(); unif_it != uniforms.end(); ++unif_it)
-            setUniform(shaderProgram->id(), unif_it->first.c_str(), unif_it->second);
+        for (L3DPackedUniformList::const_iterator unif_it = packet.programUniforms->begin(); unif_it != packet.programUniforms->end(); ++unif_it)
+            setUniform(m_renderStats, this->uniformLocation(gl_program, unif_it->name), *unif_it);
 
         // Binds matrices and vectors.
-        glUniform3fv(glGetUniformLocation(shaderProgram->id(), "u_cameraPos"), 1, glm::value_ptr(cameraPos));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram->id(), "u_vpMat"), 1, GL_FALSE, glm::value_ptr(vpMat));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram->id(), "u_viewMat"), 1, GL_FALSE, glm::value_ptr(camera->view));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram->id(), "u_projMat"), 1, GL_FALSE, glm::value_ptr(camera->proj));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram->id(), "u_modelMat"), 1, GL_FALSE, glm::value_ptr(mesh->transMatrix));
-        glUniformMatrix3fv(glGetUniformLocation(shaderProgram->id(), "u_normalMat"), 1, GL_FALSE, glm::value_ptr(mesh->normalMatrix()));
+        setUniform(m_renderStats, this->uniformLocation(gl_program, "u_cameraPos"), camera.position);
+        setUniform(m_renderStats, this->uniformLocation(gl_program, "u_vpMat"), vpMat);
+        setUniform(m_renderStats, this->uniformLocation(gl_program, "u_viewMat"), camera.view);
+        setUniform(m_renderStats, this->uniformLocation(gl_program, "u_projMat"), camera.proj);
+        setUniform(m_renderStats, this->uniformLocation(gl_program, "u_modelMat"), packet.modelMatrix);
+        setUniform(m_renderStats, this->uniformLocation(gl_program, "u_normalMat"), packet.normalMatrix);
 
         // Binds material:
-        std::string materialName = "u_material.";
-
-        // 1. Colors.
-        for (L3DColorRegistry::iterator col_it = material->colors.begin(); col_it != material->colors.end(); ++col_it)
-            setUniform(shaderProgram->id(), (materialName + col_it->first).c_str(), col_it->second);
-
-        // 2. Parameters.
-        for (L3DParameterRegistry::iterator par_it = material->params.begin(); par_it != material->params.end(); ++par_it)
-            setUniform(shaderProgram->id(), (materialName + par_it->first).c_str(), par_it->second);
+        // 1. Colors and parameters.
+        const L3DMaterialData *material = packet.materialData;
+        for (L3DPackedUniformList::const_iterator unif_it = material->uniforms.begin(); unif_it != material->uniforms.end(); ++unif_it)
+            setUniform(m_renderStats, this->uniformLocation(gl_program, unif_it->name), *unif_it);
 
-        // 3. Textures.
+        // 2. Textures.
         if (material->textures.size() > 0)
         {
-            std::string samplerName = "u_";
-
             unsigned int i = 0;
-            for (L3DTextureRegistry::iterator tex_it = material->textures.begin(); tex_it != material->textures.end(); ++tex_it)
+            for (L3DTextureBindingList::const_iterator tex_it = material->textures.begin(); tex_it != material->textures.end(); ++tex_it, ++i)
             {
-                L3DTexture *texture = tex_it->second;
-
-                if (texture)
-                {
-                    GLenum gl_type = toOpenGL(texture->type());
-                    GLint gl_sampler = glGetUniformLocation(shaderProgram->id(), (samplerName + tex_it->first).c_str());
-
-                    // Activate texture unit and bind sampler.
-                    glActiveTexture(GL_TEXTURE0 + i);
-                    glBindTexture(gl_type, texture->id());
-                    glUniform1i(gl_sampler, i);
-
-                    // Set map flag.
-                    glUniform1i(glGetUniformLocation(shaderProgram->id(), (samplerName + tex_it->first + "Enabled").c_str()), GL_TRUE);
-
-                    ++i;
-                }
+                // Activate texture unit and bind sampler.
+                glActiveTexture(GL_TEXTURE0 + i);
+                bindTexture(m_renderStats, toOpenGL(tex_it->type), tex_it->texture);
+                setUniform(m_renderStats, this->uniformLocation(gl_program, tex_it->samplerName), (GLint)i);
+
+                // Set map flag (variants are built for their maps).
+                if (!specialized)
+                    setUniform(m_renderStats, this->uniformLocation(gl_program, tex_it->enabledName), (GLint)GL_TRUE);
             }
         }
         else
         {
-            glBindTexture(GL_TEXTURE_1D, 0);
-            glBindTexture(GL_TEXTURE_2D, 0);
-            glBindTexture(GL_TEXTURE_3D, 0);
+            bindTexture(m_renderStats, GL_TEXTURE_1D, 0);
+            bindTexture(m_renderStats, GL_TEXTURE_2D, 0);
+            bindTexture(m_renderStats, GL_TEXTURE_3D, 0);
         }
 
         // Binds lights.
-        int activeLightCount = 0;
-        for (L3DLightPool::iterator light_it = m_lights.begin(); light_it != m_lights.end(); ++light_it)
-        {
-            L3DLight *light = light_it->second;
-
-            if (light && light->isOn() && L3D_TEST_BIT(light->renderLayerMask(), renderLayer))
-            {
-                std::ostringstream sstream;
-                sstream << "u_light[" << activeLightCount << "]";
-                std::string lightName = sstream.str();
-
-                setUniform(shaderProgram->id(), (lightName + ".type").c_str(), light->type);
-                setUniform(shaderProgram->id(), (lightName + ".position").c_str(), light->position);
-                setUniform(shaderProgram->id(), (lightName + ".direction").c_str(), light->direction);
-                setUniform(shaderProgram->id(), (lightName + ".color").c_str(), light->color);
-                setUniform(shaderProgram->id(), (lightName + ".kc").c_str(), light->attenuation.kc);
-                setUniform(shaderProgram->id(), (lightName + ".kl").c_str(), light->attenuation.kl);
-                setUniform(shaderProgram->id(), (lightName + ".kq").c_str(), light->attenuation.kq);
-
-                ++activeLightCount;
-            }
-        }
+        for (L3DPackedUniformList::const_iterator light_it = lightUniforms.begin(); light_it != lightUniforms.end(); ++light_it)
+            setUniform(m_renderStats, this->uniformLocation(gl_program, light_it->name), *light_it);
 
-        // Passes count of active lights.
-        setUniform(shaderProgram->id(), "u_lightNr", (int)activeLightCount);
+        L3D_COUNT(m_renderStats, drawCalls, 1);
+        L3D_COUNT(m_renderStats, primitives, (packet.indexCount > 0 ? packet.indexCount : packet.vertexCount) / packet.drawPrimitive * std::max(packet.instanceCount, 1u));
 
         // Renders geometry.
-        if (index_count > 0)
+        if (packet.indexCount > 0)
         {
             // Renders vertices using indices.
-            if (instance_count > 1)
+            if (packet.instanceCount > 1)
             {
-                glDrawElementsInstanced(gl_draw_primitive, index_count, GL_UNSIGNED_INT, 0, instance_count);
+                glDrawElementsInstanced(gl_draw_primitive, packet.indexCount, toOpenGL(packet.indexType), (const void *)(size_t)packet.indexOffset, packet.instanceCount);
             }
             else
             {
-                glDrawElements(gl_draw_primitive, index_count, GL_UNSIGNED_INT, 0);
+                glDrawElements(gl_draw_primitive, packet.indexCount, toOpenGL(packet.indexType), (const void *)(size_t)packet.indexOffset);
             }
         }
         else
         {
             // Renders vertices without using indices.
-            if (instance_count > 1)
+            if (packet.instanceCount > 1)
             {
-                glDrawArraysInstanced(gl_draw_primitive, 0, mesh->vertexCount(), instance_count);
+                glDrawArraysInstanced(gl_draw_primitive, 0, packet.vertexCount, packet.instanceCount);
             }
             else
             {
-                glDrawArrays(gl_draw_primitive, 0, mesh->vertexCount());
+                glDrawArrays(gl_draw_primitive, 0, packet.vertexCount);
             }
         }
     }
+}
 
-    glBindVertexArray(0);
+int L3DRenderer::uniformLocation(unsigned int shaderProgram, const std::string &name)
+{
+    L3DUniformLocationMap &locations = m_uniformLocations[shaderProgram];
+    L3DUniformLocationMap::const_iterator it = locations.find(name);
+
+    if (it != locations.end())
+        return it->second;
+
+    GLint gl_location = glGetUniformLocation(shaderProgram, name.c_str());
+    locations[name] = gl_location;
+
+    return gl_location;
+}
+
+bool L3DRenderer::isShaderProgramReady(L3DShaderProgram *shaderProgram)
+{
+    return shaderProgram && shaderProgram->glName() && this->checkProgramStatus(shaderProgram->glName());
+}
+
+void L3DRenderer::compileShader(L3DShader *shader)
+{
+    if (shader->glName())
+        return;
+
+    L3D_TRACE_SCOPE("Compile shader");
+
+    const char *code = shader->code();
+
+    GLuint id = glCreateShader(toOpenGL(shader->type()));
+    glShaderSource(id, 1, &code, L3D_NULLPTR);
+    glCompileShader(id);
+
+    shader->setGlName(id);
+}
+
+void L3DRenderer::linkShaderProgram(L3DShaderProgram *shaderProgram, unsigned int id)
+{
+    L3DShader *stages[] = {shaderProgram->vertexShader(), shaderProgram->fragmentShader(), shaderProgram->geometryShader()};
+
+    // Shared shaders are compiled once, by the first program using them.
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        if (stages[i])
+        {
+            this->compileShader(stages[i]);
+            glAttachShader(id, stages[i]->glName());
+        }
+    }
+
+    const L3DAttributeMap &attributes = shaderProgram->attributes();
+    for (L3DAttributeMap::const_iterator it = attributes.begin(); it != attributes.end(); ++it)
+    {
+        if (it->first >= 0 && it->first < L3D_MAX_INSTANCE_ATTRIBUTE)
+            glBindAttribLocation(id, it->first, it->second.c_str());
+    }
+
+    if (m_programBinaries && m_programCache.isEnabled())
+        glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    L3D_TRACE_SCOPE("Link program");
+    glLinkProgram(id);
+}
+
+bool L3DRenderer::checkProgramStatus(unsigned int id)
+{
+    L3DPendingProgramMap::iterator it = m_pendingPrograms.find(id);
+
+    if (it == m_pendingPrograms.end())
+        return true;
+
+    L3DPendingProgram &pending = it->second;
+
+    if (pending.failed)
+        return false;
+
+    if (m_parallelShaderCompile)
+    {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(id, GL_COMPLETION_STATUS_KHR, &completed);
+        if (completed == GL_FALSE)
+            return false;
+    }
+
+    // Without the parallel compile extension this is where the driver
+    // waits for the compiler.
+    L3D_TRACE_SCOPE("Finish program");
+
+    GLint status;
+    glGetProgramiv(id, GL_LINK_STATUS, &status);
+
+    if (status == GL_TRUE)
+    {
+        if (pending.cacheKey && !pending.fromBinary)
+        {
+            GLint length = 0;
+            glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+
+            if (length > 0)
+            {
+                std::vector<unsigned char> binary(length);
+                GLenum format = 0;
+                glGetProgramBinary(id, length, L3D_NULLPTR, &format, &binary[0]);
+                m_programCache.store(pending.cacheKey, format, binary);
+            }
+        }
+
+        m_pendingPrograms.erase(it);
+        return true;
+    }
+
+    // Rejected binaries (e.g. after a driver update) are replaced by a
+    // link from source, checked again next time.
+    if (pending.fromBinary)
+    {
+        m_programCache.remove(pending.cacheKey);
+        this->linkShaderProgram(pending.shaderProgram, id);
+        pending.fromBinary = false;
+        return false;
+    }
+
+    GLchar infoLog[512];
+    L3DShader *stages[] = {pending.shaderProgram->vertexShader(), pending.shaderProgram->fragmentShader(), pending.shaderProgram->geometryShader()};
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        GLint compiled = GL_TRUE;
+        if (stages[i] && stages[i]->glName())
+            glGetShaderiv(stages[i]->glName(), GL_COMPILE_STATUS, &compiled);
+
+        if (compiled == GL_FALSE)
+        {
+            glGetShaderInfoLog(stages[i]->glName(), 512, NULL, infoLog);
+            fprintf(stderr, "%s", infoLog);
+        }
+    }
+
+    glGetProgramInfoLog(id, 512, NULL, infoLog);
+    fprintf(stderr, "%s", infoLog);
+
+    pending.failed = true;
+
+    return false;
+}
+
+L3DShaderProgram *L3DRenderer::shaderVariant(L3DShaderProgram *shaderProgram, unsigned int features)
+{
+    if (!shaderProgram || !shaderProgram->glName())
+        return L3D_NULLPTR;
+
+    unsigned long long key = ((unsigned long long)shaderProgram->glName() << 32) | features;
+    L3DShaderVariantMap::const_iterator it = m_shaderVariants.find(key);
+
+    if (it != m_shaderVariants.end())
+        return it->second;
+
+    L3DShaderDefineList defines;
+    L3DShaderPreprocessor::variantDefines(features, defines);
+
+    L3DShader *stages[] = {shaderProgram->vertexShader(), shaderProgram->fragmentShader(), shaderProgram->geometryShader()};
+    L3DShader *variantStages[] = {L3D_NULLPTR, L3D_NULLPTR, L3D_NULLPTR};
+
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        if (stages[i] && stages[i]->code())
+        {
+            std::string code = L3DShaderPreprocessor::addDefines(stages[i]->code(), defines);
+            variantStages[i] = this->findShader(stages[i]->type(), code.c_str());
+
+            if (!variantStages[i])
+                variantStages[i] = new L3DShader(this, stages[i]->type(), code.c_str());
+        }
+    }
+
+    L3DShaderProgram *variant = new L3DShaderProgram(
+        this,
+        variantStages[0],
+        variantStages[1],
+        variantStages[2],
+        shaderProgram->uniforms(),
+        shaderProgram->attributes());
+    variant->setHasVariants(false);
+
+    m_shaderVariants[key] = variant;
+
+    return variant;
+}
+
+unsigned int L3DRenderer::shaderVariantName(unsigned int shaderProgram, unsigned int features)
+{
+    L3DShaderVariantMap::const_iterator it = m_shaderVariants.find(((unsigned long long)shaderProgram << 32) | features);
+
+    if (it != m_shaderVariants.end())
+        return it->second->glName();
+
+    // Resource pools can't change while pipelined: only variants created
+    // before are used then.
+    if (m_pipeline)
+        return 0;
+
+    // First use: the draw packet only knows the OpenGL name.
+    for (L3DShaderProgramPool::const_iterator prog_it = m_shaderPrograms.begin(); prog_it != m_shaderPrograms.end(); ++prog_it)
+    {
+        if (prog_it->second->glName() == shaderProgram)
+        {
+            L3DShaderProgram *variant = this->shaderVariant(prog_it->second, features);
+            return variant ? variant->glName() : 0;
+        }
+    }
+
+    return 0;
+}
+
+unsigned long long L3DRenderer::programKey(L3DShaderProgram *shaderProgram) const
+{
+    L3DShader *stages[] = {shaderProgram->vertexShader(), shaderProgram->fragmentShader(), shaderProgram->geometryShader()};
+    std::string content = m_driverId;
+
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        content += '\0';
+
+        if (stages[i] && stages[i]->code())
+        {
+            content += (char)stages[i]->type();
+            content += stages[i]->code();
+        }
+    }
+
+    // Attribute locations are linked into the binary too.
+    std::ostringstream sstream;
+    L3DAttributeMap attributes = shaderProgram->attributes();
+    for (L3DAttributeMap::const_iterator it = attributes.begin(); it != attributes.end(); ++it)
+        sstream << '\0' << it->first << ':' << it->second;
+    content += sstream.str();
+
+    return L3DAssetRegistry::hash(content.data(), content.size());
+}
+
+void L3DRenderer::collectRenderTargets(std::set<unsigned int> &textures) const
+{
+    for (L3DFrameBufferPool::const_iterator it = m_frameBuffers.begin(); it != m_frameBuffers.end(); ++it)
+    {
+        L3DTextureAttachments attachments = it->second->textureAttachments();
+
+        for (L3DTextureAttachments::const_iterator att_it = attachments.begin(); att_it != attachments.end(); ++att_it)
+        {
+            if (att_it->second)
+                textures.insert(att_it->second->id());
+        }
+    }
+}
+
+// Move a 2D texture to a new name holding its mip chain from firstLevel on.
+// Levels come from the local copy of the data when it has them (it always
+// has the first one), else from the current name (OpenGL 4.3). A discarded
+// copy is reloaded from its source for the time of the upload.
+bool L3DRenderer::reuploadTexture(L3DTexture *texture, unsigned int firstLevel)
+{
+    unsigned int levelCount = texture->levelCount();
+    bool canCopy = GLAD_GL_VERSION_4_3 && firstLevel > texture->evictedLevels();
+    bool reloaded = !texture->data() && !canCopy && texture->source() && this->acquireData(texture);
+    bool fromData = texture->data() && firstLevel < texture->mipCount();
+    bool fromTexture = !fromData && canCopy;
+
+    // Immutable storage is needed to allocate the chain from firstLevel.
+    if (texture->type() != L3D_TEXTURE_2D || firstLevel >= levelCount || !GLAD_GL_VERSION_4_2 || (!fromData && !fromTexture))
+    {
+        if (reloaded)
+            this->releaseData(texture);
+
+        return false;
+    }
+
+    L3D_TRACE_SCOPE("Reupload texture");
+
+    unsigned int width = std::max(texture->width() >> firstLevel, 1u);
+    unsigned int height = std::max(texture->height() >> firstLevel, 1u);
+    bool use_mipmaps = texture->useMipmap() && (texture->mipCount() > 1 || !L3DTexture::isCompressed(texture->format()));
+    GLuint oldId = texture->glName();
+    GLuint id = 0;
+
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+    allocateTextureStorage(GL_TEXTURE_2D, texture->format(), width, height, levelCount - firstLevel);
+
+    if (fromData)
+    {
+        unsigned int offset = firstLevel ? L3DTexture::dataSize(L3D_TEXTURE_2D, texture->format(), texture->width(), texture->height(), 0, firstLevel) : 0;
+        uploadTextureLevels(GL_TEXTURE_2D, texture->format(), toOpenGL(texture->pixelFormat()), texture->data() + offset, width, height, texture->mipCount() - firstLevel, true);
+
+        if (texture->mipCount() < levelCount)
+            glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    else
+    {
+        for (unsigned int level = firstLevel; level < levelCount; ++level)
+        {
+            glCopyImageSubData(
+                oldId, GL_TEXTURE_2D, level - texture->evictedLevels(), 0, 0, 0,
+                id, GL_TEXTURE_2D, level - firstLevel, 0, 0, 0,
+                std::max(texture->width() >> level, 1u), std::max(texture->height() >> level, 1u), 1);
+        }
+    }
+
+    setTextureParameters(texture, GL_TEXTURE_2D, use_mipmaps);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - firstLevel - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glDeleteTextures(1, &oldId);
+    texture->setGlName(id);
+    texture->setEvictedLevels(firstLevel);
+
+    if (reloaded)
+        this->releaseData(texture);
+
+    return true;
 }
 
 void L3DRenderer::recomputeRenderBucket()
@@ -1551,10 +3179,5 @@ void L3DRenderer::recomputeRenderBucket()
         }
     }
 
-    // Sort the generated render layers in the render bucket.
-    for (L3DRenderBucket::const_iterator it = m_renderBucket.begin(); it != m_renderBucket.end(); ++it)
-    {
-        L3DMeshList meshList = it->second;
-        meshList.sort(l3dMeshSortFunctor());
-    }
+    // NOTE: layers are sorted by the job system in prepareFrame().
 }
\ No newline at end of file
@@ -31,14 +31,16 @@ L3DResource::~L3DResource()
 }
 
 L3DResource::L3DResource(L3DRenderer *renderer)
-    : m_renderer(renderer)
+    : m_glName(0),
+      m_renderer(renderer)
 {
     m_handle.repr = 0;
 }
 
 L3DResource::L3DResource(
     const L3DResourceType &type,
-    L3DRenderer *renderer) : m_renderer(renderer)
+    L3DRenderer *renderer) : m_glName(0),
+                             m_renderer(renderer)
 {
     m_handle.data.type = type;
     m_handle.data.flags = 0;
@@ -21,6 +21,7 @@
 
 #include <leaf3d/L3DRenderer.h>
 #include <leaf3d/L3DShader.h>
+#include <leaf3d/L3DMemory.h>
 
 using namespace l3d;
 
@@ -34,9 +35,14 @@ L3DShader::L3DShader(
     if (code)
     {
         unsigned int size = strlen(code) + 1;
-        m_code = (const char *)memcpy(malloc(size), code, size);
+        m_code = (const char *)L3DMemory::duplicate(code, size, L3D_MEMORY_SHADERS);
     }
 
     if (renderer)
         renderer->addShader(this);
 }
+
+L3DShader::~L3DShader()
+{
+    L3DMemory::deallocate((void *)m_code);
+}
@@ -0,0 +1,237 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sstream>
+#include <leaf3d/L3DShaderPreprocessor.h>
+
+using namespace l3d;
+
+struct L3DShaderFeatureDefine
+{
+    unsigned int feature;
+    const char *define;
+};
+
+static const L3DShaderFeatureDefine featureDefines[] = {
+    {L3D_SHADER_DIFFUSE_MAP, "L3D_VARIANT_DIFFUSE_MAP"},
+    {L3D_SHADER_SPECULAR_MAP, "L3D_VARIANT_SPECULAR_MAP"},
+    {L3D_SHADER_NORMAL_MAP, "L3D_VARIANT_NORMAL_MAP"},
+    {L3D_SHADER_ALPHA_MAP, "L3D_VARIANT_ALPHA_MAP"},
+    {L3D_SHADER_INSTANCING, "L3D_VARIANT_INSTANCING"}};
+
+// Name included by a "#include" line, if it is one.
+static bool parseInclude(const std::string &line, std::string &name, bool &valid)
+{
+    size_t pos = line.find_first_not_of(" \t");
+
+    if (pos == std::string::npos || line[pos] != '#')
+        return false;
+
+    pos = line.find_first_not_of(" \t", pos + 1);
+
+    if (pos == std::string::npos || line.compare(pos, 7, "include") != 0)
+        return false;
+
+    size_t begin = line.find_first_of("\"<", pos + 7);
+    size_t end = (begin != std::string::npos) ? line.find_first_of(line[begin] == '<' ? ">" : "\"", begin + 1) : std::string::npos;
+
+    valid = end != std::string::npos && end > begin + 1;
+    if (valid)
+        name = line.substr(begin + 1, end - begin - 1);
+
+    return true;
+}
+
+static bool expandIncludes(
+    const std::string &source,
+    std::string &result,
+    L3DShaderIncludeCallback include,
+    void *userData,
+    unsigned int sourceNumber,
+    unsigned int depth,
+    std::vector<std::string> &included)
+{
+    std::istringstream stream(source);
+    std::string line;
+    unsigned int lineNumber = 0;
+
+    while (std::getline(stream, line))
+    {
+        std::string name;
+        bool valid = false;
+
+        ++lineNumber;
+
+        if (!parseInclude(line, name, valid))
+        {
+            result += line;
+            result += '\n';
+            continue;
+        }
+
+        if (!valid)
+        {
+            fprintf(stderr, "Shader include: malformed directive at line %u\n", lineNumber);
+            return false;
+        }
+
+        bool alreadyIncluded = false;
+        for (unsigned int i = 0; i < included.size() && !alreadyIncluded; ++i)
+            alreadyIncluded = included[i] == name;
+
+        if (alreadyIncluded)
+        {
+            // Keeps line numbers.
+            result += '\n';
+            continue;
+        }
+
+        if (depth >= L3D_SHADER_MAX_INCLUDE_DEPTH)
+        {
+            fprintf(stderr, "Shader include: %s nested too deeply\n", name.c_str());
+            return false;
+        }
+
+        std::string content;
+
+        if (!include || !include(name.c_str(), content, userData))
+        {
+            fprintf(stderr, "Shader include: can't load %s\n", name.c_str());
+            return false;
+        }
+
+        included.push_back(name);
+
+        std::ostringstream before;
+        before << "#line 1 " << included.size() << "\n";
+        result += before.str();
+
+        if (!expandIncludes(content, result, include, userData, included.size(), depth + 1, included))
+            return false;
+
+        std::ostringstream after;
+        after << "#line " << (lineNumber + 1) << " " << sourceNumber << "\n";
+        result += after.str();
+    }
+
+    return true;
+}
+
+bool L3DShaderPreprocessor::resolveIncludes(
+    const std::string &source,
+    std::string &result,
+    L3DShaderIncludeCallback include,
+    void *userData)
+{
+    std::vector<std::string> included;
+
+    result.clear();
+
+    // Sources without any include are left untouched.
+    if (source.find("include") == std::string::npos)
+    {
+        result = source;
+        return true;
+    }
+
+    return expandIncludes(source, result, include, userData, 0, 0, included);
+}
+
+std::string L3DShaderPreprocessor::addDefines(
+    const std::string &source,
+    const L3DShaderDefineList &defines)
+{
+    if (defines.empty())
+        return source;
+
+    // Defines go right after the #version directive, which must come
+    // first. Without it, they start the source.
+    size_t insertAt = 0;
+    unsigned int nextLine = 1;
+    size_t version = source.find("#version");
+
+    if (version != std::string::npos && source.find_first_not_of(" \t\r\n") == version)
+    {
+        size_t end = source.find('\n', version);
+        insertAt = (end != std::string::npos) ? end + 1 : source.size();
+
+        for (size_t i = 0; i < insertAt; ++i)
+        {
+            if (source[i] == '\n')
+                ++nextLine;
+        }
+    }
+
+    std::ostringstream header;
+
+    if (insertAt == source.size() && insertAt > 0 && source[insertAt - 1] != '\n')
+        header << "\n";
+
+    for (L3DShaderDefineList::const_iterator it = defines.begin(); it != defines.end(); ++it)
+        header << "#define " << *it << "\n";
+
+    header << "#line " << nextLine << "\n";
+
+    std::string result = source;
+    result.insert(insertAt, header.str());
+
+    return result;
+}
+
+bool L3DShaderPreprocessor::hasVariants(const char *source)
+{
+    return source && strstr(source, "L3D_VARIANT_") != L3D_NULLPTR;
+}
+
+void L3DShaderPreprocessor::variantDefines(unsigned int features, L3DShaderDefineList &defines)
+{
+    defines.clear();
+
+    for (unsigned int i = 0; i < sizeof(featureDefines) / sizeof(featureDefines[0]); ++i)
+    {
+        if (features & featureDefines[i].feature)
+            defines.push_back(featureDefines[i].define);
+    }
+
+    std::ostringstream lights;
+    lights << "L3D_VARIANT_MAX_LIGHTS " << maxLights(features);
+    defines.push_back(lights.str());
+}
+
+unsigned int L3DShaderPreprocessor::lightFeatures(unsigned int lightCount)
+{
+    // Buckets 0, 1, 2, 4... L3D_SHADER_MAX_LIGHTS.
+    unsigned int bucket = 0;
+
+    while (bucket < 7 && maxLights(bucket << L3D_SHADER_LIGHT_SHIFT) < lightCount && maxLights(bucket << L3D_SHADER_LIGHT_SHIFT) < L3D_SHADER_MAX_LIGHTS)
+        ++bucket;
+
+    return bucket << L3D_SHADER_LIGHT_SHIFT;
+}
+
+unsigned int L3DShaderPreprocessor::maxLights(unsigned int features)
+{
+    unsigned int bucket = (features & L3D_SHADER_LIGHT_MASK) >> L3D_SHADER_LIGHT_SHIFT;
+
+    return bucket ? 1u << (bucket - 1) : 0;
+}
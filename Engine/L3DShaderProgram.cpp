@@ -23,6 +23,7 @@
 #include <leaf3d/L3DRenderer.h>
 #include <leaf3d/L3DShader.h>
 #include <leaf3d/L3DShaderProgram.h>
+#include <leaf3d/L3DShaderPreprocessor.h>
 
 using namespace l3d;
 
@@ -52,68 +53,34 @@ L3DUniform::L3DUniform(bool value)
 
 L3DUniform::L3DUniform(const L3DVec2 &value)
 {
-    int size = value.length() * sizeof(float);
-    this->value.valueVec2 = (float *)malloc(size);
-    memcpy(this->value.valueVec2, glm::value_ptr(value), size);
+    memcpy(this->value.valueVec2, glm::value_ptr(value), sizeof(this->value.valueVec2));
     this->type = L3D_UNIFORM_VEC2;
 }
 
 L3DUniform::L3DUniform(const L3DVec3 &value)
 {
-    int size = value.length() * sizeof(float);
-    this->value.valueVec3 = (float *)malloc(size);
-    memcpy(this->value.valueVec3, glm::value_ptr(value), size);
+    memcpy(this->value.valueVec3, glm::value_ptr(value), sizeof(this->value.valueVec3));
     this->type = L3D_UNIFORM_VEC3;
 }
 
 L3DUniform::L3DUniform(const L3DVec4 &value)
 {
-    int size = value.length() * sizeof(float);
-    this->value.valueVec4 = (float *)malloc(size);
-    memcpy(this->value.valueVec4, glm::value_ptr(value), size);
+    memcpy(this->value.valueVec4, glm::value_ptr(value), sizeof(this->value.valueVec4));
     this->type = L3D_UNIFORM_VEC4;
 }
 
 L3DUniform::L3DUniform(const L3DMat3 &value)
 {
-    int size = value.length() * sizeof(float);
-    this->value.valueMat3 = (float *)malloc(size);
-    memcpy(this->value.valueMat3, glm::value_ptr(value), size);
+    memcpy(this->value.valueMat3, glm::value_ptr(value), sizeof(this->value.valueMat3));
     this->type = L3D_UNIFORM_MAT3;
 }
 
 L3DUniform::L3DUniform(const L3DMat4 &value)
 {
-    int size = value.length() * sizeof(float);
-    this->value.valueMat4 = (float *)malloc(size);
-    memcpy(this->value.valueMat4, glm::value_ptr(value), size);
+    memcpy(this->value.valueMat4, glm::value_ptr(value), sizeof(this->value.valueMat4));
     this->type = L3D_UNIFORM_MAT4;
 }
 
-/*L3DUniform::~L3DUniform()
-{
-    switch (this->type)
-    {
-    case L3D_UNIFORM_VEC2:
-        free(this->value.valueVec2);
-        break;
-    case L3D_UNIFORM_VEC3:
-        free(this->value.valueVec3);
-        break;
-    case L3D_UNIFORM_VEC4:
-        free(this->value.valueVec4);
-        break;
-    case L3D_UNIFORM_MAT3:
-        free(this->value.valueMat3);
-        break;
-    case L3D_UNIFORM_MAT4:
-        free(this->value.valueMat4);
-        break;
-    default:
-        break;
-    }
-}*/
-
 L3DShaderProgram::L3DShaderProgram(
     L3DRenderer *renderer,
     L3DShader *vertexShader,
@@ -125,10 +92,15 @@ L3DShaderProgram::L3DShaderProgram(
                                          m_fragmentShader(fragmentShader),
                                          m_geometryShader(geometryShader),
                                          m_uniforms(uniforms),
-                                         m_attributes(attributes)
+                                         m_attributes(attributes),
+                                         m_hasVariants(false)
 {
-    if (renderer)
-        renderer->addShaderProgram(this);
+    L3DShader *stages[] = {vertexShader, fragmentShader, geometryShader};
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        if (stages[i] && L3DShaderPreprocessor::hasVariants(stages[i]->code()))
+            m_hasVariants = true;
+    }
 
     if (m_attributes.empty())
     {
@@ -143,6 +115,10 @@ L3DShaderProgram::L3DShaderProgram(
         m_attributes[L3D_INSTANCE_UV] = "i_instanceUv";
         m_attributes[L3D_INSTANCE_MATRIX] = "i_instanceMat";
     }
+
+    // Attribute locations are bound at link time.
+    if (renderer)
+        renderer->addShaderProgram(this);
 }
 
 void L3DShaderProgram::setUniform(const char *name, const L3DUniform &value)
@@ -21,6 +21,7 @@
 
 #include <leaf3d/L3DTexture.h>
 #include <leaf3d/L3DRenderer.h>
+#include <leaf3d/L3DMemory.h>
 
 using namespace l3d;
 
@@ -38,7 +39,10 @@ L3DTexture::L3DTexture(
     const L3DImageMagFilter &magFilter,
     const L3DImageWrapMethod &wrapS,
     const L3DImageWrapMethod &wrapT,
-    const L3DImageWrapMethod &wrapR) : L3DResource(L3D_TEXTURE, renderer),
+    const L3DImageWrapMethod &wrapR,
+    unsigned int mipCount,
+    L3DReleaseCallback release,
+    void *releaseData) : L3DResource(L3D_TEXTURE, renderer),
                                        m_type(type),
                                        m_format(format),
                                        m_pixelFormat(pixelFormat),
@@ -46,38 +50,173 @@ L3DTexture::L3DTexture(
                                        m_width(width),
                                        m_height(height),
                                        m_depth(depth),
+                                       m_mipCount(mipCount ? mipCount : 1),
+                                       m_evictedLevels(0),
+                                       m_lastUsedFrame(0),
                                        m_useMipmap(mipmap),
                                        m_minFilter(minFilter),
                                        m_magFilter(magFilter),
                                        m_wrapS(wrapS),
                                        m_wrapT(wrapT),
-                                       m_wrapR(wrapR)
+                                       m_wrapR(wrapR),
+                                       m_residency(renderer ? renderer->residencyPolicy() : L3D_RESIDENCY_KEEP),
+                                       m_source(L3D_NULLPTR),
+                                       m_sourceData(L3D_NULLPTR),
+                                       m_release(L3D_NULLPTR),
+                                       m_releaseData(L3D_NULLPTR)
 {
-    if (data)
+    // Without a copy to keep, upload straight from the caller data.
+    if (data && release)
+    {
+        m_release = release;
+        m_releaseData = releaseData;
+    }
+    else if (data && m_residency == L3D_RESIDENCY_KEEP)
     {
         unsigned int size = this->size();
-        m_data = (unsigned char *)memcpy(malloc(size), data, size);
+        m_data = (unsigned char *)L3DMemory::duplicate(data, size, L3D_MEMORY_TEXTURES);
     }
 
     if (renderer)
         renderer->addTexture(this);
+
+    if (m_residency != L3D_RESIDENCY_KEEP && m_release)
+        this->discardData();
+    else if (m_residency != L3D_RESIDENCY_KEEP)
+        m_data = L3D_NULLPTR;
 }
 
 L3DTexture::~L3DTexture()
 {
-    free(m_data);
+    this->freeData();
+}
+
+void L3DTexture::freeData()
+{
+    if (m_release && m_data)
+        m_release(m_data, m_releaseData);
+    else
+        L3DMemory::deallocate(m_data);
+
+    m_release = L3D_NULLPTR;
+    m_releaseData = L3D_NULLPTR;
+}
+
+void L3DTexture::setImage(
+    const L3DImageFormat &format,
+    unsigned int width,
+    unsigned int height,
+    unsigned int mipCount)
+{
+    this->freeData();
+
+    m_data = L3D_NULLPTR;
+    m_format = format;
+    m_width = width;
+    m_height = height;
+    m_mipCount = mipCount ? mipCount : 1;
+    m_evictedLevels = 0;
 }
 
 unsigned int L3DTexture::size() const
 {
-    unsigned int size = m_width * sizeof(unsigned char);
+    return L3DTexture::dataSize(m_type, m_format, m_width, m_height, m_depth, m_mipCount);
+}
+
+void L3DTexture::setData(unsigned char *data)
+{
+    if (data != m_data)
+        this->freeData();
+
+    m_data = data;
+}
+
+void L3DTexture::discardData()
+{
+    this->setData(L3D_NULLPTR);
+}
+
+void L3DTexture::setSource(L3DReloadCallback source, void *userData)
+{
+    m_source = source;
+    m_sourceData = userData;
+}
+
+unsigned int L3DTexture::levelCount() const
+{
+    unsigned int levels = m_mipCount;
+
+    // Full chain generated by the driver.
+    if (levels == 1 && m_useMipmap && !L3DTexture::isCompressed(m_format))
+    {
+        unsigned int extent = m_width > m_height ? m_width : m_height;
+        while (extent >> levels)
+            ++levels;
+    }
+
+    return levels;
+}
+
+unsigned int L3DTexture::gpuSize(unsigned int evictedLevels) const
+{
+    unsigned int levels = this->levelCount();
+    unsigned int evicted = (evictedLevels < levels) ? evictedLevels : levels - 1;
+    unsigned int width = (m_width >> evicted) ? (m_width >> evicted) : 1;
+    unsigned int height = m_height ? ((m_height >> evicted) ? (m_height >> evicted) : 1) : 0;
+
+    // Drivers store 24-bit formats padded to 32 bits.
+    L3DImageFormat format = (m_format == L3D_RGB || m_format == L3D_DEPTH24_STENCIL8) ? L3D_RGBA : m_format;
+
+    return L3DTexture::dataSize(m_type, format, width, height, m_depth, levels - evicted);
+}
+
+unsigned int L3DTexture::dataSize(
+    const L3DTextureType &type,
+    const L3DImageFormat &format,
+    unsigned int width,
+    unsigned int height,
+    unsigned int depth,
+    unsigned int mipCount)
+{
+    unsigned int size = 0;
 
-    if (m_height)
-        size *= m_height;
-    if (m_depth)
-        size *= m_depth;
+    for (unsigned int level = 0; level < (mipCount ? mipCount : 1); ++level)
+    {
+        unsigned int levelDepth = (level < 32) ? depth >> level : 0;
+        size += L3DTexture::levelSize(format, width, height, level) * (depth ? (levelDepth ? levelDepth : 1) : 1);
+    }
 
-    switch (this->format())
+    // Cube maps has 6 faces: total size is 1 face' size * 6.
+    if (type == L3D_TEXTURE_CUBE_MAP)
+        size *= 6;
+
+    return size;
+}
+
+unsigned int L3DTexture::levelSize(
+    const L3DImageFormat &format,
+    unsigned int width,
+    unsigned int height,
+    unsigned int level)
+{
+    // Shifting by 32 bits or more is undefined.
+    width = (level < 32 && (width >> level)) ? (width >> level) : 1;
+    height = height ? ((level < 32 && (height >> level)) ? (height >> level) : 1) : 0;
+
+    if (L3DTexture::isCompressed(format))
+    {
+        unsigned int blocks = ((width + 3) / 4) * (height ? (height + 3) / 4 : 1);
+        bool smallBlocks = (format == L3D_BC1 || format == L3D_BC4);
+
+        return blocks * (smallBlocks ? 8 : 16); // bytes.
+    }
+
+    unsigned int size = width * sizeof(unsigned char);
+
+    if (height)
+        size *= height;
+
+    switch (format)
     {
     case L3D_RGB:
     case L3D_DEPTH24_STENCIL8:
@@ -90,9 +229,22 @@ unsigned int L3DTexture::size() const
         break;
     }
 
-    // Cube maps has 6 faces: total size is 1 face' size * 6.
-    if (m_type == L3D_TEXTURE_CUBE_MAP)
-        size *= 6;
-
     return size;
 }
+
+bool L3DTexture::isCompressed(const L3DImageFormat &format)
+{
+    switch (format)
+    {
+    case L3D_BC1:
+    case L3D_BC3:
+    case L3D_BC4:
+    case L3D_BC5:
+    case L3D_BC7:
+        return true;
+    default:
+        break;
+    }
+
+    return false;
+}
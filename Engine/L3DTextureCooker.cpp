@@ -0,0 +1,386 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <leaf3d/L3DTextureCooker.h>
+#include <leaf3d/L3DTexture.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define L3D_COOKER_SSE
+#endif
+
+using namespace l3d;
+
+#define L3D_SRGB_TABLE_SIZE 4096
+
+// Conversion tables between 8-bit sRGB and linear values.
+struct L3DColorTables
+{
+    float toLinear[256];
+    unsigned char toSRGB[L3D_SRGB_TABLE_SIZE];
+
+    L3DColorTables()
+    {
+        for (unsigned int i = 0; i < 256; ++i)
+        {
+            float c = i / 255.0f;
+            toLinear[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+
+        for (unsigned int i = 0; i < L3D_SRGB_TABLE_SIZE; ++i)
+        {
+            float c = i / (float)(L3D_SRGB_TABLE_SIZE - 1);
+            float s = (c <= 0.0031308f) ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+            toSRGB[i] = (unsigned char)(s * 255.0f + 0.5f);
+        }
+    }
+};
+
+static const L3DColorTables &colorTables()
+{
+    static const L3DColorTables tables;
+
+    return tables;
+}
+
+static unsigned int quantize(float value, unsigned int maxValue)
+{
+    value = (value < 0.0f) ? 0.0f : (value > 1.0f ? 1.0f : value);
+
+    return (unsigned int)(value * maxValue + 0.5f);
+}
+
+static void decodeLevel(const unsigned char *src, unsigned int count, float *dst, bool srgb)
+{
+    const L3DColorTables &tables = colorTables();
+
+    for (unsigned int i = 0; i < count; ++i, src += 4, dst += 4)
+    {
+        for (unsigned int c = 0; c < 3; ++c)
+            dst[c] = srgb ? tables.toLinear[src[c]] : src[c] / 255.0f;
+
+        dst[3] = src[3] / 255.0f;
+    }
+}
+
+static void encodeLevel(const float *src, unsigned int count, unsigned char *dst, bool srgb)
+{
+    const L3DColorTables &tables = colorTables();
+
+    for (unsigned int i = 0; i < count; ++i, src += 4, dst += 4)
+    {
+        for (unsigned int c = 0; c < 3; ++c)
+            dst[c] = srgb ? tables.toSRGB[quantize(src[c], L3D_SRGB_TABLE_SIZE - 1)] : quantize(src[c], 255);
+
+        dst[3] = quantize(src[3], 255);
+    }
+}
+
+// 2x2 box filter of linear RGBA texels, one texel per SSE register.
+// Odd rows and columns are clamped to the image.
+static void downsampleLevel(const float *src, unsigned int width, unsigned int height, float *dst)
+{
+    unsigned int dstWidth = (width > 1) ? width / 2 : 1;
+    unsigned int dstHeight = (height > 1) ? height / 2 : 1;
+
+#ifdef L3D_COOKER_SSE
+    const __m128 quarter = _mm_set1_ps(0.25f);
+#endif
+
+    for (unsigned int y = 0; y < dstHeight; ++y)
+    {
+        const float *row0 = src + (2 * y) * width * 4;
+        const float *row1 = src + ((2 * y + 1 < height) ? 2 * y + 1 : height - 1) * width * 4;
+
+        for (unsigned int x = 0; x < dstWidth; ++x, dst += 4)
+        {
+            unsigned int x0 = 2 * x * 4;
+            unsigned int x1 = ((2 * x + 1 < width) ? 2 * x + 1 : width - 1) * 4;
+
+#ifdef L3D_COOKER_SSE
+            __m128 sum = _mm_add_ps(
+                _mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+            _mm_storeu_ps(dst, _mm_mul_ps(sum, quarter));
+#else
+            for (unsigned int c = 0; c < 4; ++c)
+                dst[c] = 0.25f * (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]);
+#endif
+        }
+    }
+}
+
+static unsigned short toRGB565(const unsigned char *color)
+{
+    return ((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3);
+}
+
+static void fromRGB565(unsigned short value, int *color)
+{
+    int r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+static void writeLittleEndian(unsigned char *dst, unsigned long long value, unsigned int size)
+{
+    for (unsigned int i = 0; i < size; ++i)
+        dst[i] = (unsigned char)(value >> (8 * i));
+}
+
+// Color endpoints are the corners of the block bounding box.
+static void compressColorBlock(const unsigned char *block, unsigned char *dst)
+{
+    unsigned char minColor[3] = {255, 255, 255};
+    unsigned char maxColor[3] = {0, 0, 0};
+
+    for (unsigned int i = 0; i < 16; ++i)
+    {
+        for (unsigned int c = 0; c < 3; ++c)
+        {
+            minColor[c] = (block[i * 4 + c] < minColor[c]) ? block[i * 4 + c] : minColor[c];
+            maxColor[c] = (block[i * 4 + c] > maxColor[c]) ? block[i * 4 + c] : maxColor[c];
+        }
+    }
+
+    unsigned short color0 = toRGB565(maxColor);
+    unsigned short color1 = toRGB565(minColor);
+    unsigned int indices = 0;
+
+    // color0 > color1 selects the 4 colors mode.
+    if (color0 > color1)
+    {
+        int palette[4][3];
+        fromRGB565(color0, palette[0]);
+        fromRGB565(color1, palette[1]);
+
+        for (unsigned int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            unsigned int best = 0;
+            int bestDistance = 0x7fffffff;
+
+            for (unsigned int p = 0; p < 4; ++p)
+            {
+                int distance = 0;
+                for (unsigned int c = 0; c < 3; ++c)
+                    distance += (block[i * 4 + c] - palette[p][c]) * (block[i * 4 + c] - palette[p][c]);
+
+                if (distance < bestDistance)
+                {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+
+            indices |= best << (2 * i);
+        }
+    }
+
+    writeLittleEndian(dst, color0, 2);
+    writeLittleEndian(dst + 2, color1, 2);
+    writeLittleEndian(dst + 4, indices, 4);
+}
+
+static void compressAlphaBlock(const unsigned char *block, unsigned char *dst)
+{
+    unsigned char minAlpha = 255, maxAlpha = 0;
+
+    for (unsigned int i = 0; i < 16; ++i)
+    {
+        minAlpha = (block[i * 4 + 3] < minAlpha) ? block[i * 4 + 3] : minAlpha;
+        maxAlpha = (block[i * 4 + 3] > maxAlpha) ? block[i * 4 + 3] : maxAlpha;
+    }
+
+    unsigned long long indices = 0;
+
+    // alpha0 > alpha1 selects the 8 alphas mode.
+    if (maxAlpha > minAlpha)
+    {
+        int palette[8] = {maxAlpha, minAlpha};
+        for (unsigned int p = 2; p < 8; ++p)
+            palette[p] = ((8 - p) * maxAlpha + (p - 1) * minAlpha) / 7;
+
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            unsigned long long best = 0;
+            int bestDistance = 256;
+
+            for (unsigned int p = 0; p < 8; ++p)
+            {
+                int distance = abs(block[i * 4 + 3] - palette[p]);
+
+                if (distance < bestDistance)
+                {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+
+            indices |= best << (3 * i);
+        }
+    }
+
+    dst[0] = maxAlpha;
+    dst[1] = minAlpha;
+    writeLittleEndian(dst + 2, indices, 6);
+}
+
+bool L3DTextureCooker::cook(
+    const unsigned char *pixels,
+    unsigned int width,
+    unsigned int height,
+    unsigned int comp,
+    const L3DTextureCookOptions &options,
+    L3DTextureImage &image)
+{
+    if (!pixels || !width || !height || comp < 1 || comp > 4)
+        return false;
+
+    if (options.compression != L3D_UNKNOWN && options.compression != L3D_BC1 && options.compression != L3D_BC3)
+    {
+        fprintf(stderr, "Texture cooker: only BC1 and BC3 compression are supported\n");
+        return false;
+    }
+
+    unsigned int mipCount = 1;
+    if (options.generateMipmaps)
+    {
+        for (unsigned int size = (width > height) ? width : height; size > 1; size /= 2)
+            ++mipCount;
+    }
+
+    image.type = L3D_TEXTURE_2D;
+    image.format = (options.compression != L3D_UNKNOWN) ? options.compression : L3D_RGBA;
+    image.width = width;
+    image.height = height;
+    image.mipCount = mipCount;
+    image.data.resize(L3DTexture::dataSize(L3D_TEXTURE_2D, image.format, width, height, 0, mipCount));
+
+    // Pad texels to RGBA: grey and grey-alpha images are expanded too.
+    std::vector<unsigned char> texels(width * height * 4);
+    for (unsigned int i = 0; i < width * height; ++i)
+    {
+        const unsigned char *src = pixels + i * comp;
+        unsigned char *dst = &texels[i * 4];
+
+        dst[0] = src[0];
+        dst[1] = (comp >= 3) ? src[1] : src[0];
+        dst[2] = (comp >= 3) ? src[2] : src[0];
+        dst[3] = (comp == 4) ? src[3] : (comp == 2 ? src[1] : 255);
+    }
+
+    // Filter the chain from linear texels, re-encoding each level.
+    std::vector<float> level(width * height * 4);
+    std::vector<float> nextLevel;
+    decodeLevel(&texels[0], width * height, &level[0], options.srgb);
+
+    unsigned int offset = 0;
+    unsigned int levelWidth = width;
+    unsigned int levelHeight = height;
+
+    for (unsigned int i = 0; i < mipCount; ++i)
+    {
+        if (i > 0)
+            encodeLevel(&level[0], levelWidth * levelHeight, &texels[0], options.srgb);
+
+        if (image.format == L3D_RGBA)
+            memcpy(&image.data[offset], &texels[0], levelWidth * levelHeight * 4);
+        else
+            L3DTextureCooker::compress(&texels[0], levelWidth, levelHeight, image.format, &image.data[offset]);
+
+        offset += L3DTexture::levelSize(image.format, width, height, i);
+
+        if (i + 1 < mipCount)
+        {
+            nextLevel.resize(((levelWidth > 1) ? levelWidth / 2 : 1) * ((levelHeight > 1) ? levelHeight / 2 : 1) * 4);
+            downsampleLevel(&level[0], levelWidth, levelHeight, &nextLevel[0]);
+            level.swap(nextLevel);
+
+            levelWidth = (levelWidth > 1) ? levelWidth / 2 : 1;
+            levelHeight = (levelHeight > 1) ? levelHeight / 2 : 1;
+        }
+    }
+
+    return true;
+}
+
+void L3DTextureCooker::downsample(
+    const unsigned char *src,
+    unsigned int width,
+    unsigned int height,
+    unsigned char *dst,
+    bool srgb)
+{
+    unsigned int dstCount = ((width > 1) ? width / 2 : 1) * ((height > 1) ? height / 2 : 1);
+    std::vector<float> level(width * height * 4);
+    std::vector<float> nextLevel(dstCount * 4);
+
+    decodeLevel(src, width * height, &level[0], srgb);
+    downsampleLevel(&level[0], width, height, &nextLevel[0]);
+    encodeLevel(&nextLevel[0], dstCount, dst, srgb);
+}
+
+void L3DTextureCooker::compress(
+    const unsigned char *src,
+    unsigned int width,
+    unsigned int height,
+    const L3DImageFormat &format,
+    unsigned char *dst)
+{
+    unsigned char block[16 * 4];
+
+    for (unsigned int by = 0; by < height; by += 4)
+    {
+        for (unsigned int bx = 0; bx < width; bx += 4)
+        {
+            // Edge blocks repeat the last row and column.
+            for (unsigned int i = 0; i < 16; ++i)
+            {
+                unsigned int x = (bx + i % 4 < width) ? bx + i % 4 : width - 1;
+                unsigned int y = (by + i / 4 < height) ? by + i / 4 : height - 1;
+
+                memcpy(&block[i * 4], src + (y * width + x) * 4, 4);
+            }
+
+            if (format == L3D_BC3)
+            {
+                compressAlphaBlock(block, dst);
+                dst += 8;
+            }
+
+            compressColorBlock(block, dst);
+            dst += 8;
+        }
+    }
+}
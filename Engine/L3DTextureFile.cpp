@@ -0,0 +1,456 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <leaf3d/L3DTextureFile.h>
+#include <leaf3d/L3DTexture.h>
+#include <leaf3d/L3DMeshFile.h>
+
+using namespace l3d;
+
+static const unsigned char s_ktxIdentifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+struct L3DKTXHeader
+{
+    uint8_t identifier[12];
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+struct L3DDDSPixelFormat
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t rBitMask;
+    uint32_t gBitMask;
+    uint32_t bBitMask;
+    uint32_t aBitMask;
+};
+
+struct L3DDDSHeader
+{
+    uint32_t magic;
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    L3DDDSPixelFormat pixelFormat;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+
+struct L3DDDSHeaderDX10
+{
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+#define L3D_DDS_MAGIC 0x20534444 // "DDS "
+#define L3D_DDSD_MIPMAPCOUNT 0x20000
+#define L3D_DDPF_FOURCC 0x4
+#define L3D_DDPF_RGB 0x40
+#define L3D_DDSCAPS2_CUBEMAP 0x200
+#define L3D_DDSCAPS2_CUBEMAP_ALLFACES 0xFC00
+#define L3D_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+static L3DImageFormat formatFromGL(uint32_t internalFormat)
+{
+    switch (internalFormat)
+    {
+    case 0x8058: // GL_RGBA8
+        return L3D_RGBA;
+    case 0x83F0: // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    case 0x83F1: // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+        return L3D_BC1;
+    case 0x83F3: // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+        return L3D_BC3;
+    case 0x8DBB: // GL_COMPRESSED_RED_RGTC1
+        return L3D_BC4;
+    case 0x8DBD: // GL_COMPRESSED_RG_RGTC2
+        return L3D_BC5;
+    case 0x8E8C: // GL_COMPRESSED_RGBA_BPTC_UNORM
+        return L3D_BC7;
+    default:
+        break;
+    }
+
+    return L3D_UNKNOWN;
+}
+
+static uint32_t formatToGL(const L3DImageFormat &format)
+{
+    switch (format)
+    {
+    case L3D_RGBA:
+        return 0x8058; // GL_RGBA8
+    case L3D_BC1:
+        return 0x83F1; // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+    case L3D_BC3:
+        return 0x83F3; // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    case L3D_BC4:
+        return 0x8DBB; // GL_COMPRESSED_RED_RGTC1
+    case L3D_BC5:
+        return 0x8DBD; // GL_COMPRESSED_RG_RGTC2
+    case L3D_BC7:
+        return 0x8E8C; // GL_COMPRESSED_RGBA_BPTC_UNORM
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+static L3DImageFormat formatFromDXGI(uint32_t dxgiFormat)
+{
+    switch (dxgiFormat)
+    {
+    case 28: // DXGI_FORMAT_R8G8B8A8_UNORM
+        return L3D_RGBA;
+    case 71: // DXGI_FORMAT_BC1_UNORM
+        return L3D_BC1;
+    case 77: // DXGI_FORMAT_BC3_UNORM
+        return L3D_BC3;
+    case 80: // DXGI_FORMAT_BC4_UNORM
+        return L3D_BC4;
+    case 83: // DXGI_FORMAT_BC5_UNORM
+        return L3D_BC5;
+    case 98: // DXGI_FORMAT_BC7_UNORM
+        return L3D_BC7;
+    default:
+        break;
+    }
+
+    return L3D_UNKNOWN;
+}
+
+static L3DImageFormat formatFromDDS(const L3DDDSPixelFormat &pixelFormat)
+{
+    if (pixelFormat.flags & L3D_DDPF_FOURCC)
+    {
+        switch (pixelFormat.fourCC)
+        {
+        case L3D_FOURCC('D', 'X', 'T', '1'):
+            return L3D_BC1;
+        case L3D_FOURCC('D', 'X', 'T', '5'):
+            return L3D_BC3;
+        case L3D_FOURCC('A', 'T', 'I', '1'):
+        case L3D_FOURCC('B', 'C', '4', 'U'):
+            return L3D_BC4;
+        case L3D_FOURCC('A', 'T', 'I', '2'):
+        case L3D_FOURCC('B', 'C', '5', 'U'):
+            return L3D_BC5;
+        default:
+            break;
+        }
+    }
+    else if ((pixelFormat.flags & L3D_DDPF_RGB) && pixelFormat.rgbBitCount == 32 &&
+             pixelFormat.rBitMask == 0x000000ff && pixelFormat.gBitMask == 0x0000ff00 && pixelFormat.bBitMask == 0x00ff0000)
+    {
+        return L3D_RGBA;
+    }
+
+    return L3D_UNKNOWN;
+}
+
+// Levels of a full mip chain, down to 1x1.
+static unsigned int maxMipCount(unsigned int width, unsigned int height)
+{
+    unsigned int count = 1;
+    for (unsigned int size = (width > height) ? width : height; size > 1; size /= 2)
+        ++count;
+
+    return count;
+}
+
+// Size of a face mip chain, in 64 bits: dimensions come from the file and
+// may overflow L3DTexture::dataSize().
+static unsigned long long chainSize(
+    const L3DImageFormat &format,
+    unsigned int width,
+    unsigned int height,
+    unsigned int mipCount)
+{
+    // A pixel (or 4x4 block when compressed) size.
+    unsigned long long unitSize = L3DTexture::levelSize(format, 1, 1);
+    bool compressed = L3DTexture::isCompressed(format);
+    unsigned long long size = 0;
+
+    for (unsigned int level = 0; level < mipCount; ++level)
+    {
+        unsigned long long levelWidth = (width >> level) ? (width >> level) : 1;
+        unsigned long long levelHeight = (height >> level) ? (height >> level) : 1;
+
+        if (compressed)
+            size += ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * unitSize;
+        else
+            size += levelWidth * levelHeight * unitSize;
+    }
+
+    return size;
+}
+
+static std::string lowerExtension(const std::string &path)
+{
+    std::string::size_type dot = path.find_last_of('.');
+    std::string extension = (dot == std::string::npos) ? "" : path.substr(dot + 1);
+
+    for (unsigned int i = 0; i < extension.size(); ++i)
+        extension[i] = tolower(extension[i]);
+
+    return extension;
+}
+
+bool L3DTextureFile::isContainer(const std::string &path)
+{
+    std::string extension = lowerExtension(path);
+
+    return extension == "ktx" || extension == "dds";
+}
+
+bool L3DTextureFile::load(const std::string &path, L3DTextureImage &image)
+{
+    L3DMappedFile file;
+
+    if (!file.open(path))
+    {
+        fprintf(stderr, "Failed to open texture %s\n", path.c_str());
+        return false;
+    }
+
+    bool loaded = (lowerExtension(path) == "ktx")
+                      ? L3DTextureFile::loadKTX(file.data(), file.size(), image)
+                      : L3DTextureFile::loadDDS(file.data(), file.size(), image);
+
+    if (!loaded)
+        fprintf(stderr, "Failed to load texture %s: unsupported or invalid\n", path.c_str());
+
+    return loaded;
+}
+
+bool L3DTextureFile::loadKTX(const unsigned char *data, unsigned int size, L3DTextureImage &image)
+{
+    if (size < sizeof(L3DKTXHeader))
+        return false;
+
+    L3DKTXHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    // Only files written in native (little-endian) order.
+    if (memcmp(header.identifier, s_ktxIdentifier, sizeof(s_ktxIdentifier)) != 0 || header.endianness != 0x04030201)
+        return false;
+
+    if (header.pixelDepth > 1 || header.numberOfArrayElements > 1 || (header.numberOfFaces != 1 && header.numberOfFaces != 6))
+        return false;
+
+    image.type = (header.numberOfFaces == 6) ? L3D_TEXTURE_CUBE_MAP : L3D_TEXTURE_2D;
+    image.format = formatFromGL(header.glInternalFormat);
+    image.width = header.pixelWidth;
+    image.height = header.pixelHeight ? header.pixelHeight : 1;
+    image.mipCount = header.numberOfMipmapLevels ? header.numberOfMipmapLevels : 1;
+
+    if (image.format == L3D_UNKNOWN || !image.width || image.mipCount > maxMipCount(image.width, image.height))
+        return false;
+
+    // The file holds the whole image at least: sizes below fit 32 bits.
+    if (chainSize(image.format, image.width, image.height, image.mipCount) * header.numberOfFaces > size)
+        return false;
+
+    unsigned int faceSize = L3DTexture::dataSize(L3D_TEXTURE_2D, image.format, image.width, image.height, 0, image.mipCount);
+    image.data.resize(faceSize * header.numberOfFaces);
+
+    // KTX stores faces inside each level: reorder them face by face.
+    unsigned long long offset = sizeof(L3DKTXHeader) + (unsigned long long)header.bytesOfKeyValueData;
+    unsigned int levelOffset = 0;
+
+    for (unsigned int level = 0; level < image.mipCount; ++level)
+    {
+        unsigned int levelSize = L3DTexture::levelSize(image.format, image.width, image.height, level);
+
+        if (offset + 4 > size)
+            return false;
+        offset += 4; // imageSize.
+
+        for (unsigned int face = 0; face < header.numberOfFaces; ++face)
+        {
+            if (offset + levelSize > size)
+                return false;
+
+            memcpy(&image.data[face * faceSize + levelOffset], data + offset, levelSize);
+            offset += (levelSize + 3) & ~3u; // cubePadding.
+        }
+
+        offset = (offset + 3) & ~3ull; // mipPadding.
+        levelOffset += levelSize;
+    }
+
+    return true;
+}
+
+bool L3DTextureFile::loadDDS(const unsigned char *data, unsigned int size, L3DTextureImage &image)
+{
+    if (size < sizeof(L3DDDSHeader))
+        return false;
+
+    L3DDDSHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != L3D_DDS_MAGIC || header.size != 124 || header.depth > 1)
+        return false;
+
+    unsigned int offset = sizeof(L3DDDSHeader);
+
+    if ((header.pixelFormat.flags & L3D_DDPF_FOURCC) && header.pixelFormat.fourCC == L3D_FOURCC('D', 'X', '1', '0'))
+    {
+        if (size < offset + sizeof(L3DDDSHeaderDX10))
+            return false;
+
+        L3DDDSHeaderDX10 extended;
+        memcpy(&extended, data + offset, sizeof(extended));
+        offset += sizeof(L3DDDSHeaderDX10);
+
+        if (extended.arraySize > 1)
+            return false;
+
+        image.format = formatFromDXGI(extended.dxgiFormat);
+    }
+    else
+    {
+        image.format = formatFromDDS(header.pixelFormat);
+    }
+
+    bool cubeMap = (header.caps2 & L3D_DDSCAPS2_CUBEMAP) != 0;
+
+    if (cubeMap && (header.caps2 & L3D_DDSCAPS2_CUBEMAP_ALLFACES) != L3D_DDSCAPS2_CUBEMAP_ALLFACES)
+        return false;
+
+    image.type = cubeMap ? L3D_TEXTURE_CUBE_MAP : L3D_TEXTURE_2D;
+    image.width = header.width;
+    image.height = header.height;
+    image.mipCount = ((header.flags & L3D_DDSD_MIPMAPCOUNT) && header.mipMapCount) ? header.mipMapCount : 1;
+
+    if (image.format == L3D_UNKNOWN || !image.width || !image.height || image.mipCount > maxMipCount(image.width, image.height))
+        return false;
+
+    // DDS already stores the levels face by face.
+    unsigned long long dataSize = chainSize(image.format, image.width, image.height, image.mipCount) * (cubeMap ? 6 : 1);
+
+    if (offset + dataSize > size)
+        return false;
+
+    image.data.assign(data + offset, data + offset + dataSize);
+
+    return true;
+}
+
+bool L3DTextureFile::writeKTX(const std::string &path, const L3DTextureImage &image)
+{
+    unsigned int faceCount = (image.type == L3D_TEXTURE_CUBE_MAP) ? 6 : 1;
+    unsigned int mipCount = image.mipCount ? image.mipCount : 1;
+    unsigned int faceSize = L3DTexture::dataSize(L3D_TEXTURE_2D, image.format, image.width, image.height, 0, mipCount);
+    bool compressed = L3DTexture::isCompressed(image.format);
+
+    if (!formatToGL(image.format) || (image.type != L3D_TEXTURE_2D && image.type != L3D_TEXTURE_CUBE_MAP) || image.data.size() != faceSize * faceCount)
+    {
+        fprintf(stderr, "Texture file %s: unsupported image\n", path.c_str());
+        return false;
+    }
+
+    L3DKTXHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.identifier, s_ktxIdentifier, sizeof(s_ktxIdentifier));
+    header.endianness = 0x04030201;
+    header.glType = compressed ? 0 : 0x1401; // GL_UNSIGNED_BYTE
+    header.glTypeSize = 1;
+    header.glFormat = compressed ? 0 : 0x1908; // GL_RGBA
+    header.glInternalFormat = formatToGL(image.format);
+    header.glBaseInternalFormat = 0x1908; // GL_RGBA
+    header.pixelWidth = image.width;
+    header.pixelHeight = image.height;
+    header.numberOfFaces = faceCount;
+    header.numberOfMipmapLevels = mipCount;
+
+    // Write aside and rename, so that readers never map a partial file.
+    std::string tmpPath = path + ".tmp";
+    FILE *file = fopen(tmpPath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    unsigned int levelOffset = 0;
+    const unsigned char padding[4] = {0, 0, 0, 0};
+
+    for (unsigned int level = 0; ok && level < mipCount; ++level)
+    {
+        uint32_t levelSize = L3DTexture::levelSize(image.format, image.width, image.height, level);
+        ok = fwrite(&levelSize, sizeof(levelSize), 1, file) == 1;
+
+        for (unsigned int face = 0; ok && face < faceCount; ++face)
+        {
+            ok = fwrite(&image.data[face * faceSize + levelOffset], 1, levelSize, file) == levelSize;
+
+            if (ok && (levelSize & 3))
+                ok = fwrite(padding, 1, 4 - (levelSize & 3), file) == 4 - (levelSize & 3);
+        }
+
+        levelOffset += levelSize;
+    }
+
+    ok = (fclose(file) == 0) && ok;
+
+    if (ok)
+    {
+        remove(path.c_str());
+        ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+
+    if (!ok)
+    {
+        fprintf(stderr, "Texture file %s: write failed\n", path.c_str());
+        remove(tmpPath.c_str());
+    }
+
+    return ok;
+}
@@ -0,0 +1,224 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <leaf3d/L3DTrace.h>
+
+using namespace l3d;
+
+std::atomic<bool> L3DTrace::s_enabled(false);
+
+static std::mutex s_mutex;
+static std::vector<L3DTraceBuffer *> s_buffers;
+static std::string s_path;
+static std::atomic<double> s_start(0.0);
+// Bumped by each start(), so that buffers know their events are stale.
+static std::atomic<unsigned int> s_generation(0);
+
+static thread_local L3DTraceBuffer *s_threadBuffer = L3D_NULLPTR;
+static thread_local std::string s_threadName;
+
+static double now()
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void writeString(FILE *file, const char *str)
+{
+    fputc('"', file);
+
+    for (; *str; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', file);
+
+        if ((unsigned char)*str >= 0x20)
+            fputc(*str, file);
+    }
+
+    fputc('"', file);
+}
+
+bool L3DTrace::start(const char *path)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    if (s_enabled)
+    {
+        fprintf(stderr, "L3DTrace: already recording to %s\n", s_path.c_str());
+        return false;
+    }
+
+    // Other threads may be recording: they empty their own buffers.
+    s_path = path;
+    s_start = now();
+    s_generation.fetch_add(1, std::memory_order_release);
+    s_enabled = true;
+
+    return true;
+}
+
+bool L3DTrace::stop()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    if (!s_enabled)
+        return false;
+
+    s_enabled = false;
+
+    FILE *file = fopen(s_path.c_str(), "w");
+    if (!file)
+    {
+        fprintf(stderr, "L3DTrace: failed to write %s\n", s_path.c_str());
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    unsigned int generation = s_generation.load(std::memory_order_relaxed);
+
+    bool first = true;
+    for (std::vector<L3DTraceBuffer *>::iterator it = s_buffers.begin(); it != s_buffers.end(); ++it)
+    {
+        L3DTraceBuffer *buffer = *it;
+
+        // Threads which didn't record during this trace.
+        if (buffer->generation.load(std::memory_order_acquire) != generation)
+            continue;
+
+        // Events published before recording stopped.
+        unsigned int count = buffer->count.load(std::memory_order_acquire);
+
+        if (count == 0)
+            continue;
+
+        if (!buffer->threadName.empty())
+        {
+            fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",", buffer->threadId);
+            writeString(file, buffer->threadName.c_str());
+            fprintf(file, "}}");
+            first = false;
+        }
+
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            const L3DTraceEvent &event = buffer->events[i];
+
+            fprintf(file, "%s\n{\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u", first ? "" : ",", event.phase, event.time, buffer->threadId);
+            if (event.phase == 'B')
+            {
+                fprintf(file, ",\"name\":");
+                writeString(file, event.name);
+            }
+            fprintf(file, "}");
+            first = false;
+        }
+
+        unsigned int dropped = buffer->dropped.load(std::memory_order_relaxed);
+        if (dropped > 0)
+            fprintf(stderr, "L3DTrace: %u events of thread %u dropped\n", dropped, buffer->threadId);
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    return true;
+}
+
+void L3DTrace::beginEvent(const char *name)
+{
+    L3DTrace::record(name, 'B');
+}
+
+void L3DTrace::endEvent()
+{
+    L3DTrace::record("", 'E');
+}
+
+void L3DTrace::setThreadName(const char *name)
+{
+    // The buffer is only allocated when the thread records its first event.
+    s_threadName = name;
+
+    if (s_threadBuffer)
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_threadBuffer->threadName = name;
+    }
+}
+
+L3DTraceBuffer *L3DTrace::threadBuffer()
+{
+    if (!s_threadBuffer)
+    {
+        L3DTraceBuffer *buffer = new L3DTraceBuffer();
+        buffer->generation = 0;
+        buffer->count = 0;
+        buffer->dropped = 0;
+        buffer->threadName = s_threadName;
+
+        std::lock_guard<std::mutex> lock(s_mutex);
+        buffer->threadId = s_buffers.size() + 1;
+        s_buffers.push_back(buffer);
+        s_threadBuffer = buffer;
+    }
+
+    return s_threadBuffer;
+}
+
+void L3DTrace::record(const char *name, char phase)
+{
+    L3DTraceBuffer *buffer = L3DTrace::threadBuffer();
+    unsigned int generation = s_generation.load(std::memory_order_acquire);
+
+    // First event of a new trace.
+    if (buffer->generation.load(std::memory_order_relaxed) != generation)
+    {
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+        buffer->generation.store(generation, std::memory_order_release);
+    }
+
+    unsigned int count = buffer->count.load(std::memory_order_relaxed);
+
+    if (count >= L3D_TRACE_BUFFER_SIZE)
+    {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    L3DTraceEvent &event = buffer->events[count];
+    strncpy(event.name, name, L3D_TRACE_NAME_SIZE - 1);
+    event.name[L3D_TRACE_NAME_SIZE - 1] = '\0';
+    event.phase = phase;
+    event.time = now() - s_start.load(std::memory_order_relaxed);
+
+    // A trace started meanwhile: the event belongs to the previous one.
+    if (s_generation.load(std::memory_order_acquire) != generation)
+        return;
+
+    buffer->count.store(count + 1, std::memory_order_release);
+}
@@ -21,8 +21,14 @@
 
 #include <stdio.h>
 #include <sstream>
+#include <future>
+#include <memory>
+#include <vector>
+#include <functional>
 #include <leaf3d/leaf3d.h>
 #include <leaf3d/L3DRenderer.h>
+#include <leaf3d/L3DContext.h>
+#include <leaf3d/L3DBuffer.h>
 #include <leaf3d/L3DTexture.h>
 #include <leaf3d/L3DShader.h>
 #include <leaf3d/L3DShaderProgram.h>
@@ -39,10 +45,36 @@
 #include <leaf3d/L3DSetDepthTestCommand.h>
 #include <leaf3d/L3DSetDepthMaskCommand.h>
 #include <leaf3d/L3DDrawMeshesCommand.h>
+#include <leaf3d/L3DTrace.h>
+#include <leaf3d/L3DMemory.h>
 
 using namespace l3d;
 
-static L3DRenderer *s_renderer = L3D_NULLPTR;
+static L3DRenderer *currentRenderer()
+{
+    L3DContext *context = L3DContext::current();
+
+    return context ? context->renderer() : L3D_NULLPTR;
+}
+
+// Calls made off the render thread are queued: the render thread executes
+// them, in order, at the beginning of the next frame.
+#define L3D_DEFER_CALL(call)               \
+    if (!renderer->isRenderThread())       \
+    {                                      \
+        renderer->enqueueCall(call);       \
+        return;                            \
+    }
+
+// Queries made off the render thread wait for the render thread to run them.
+#define L3D_DEFER_QUERY(type, call)        \
+    if (!renderer->isRenderThread())       \
+        return deferQuery<type>(renderer, call);
+
+// Loads made off the render thread return a reserved handle immediately.
+#define L3D_DEFER_LOAD(resourceType, call) \
+    if (!renderer->isRenderThread())       \
+        return deferLoad(renderer, resourceType, call);
 
 static const char *s_defaultScreenVertexShader = GLSL(
     in vec2 i_position;
@@ -65,6 +97,47 @@ static const char *s_defaultScreenFragmentShader = GLSL(
         fragColor = vec4(texture(u_diffuseMap, o_texcoord0).rgb, 1);
     });
 
+template <typename T>
+static T deferQuery(
+    L3DRenderer *renderer,
+    const std::function<T()> &query)
+{
+    std::promise<T> promise;
+    std::future<T> result = promise.get_future();
+
+    renderer->enqueueCall([&promise, &query]() { promise.set_value(query()); });
+
+    return result.get();
+}
+
+static L3DHandle deferLoad(
+    L3DRenderer *renderer,
+    const L3DResourceType &type,
+    const std::function<L3DHandle()> &load)
+{
+    L3DHandle reserved = renderer->reserveHandle(type);
+
+    renderer->enqueueCall([renderer, type, load, reserved]() {
+        unsigned int handleCount = renderer->handleCount(type);
+        L3DHandle handle = load();
+
+        if (handle.repr == L3D_INVALID_HANDLE.repr)
+            return;
+
+        // A resource registered before the load (e.g. a shader with the
+        // same source) keeps its handle for its other users.
+        unsigned short int firstId = (unsigned short int)(handleCount + 1);
+        bool created = (unsigned short int)(handle.data.id - firstId) < renderer->handleCount(type) - handleCount;
+
+        if (created)
+            renderer->rebindResource(handle, reserved);
+        else
+            renderer->aliasResource(handle, reserved);
+    });
+
+    return reserved;
+}
+
 static const std::string getUniformName(const char *name, int index)
 {
     std::string _name(name);
@@ -79,12 +152,50 @@ static const std::string getUniformName(const char *name, int index)
     return _name;
 }
 
-int l3dInit()
+L3DContext *l3dCreateContext()
+{
+    return new L3DContext();
+}
+
+int l3dDestroyContext(L3DContext *context)
 {
-    if (s_renderer == L3D_NULLPTR)
+    if (context == L3D_NULLPTR)
+        return -1;
+
+    delete context;
+
+    return L3D_TRUE;
+}
+
+int l3dMakeCurrent(L3DContext *context)
+{
+    L3DContext::makeCurrent(context);
+
+    return L3D_TRUE;
+}
+
+L3DContext *l3dCurrentContext()
+{
+    return L3DContext::current();
+}
+
+int l3dInit(int workerCount)
+{
+    L3DContext *context = L3DContext::current();
+
+    // No context: create the default one.
+    if (context == L3D_NULLPTR)
+    {
+        context = new L3DContext();
+        L3DContext::setDefaultContext(context);
+        L3DContext::makeCurrent(context);
+    }
+
+    if (context->renderer() == L3D_NULLPTR)
     {
-        s_renderer = new L3DRenderer();
-        return s_renderer->init();
+        L3DRenderer *renderer = new L3DRenderer();
+        context->setRenderer(renderer);
+        return renderer->init(workerCount);
     }
 
     return L3D_TRUE;
@@ -92,9 +203,22 @@ int l3dInit()
 
 int l3dTerminate()
 {
-    delete s_renderer;
+    L3DContext *context = L3DContext::current();
 
-    s_renderer = L3D_NULLPTR;
+    if (context == L3D_NULLPTR)
+        return L3D_TRUE;
+
+    if (context == L3DContext::defaultContext())
+    {
+        delete context;
+
+        // Other contexts may still own resources.
+        L3DMemory::reportLeaks();
+    }
+    else
+    {
+        context->setRenderer(L3D_NULLPTR);
+    }
 
     return L3D_TRUE;
 }
@@ -103,11 +227,130 @@ void l3dRenderFrame(
     const L3DHandle &camera,
     const L3DHandle &renderQueue)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    s_renderer->renderFrame(
-        s_renderer->getCamera(camera),
-        s_renderer->getRenderQueue(renderQueue));
+    renderer->renderFrame(
+        renderer->getCamera(camera),
+        renderer->getRenderQueue(renderQueue));
+}
+
+int l3dBeginPipelinedRendering(
+    L3DContextCallback acquireContext,
+    L3DContextCallback releaseContext,
+    L3DContextCallback presentFrame,
+    void *userData,
+    unsigned int queueDepth)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    return renderer->beginPipelinedRendering(
+        queueDepth,
+        acquireContext,
+        releaseContext,
+        presentFrame,
+        userData);
+}
+
+int l3dEndPipelinedRendering()
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    return renderer->endPipelinedRendering();
+}
+
+void l3dSetLodBias(float bias)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetLodBias, bias));
+
+    renderer->setLodBias(bias);
+}
+
+void l3dEnableProfiler(bool enable)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dEnableProfiler, enable));
+
+    renderer->profiler()->setEnabled(enable);
+}
+
+unsigned int l3dGetProfile(
+    L3DProfileEntry *entries,
+    unsigned int maxCount)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    // The profiler has its own lock.
+    return renderer->profiler()->profile(entries, maxCount);
+}
+
+L3DFrameStats l3dGetFrameStats()
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    return renderer->renderStats().stats();
+}
+
+L3DMemoryStats l3dGetMemoryStats()
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_QUERY(L3DMemoryStats, std::bind(l3dGetMemoryStats));
+
+    return renderer->memoryStats();
+}
+
+void l3dSetTextureBudget(unsigned long long bytes)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetTextureBudget, bytes));
+
+    renderer->setTextureBudget(bytes);
+}
+
+void l3dSetResidencyPolicy(const L3DResidencyPolicy &policy)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetResidencyPolicy, policy));
+
+    renderer->setResidencyPolicy(policy);
+}
+
+int l3dSetAllocator(const L3DAllocator *allocator)
+{
+    return L3DMemory::setAllocator(allocator) ? L3D_TRUE : -1;
+}
+
+L3DAllocationStats l3dGetAllocationStats()
+{
+    return L3DMemory::stats();
+}
+
+int l3dTraceBegin(const char *path)
+{
+    L3D_ASSERT(path != L3D_NULLPTR);
+
+    // Not bound to a context: no need to defer.
+    return L3DTrace::start(path) ? L3D_TRUE : -1;
+}
+
+int l3dTraceEnd()
+{
+    return L3DTrace::stop() ? L3D_TRUE : -1;
 }
 
 L3DHandle l3dLoadForwardRenderQueue(
@@ -116,43 +359,46 @@ L3DHandle l3dLoadForwardRenderQueue(
     const L3DVec4 &clearColor,
     const L3DHandle &screenFragmentShader)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_LOAD(L3D_RENDER_QUEUE, std::bind(l3dLoadForwardRenderQueue, width, height, clearColor, screenFragmentShader));
 
     L3DRenderQueue *renderQueue = new L3DRenderQueue(
-        s_renderer,
+        renderer,
         "ForwardRendering");
 
     // A. Init framebuffer.
-    L3DTexture *frameBufferColorTexture = new L3DTexture(s_renderer, L3D_TEXTURE_2D, L3D_RGB, 0, width, height, 0);
+    L3DTexture *frameBufferColorTexture = new L3DTexture(renderer, L3D_TEXTURE_2D, L3D_RGB, 0, width, height, 0);
 
     L3DFrameBuffer *backendBuffer = new L3DFrameBuffer(
-        s_renderer,
-        new L3DTexture(s_renderer, L3D_TEXTURE_2D, L3D_DEPTH24_STENCIL8, 0, width, height, 0, false, L3D_UNSIGNED_INT_24_8),
+        renderer,
+        new L3DTexture(renderer, L3D_TEXTURE_2D, L3D_DEPTH24_STENCIL8, 0, width, height, 0, false, L3D_UNSIGNED_INT_24_8),
         frameBufferColorTexture);
 
     // B. Init fullscreen quad.
     L3DShader *fsQuadVertexShader = new L3DShader(
-        s_renderer,
+        renderer,
         L3D_SHADER_VERTEX,
         s_defaultScreenVertexShader);
 
-    L3DShader *fsQuadFragmentShader = s_renderer->getShader(screenFragmentShader);
+    L3DShader *fsQuadFragmentShader = renderer->getShader(screenFragmentShader);
 
     if (!fsQuadFragmentShader)
     {
         fsQuadFragmentShader = new L3DShader(
-            s_renderer,
+            renderer,
             L3D_SHADER_FRAGMENT,
             s_defaultScreenFragmentShader);
     }
 
     L3DShaderProgram *fsQuadShaderProgram = new L3DShaderProgram(
-        s_renderer,
+        renderer,
         fsQuadVertexShader,
         fsQuadFragmentShader);
 
     L3DMaterial *fsQuadMaterial = new L3DMaterial(
-        s_renderer,
+        renderer,
         "Fullscreen Quad",
         fsQuadShaderProgram,
         L3DColorRegistry(),
@@ -176,7 +422,7 @@ L3DHandle l3dLoadForwardRenderQueue(
         2, 3, 0};
 
     L3DMesh *fsQuad = new L3DMesh(
-        s_renderer,
+        renderer,
         vertices, 4,
         indices, 6,
         fsQuadMaterial,
@@ -246,12 +492,115 @@ L3DHandle l3dLoadTexture(
     const L3DImageMagFilter &magFilter,
     const L3DImageWrapMethod &wrapS,
     const L3DImageWrapMethod &wrapT,
-    const L3DImageWrapMethod &wrapR)
+    const L3DImageWrapMethod &wrapR,
+    unsigned int mipCount)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        // Caller data may be released before the call runs: copy it.
+        unsigned int size = data ? L3DTexture::dataSize(type, format, width, height, depth, mipCount) : 0;
+        std::shared_ptr<std::vector<unsigned char> > pixels(new std::vector<unsigned char>(data, data + size));
+
+        return deferLoad(renderer, L3D_TEXTURE, [=]() {
+            return l3dLoadTexture(type, format, pixels->empty() ? L3D_NULLPTR : &(*pixels)[0], width, height, depth, mipmap, pixelFormat, minFilter, magFilter, wrapS, wrapT, wrapR, mipCount);
+        });
+    }
+
+    L3DTexture *texture = new L3DTexture(
+        renderer,
+        type,
+        format,
+        data,
+        width,
+        height,
+        depth,
+        mipmap,
+        pixelFormat,
+        minFilter,
+        magFilter,
+        wrapS,
+        wrapT,
+        wrapR,
+        mipCount);
+
+    if (texture)
+        return texture->handle();
+
+    return L3D_INVALID_HANDLE;
+}
+
+void l3dUpdateTexture(
+    const L3DHandle &texture,
+    const L3DImageFormat &format,
+    const unsigned char *data,
+    unsigned int width,
+    unsigned int height,
+    unsigned int face,
+    bool updateMipmaps,
+    unsigned int mipCount)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        // Caller data may be released before the call runs: copy it.
+        unsigned int size = data ? L3DTexture::dataSize(L3D_TEXTURE_2D, format, width, height, 0, mipCount) : 0;
+        std::shared_ptr<std::vector<unsigned char> > pixels(new std::vector<unsigned char>(data, data + size));
+
+        renderer->enqueueCall([=]() {
+            l3dUpdateTexture(texture, format, pixels->empty() ? L3D_NULLPTR : &(*pixels)[0], width, height, face, updateMipmaps, mipCount);
+        });
+        return;
+    }
+
+    renderer->updateTexture(renderer->getTexture(texture), format, data, width, height, face, updateMipmaps, mipCount);
+}
+
+unsigned int l3dGetTextureGpuSize(const L3DHandle &texture)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_QUERY(unsigned int, std::bind(l3dGetTextureGpuSize, texture));
+
+    L3DTexture *target = renderer->getTexture(texture);
+    if (target)
+        return target->gpuSize();
+
+    return 0;
+}
+
+L3DHandle l3dAdoptTexture(
+    const L3DTextureType &type,
+    const L3DImageFormat &format,
+    unsigned char *data,
+    unsigned int width,
+    unsigned int height,
+    unsigned int depth,
+    L3DReleaseCallback release,
+    void *userData,
+    bool mipmap,
+    const L3DPixelFormat &pixelFormat,
+    const L3DImageMinFilter &minFilter,
+    const L3DImageMagFilter &magFilter,
+    const L3DImageWrapMethod &wrapS,
+    const L3DImageWrapMethod &wrapT,
+    const L3DImageWrapMethod &wrapR,
+    unsigned int mipCount)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+    L3D_ASSERT(release != L3D_NULLPTR);
+
+    // The data belongs to the engine now: no need to copy it.
+    L3D_DEFER_LOAD(L3D_TEXTURE, std::bind(l3dAdoptTexture, type, format, data, width, height, depth, release, userData, mipmap, pixelFormat, minFilter, magFilter, wrapS, wrapT, wrapR, mipCount));
 
     L3DTexture *texture = new L3DTexture(
-        s_renderer,
+        renderer,
         type,
         format,
         data,
@@ -264,7 +613,10 @@ L3DHandle l3dLoadTexture(
         magFilter,
         wrapS,
         wrapT,
-        wrapR);
+        wrapR,
+        mipCount,
+        release,
+        userData);
 
     if (texture)
         return texture->handle();
@@ -272,16 +624,61 @@ L3DHandle l3dLoadTexture(
     return L3D_INVALID_HANDLE;
 }
 
+void l3dSetTextureResidency(
+    const L3DHandle &texture,
+    const L3DResidencyPolicy &policy)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetTextureResidency, texture, policy));
+
+    L3DTexture *target = renderer->getTexture(texture);
+    if (target)
+    {
+        target->setResidency(policy);
+        renderer->releaseData(target);
+    }
+}
+
+void l3dSetTextureSource(
+    const L3DHandle &texture,
+    L3DReloadCallback source,
+    void *userData)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetTextureSource, texture, source, userData));
+
+    L3DTexture *target = renderer->getTexture(texture);
+    if (target)
+        target->setSource(source, userData);
+}
+
 L3DHandle l3dLoadShader(
     const L3DShaderType &type,
     const char *code)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DShader *shader = new L3DShader(
-        s_renderer,
-        type,
-        code);
+    if (!renderer->isRenderThread())
+    {
+        std::string source(code ? code : "");
+
+        return deferLoad(renderer, L3D_SHADER, [=]() { return l3dLoadShader(type, source.c_str()); });
+    }
+
+    L3DShader *shader = renderer->findShader(type, code);
+
+    if (!shader)
+    {
+        shader = new L3DShader(
+            renderer,
+            type,
+            code);
+    }
 
     if (shader)
         return shader->handle();
@@ -289,18 +686,36 @@ L3DHandle l3dLoadShader(
     return L3D_INVALID_HANDLE;
 }
 
+void l3dSetProgramCachePath(const char *path)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        std::string pathCopy(path ? path : "");
+        renderer->enqueueCall([pathCopy]() { l3dSetProgramCachePath(pathCopy.c_str()); });
+        return;
+    }
+
+    renderer->programCache().setPath(path ? path : "");
+}
+
 L3DHandle l3dLoadShaderProgram(
     const L3DHandle &vertexShader,
     const L3DHandle &fragmentShader,
     const L3DHandle &geometryShader)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_LOAD(L3D_SHADER_PROGRAM, std::bind(l3dLoadShaderProgram, vertexShader, fragmentShader, geometryShader));
 
     L3DShaderProgram *shaderProgram = new L3DShaderProgram(
-        s_renderer,
-        s_renderer->getShader(vertexShader),
-        s_renderer->getShader(fragmentShader),
-        s_renderer->getShader(geometryShader));
+        renderer,
+        renderer->getShader(vertexShader),
+        renderer->getShader(fragmentShader),
+        renderer->getShader(geometryShader));
 
     if (shaderProgram)
         return shaderProgram->handle();
@@ -314,9 +729,17 @@ void l3dSetShaderProgramUniformF(
     float value,
     int index)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        std::string nameCopy(name);
+        renderer->enqueueCall([target, nameCopy, value, index]() { l3dSetShaderProgramUniformF(target, nameCopy.c_str(), value, index); });
+        return;
+    }
 
-    L3DShaderProgram *shaderProgram = s_renderer->getShaderProgram(target);
+    L3DShaderProgram *shaderProgram = renderer->getShaderProgram(target);
     if (shaderProgram)
         shaderProgram->setUniform(getUniformName(name, index).c_str(), value);
 }
@@ -327,9 +750,17 @@ void l3dSetShaderProgramUniformI(
     int value,
     int index)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DShaderProgram *shaderProgram = s_renderer->getShaderProgram(target);
+    if (!renderer->isRenderThread())
+    {
+        std::string nameCopy(name);
+        renderer->enqueueCall([target, nameCopy, value, index]() { l3dSetShaderProgramUniformI(target, nameCopy.c_str(), value, index); });
+        return;
+    }
+
+    L3DShaderProgram *shaderProgram = renderer->getShaderProgram(target);
     if (shaderProgram)
         shaderProgram->setUniform(getUniformName(name, index).c_str(), value);
 }
@@ -340,9 +771,17 @@ void l3dSetShaderProgramUniformUI(
     unsigned int value,
     int index)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        std::string nameCopy(name);
+        renderer->enqueueCall([target, nameCopy, value, index]() { l3dSetShaderProgramUniformUI(target, nameCopy.c_str(), value, index); });
+        return;
+    }
 
-    L3DShaderProgram *shaderProgram = s_renderer->getShaderProgram(target);
+    L3DShaderProgram *shaderProgram = renderer->getShaderProgram(target);
     if (shaderProgram)
         shaderProgram->setUniform(getUniformName(name, index).c_str(), value);
 }
@@ -353,9 +792,17 @@ void l3dSetShaderProgramUniformB(
     bool value,
     int index)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DShaderProgram *shaderProgram = s_renderer->getShaderProgram(target);
+    if (!renderer->isRenderThread())
+    {
+        std::string nameCopy(name);
+        renderer->enqueueCall([target, nameCopy, value, index]() { l3dSetShaderProgramUniformB(target, nameCopy.c_str(), value, index); });
+        return;
+    }
+
+    L3DShaderProgram *shaderProgram = renderer->getShaderProgram(target);
     if (shaderProgram)
         shaderProgram->setUniform(getUniformName(name, index).c_str(), value);
 }
@@ -366,9 +813,17 @@ void l3dSetShaderProgramUniformVec2(
     const L3DVec2 &value,
     int index)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        std::string nameCopy(name);
+        renderer->enqueueCall([target, nameCopy, value, index]() { l3dSetShaderProgramUniformVec2(target, nameCopy.c_str(), value, index); });
+        return;
+    }
 
-    L3DShaderProgram *shaderProgram = s_renderer->getShaderProgram(target);
+    L3DShaderProgram *shaderProgram = renderer->getShaderProgram(target);
     if (shaderProgram)
         shaderProgram->setUniform(getUniformName(name, index).c_str(), value);
 }
@@ -379,9 +834,17 @@ void l3dSetShaderProgramUniformVec3(
     const L3DVec3 &value,
     int index)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DShaderProgram *shaderProgram = s_renderer->getShaderProgram(target);
+    if (!renderer->isRenderThread())
+    {
+        std::string nameCopy(name);
+        renderer->enqueueCall([target, nameCopy, value, index]() { l3dSetShaderProgramUniformVec3(target, nameCopy.c_str(), value, index); });
+        return;
+    }
+
+    L3DShaderProgram *shaderProgram = renderer->getShaderProgram(target);
     if (shaderProgram)
         shaderProgram->setUniform(getUniformName(name, index).c_str(), value);
 }
@@ -392,9 +855,17 @@ void l3dSetShaderProgramUniformVec4(
     const L3DVec4 &value,
     int index)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        std::string nameCopy(name);
+        renderer->enqueueCall([target, nameCopy, value, index]() { l3dSetShaderProgramUniformVec4(target, nameCopy.c_str(), value, index); });
+        return;
+    }
 
-    L3DShaderProgram *shaderProgram = s_renderer->getShaderProgram(target);
+    L3DShaderProgram *shaderProgram = renderer->getShaderProgram(target);
     if (shaderProgram)
         shaderProgram->setUniform(getUniformName(name, index).c_str(), value);
 }
@@ -405,9 +876,17 @@ void l3dSetShaderProgramUniformMat3(
     const L3DMat3 &value,
     int index)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DShaderProgram *shaderProgram = s_renderer->getShaderProgram(target);
+    if (!renderer->isRenderThread())
+    {
+        std::string nameCopy(name);
+        renderer->enqueueCall([target, nameCopy, value, index]() { l3dSetShaderProgramUniformMat3(target, nameCopy.c_str(), value, index); });
+        return;
+    }
+
+    L3DShaderProgram *shaderProgram = renderer->getShaderProgram(target);
     if (shaderProgram)
         shaderProgram->setUniform(getUniformName(name, index).c_str(), value);
 }
@@ -418,9 +897,17 @@ void l3dSetShaderProgramUniformMat4(
     const L3DMat4 &value,
     int index)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        std::string nameCopy(name);
+        renderer->enqueueCall([target, nameCopy, value, index]() { l3dSetShaderProgramUniformMat4(target, nameCopy.c_str(), value, index); });
+        return;
+    }
 
-    L3DShaderProgram *shaderProgram = s_renderer->getShaderProgram(target);
+    L3DShaderProgram *shaderProgram = renderer->getShaderProgram(target);
     if (shaderProgram)
         shaderProgram->setUniform(getUniformName(name, index).c_str(), value);
 }
@@ -444,97 +931,100 @@ L3DHandle l3dLoadFrameBuffer(
     const L3DHandle &textureColorAttachment14,
     const L3DHandle &textureColorAttachment15)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_LOAD(L3D_FRAME_BUFFER, std::bind(l3dLoadFrameBuffer, textureDepthStencilAttachment, textureColorAttachment0, textureColorAttachment1, textureColorAttachment2, textureColorAttachment3, textureColorAttachment4, textureColorAttachment5, textureColorAttachment6, textureColorAttachment7, textureColorAttachment8, textureColorAttachment9, textureColorAttachment10, textureColorAttachment11, textureColorAttachment12, textureColorAttachment13, textureColorAttachment14, textureColorAttachment15));
 
     L3DTextureAttachments textures;
 
     if (textureDepthStencilAttachment.data.id)
     {
-        textures[L3D_DEPTH_STENCIL_ATTACHMENT] = s_renderer->getTexture(textureDepthStencilAttachment);
+        textures[L3D_DEPTH_STENCIL_ATTACHMENT] = renderer->getTexture(textureDepthStencilAttachment);
     }
 
     if (textureColorAttachment0.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT0] = s_renderer->getTexture(textureColorAttachment0);
+        textures[L3D_COLOR_ATTACHMENT0] = renderer->getTexture(textureColorAttachment0);
     }
 
     if (textureColorAttachment1.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT1] = s_renderer->getTexture(textureColorAttachment1);
+        textures[L3D_COLOR_ATTACHMENT1] = renderer->getTexture(textureColorAttachment1);
     }
 
     if (textureColorAttachment2.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT2] = s_renderer->getTexture(textureColorAttachment2);
+        textures[L3D_COLOR_ATTACHMENT2] = renderer->getTexture(textureColorAttachment2);
     }
 
     if (textureColorAttachment3.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT3] = s_renderer->getTexture(textureColorAttachment3);
+        textures[L3D_COLOR_ATTACHMENT3] = renderer->getTexture(textureColorAttachment3);
     }
 
     if (textureColorAttachment4.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT4] = s_renderer->getTexture(textureColorAttachment4);
+        textures[L3D_COLOR_ATTACHMENT4] = renderer->getTexture(textureColorAttachment4);
     }
 
     if (textureColorAttachment5.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT5] = s_renderer->getTexture(textureColorAttachment5);
+        textures[L3D_COLOR_ATTACHMENT5] = renderer->getTexture(textureColorAttachment5);
     }
 
     if (textureColorAttachment6.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT6] = s_renderer->getTexture(textureColorAttachment6);
+        textures[L3D_COLOR_ATTACHMENT6] = renderer->getTexture(textureColorAttachment6);
     }
 
     if (textureColorAttachment7.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT7] = s_renderer->getTexture(textureColorAttachment7);
+        textures[L3D_COLOR_ATTACHMENT7] = renderer->getTexture(textureColorAttachment7);
     }
 
     if (textureColorAttachment8.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT8] = s_renderer->getTexture(textureColorAttachment8);
+        textures[L3D_COLOR_ATTACHMENT8] = renderer->getTexture(textureColorAttachment8);
     }
 
     if (textureColorAttachment9.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT9] = s_renderer->getTexture(textureColorAttachment9);
+        textures[L3D_COLOR_ATTACHMENT9] = renderer->getTexture(textureColorAttachment9);
     }
 
     if (textureColorAttachment10.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT10] = s_renderer->getTexture(textureColorAttachment10);
+        textures[L3D_COLOR_ATTACHMENT10] = renderer->getTexture(textureColorAttachment10);
     }
 
     if (textureColorAttachment11.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT11] = s_renderer->getTexture(textureColorAttachment11);
+        textures[L3D_COLOR_ATTACHMENT11] = renderer->getTexture(textureColorAttachment11);
     }
 
     if (textureColorAttachment12.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT12] = s_renderer->getTexture(textureColorAttachment12);
+        textures[L3D_COLOR_ATTACHMENT12] = renderer->getTexture(textureColorAttachment12);
     }
 
     if (textureColorAttachment13.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT13] = s_renderer->getTexture(textureColorAttachment13);
+        textures[L3D_COLOR_ATTACHMENT13] = renderer->getTexture(textureColorAttachment13);
     }
 
     if (textureColorAttachment14.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT14] = s_renderer->getTexture(textureColorAttachment14);
+        textures[L3D_COLOR_ATTACHMENT14] = renderer->getTexture(textureColorAttachment14);
     }
 
     if (textureColorAttachment15.data.id)
     {
-        textures[L3D_COLOR_ATTACHMENT15] = s_renderer->getTexture(textureColorAttachment15);
+        textures[L3D_COLOR_ATTACHMENT15] = renderer->getTexture(textureColorAttachment15);
     }
 
     L3DFrameBuffer *frameBuffer = new L3DFrameBuffer(
-        s_renderer,
+        renderer,
         textures);
 
     if (frameBuffer)
@@ -551,12 +1041,23 @@ L3DHandle l3dLoadMaterial(
     const L3DVec3 &specular,
     float shininess)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        // Caller name may be released before the call runs: copy it.
+        std::string nameCopy(name ? name : "");
+
+        return deferLoad(renderer, L3D_MATERIAL, [=]() {
+            return l3dLoadMaterial(nameCopy.c_str(), shaderProgram, diffuse, ambient, specular, shininess);
+        });
+    }
 
     L3DMaterial *material = L3DMaterial::createBlinnPhongMaterial(
-        s_renderer,
+        renderer,
         name,
-        s_renderer->getShaderProgram(shaderProgram),
+        renderer->getShaderProgram(shaderProgram),
         diffuse,
         ambient,
         specular,
@@ -573,11 +1074,19 @@ void l3dAddTextureToMaterial(
     const char *name,
     const L3DHandle &texture)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        std::string nameCopy(name);
+        renderer->enqueueCall([target, nameCopy, texture]() { l3dAddTextureToMaterial(target, nameCopy.c_str(), texture); });
+        return;
+    }
 
-    L3DMaterial *material = s_renderer->getMaterial(target);
+    L3DMaterial *material = renderer->getMaterial(target);
     if (material)
-        material->textures[name] = s_renderer->getTexture(texture);
+        material->textures[name] = renderer->getTexture(texture);
 
     return;
 }
@@ -587,10 +1096,19 @@ L3DHandle l3dLoadCamera(
     const L3DMat4 &view,
     const L3DMat4 &projection)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        // Caller name may be released before the call runs: copy it.
+        std::string nameCopy(name ? name : "");
+
+        return deferLoad(renderer, L3D_CAMERA, [=]() { return l3dLoadCamera(nameCopy.c_str(), view, projection); });
+    }
 
     L3DCamera *camera = new L3DCamera(
-        s_renderer,
+        renderer,
         name,
         view,
         projection);
@@ -604,9 +1122,12 @@ L3DHandle l3dLoadCamera(
 L3DMat4 l3dGetCameraView(
     const L3DHandle &target)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DCamera *camera = s_renderer->getCamera(target);
+    L3D_DEFER_QUERY(L3DMat4, std::bind(l3dGetCameraView, target));
+
+    L3DCamera *camera = renderer->getCamera(target);
 
     if (camera)
         return camera->view;
@@ -618,9 +1139,12 @@ void l3dSetCameraView(
     const L3DHandle &target,
     const L3DMat4 &view)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetCameraView, target, view));
 
-    L3DCamera *camera = s_renderer->getCamera(target);
+    L3DCamera *camera = renderer->getCamera(target);
 
     if (camera)
         camera->view = view;
@@ -629,9 +1153,12 @@ void l3dSetCameraView(
 L3DMat4 l3dGetCameraProj(
     const L3DHandle &target)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_QUERY(L3DMat4, std::bind(l3dGetCameraProj, target));
 
-    L3DCamera *camera = s_renderer->getCamera(target);
+    L3DCamera *camera = renderer->getCamera(target);
 
     if (camera)
         return camera->proj;
@@ -643,9 +1170,12 @@ void l3dSetCameraProj(
     const L3DHandle &target,
     const L3DMat4 &proj)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DCamera *camera = s_renderer->getCamera(target);
+    L3D_DEFER_CALL(std::bind(l3dSetCameraProj, target, proj));
+
+    L3DCamera *camera = renderer->getCamera(target);
 
     if (camera)
         camera->proj = proj;
@@ -655,9 +1185,12 @@ void l3dTranslateCamera(
     const L3DHandle &target,
     const L3DVec3 &movement)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dTranslateCamera, target, movement));
 
-    L3DCamera *camera = s_renderer->getCamera(target);
+    L3DCamera *camera = renderer->getCamera(target);
 
     if (camera)
         camera->translate(movement);
@@ -668,9 +1201,12 @@ void l3dRotateCamera(
     float radians,
     const L3DVec3 &direction)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dRotateCamera, target, radians, direction));
 
-    L3DCamera *camera = s_renderer->getCamera(target);
+    L3DCamera *camera = renderer->getCamera(target);
 
     if (camera)
         camera->rotate(radians, direction);
@@ -688,15 +1224,98 @@ L3DHandle l3dLoadMesh(
     const L3DDrawPrimitive &drawPrimitive,
     unsigned char renderLayer)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        // Caller data may be released before the call runs: copy it.
+        std::shared_ptr<std::vector<float> > vertexData(new std::vector<float>());
+        std::shared_ptr<std::vector<unsigned int> > indexData(new std::vector<unsigned int>());
+
+        if (vertices)
+            vertexData->assign(vertices, vertices + vertexCount * L3DMesh::unpackedFormat(vertexFormat));
+
+        if (indices)
+            indexData->assign(indices, indices + indexCount);
+
+        return deferLoad(renderer, L3D_MESH, [=]() {
+            return l3dLoadMesh(
+                vertexData->empty() ? L3D_NULLPTR : &(*vertexData)[0], vertexCount,
+                indexData->empty() ? L3D_NULLPTR : &(*indexData)[0], indexCount,
+                material, vertexFormat, transMatrix, drawType, drawPrimitive, renderLayer);
+        });
+    }
 
     L3DMesh *mesh = new L3DMesh(
-        s_renderer,
+        renderer,
         vertices,
         vertexCount,
         indices,
         indexCount,
-        s_renderer->getMaterial(material),
+        renderer->getMaterial(material),
+        vertexFormat,
+        transMatrix,
+        drawType,
+        drawPrimitive,
+        renderLayer);
+
+    if (mesh)
+        return mesh->handle();
+
+    return L3D_INVALID_HANDLE;
+}
+
+L3DHandle l3dAdoptMesh(
+    void *vertices,
+    unsigned int vertexCount,
+    void *indices,
+    unsigned int indexCount,
+    const L3DIndexType &indexType,
+    const L3DHandle &material,
+    const L3DVertexFormat &vertexFormat,
+    L3DReleaseCallback release,
+    void *userData,
+    const L3DMat4 &transMatrix,
+    const L3DDrawType &drawType,
+    const L3DDrawPrimitive &drawPrimitive,
+    unsigned char renderLayer)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+    L3D_ASSERT(release != L3D_NULLPTR);
+
+    // The data belongs to the engine now: no need to copy it.
+    L3D_DEFER_LOAD(L3D_MESH, std::bind(l3dAdoptMesh, vertices, vertexCount, indices, indexCount, indexType, material, vertexFormat, release, userData, transMatrix, drawType, drawPrimitive, renderLayer));
+
+    // Packing is a copy, whose decoding is only known to L3DMesh.
+    if (L3DMesh::isPacked(vertexFormat))
+    {
+        fprintf(stderr, "Can't adopt packed vertices\n");
+
+        if (vertices)
+            release(vertices, userData);
+        if (indices)
+            release(indices, userData);
+
+        return L3D_INVALID_HANDLE;
+    }
+
+    unsigned int vertexSize = L3DMesh::vertexSize(vertexFormat);
+    L3DBuffer *vertexBuffer = L3D_NULLPTR;
+    L3DBuffer *indexBuffer = L3D_NULLPTR;
+
+    if (vertices)
+        vertexBuffer = new L3DBuffer(renderer, L3D_BUFFER_VERTEX, vertices, vertexCount * vertexSize, vertexSize, drawType, release, userData);
+
+    if (indices)
+        indexBuffer = new L3DBuffer(renderer, L3D_BUFFER_INDEX, indices, indexCount * indexType, indexType, drawType, release, userData);
+
+    L3DMesh *mesh = new L3DMesh(
+        renderer,
+        vertexBuffer,
+        indexBuffer,
+        renderer->getMaterial(material),
         vertexFormat,
         transMatrix,
         drawType,
@@ -709,6 +1328,107 @@ L3DHandle l3dLoadMesh(
     return L3D_INVALID_HANDLE;
 }
 
+L3DMeshStorage l3dAllocMeshStorage(
+    unsigned int vertexCount,
+    unsigned int indexCount,
+    const L3DVertexFormat &vertexFormat,
+    const L3DDrawType &drawType)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_QUERY(L3DMeshStorage, std::bind(l3dAllocMeshStorage, vertexCount, indexCount, vertexFormat, drawType));
+
+    L3DMeshStorage storage = L3DMeshStorage();
+    storage.vertexCount = vertexCount;
+    storage.indexCount = indexCount;
+    storage.vertexFormat = vertexFormat;
+    storage.indexType = (vertexCount <= 0x10000) ? L3D_INDEX_UNSIGNED_SHORT : L3D_INDEX_UNSIGNED_INT;
+    storage.drawType = drawType;
+
+    if (!vertexCount || L3DMesh::isPacked(vertexFormat))
+    {
+        fprintf(stderr, "Can't allocate mesh storage for %u packed or no vertices\n", vertexCount);
+        return storage;
+    }
+
+    unsigned int vertexSize = L3DMesh::vertexSize(vertexFormat);
+    L3DBuffer *vertexBuffer = new L3DBuffer(renderer, L3D_BUFFER_VERTEX, L3D_NULLPTR, vertexCount * vertexSize, vertexSize, drawType);
+    L3DBuffer *indexBuffer = L3D_NULLPTR;
+
+    if (indexCount)
+        indexBuffer = new L3DBuffer(renderer, L3D_BUFFER_INDEX, L3D_NULLPTR, indexCount * storage.indexType, storage.indexType, drawType);
+
+    // There is no CPU copy to keep: read back video memory when needed.
+    L3DBuffer *buffers[] = {vertexBuffer, indexBuffer};
+    for (unsigned int i = 0; i < 2; ++i)
+    {
+        if (buffers[i] && buffers[i]->residency() == L3D_RESIDENCY_KEEP)
+            buffers[i]->setResidency(L3D_RESIDENCY_RELOAD);
+    }
+
+    storage.vertexBuffer = vertexBuffer->handle();
+    storage.vertices = renderer->mapBuffer(vertexBuffer);
+
+    if (indexBuffer)
+    {
+        storage.indexBuffer = indexBuffer->handle();
+        storage.indices = renderer->mapBuffer(indexBuffer);
+
+        if (!storage.indices)
+            storage.vertices = L3D_NULLPTR;
+    }
+
+    return storage;
+}
+
+L3DHandle l3dCommitMeshStorage(
+    const L3DMeshStorage &storage,
+    const L3DHandle &material,
+    const L3DMat4 &transMatrix,
+    const L3DDrawPrimitive &drawPrimitive,
+    unsigned char renderLayer)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_LOAD(L3D_MESH, std::bind(l3dCommitMeshStorage, storage, material, transMatrix, drawPrimitive, renderLayer));
+
+    L3DBuffer *vertexBuffer = renderer->getBuffer(storage.vertexBuffer);
+    L3DBuffer *indexBuffer = renderer->getBuffer(storage.indexBuffer);
+
+    // Both buffers are unmapped, whatever happens.
+    bool unmapped = vertexBuffer && renderer->unmapBuffer(vertexBuffer);
+
+    if (indexBuffer && !renderer->unmapBuffer(indexBuffer))
+        unmapped = false;
+
+    // Without a mesh to own them, the buffers are deleted.
+    if (!unmapped || !storage.vertices)
+    {
+        delete vertexBuffer;
+        delete indexBuffer;
+
+        return L3D_INVALID_HANDLE;
+    }
+
+    L3DMesh *mesh = new L3DMesh(
+        renderer,
+        vertexBuffer,
+        indexBuffer,
+        renderer->getMaterial(material),
+        storage.vertexFormat,
+        transMatrix,
+        storage.drawType,
+        drawPrimitive,
+        renderLayer);
+
+    if (mesh)
+        return mesh->handle();
+
+    return L3D_INVALID_HANDLE;
+}
+
 L3DHandle l3dLoadQuad(
     const L3DHandle &material,
     const L3DVec2 &texMulFactor,
@@ -926,8 +1646,15 @@ L3DHandle l3dLoadGrid(
     unsigned int numVertices = (n + 1) * (n + 1);
     unsigned int numIndices = 6 * n * n;
 
-    GLfloat *vertices = (GLfloat *)malloc(numVertices * 11 * sizeof(GLfloat));
-    GLuint *indices = (GLuint *)malloc(numIndices * sizeof(GLuint));
+    GLfloat *vertices = (GLfloat *)L3DMemory::allocate(numVertices * 11 * sizeof(GLfloat), L3D_MEMORY_LOADER);
+    GLuint *indices = (GLuint *)L3DMemory::allocate(numIndices * sizeof(GLuint), L3D_MEMORY_LOADER);
+
+    if (!vertices || !indices)
+    {
+        L3DMemory::deallocate(vertices);
+        L3DMemory::deallocate(indices);
+        return L3D_INVALID_HANDLE;
+    }
 
     GLfloat k = 1.0f / n;
 
@@ -980,21 +1707,30 @@ L3DHandle l3dLoadGrid(
         }
     }
 
-    return l3dLoadMesh(
+    // The mesh keeps its own copy.
+    L3DHandle mesh = l3dLoadMesh(
         vertices, numVertices,
         indices, numIndices,
         material,
         L3D_VERTEX_POS3_NOR3_TAN3_UV2,
         L3DMat4(), L3D_DRAW_STATIC, L3D_DRAW_TRIANGLES,
         renderLayer);
+
+    L3DMemory::deallocate(vertices);
+    L3DMemory::deallocate(indices);
+
+    return mesh;
 }
 
 L3DMat4 l3dGetMeshTrans(
     const L3DHandle &target)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DMesh *mesh = s_renderer->getMesh(target);
+    L3D_DEFER_QUERY(L3DMat4, std::bind(l3dGetMeshTrans, target));
+
+    L3DMesh *mesh = renderer->getMesh(target);
 
     if (mesh)
         return mesh->transMatrix;
@@ -1004,9 +1740,12 @@ L3DMat4 l3dGetMeshTrans(
 
 unsigned char l3dMeshRenderLayer(const L3DHandle &target)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_QUERY(unsigned char, std::bind(l3dMeshRenderLayer, target));
 
-    L3DMesh *mesh = s_renderer->getMesh(target);
+    L3DMesh *mesh = renderer->getMesh(target);
 
     if (mesh)
         return mesh->renderLayer();
@@ -1018,9 +1757,12 @@ void l3dSetMeshTrans(
     const L3DHandle &target,
     const L3DMat4 &trans)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetMeshTrans, target, trans));
 
-    L3DMesh *mesh = s_renderer->getMesh(target);
+    L3DMesh *mesh = renderer->getMesh(target);
 
     if (mesh)
         mesh->transMatrix = trans;
@@ -1030,9 +1772,12 @@ void l3dTranslateMesh(
     const L3DHandle &target,
     const L3DVec3 &movement)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DMesh *mesh = s_renderer->getMesh(target);
+    L3D_DEFER_CALL(std::bind(l3dTranslateMesh, target, movement));
+
+    L3DMesh *mesh = renderer->getMesh(target);
 
     if (mesh)
         mesh->translate(movement);
@@ -1043,9 +1788,12 @@ void l3dRotateMesh(
     float radians,
     const L3DVec3 &direction)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dRotateMesh, target, radians, direction));
 
-    L3DMesh *mesh = s_renderer->getMesh(target);
+    L3DMesh *mesh = renderer->getMesh(target);
 
     if (mesh)
         mesh->rotate(radians, direction);
@@ -1055,9 +1803,12 @@ void l3dScaleMesh(
     const L3DHandle &target,
     const L3DVec3 &factor)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dScaleMesh, target, factor));
 
-    L3DMesh *mesh = s_renderer->getMesh(target);
+    L3DMesh *mesh = renderer->getMesh(target);
 
     if (mesh)
         mesh->scale(factor);
@@ -1067,10 +1818,13 @@ void l3dSetMeshMaterial(
     const L3DHandle &target,
     const L3DHandle &material)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DMesh *mesh = s_renderer->getMesh(target);
-    L3DMaterial *mat = s_renderer->getMaterial(material);
+    L3D_DEFER_CALL(std::bind(l3dSetMeshMaterial, target, material));
+
+    L3DMesh *mesh = renderer->getMesh(target);
+    L3DMaterial *mat = renderer->getMaterial(material);
 
     if (mesh)
         mesh->setMaterial(mat);
@@ -1080,9 +1834,12 @@ void l3dSetMeshRenderLayer(
     const L3DHandle &target,
     unsigned char renderLayer)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetMeshRenderLayer, target, renderLayer));
 
-    L3DMesh *mesh = s_renderer->getMesh(target);
+    L3DMesh *mesh = renderer->getMesh(target);
 
     if (mesh)
         mesh->setRenderLayer(renderLayer);
@@ -1094,23 +1851,109 @@ void l3dSetMeshInstances(
     unsigned int instanceCount,
     const L3DInstanceFormat &instanceFormat)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        // Caller data may be released before the call runs: copy it.
+        std::shared_ptr<std::vector<float> > instanceData(new std::vector<float>());
+
+        if (instances)
+            instanceData->assign((float *)instances, (float *)instances + instanceCount * instanceFormat);
 
-    L3DMesh *mesh = s_renderer->getMesh(target);
+        renderer->enqueueCall([=]() {
+            l3dSetMeshInstances(target, instanceData->empty() ? L3D_NULLPTR : &(*instanceData)[0], instanceCount, instanceFormat);
+        });
+        return;
+    }
+
+    L3DMesh *mesh = renderer->getMesh(target);
 
     if (mesh && instances && instanceCount && instanceFormat)
         mesh->setInstances(instances, instanceCount, instanceFormat);
 }
 
+void l3dSetMeshLods(
+    const L3DHandle &target,
+    const L3DMeshLod *lods,
+    unsigned int lodCount)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    if (!renderer->isRenderThread())
+    {
+        std::shared_ptr<std::vector<L3DMeshLod> > lodData(new std::vector<L3DMeshLod>());
+
+        if (lods)
+            lodData->assign(lods, lods + lodCount);
+
+        renderer->enqueueCall([=]() {
+            l3dSetMeshLods(target, lodData->empty() ? L3D_NULLPTR : &(*lodData)[0], lodData->size());
+        });
+        return;
+    }
+
+    L3DMesh *mesh = renderer->getMesh(target);
+
+    if (mesh)
+        mesh->setLods(lods, lods ? lodCount : 0);
+}
+
+void l3dSetMeshBounds(
+    const L3DHandle &target,
+    const L3DVec3 &boundsMin,
+    const L3DVec3 &boundsMax)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetMeshBounds, target, boundsMin, boundsMax));
+
+    L3DMesh *mesh = renderer->getMesh(target);
+
+    if (mesh)
+        mesh->setBounds(boundsMin, boundsMax);
+}
+
+void l3dSetMeshResidency(
+    const L3DHandle &target,
+    const L3DResidencyPolicy &policy)
+{
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetMeshResidency, target, policy));
+
+    L3DMesh *mesh = renderer->getMesh(target);
+    if (!mesh)
+        return;
+
+    L3DBuffer *buffers[] = {mesh->vertexBuffer(), mesh->indexBuffer(), mesh->instanceBuffer()};
+
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        if (buffers[i])
+        {
+            buffers[i]->setResidency(policy);
+            renderer->releaseData(buffers[i]);
+        }
+    }
+}
+
 L3DHandle l3dLoadDirectionalLight(
     const L3DVec3 &direction,
     const L3DVec4 &color,
     unsigned int renderLayerMask)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_LOAD(L3D_LIGHT, std::bind(l3dLoadDirectionalLight, direction, color, renderLayerMask));
 
     L3DLight *light = L3DLight::createDirectionalLight(
-        s_renderer,
+        renderer,
         direction,
         color,
         renderLayerMask);
@@ -1127,10 +1970,13 @@ L3DHandle l3dLoadPointLight(
     const L3DLightAttenuation &attenuation,
     unsigned int renderLayerMask)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_LOAD(L3D_LIGHT, std::bind(l3dLoadPointLight, position, color, attenuation, renderLayerMask));
 
     L3DLight *light = L3DLight::createPointLight(
-        s_renderer,
+        renderer,
         position,
         color,
         attenuation,
@@ -1149,10 +1995,13 @@ L3DHandle l3dLoadSpotLight(
     const L3DLightAttenuation &attenuation,
     unsigned int renderLayerMask)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_LOAD(L3D_LIGHT, std::bind(l3dLoadSpotLight, position, direction, color, attenuation, renderLayerMask));
 
     L3DLight *light = L3DLight::createSpotLight(
-        s_renderer,
+        renderer,
         position,
         direction,
         color,
@@ -1167,9 +2016,12 @@ L3DHandle l3dLoadSpotLight(
 
 int l3dLightType(const L3DHandle &target)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_QUERY(int, std::bind(l3dLightType, target));
 
-    L3DLight *light = s_renderer->getLight(target);
+    L3DLight *light = renderer->getLight(target);
 
     if (light)
         return light->type;
@@ -1179,9 +2031,12 @@ int l3dLightType(const L3DHandle &target)
 
 unsigned int l3dLightRenderLayerMask(const L3DHandle &target)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_QUERY(unsigned int, std::bind(l3dLightRenderLayerMask, target));
 
-    L3DLight *light = s_renderer->getLight(target);
+    L3DLight *light = renderer->getLight(target);
 
     if (light)
         return light->renderLayerMask();
@@ -1192,9 +2047,12 @@ unsigned int l3dLightRenderLayerMask(const L3DHandle &target)
 bool l3dIsLightOn(
     const L3DHandle &target)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DLight *light = s_renderer->getLight(target);
+    L3D_DEFER_QUERY(bool, std::bind(l3dIsLightOn, target));
+
+    L3DLight *light = renderer->getLight(target);
 
     if (light)
         return light->isOn();
@@ -1206,9 +2064,12 @@ void l3dSetLightRenderLayerMask(
     const L3DHandle &target,
     unsigned int renderLayerMask)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetLightRenderLayerMask, target, renderLayerMask));
 
-    L3DLight *light = s_renderer->getLight(target);
+    L3DLight *light = renderer->getLight(target);
 
     if (light)
         return light->setRenderLayerMask(renderLayerMask);
@@ -1218,9 +2079,12 @@ void l3dSetLightDirection(
     const L3DHandle &target,
     const L3DVec3 &direction)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetLightDirection, target, direction));
 
-    L3DLight *light = s_renderer->getLight(target);
+    L3DLight *light = renderer->getLight(target);
 
     if (light)
         light->direction = direction;
@@ -1232,9 +2096,12 @@ void l3dSetLightAttenuation(
     float kl,
     float kq)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DLight *light = s_renderer->getLight(target);
+    L3D_DEFER_CALL(std::bind(l3dSetLightAttenuation, target, kc, kl, kq));
+
+    L3DLight *light = renderer->getLight(target);
 
     if (light)
         light->attenuation = L3DLightAttenuation(kc, kl, kq);
@@ -1244,9 +2111,12 @@ void l3dSetLightColor(
     const L3DHandle &target,
     const L3DVec4 &color)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dSetLightColor, target, color));
 
-    L3DLight *light = s_renderer->getLight(target);
+    L3DLight *light = renderer->getLight(target);
 
     if (light)
         light->color = color;
@@ -1256,9 +2126,12 @@ void l3dTranslateLight(
     const L3DHandle &target,
     const L3DVec3 &movement)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dTranslateLight, target, movement));
 
-    L3DLight *light = s_renderer->getLight(target);
+    L3DLight *light = renderer->getLight(target);
 
     if (light)
         light->translate(movement);
@@ -1269,9 +2142,12 @@ void l3dRotateLight(
     float radians,
     const L3DVec3 &direction)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
 
-    L3DLight *light = s_renderer->getLight(target);
+    L3D_DEFER_CALL(std::bind(l3dRotateLight, target, radians, direction));
+
+    L3DLight *light = renderer->getLight(target);
 
     if (light)
         light->rotate(radians, direction);
@@ -1281,9 +2157,12 @@ void l3dLightLookAt(
     const L3DHandle &target,
     const L3DVec3 &targetPosition)
 {
-    L3D_ASSERT(s_renderer != L3D_NULLPTR);
+    L3DRenderer *renderer = currentRenderer();
+    L3D_ASSERT(renderer != L3D_NULLPTR);
+
+    L3D_DEFER_CALL(std::bind(l3dLightLookAt, target, targetPosition));
 
-    L3DLight *light = s_renderer->getLight(target);
+    L3DLight *light = renderer->getLight(target);
 
     if (light)
         light->lookAt(targetPosition);
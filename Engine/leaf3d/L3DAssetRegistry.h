@@ -0,0 +1,95 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DASSETREGISTRY_H
+#define L3D_L3DASSETREGISTRY_H
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "leaf3d/types.h"
+
+namespace l3d
+{
+    typedef std::vector<L3DHandle> L3DHandleList;
+
+    struct L3DAsset
+    {
+        L3DHandleList handles;
+        unsigned long long hash;
+        unsigned int size;
+        unsigned int refCount;
+        unsigned int hitCount;
+    };
+
+    struct L3DAssetStats
+    {
+        unsigned int assetCount;
+        unsigned int hitCount;
+        unsigned long long bytesSaved;
+    };
+
+    typedef std::map<std::string, L3DAsset> L3DAssetMap;
+    typedef std::map<unsigned long long, std::string> L3DAssetHashMap;
+
+    // Keeps track of the loaded assets, so that loading the same file (or
+    // the same content, when a hash is given) again returns the handles
+    // created the first time. Thread-safe.
+    class L3DAssetRegistry
+    {
+    private:
+        mutable std::mutex m_mutex;
+        L3DAssetMap m_assets;
+        L3DAssetHashMap m_hashes;
+
+    public:
+        // Return true and the handles of an asset already loaded, taking
+        // a reference to it. A non-zero hash is looked up when the key is
+        // unknown.
+        bool acquire(
+            const std::string &key,
+            L3DHandleList &handles,
+            unsigned long long hash = 0);
+        void add(
+            const std::string &key,
+            const L3DHandleList &handles,
+            unsigned int size = 0,
+            unsigned long long hash = 0);
+        // Size is used for statistics: it may be known after loading.
+        void setSize(const std::string &key, unsigned int size);
+        // Drop a reference to the asset owning the handle. The asset is
+        // forgotten with its last reference. Return false if not found.
+        bool release(const L3DHandle &handle);
+        void clear();
+
+        unsigned int refCount(const std::string &key) const;
+        L3DAssetStats stats() const;
+
+        // Make equivalent paths equal: "a\\b/./c/../d" -> "a/b/d".
+        static std::string normalizePath(const std::string &path);
+        // 64-bit FNV-1a.
+        static unsigned long long hash(const void *data, unsigned int size);
+    };
+}
+
+#endif // L3D_L3DASSETREGISTRY_H
@@ -35,15 +35,24 @@ namespace l3d
         unsigned int m_size;
         unsigned int m_stride;
         L3DDrawType m_drawType;
+        L3DResidencyPolicy m_residency;
+        L3DReleaseCallback m_release;
+        void *m_releaseData;
+
+        void freeData();
 
     public:
+        // Data is copied, unless a release callback is given: the buffer
+        // then adopts it.
         L3DBuffer(
             L3DRenderer *renderer,
             const L3DBufferType &type,
             void *data,
             unsigned int size,
             unsigned int stride,
-            const L3DDrawType &drawType = L3D_DRAW_STATIC);
+            const L3DDrawType &drawType = L3D_DRAW_STATIC,
+            L3DReleaseCallback release = L3D_NULLPTR,
+            void *releaseData = L3D_NULLPTR);
         ~L3DBuffer();
 
         L3DBufferType type() const { return m_type; }
@@ -51,10 +60,20 @@ namespace l3d
         unsigned int size() const { return m_size; }
         unsigned int stride() const { return m_stride; }
         unsigned int count() const { return (m_stride > 0) ? m_size / m_stride : 0; }
+        // Type of the elements of an index buffer, given by its stride.
+        L3DIndexType indexType() const { return (m_stride == sizeof(unsigned short)) ? L3D_INDEX_UNSIGNED_SHORT : L3D_INDEX_UNSIGNED_INT; }
         void *data() const { return m_data; }
 
         template <typename T>
         T *data() const { return static_cast<T *>(m_data); }
+
+        // The local copy of the data: released after upload unless kept.
+        // It is then fetched back by L3DRenderer::acquireData().
+        L3DResidencyPolicy residency() const { return m_residency; }
+        void setResidency(const L3DResidencyPolicy &policy) { m_residency = policy; }
+        // Take ownership of data, allocated by L3DMemory.
+        void setData(void *data);
+        void discardData();
     };
 }
 
@@ -0,0 +1,75 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DCALLQUEUE_H
+#define L3D_L3DCALLQUEUE_H
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include "leaf3d/types.h"
+
+namespace l3d
+{
+    typedef std::function<void()> L3DCall;
+
+    // Bounded lock-free multi-producer single-consumer ring of calls.
+    //
+    // Each slot carries a sequence number: producers claim a position with
+    // a CAS on the tail and publish the slot by bumping its sequence, the
+    // consumer only reads slots that have been published.
+    class L3DCallQueue
+    {
+    private:
+        struct Slot
+        {
+            std::atomic<unsigned int> sequence;
+            L3DCall call;
+        };
+
+        Slot *m_slots;
+        unsigned int m_mask;
+        std::atomic<unsigned int> m_tail;
+        unsigned int m_head;
+
+    public:
+        // Capacity is rounded up to a power of two.
+        L3DCallQueue(unsigned int capacity = 4096);
+        ~L3DCallQueue();
+
+        unsigned int capacity() const { return m_mask + 1; }
+
+        // Producers: any thread.
+        bool tryPush(const L3DCall &call);
+        void push(const L3DCall &call);
+
+        // Consumer: a single thread.
+        bool pop(L3DCall &call);
+        unsigned int drain();
+        bool isEmpty() const;
+
+    private:
+        L3DCallQueue(const L3DCallQueue &);
+        L3DCallQueue &operator=(const L3DCallQueue &);
+    };
+}
+
+#endif // L3D_L3DCALLQUEUE_H
@@ -47,6 +47,7 @@ namespace l3d
                                                                m_clearColor(clearColor) {}
 
         void execute(L3DRenderer *renderer, L3DCamera *camera);
+        const char *name() const { return "ClearBuffers"; }
     };
 }
 
@@ -0,0 +1,85 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DCONTEXT_H
+#define L3D_L3DCONTEXT_H
+#pragma once
+
+#include <mutex>
+#include <string>
+#include "leaf3d/types.h"
+#include "leaf3d/L3DJobSystem.h"
+#include "leaf3d/L3DAssetRegistry.h"
+
+#ifdef __APPLE__
+#define L3D_DEFAULT_ROOT_PATH ""
+#else
+#define L3D_DEFAULT_ROOT_PATH "Resources/"
+#endif
+
+namespace l3d
+{
+    class L3DRenderer;
+
+    // Holds the whole state of an independent scene: a renderer and the
+    // utility library settings. Each thread has its own current context,
+    // so several contexts can be driven concurrently by different threads.
+    class L3DContext
+    {
+    private:
+        L3DRenderer *m_renderer;
+        std::string m_rootPath;
+        L3DJobSystem *m_loader;
+        L3DJobCounter m_pendingLoads;
+        std::once_flag m_loaderCreated;
+        L3DAssetRegistry m_assets;
+
+    public:
+        L3DContext();
+        ~L3DContext();
+
+        L3DRenderer *renderer() const { return m_renderer; }
+        void setRenderer(L3DRenderer *renderer);
+
+        const std::string &rootPath() const { return m_rootPath; }
+        void setRootPath(const std::string &rootPath) { m_rootPath = rootPath; }
+
+        // Background pool used to read and decode resources, apart from
+        // the frame preparation workers. It is shared by all the contexts,
+        // spawned on first use and joined with the last context using it.
+        L3DJobSystem *loader();
+        L3DJobCounter *pendingLoads() { return &m_pendingLoads; }
+        void finishLoads();
+
+        // Assets loaded through the utility library.
+        L3DAssetRegistry *assets() { return &m_assets; }
+
+        // The context current on the calling thread, or else the default
+        // one (the context implicitly created by l3dInit()).
+        static L3DContext *current();
+        static void makeCurrent(L3DContext *context);
+
+        static L3DContext *defaultContext();
+        static void setDefaultContext(L3DContext *context);
+    };
+}
+
+#endif // L3D_L3DCONTEXT_H
@@ -37,6 +37,7 @@ namespace l3d
             unsigned char renderLayer = 0) : m_renderLayer(renderLayer) {}
 
         void execute(L3DRenderer *renderer, L3DCamera *camera);
+        const char *name() const { return "DrawMeshes"; }
     };
 }
 
@@ -0,0 +1,152 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DFRAMEDATA_H
+#define L3D_L3DFRAMEDATA_H
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include "leaf3d/types.h"
+
+namespace l3d
+{
+    class L3DMesh;
+    class L3DUniform;
+    class L3DCamera;
+    class L3DRenderQueue;
+
+    // Uniform value packed by value, ready to be submitted to OpenGL.
+    struct L3DPackedUniform
+    {
+        std::string name;
+        L3DUniformType type;
+        union
+        {
+            float valueF[16];
+            int valueI;
+            unsigned int valueUI;
+        };
+
+        L3DPackedUniform() : type(L3D_UNIFORM_INVALID) { this->valueUI = 0; }
+        L3DPackedUniform(const std::string &name, float value);
+        L3DPackedUniform(const std::string &name, int value);
+        L3DPackedUniform(const std::string &name, const L3DVec3 &value);
+        L3DPackedUniform(const std::string &name, const L3DVec4 &value);
+        L3DPackedUniform(const std::string &name, const L3DUniform &value);
+    };
+
+    typedef std::vector<L3DPackedUniform> L3DPackedUniformList;
+
+    struct L3DTextureBinding
+    {
+        std::string samplerName;
+        std::string enabledName;
+        L3DTextureType type;
+        unsigned int texture;
+    };
+
+    typedef std::vector<L3DTextureBinding> L3DTextureBindingList;
+
+    struct L3DMaterialData
+    {
+        L3DPackedUniformList uniforms;
+        L3DTextureBindingList textures;
+        // L3DShaderFeature of the bound maps.
+        unsigned int shaderFeatures;
+
+        L3DMaterialData() : shaderFeatures(0) {}
+    };
+
+    // Mesh draw prepared by the job system.
+    struct L3DDrawItem
+    {
+        L3DMesh *mesh;
+        unsigned int sortKey;
+        L3DMat3 normalMatrix;
+        unsigned int lod;
+    };
+
+    typedef std::vector<L3DDrawItem> L3DDrawItemList;
+
+    // Backend-agnostic draw recorded by worker threads and replayed,
+    // in order, by the thread owning the OpenGL context.
+    struct L3DDrawPacket
+    {
+        unsigned int sortKey;
+        unsigned int vertexArray;
+        unsigned int shaderProgram;
+        // L3DShaderFeature of the mesh, when the program has variants.
+        unsigned int shaderFeatures;
+        unsigned int material;
+        L3DDrawPrimitive drawPrimitive;
+        unsigned int vertexCount;
+        unsigned int indexCount;
+        L3DIndexType indexType;
+        // Byte offset of the first index.
+        unsigned int indexOffset;
+        unsigned int instanceCount;
+        L3DMat4 modelMatrix;
+        L3DMat3 normalMatrix;
+        const L3DPackedUniformList *programUniforms;
+        const L3DMaterialData *materialData;
+    };
+
+    // Linear buffer filled by one recording job. It keeps its storage
+    // between frames.
+    typedef std::vector<L3DDrawPacket> L3DCommandBuffer;
+    typedef std::vector<L3DCommandBuffer> L3DCommandBufferList;
+
+    struct L3DRenderLayerData
+    {
+        L3DDrawItemList drawItems;
+        L3DPackedUniformList lightUniforms;
+        L3DCommandBufferList commandBuffers;
+    };
+
+    typedef std::map<unsigned int, L3DRenderLayerData> L3DRenderLayerDataMap;
+    typedef std::map<unsigned int, L3DMaterialData> L3DMaterialDataMap;
+    typedef std::map<unsigned int, L3DPackedUniformList> L3DProgramUniformMap;
+
+    struct L3DCameraSnapshot
+    {
+        L3DMat4 view;
+        L3DMat4 proj;
+        L3DVec3 position;
+    };
+
+    // CPU-side data prepared before OpenGL submission. It is a snapshot:
+    // submitting it never reads back the live resources.
+    struct L3DFrameData
+    {
+        L3DCamera *camera;
+        L3DRenderQueue *renderQueue;
+        L3DCameraSnapshot cameraSnapshot;
+        L3DRenderLayerDataMap layers;
+        L3DMaterialDataMap materials;
+        L3DProgramUniformMap programUniforms;
+
+        L3DFrameData() : camera(L3D_NULLPTR), renderQueue(L3D_NULLPTR) {}
+    };
+}
+
+#endif // L3D_L3DFRAMEDATA_H
@@ -0,0 +1,124 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DJOBSYSTEM_H
+#define L3D_L3DJOBSYSTEM_H
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include "leaf3d/types.h"
+
+namespace l3d
+{
+    class L3DJobCounter;
+
+    typedef std::function<void()> L3DJob;
+    typedef std::function<void(unsigned int begin, unsigned int end)> L3DRangeJob;
+
+    struct L3DScheduledJob
+    {
+        L3DJob job;
+        L3DJobCounter *counter;
+    };
+
+    typedef std::vector<L3DScheduledJob> L3DScheduledJobList;
+
+    // Tracks a group of jobs. A counter reaches zero when all the jobs
+    // run against it are done: it can be waited on or used as the
+    // dependency of other jobs, which are deferred until then.
+    class L3DJobCounter
+    {
+    private:
+        std::atomic<unsigned int> m_pending;
+        std::mutex m_mutex;
+        L3DScheduledJobList m_continuations;
+
+    public:
+        L3DJobCounter() : m_pending(0) {}
+
+        bool isDone() const { return m_pending.load() == 0; }
+
+        friend class L3DJobSystem;
+    };
+
+    class L3DWorkQueue
+    {
+    public:
+        std::mutex mutex;
+        std::deque<L3DScheduledJob> jobs;
+    };
+
+    typedef std::vector<L3DWorkQueue *> L3DWorkQueueList;
+    typedef std::vector<std::thread> L3DWorkerList;
+
+    // Work-stealing thread pool.
+    //
+    // Each worker owns a queue: it pops its own jobs LIFO and, when empty,
+    // steals FIFO from the others. Jobs submitted from threads outside the
+    // pool go to a shared queue (index 0), which every worker steals from.
+    // Waiting threads help executing jobs instead of blocking, so nested
+    // parallelFor() calls never dead-lock.
+    class L3DJobSystem
+    {
+    private:
+        L3DWorkQueueList m_queues;
+        L3DWorkerList m_workers;
+        std::atomic<unsigned int> m_queuedJobs;
+        std::atomic<bool> m_stop;
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wakeCondition;
+
+    public:
+        // A worker count of 0 runs every job inline on the calling thread.
+        L3DJobSystem(unsigned int workerCount = 0);
+        ~L3DJobSystem();
+
+        unsigned int workerCount() const { return m_workers.size(); }
+
+        void run(
+            const L3DJob &job,
+            L3DJobCounter *counter = L3D_NULLPTR,
+            L3DJobCounter *dependency = L3D_NULLPTR);
+        void wait(L3DJobCounter *counter);
+        void parallelFor(
+            unsigned int count,
+            unsigned int grainSize,
+            const L3DRangeJob &job);
+
+        static unsigned int defaultWorkerCount();
+
+    protected:
+        void push(const L3DScheduledJob &job);
+        bool pop(L3DScheduledJob &job);
+        bool runPending();
+        void execute(L3DScheduledJob &job);
+        void finish(L3DJobCounter *counter);
+        void workerLoop(unsigned int queueIndex);
+    };
+}
+
+#endif // L3D_L3DJOBSYSTEM_H
@@ -39,7 +39,7 @@ namespace l3d
     class L3DMaterial : public L3DResource
     {
     private:
-        const char *m_name;
+        std::string m_name;
         L3DShaderProgram *m_shaderProgram;
 
     public:
@@ -57,7 +57,7 @@ namespace l3d
             const L3DTextureRegistry &textures);
         ~L3DMaterial() {}
 
-        const char *name() const { return m_name; }
+        const char *name() const { return m_name.c_str(); }
         L3DShaderProgram *shaderProgram() const { return m_shaderProgram; }
 
         static L3DMaterial *createBlinnPhongMaterial(
@@ -0,0 +1,55 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DMEMORY_H
+#define L3D_L3DMEMORY_H
+#pragma once
+
+#include <stddef.h>
+#include "leaf3d/types.h"
+
+namespace l3d
+{
+    // Engine CPU allocations, tagged by subsystem and counted per tag.
+    //
+    // Blocks start with a small header recording their size and tag, so
+    // that they can be released without them. The allocator can only be
+    // replaced while no block is allocated.
+    class L3DMemory
+    {
+    public:
+        // NULL restores malloc() and free().
+        static bool setAllocator(const L3DAllocator *allocator);
+
+        // Return NULL (and print an error) when the allocator refuses.
+        static void *allocate(size_t size, L3DMemoryTag tag);
+        static void *duplicate(const void *data, size_t size, L3DMemoryTag tag);
+        static void *reallocate(void *ptr, size_t size, L3DMemoryTag tag);
+        static void deallocate(void *ptr);
+
+        static L3DAllocationStats stats();
+
+        // Print the blocks still allocated, per tag: return their count.
+        static unsigned int reportLeaks();
+    };
+}
+
+#endif // L3D_L3DMEMORY_H
@@ -29,6 +29,7 @@ namespace l3d
 {
     class L3DBuffer;
     class L3DMaterial;
+    class L3DJobSystem;
 
     class L3DMesh : public L3DResource
     {
@@ -40,11 +41,18 @@ namespace l3d
         L3DBuffer *m_indexBuffer;
         L3DBuffer *m_instanceBuffer;
         L3DMaterial *m_material;
+        L3DMat4 m_decodeMatrix;
         L3DVertexFormat m_vertexFormat;
         L3DInstanceFormat m_instanceFormat;
         L3DDrawPrimitive m_drawPrimitive;
         unsigned char m_renderLayer;
         unsigned int m_sortKey;
+        L3DMeshLod m_lods[L3D_MAX_MESH_LODS];
+        unsigned int m_lodCount;
+        unsigned int m_lod;
+        // Bounding sphere in model space.
+        L3DVec3 m_boundsCenter;
+        float m_boundsRadius;
 
     public:
         L3DMesh(
@@ -81,13 +89,23 @@ namespace l3d
         unsigned char renderLayer() const { return m_renderLayer; }
         unsigned int sortKey() const { return m_sortKey; }
 
+        // Model matrix applied to vertex positions: it includes the decoding
+        // of packed positions.
+        L3DMat4 modelMatrix() const { return transMatrix * m_decodeMatrix; }
         L3DMat3 normalMatrix() const;
         unsigned int vertexCount() const;
         unsigned int indexCount() const;
+        unsigned int index(unsigned int i) const;
+        unsigned int lodCount() const { return m_lodCount; }
+        unsigned int lod() const { return m_lod; }
+        const L3DMeshLod &lodLevel(unsigned int lod) const { return m_lods[lod]; }
         unsigned int instanceCount() const;
         unsigned int primitiveCount() const;
 
-        void recalculateTangents();
+        // Recompute the tangents of the vertex buffer from normals and the
+        // first UV set, on the job system of the renderer if any, and
+        // upload it again.
+        void recalculateTangents(const L3DTangentMode &mode = L3D_TANGENTS_FAST);
 
         void translate(const L3DVec3 &movement);
         void rotate(
@@ -97,6 +115,23 @@ namespace l3d
 
         void setMaterial(L3DMaterial *material);
         void setRenderLayer(unsigned char renderLayer);
+        // Levels of detail stored in the index buffer, the first one being
+        // the full mesh. Return false if a level is out of the buffer.
+        bool setLods(
+            const L3DMeshLod *lods,
+            unsigned int lodCount);
+        // Box around the vertices, in model space, from which levels of
+        // detail are selected. Computed when the vertices are given to the
+        // mesh, left empty around the origin otherwise.
+        void setBounds(const L3DVec3 &boundsMin, const L3DVec3 &boundsMax);
+        // Pick the coarsest level whose error, projected at the distance of
+        // the mesh bounds, stays below maxError. Projection scale maps
+        // model units at distance 1 to the same units as maxError. Levels
+        // change only once past a margin, so that they don't flicker.
+        unsigned int selectLod(
+            const L3DVec3 &eye,
+            float projectionScale,
+            float maxError);
         void setInstances(
             L3DBuffer *instanceBuffer,
             const L3DInstanceFormat &instanceFormat);
@@ -105,8 +140,35 @@ namespace l3d
             unsigned int instanceCount,
             const L3DInstanceFormat &instanceFormat);
 
+        // Vertex layouts.
+        static bool isPacked(const L3DVertexFormat &format);
+        static L3DVertexFormat unpackedFormat(const L3DVertexFormat &format);
+        static unsigned int vertexSize(const L3DVertexFormat &format);
+        // Pack vertices laid out as unpackedFormat(format). Positions are
+        // normalized to the bounds of the vertices: decodeMatrix maps them
+        // back to model space.
+        static void packVertices(
+            const float *vertices,
+            unsigned int vertexCount,
+            const L3DVertexFormat &format,
+            unsigned char *packed,
+            L3DMat4 &decodeMatrix);
+
+        // Fill the tangents of unpacked vertices laid out as format,
+        // splitting the triangles over jobSystem if given. Return false if
+        // the format has no tangents.
+        static bool computeTangents(
+            float *vertices,
+            unsigned int vertexCount,
+            const unsigned int *indices,
+            unsigned int indexCount,
+            const L3DVertexFormat &format,
+            const L3DTangentMode &mode = L3D_TANGENTS_FAST,
+            L3DJobSystem *jobSystem = L3D_NULLPTR);
+
     protected:
         void updateSortKey();
+        void computeBounds(const float *vertices, unsigned int vertexCount, const L3DVertexFormat &format);
     };
 }
 
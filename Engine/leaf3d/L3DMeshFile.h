@@ -0,0 +1,162 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DMESHFILE_H
+#define L3D_L3DMESHFILE_H
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "leaf3d/types.h"
+
+// Binary mesh format (.l3dm), little-endian:
+//
+// |-- header --|-- materials --|-- meshes --|-- vertex and index blocks --|
+//
+// Vertex blocks are interleaved exactly as their L3DVertexFormat expects,
+// index blocks are 32-bit: both can be uploaded straight from the file.
+#define L3D_MESH_FILE_MAGIC 0x4d44334c // "L3DM"
+#define L3D_MESH_FILE_VERSION 4
+#define L3D_MESH_FILE_NAME_SIZE 128
+
+namespace l3d
+{
+    enum L3DMeshFileTexture
+    {
+        L3D_MESH_FILE_DIFFUSE_MAP = 0,
+        L3D_MESH_FILE_SPECULAR_MAP,
+        L3D_MESH_FILE_ALPHA_MAP,
+        L3D_MESH_FILE_NORMAL_MAP,
+        L3D_MESH_FILE_TEXTURE_COUNT
+    };
+
+    struct L3DMeshFileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t materialCount;
+        uint32_t meshCount;
+    };
+
+    struct L3DMeshFileMaterial
+    {
+        char name[L3D_MESH_FILE_NAME_SIZE];
+        float diffuse[3];
+        float ambient[3];
+        float specular[3];
+        float shininess;
+        // Texture filenames, empty when missing.
+        char textures[L3D_MESH_FILE_TEXTURE_COUNT][L3D_MESH_FILE_NAME_SIZE];
+    };
+
+    // Range of a mesh index block, in indices.
+    struct L3DMeshFileLod
+    {
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        float error;
+    };
+
+    struct L3DMeshFileMesh
+    {
+        uint32_t vertexFormat;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        int32_t material; // -1 for none.
+        float boundsMin[3];
+        float boundsMax[3];
+        // Levels of detail share the index block: 0 when there are none.
+        uint32_t lodCount;
+        L3DMeshFileLod lods[L3D_MAX_MESH_LODS];
+        // Byte offsets from the beginning of the file.
+        uint32_t vertexOffset;
+        uint32_t indexOffset;
+    };
+
+    // A mesh to be written: data is referenced, not copied.
+    struct L3DMeshFileSource
+    {
+        L3DMeshFileMesh info;
+        const float *vertices;
+        const unsigned int *indices;
+    };
+
+    typedef std::vector<L3DMeshFileMaterial> L3DMeshFileMaterialList;
+    typedef std::vector<L3DMeshFileSource> L3DMeshFileSourceList;
+
+    // Read-only memory mapping of a whole file.
+    class L3DMappedFile
+    {
+    private:
+        void *m_data;
+        unsigned int m_size;
+#ifdef L3D_PLATFORM_WIN
+        void *m_file;
+        void *m_mapping;
+#endif
+
+    public:
+        L3DMappedFile();
+        ~L3DMappedFile();
+
+        bool open(const std::string &path);
+        void close();
+
+        const unsigned char *data() const { return static_cast<const unsigned char *>(m_data); }
+        unsigned int size() const { return m_size; }
+
+    private:
+        L3DMappedFile(const L3DMappedFile &);
+        L3DMappedFile &operator=(const L3DMappedFile &);
+    };
+
+    // Mapped .l3dm file: every accessor points into the mapping.
+    class L3DMeshFile
+    {
+    private:
+        L3DMappedFile m_file;
+        const L3DMeshFileHeader *m_header;
+
+    public:
+        L3DMeshFile();
+
+        // Map and validate a file. Return false if missing or invalid.
+        bool open(const std::string &path);
+        void close();
+
+        unsigned int materialCount() const { return m_header ? m_header->materialCount : 0; }
+        unsigned int meshCount() const { return m_header ? m_header->meshCount : 0; }
+        const L3DMeshFileMaterial *materials() const;
+        const L3DMeshFileMesh *meshes() const;
+        const float *vertices(unsigned int mesh) const;
+        const unsigned int *indices(unsigned int mesh) const;
+
+        // Fill the bounds of a mesh from its vertex positions.
+        static void computeBounds(L3DMeshFileMesh &mesh, const float *vertices);
+        static bool write(
+            const std::string &path,
+            const L3DMeshFileMaterialList &materials,
+            const L3DMeshFileSourceList &meshes);
+    };
+}
+
+#endif // L3D_L3DMESHFILE_H
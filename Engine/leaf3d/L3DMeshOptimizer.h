@@ -0,0 +1,116 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DMESHOPTIMIZER_H
+#define L3D_L3DMESHOPTIMIZER_H
+#pragma once
+
+#include <vector>
+#include "leaf3d/types.h"
+
+namespace l3d
+{
+    // Post-transform vertex cache efficiency of an index buffer.
+    struct L3DVertexCacheStats
+    {
+        // Average cache miss ratio: transformed vertices per triangle.
+        float acmr;
+        // Average transform to vertex ratio: 1 is optimal.
+        float atvr;
+    };
+
+    struct L3DMeshOptimizerStats
+    {
+        L3DVertexCacheStats before;
+        L3DVertexCacheStats after;
+        unsigned int vertexCountBefore;
+        unsigned int vertexCountAfter;
+    };
+
+    // Optimizations of indexed triangle lists. Vertices are interleaved
+    // floats, vertexSize per vertex, starting with the position.
+    class L3DMeshOptimizer
+    {
+    public:
+        // Run all the passes below, in order.
+        static L3DMeshOptimizerStats optimize(
+            std::vector<float> &vertices,
+            std::vector<unsigned int> &indices,
+            unsigned int vertexSize);
+
+        // Merge identical vertices. Return the new vertex count.
+        static unsigned int weldVertices(
+            std::vector<float> &vertices,
+            std::vector<unsigned int> &indices,
+            unsigned int vertexSize);
+
+        // Reorder triangles for the post-transform vertex cache, after
+        // Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+        static void optimizeVertexCache(
+            std::vector<unsigned int> &indices,
+            unsigned int vertexCount);
+
+        // Reorder the clusters of a cache optimized index buffer so that
+        // outer-facing ones are drawn first, after Sander et al. "Fast
+        // Triangle Reordering for Vertex Locality and Reduced Overdraw".
+        static void optimizeOverdraw(
+            std::vector<unsigned int> &indices,
+            const std::vector<float> &vertices,
+            unsigned int vertexSize);
+
+        // Store vertices in the order they are first used, dropping unused
+        // ones. Return the new vertex count.
+        static unsigned int optimizeVertexFetch(
+            std::vector<float> &vertices,
+            std::vector<unsigned int> &indices,
+            unsigned int vertexSize);
+
+        // Quadric error simplification (Garland and Heckbert) down to about
+        // targetIndexCount indices. Edges collapse onto existing vertices,
+        // so the result indexes the same vertex buffer; borders and
+        // attribute seams are kept. Return the geometric error, in model
+        // units.
+        static float simplify(
+            const std::vector<float> &vertices,
+            unsigned int vertexSize,
+            const std::vector<unsigned int> &indices,
+            unsigned int targetIndexCount,
+            std::vector<unsigned int> &result);
+
+        // Append up to lodCount - 1 simplified levels to indices, each one
+        // with about half the triangles of the previous. The first level
+        // is the input itself. Return the number of levels.
+        static unsigned int buildLods(
+            const std::vector<float> &vertices,
+            unsigned int vertexSize,
+            std::vector<unsigned int> &indices,
+            L3DMeshLod *lods,
+            unsigned int lodCount);
+
+        // Simulate a FIFO vertex cache.
+        static L3DVertexCacheStats analyzeVertexCache(
+            const std::vector<unsigned int> &indices,
+            unsigned int vertexCount,
+            unsigned int cacheSize = 16);
+    };
+}
+
+#endif // L3D_L3DMESHOPTIMIZER_H
@@ -0,0 +1,160 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DPROFILER_H
+#define L3D_L3DPROFILER_H
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "leaf3d/types.h"
+#include "leaf3d/L3DTrace.h"
+
+// Weight of the last frame in the rolling averages.
+#define L3D_PROFILER_SMOOTHING 0.05
+
+// GPU timings are read back once every query of their frame is complete,
+// so that reading them never stalls. The ring of frames is deeper than the
+// driver's queue: a frame still incomplete when it wraps is dropped.
+#define L3D_PROFILER_FRAMES 8
+
+namespace l3d
+{
+    struct L3DProfileNode
+    {
+        std::string name;
+        int parent;
+        unsigned int depth;
+        // Totals of the frame being recorded.
+        double frameCpuTime;
+        double frameGpuTime;
+        unsigned int frameCalls;
+        // Rolling averages, in milliseconds.
+        double cpuTime;
+        double gpuTime;
+        unsigned int calls;
+        bool sampled;
+        bool gpuSampled;
+        bool gpuAveraged;
+    };
+
+    struct L3DProfileStack
+    {
+        std::vector<int> nodes;
+        std::vector<double> starts;
+        // GPU sample of each scope, or -1.
+        std::vector<int> samples;
+    };
+
+    struct L3DGpuSample
+    {
+        int node;
+        unsigned int queries[2];
+    };
+
+    typedef std::vector<L3DProfileNode> L3DProfileNodeList;
+    typedef std::vector<L3DGpuSample> L3DGpuSampleList;
+    typedef std::map<std::thread::id, L3DProfileStack> L3DProfileStackMap;
+
+    // Hierarchical frame profiler.
+    //
+    // CPU scopes can be recorded by any thread: each thread nests its own
+    // scopes. GPU scopes are recorded by the thread owning the OpenGL
+    // context, with pairs of timestamp queries (GL_TIME_ELAPSED queries
+    // can't be nested) and a KHR_debug group naming the scope in graphics
+    // debuggers. Scopes are identified by their name and parent.
+    class L3DProfiler
+    {
+    private:
+        std::atomic<bool> m_enabled;
+        bool m_gpuTimers;
+        bool m_debugGroups;
+        std::mutex m_mutex;
+        L3DProfileNodeList m_nodes;
+        L3DProfileStackMap m_stacks;
+        L3DGpuSampleList m_gpuSamples[L3D_PROFILER_FRAMES];
+        std::vector<unsigned int> m_freeQueries;
+        unsigned int m_frame;
+        // Oldest frame whose GPU samples are not read back yet.
+        unsigned int m_gpuFrame;
+
+    public:
+        L3DProfiler();
+        ~L3DProfiler();
+
+        bool isEnabled() const { return m_enabled; }
+        void setEnabled(bool enabled) { m_enabled = enabled; }
+
+        // OpenGL features, set by the renderer.
+        void setGpuFeatures(bool timers, bool debugGroups);
+
+        void beginScope(const char *name, bool gpu = false);
+        void endScope(bool gpu = false);
+
+        // Called by the thread owning the OpenGL context once a frame has
+        // been submitted: folds the frame totals into the averages.
+        void endFrame();
+
+        // Scopes in depth-first order.
+        unsigned int profile(L3DProfileEntry *entries, unsigned int maxCount);
+
+        // Forget every scope and delete the queries (needs the context).
+        void clear();
+
+    protected:
+        int findNode(const char *name, int parent, unsigned int depth);
+        unsigned int acquireQuery();
+        bool readGpuSamples(L3DGpuSampleList &samples);
+        void releaseGpuSamples(L3DGpuSampleList &samples);
+    };
+
+    // Scope lasting until the end of the enclosing block. It is also
+    // recorded in the trace, if any.
+    class L3DProfileScope
+    {
+    private:
+        L3DProfiler *m_profiler;
+        bool m_gpu;
+        L3DTraceScope m_trace;
+
+    public:
+        L3DProfileScope(L3DProfiler *profiler, const char *name, bool gpu = false)
+            : m_profiler(profiler->isEnabled() ? profiler : L3D_NULLPTR),
+              m_gpu(gpu),
+              m_trace(name)
+        {
+            if (m_profiler)
+                m_profiler->beginScope(name, gpu);
+        }
+
+        ~L3DProfileScope()
+        {
+            if (m_profiler)
+                m_profiler->endScope(m_gpu);
+        }
+    };
+}
+
+#endif // L3D_L3DPROFILER_H
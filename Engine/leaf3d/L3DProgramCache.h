@@ -0,0 +1,65 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DPROGRAMCACHE_H
+#define L3D_L3DPROGRAMCACHE_H
+#pragma once
+
+#include <string>
+#include <vector>
+#include "leaf3d/types.h"
+
+#define L3D_PROGRAM_CACHE_MAGIC 0x5044334c // "L3DP"
+#define L3D_PROGRAM_CACHE_VERSION 2
+
+namespace l3d
+{
+    // Linked shader program binaries stored on disk, one file per key.
+    // Keys must identify both the sources and the driver: binaries are
+    // only valid for the driver which produced them.
+    class L3DProgramCache
+    {
+    private:
+        std::string m_path;
+
+    public:
+        // An empty path disables the cache. The directory is created when
+        // missing.
+        bool setPath(const std::string &path);
+        const std::string &path() const { return m_path; }
+        bool isEnabled() const { return !m_path.empty(); }
+
+        bool load(
+            unsigned long long key,
+            unsigned int &format,
+            std::vector<unsigned char> &binary) const;
+        bool store(
+            unsigned long long key,
+            unsigned int format,
+            const std::vector<unsigned char> &binary) const;
+        // Forget a binary rejected by the driver.
+        void remove(unsigned long long key) const;
+
+        std::string filename(unsigned long long key) const;
+    };
+}
+
+#endif // L3D_L3DPROGRAMCACHE_H
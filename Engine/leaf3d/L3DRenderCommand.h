@@ -24,6 +24,7 @@
 #pragma once
 
 #include <queue>
+#include "leaf3d/L3DMemory.h"
 
 namespace l3d
 {
@@ -34,6 +35,14 @@ namespace l3d
     {
     public:
         virtual void execute(L3DRenderer *renderer, L3DCamera *camera) = 0;
+
+        // Profiler scope name.
+        virtual const char *name() const { return "RenderCommand"; }
+
+        // Commands are counted as L3D_MEMORY_COMMANDS: new returns NULL
+        // when the allocator refuses.
+        static void *operator new(size_t size) noexcept { return L3DMemory::allocate(size, L3D_MEMORY_COMMANDS); }
+        static void operator delete(void *ptr) { L3DMemory::deallocate(ptr); }
     };
 
     typedef std::vector<L3DRenderCommand *> L3DRenderCommandList;
@@ -0,0 +1,91 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DRENDERPIPELINE_H
+#define L3D_L3DRENDERPIPELINE_H
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include "leaf3d/types.h"
+#include "leaf3d/L3DFrameData.h"
+
+namespace l3d
+{
+    class L3DRenderer;
+
+    typedef std::vector<L3DFrameData *> L3DFrameDataList;
+    typedef std::deque<L3DFrameData *> L3DFrameDataQueue;
+
+    // Bounded queue of frame snapshots consumed by a render thread.
+    //
+    // The application thread fills a free snapshot and queues it; the render
+    // thread submits queued snapshots in order, then gives them back. At most
+    // queueDepth frames are in flight, so the application thread blocks when
+    // it gets too far ahead.
+    class L3DRenderPipeline
+    {
+    private:
+        L3DRenderer *m_renderer;
+        L3DContextCallback m_acquireContext;
+        L3DContextCallback m_releaseContext;
+        L3DContextCallback m_presentFrame;
+        void *m_userData;
+        L3DFrameDataList m_frames;
+        L3DFrameDataQueue m_freeFrames;
+        L3DFrameDataQueue m_queuedFrames;
+        bool m_executeCalls;
+        unsigned int m_executedCalls;
+        bool m_stop;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::thread m_thread;
+
+    public:
+        L3DRenderPipeline(
+            L3DRenderer *renderer,
+            unsigned int queueDepth,
+            L3DContextCallback acquireContext,
+            L3DContextCallback releaseContext,
+            L3DContextCallback presentFrame = L3D_NULLPTR,
+            void *userData = L3D_NULLPTR);
+        ~L3DRenderPipeline();
+
+        unsigned int queueDepth() const { return m_frames.size(); }
+
+        L3DFrameData *acquireFrame();
+        void submitFrame(L3DFrameData *frame);
+        void flush();
+
+        // Execute the calls deferred to the renderer once the queued frames
+        // are rendered, and wait for them: the resources they touch are not
+        // used meanwhile.
+        unsigned int executeCalls();
+
+    protected:
+        void renderLoop();
+    };
+}
+
+#endif // L3D_L3DRENDERPIPELINE_H
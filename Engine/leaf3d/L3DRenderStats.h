@@ -0,0 +1,89 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DRENDERSTATS_H
+#define L3D_L3DRENDERSTATS_H
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include "leaf3d/types.h"
+
+// Counting is compiled out unless L3D_ENABLE_FRAME_STATS is defined (see
+// the L3D_FRAME_STATS build option): l3dGetFrameStats() then reports zeros.
+#ifdef L3D_ENABLE_FRAME_STATS
+#define L3D_COUNT(stats, counter, value) (stats).add(&L3DRenderCounters::counter, (value))
+#else
+#define L3D_COUNT(stats, counter, value) ((void)(stats))
+#endif
+
+namespace l3d
+{
+    typedef std::vector<L3DRenderCounters> L3DRenderCountersList;
+
+    // Counters of the frame being submitted, by the thread owning the
+    // OpenGL context, and statistics of the last frames.
+    class L3DRenderStats
+    {
+    private:
+        L3DRenderCounters m_frame;
+        L3DRenderCounters m_layers[L3D_MAX_RENDER_LAYERS];
+        int m_layer;
+        L3DRenderCountersList m_window;
+        unsigned int m_next;
+        std::mutex m_mutex;
+        L3DFrameStats m_stats;
+
+    public:
+        L3DRenderStats();
+
+        void add(unsigned int L3DRenderCounters::*counter, unsigned int value)
+        {
+            m_frame.*counter += value;
+            if (m_layer >= 0)
+                m_layers[m_layer].*counter += value;
+        }
+
+        // Counters added meanwhile also go to a render layer.
+        void beginLayer(unsigned int renderLayer)
+        {
+#ifdef L3D_ENABLE_FRAME_STATS
+            m_layer = renderLayer;
+#else
+            (void)renderLayer;
+#endif
+        }
+        void endLayer()
+        {
+#ifdef L3D_ENABLE_FRAME_STATS
+            m_layer = -1;
+#endif
+        }
+
+        // Publish the frame counters and start a new frame.
+        void endFrame();
+
+        // Can be called from any thread.
+        L3DFrameStats stats();
+    };
+}
+
+#endif // L3D_L3DRENDERSTATS_H
@@ -24,8 +24,17 @@
 #pragma once
 
 #include <map>
-#include <list>
+#include <set>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
 #include "leaf3d/types.h"
+#include "leaf3d/L3DFrameData.h"
+#include "leaf3d/L3DCallQueue.h"
+#include "leaf3d/L3DProgramCache.h"
+#include "leaf3d/L3DProfiler.h"
+#include "leaf3d/L3DRenderStats.h"
 
 namespace l3d
 {
@@ -40,6 +49,8 @@ namespace l3d
     class L3DLight;
     class L3DMesh;
     class L3DRenderQueue;
+    class L3DJobSystem;
+    class L3DRenderPipeline;
 
     typedef std::map<unsigned int, L3DBuffer *> L3DBufferPool;
     typedef std::map<unsigned int, L3DTexture *> L3DTexturePool;
@@ -51,8 +62,23 @@ namespace l3d
     typedef std::map<unsigned int, L3DLight *> L3DLightPool;
     typedef std::map<unsigned int, L3DMesh *> L3DMeshPool;
     typedef std::map<unsigned int, L3DRenderQueue *> L3DRenderQueuePool;
-    typedef std::list<L3DMesh *> L3DMeshList;
+    typedef std::vector<L3DMesh *> L3DMeshList;
     typedef std::map<unsigned int, L3DMeshList> L3DRenderBucket;
+    typedef std::map<std::string, int> L3DUniformLocationMap;
+    typedef std::map<unsigned int, L3DUniformLocationMap> L3DUniformLocationCache;
+    typedef std::multimap<unsigned long long, unsigned int> L3DShaderSourceMap;
+
+    // Program whose link was submitted but whose status wasn't checked yet.
+    struct L3DPendingProgram
+    {
+        L3DShaderProgram *shaderProgram;
+        unsigned long long cacheKey;
+        bool fromBinary;
+        bool failed;
+    };
+
+    typedef std::map<unsigned int, L3DPendingProgram> L3DPendingProgramMap;
+    typedef std::map<unsigned long long, L3DShaderProgram *> L3DShaderVariantMap;
 
     class L3DRenderer
     {
@@ -68,19 +94,120 @@ namespace l3d
         L3DMeshPool m_meshes;
         L3DRenderQueuePool m_renderQueues;
         L3DRenderBucket m_renderBucket;
+        L3DJobSystem *m_jobSystem;
+        L3DRenderPipeline *m_pipeline;
+        L3DFrameData m_frameData;
+        // Prepared by the submitting thread for other cameras (see
+        // drawMeshes()): m_frameData may be written by the application
+        // thread meanwhile.
+        L3DFrameData m_cameraFrameData;
+        L3DFrameData *m_frame;
+        L3DUniformLocationCache m_uniformLocations;
+        L3DShaderSourceMap m_shaderSources;
+        // Reserved handles resolving to resources registered before (see
+        // aliasResource()), by handle representation.
+        std::map<unsigned int, unsigned int> m_aliases;
+        L3DProgramCache m_programCache;
+        L3DProfiler m_profiler;
+        L3DRenderStats m_renderStats;
+        std::string m_driverId;
+        bool m_programBinaries;
+        bool m_parallelShaderCompile;
+        L3DPendingProgramMap m_pendingPrograms;
+        L3DShaderVariantMap m_shaderVariants;
+        float m_lodBias;
+        unsigned long long m_textureBudget;
+        L3DResidencyPolicy m_residency;
+        unsigned int m_frameIndex;
+        L3DCallQueue m_calls;
+        // Lent to the pipeline thread while it executes the calls.
+        std::atomic<std::thread::id> m_renderThread;
+        std::atomic<unsigned int> m_nextIds[L3D_RENDER_QUEUE + 1];
 
     public:
         L3DRenderer();
         virtual ~L3DRenderer();
 
         // Init and clearing.
-        int init();
+        // A negative worker count picks one worker per extra CPU core.
+        int init(int workerCount = -1);
         int terminate();
 
+        L3DJobSystem *jobSystem() const { return m_jobSystem; }
+        L3DProfiler *profiler() { return &m_profiler; }
+        L3DRenderStats &renderStats() { return m_renderStats; }
+
+        // Threading: the render thread is the one which initialized the
+        // renderer. Other threads defer their calls, which are executed by
+        // the render thread at the beginning of the next frame. While
+        // pipelined, the thread owning the OpenGL context executes them
+        // and the render thread waits.
+        bool isRenderThread() const { return std::this_thread::get_id() == m_renderThread.load(); }
+        void enqueueCall(const L3DCall &call);
+        unsigned int executeCalls();
+        // Called by the pipeline thread on behalf of the render thread.
+        unsigned int executeCallsAsRenderThread();
+
         // Rendering.
         void renderFrame(
             L3DCamera *camera,
             L3DRenderQueue *renderQueue);
+        void prepareFrame(
+            L3DFrameData &frame,
+            L3DCamera *camera,
+            L3DRenderQueue *renderQueue);
+        void submitFrame(L3DFrameData &frame);
+
+        // Pipelined rendering: frames are submitted by a render thread
+        // owning the OpenGL context, up to queueDepth frames behind.
+        int beginPipelinedRendering(
+            unsigned int queueDepth,
+            L3DContextCallback acquireContext,
+            L3DContextCallback releaseContext,
+            L3DContextCallback presentFrame = L3D_NULLPTR,
+            void *userData = L3D_NULLPTR);
+        int endPipelinedRendering();
+        bool isPipelined() const { return m_pipeline != L3D_NULLPTR; }
+
+        // Mesh levels of detail: each unit of bias doubles the geometric
+        // error allowed on screen (negative values refine).
+        float lodBias() const { return m_lodBias; }
+        void setLodBias(float bias) { m_lodBias = bias; }
+
+        // Estimated video memory used by the resources.
+        L3DMemoryStats memoryStats() const;
+
+        // Limit of the video memory used by sampled textures (0 for none).
+        // After each frame, the least recently used textures over budget
+        // lose their largest mip levels, which are restored from the local
+        // copy of their data when drawn again. Only 2D textures keeping
+        // their data are evicted, and nothing happens while pipelined.
+        unsigned long long textureBudget() const { return m_textureBudget; }
+        void setTextureBudget(unsigned long long bytes) { m_textureBudget = bytes; }
+        // Return the count of evicted mip levels.
+        unsigned int enforceTextureBudget();
+
+        // Residency of the buffers and textures created from now on.
+        L3DResidencyPolicy residencyPolicy() const { return m_residency; }
+        void setResidencyPolicy(const L3DResidencyPolicy &policy) { m_residency = policy; }
+
+        // Make sure the local copy of the data is available, fetching it
+        // back if discarded (see L3D_RESIDENCY_RELOAD). Reading back from
+        // video memory needs the context: not while pipelined. Evicted
+        // texture levels can only come from a source.
+        bool acquireData(L3DBuffer *buffer);
+        bool acquireData(L3DTexture *texture);
+        // Discard the local copy again, unless kept.
+        void releaseData(L3DBuffer *buffer);
+        void releaseData(L3DTexture *texture);
+
+        // Upload the local copy of a buffer again, after changing it.
+        void updateBuffer(L3DBuffer *buffer);
+
+        // Map the video memory of a buffer, for its whole contents to be
+        // written in place (from any thread) until unmapped.
+        void *mapBuffer(L3DBuffer *buffer);
+        bool unmapBuffer(L3DBuffer *buffer);
 
         // Add resources to renderer.
         void addResource(L3DResource *resource);
@@ -108,6 +235,51 @@ namespace l3d
         void removeMesh(L3DMesh *mesh);
         void removeRenderQueue(L3DRenderQueue *renderQueue);
 
+        // Upload a new image to a 2D texture or to a face of a cube map.
+        // A new size or format reallocates the texture: textures attached
+        // to frame buffers can't be resized this way.
+        void updateTexture(
+            L3DTexture *texture,
+            const L3DImageFormat &format,
+            const unsigned char *data,
+            unsigned int width,
+            unsigned int height,
+            unsigned int face = 0,
+            bool updateMipmaps = true,
+            unsigned int mipCount = 1);
+
+        // Shader already added with the same type and source, if any.
+        L3DShader *findShader(const L3DShaderType &type, const char *code) const;
+
+        // Linked programs are cached on disk when a path is set (and the
+        // driver supports program binaries): programs found there skip
+        // compilation and linking.
+        L3DProgramCache &programCache() { return m_programCache; }
+
+        // Shaders are compiled and programs linked asynchronously: their
+        // status is checked the first time they are drawn, and meshes
+        // using programs still linking (or failed) are skipped meanwhile.
+        bool isShaderProgramReady(L3DShaderProgram *shaderProgram);
+        unsigned int pendingShaderProgramCount() const { return m_pendingPrograms.size(); }
+
+        // Variant of a program specialized for a set of L3DShaderFeature,
+        // created on first use (not while pipelined). Variants are released
+        // with their program.
+        L3DShaderProgram *shaderVariant(L3DShaderProgram *shaderProgram, unsigned int features);
+        unsigned int shaderVariantCount() const { return m_shaderVariants.size(); }
+
+        // Allocate a handle, usable before its resource exists.
+        L3DHandle reserveHandle(const L3DResourceType &type);
+        // Count of handles allocated so far for type: resources registered
+        // meanwhile have ids following it.
+        unsigned int handleCount(const L3DResourceType &type) const { return m_nextIds[type]; }
+        // Move a resource to a previously reserved handle.
+        bool rebindResource(const L3DHandle &handle, const L3DHandle &reserved);
+        // Make a previously reserved handle resolve to a resource which
+        // keeps its own handle, e.g. when a load finds an existing one.
+        bool aliasResource(const L3DHandle &handle, const L3DHandle &reserved);
+        L3DHandle resolveHandle(const L3DHandle &handle) const;
+
         // Convert handle to resource pointer.
         L3DResource *getResource(const L3DHandle &handle) const;
         L3DBuffer *getBuffer(const L3DHandle &handle) const;
@@ -156,6 +328,21 @@ namespace l3d
             L3DCamera *camera,
             unsigned char renderLayer = 0);
         void recomputeRenderBucket();
+
+    protected:
+        void registerResource(L3DResource *resource);
+        void submitCommandBuffer(
+            const L3DCommandBuffer &commandBuffer,
+            const L3DCameraSnapshot &camera,
+            const L3DPackedUniformList &lightUniforms);
+        int uniformLocation(unsigned int shaderProgram, const std::string &name);
+        void compileShader(L3DShader *shader);
+        void linkShaderProgram(L3DShaderProgram *shaderProgram, unsigned int id);
+        bool checkProgramStatus(unsigned int id);
+        unsigned int shaderVariantName(unsigned int shaderProgram, unsigned int features);
+        unsigned long long programKey(L3DShaderProgram *shaderProgram) const;
+        void collectRenderTargets(std::set<unsigned int> &textures) const;
+        bool reuploadTexture(L3DTexture *texture, unsigned int firstLevel);
     };
 }
 
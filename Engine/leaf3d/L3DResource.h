@@ -33,6 +33,7 @@ namespace l3d
     {
     private:
         L3DHandle m_handle;
+        unsigned int m_glName;
         L3DRenderer *m_renderer;
 
     public:
@@ -42,6 +43,7 @@ namespace l3d
         L3DResourceType resourceType() const { return (L3DResourceType)m_handle.data.type; }
         unsigned short int id() const { return m_handle.data.id; }
         unsigned char flags() const { return m_handle.data.flags; }
+        unsigned int glName() const { return m_glName; }
         bool hasFlag(unsigned char bit) const { return L3D_TEST_BIT(m_handle.data.flags, bit); }
         L3DRenderer *renderer() const { return m_renderer; }
 
@@ -52,6 +54,7 @@ namespace l3d
             L3DRenderer *renderer = L3D_NULLPTR);
 
         void setId(unsigned short int id) { m_handle.data.id = id; }
+        void setGlName(unsigned int glName) { m_glName = glName; }
         void setFlags(unsigned char flags) { m_handle.data.flags = flags; }
         void setFlag(unsigned char flag, bool enable = true) { L3D_SET_BIT(m_handle.data.flags, flag, enable); }
 
@@ -44,6 +44,7 @@ namespace l3d
                                                                          m_dstFactor(dstFactor) {}
 
         void execute(L3DRenderer *renderer, L3DCamera *camera);
+        const char *name() const { return "SetBlend"; }
     };
 }
 
@@ -41,6 +41,7 @@ namespace l3d
                                                            m_cullFace(cullFace) {}
 
         void execute(L3DRenderer *renderer, L3DCamera *camera);
+        const char *name() const { return "SetCullFace"; }
     };
 }
 
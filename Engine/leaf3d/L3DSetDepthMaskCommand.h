@@ -37,6 +37,7 @@ namespace l3d
             bool enable = true) : m_enable(enable) {}
 
         void execute(L3DRenderer *renderer, L3DCamera *camera);
+        const char *name() const { return "SetDepthMask"; }
     };
 }
 
@@ -41,6 +41,7 @@ namespace l3d
                                                        m_factor(factor) {}
 
         void execute(L3DRenderer *renderer, L3DCamera *camera);
+        const char *name() const { return "SetDepthTest"; }
     };
 }
 
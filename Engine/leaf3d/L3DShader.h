@@ -38,7 +38,7 @@ namespace l3d
             L3DRenderer *renderer,
             const L3DShaderType &type,
             const char *code);
-        ~L3DShader() {}
+        ~L3DShader();
 
         L3DShaderType type() const { return m_type; }
         const char *code() const { return m_code; }
@@ -0,0 +1,75 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DSHADERPREPROCESSOR_H
+#define L3D_L3DSHADERPREPROCESSOR_H
+#pragma once
+
+#include <string>
+#include <vector>
+#include "leaf3d/types.h"
+
+// Nesting level at which #include directives are considered recursive.
+#define L3D_SHADER_MAX_INCLUDE_DEPTH 16
+
+namespace l3d
+{
+    // Loads the source of an included file, by the name given in the
+    // #include directive.
+    typedef bool (*L3DShaderIncludeCallback)(const char *name, std::string &source, void *userData);
+
+    typedef std::vector<std::string> L3DShaderDefineList;
+
+    // Source transformations done before handing shaders to the driver.
+    class L3DShaderPreprocessor
+    {
+    public:
+        // Expand #include "name" (or <name>) directives. Each file is
+        // expanded once, at its first inclusion. #line directives keep
+        // the driver logs pointing at the original lines, with included
+        // files numbered from 1 in inclusion order.
+        static bool resolveIncludes(
+            const std::string &source,
+            std::string &result,
+            L3DShaderIncludeCallback include,
+            void *userData = L3D_NULLPTR);
+
+        // Insert a #define for each entry ("NAME" or "NAME value") after
+        // the #version directive.
+        static std::string addDefines(
+            const std::string &source,
+            const L3DShaderDefineList &defines);
+
+        // Whether a source is written for specialized variants, i.e. it
+        // tests L3D_VARIANT_* macros.
+        static bool hasVariants(const char *source);
+
+        // Defines specializing a variant for a set of L3DShaderFeature.
+        static void variantDefines(unsigned int features, L3DShaderDefineList &defines);
+
+        // Light count rounded up to a power of two (capped at
+        // L3D_SHADER_MAX_LIGHTS), as L3D_SHADER_LIGHT_MASK bits.
+        static unsigned int lightFeatures(unsigned int lightCount);
+        static unsigned int maxLights(unsigned int features);
+    };
+}
+
+#endif // L3D_L3DSHADERPREPROCESSOR_H
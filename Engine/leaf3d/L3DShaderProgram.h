@@ -63,6 +63,7 @@ namespace l3d
         L3DShader *m_geometryShader;
         L3DUniformMap m_uniforms;
         L3DAttributeMap m_attributes;
+        bool m_hasVariants;
 
     public:
         L3DShaderProgram(
@@ -77,11 +78,17 @@ namespace l3d
         L3DShader *vertexShader() const { return m_vertexShader; }
         L3DShader *fragmentShader() const { return m_fragmentShader; }
         L3DShader *geometryShader() const { return m_geometryShader; }
-        L3DUniformMap uniforms() const { return m_uniforms; }
+        const L3DUniformMap &uniforms() const { return m_uniforms; }
         unsigned int uniformCount() const { return m_uniforms.size(); }
         L3DAttributeMap attributes() const { return m_attributes; }
         unsigned int attributeCount() const { return m_attributes.size(); }
 
+        // Programs whose sources test L3D_VARIANT_* macros are drawn with
+        // variants specialized for each material (see
+        // L3DRenderer::shaderVariant()).
+        bool hasVariants() const { return m_hasVariants; }
+        void setHasVariants(bool hasVariants) { m_hasVariants = hasVariants; }
+
         void setUniform(const char *name, const L3DUniform &value);
         void removeUniform(const char *name);
 
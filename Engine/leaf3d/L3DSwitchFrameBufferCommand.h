@@ -39,6 +39,7 @@ namespace l3d
             L3DFrameBuffer *frameBuffer = 0) : m_frameBuffer(frameBuffer) {}
 
         void execute(L3DRenderer *renderer, L3DCamera *camera);
+        const char *name() const { return "SwitchFrameBuffer"; }
     };
 }
 
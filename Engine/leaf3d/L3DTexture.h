@@ -37,12 +37,22 @@ namespace l3d
         unsigned int m_width;
         unsigned int m_height;
         unsigned int m_depth;
+        unsigned int m_mipCount;
+        unsigned int m_evictedLevels;
+        unsigned int m_lastUsedFrame;
         bool m_useMipmap;
         L3DImageMinFilter m_minFilter;
         L3DImageMagFilter m_magFilter;
         L3DImageWrapMethod m_wrapS;
         L3DImageWrapMethod m_wrapT;
         L3DImageWrapMethod m_wrapR;
+        L3DResidencyPolicy m_residency;
+        L3DReloadCallback m_source;
+        void *m_sourceData;
+        L3DReleaseCallback m_release;
+        void *m_releaseData;
+
+        void freeData();
 
     public:
         L3DTexture(
@@ -59,7 +69,10 @@ namespace l3d
             const L3DImageMagFilter &magFilter = L3D_MAG_LINEAR,
             const L3DImageWrapMethod &wrapS = L3D_REPEAT,
             const L3DImageWrapMethod &wrapT = L3D_REPEAT,
-            const L3DImageWrapMethod &wrapR = L3D_REPEAT);
+            const L3DImageWrapMethod &wrapR = L3D_REPEAT,
+            unsigned int mipCount = 1,
+            L3DReleaseCallback release = L3D_NULLPTR,
+            void *releaseData = L3D_NULLPTR);
         ~L3DTexture();
 
         L3DTextureType type() const { return m_type; }
@@ -69,7 +82,62 @@ namespace l3d
         unsigned int width() const { return m_width; }
         unsigned int height() const { return m_height; }
         unsigned int depth() const { return m_depth; }
+        // Mip levels provided with the data: when 1, they are generated
+        // if mipmapping is enabled (and the format is not compressed).
+        unsigned int mipCount() const { return m_mipCount; }
+        // Mip levels in video memory, generated ones included.
+        unsigned int levelCount() const;
         unsigned int size() const;
+        // Estimated video memory used, mip levels included, as is or with
+        // the given number of largest levels evicted.
+        unsigned int gpuSize() const { return this->gpuSize(m_evictedLevels); }
+        unsigned int gpuSize(unsigned int evictedLevels) const;
+
+        // Largest mip levels dropped from video memory to fit the texture
+        // budget: the texture is sampled at a lower resolution meanwhile.
+        unsigned int evictedLevels() const { return m_evictedLevels; }
+        void setEvictedLevels(unsigned int levels) { m_evictedLevels = levels; }
+
+        // The local copy of the data: released after upload unless kept.
+        // It is then fetched back by L3DRenderer::acquireData(), from the
+        // source if any.
+        L3DResidencyPolicy residency() const { return m_residency; }
+        void setResidency(const L3DResidencyPolicy &policy) { m_residency = policy; }
+        // Take ownership of data, allocated by L3DMemory.
+        void setData(unsigned char *data);
+        void discardData();
+        L3DReloadCallback source() const { return m_source; }
+        void *sourceData() const { return m_sourceData; }
+        void setSource(L3DReloadCallback source, void *userData = L3D_NULLPTR);
+
+        // Last frame drawing the texture, for the texture budget.
+        unsigned int lastUsedFrame() const { return m_lastUsedFrame; }
+        void setLastUsedFrame(unsigned int frame) { m_lastUsedFrame = frame; }
+
+        // Data layout: for each cube map face, for each mip level, the
+        // level image (rows of pixels, or of 4x4 blocks when compressed).
+        static unsigned int dataSize(
+            const L3DTextureType &type,
+            const L3DImageFormat &format,
+            unsigned int width,
+            unsigned int height,
+            unsigned int depth,
+            unsigned int mipCount = 1);
+        static unsigned int levelSize(
+            const L3DImageFormat &format,
+            unsigned int width,
+            unsigned int height,
+            unsigned int level = 0);
+        static bool isCompressed(const L3DImageFormat &format);
+
+        // Replace the image description after an upload: the local copy
+        // of the data is stale then, so it is released.
+        void setImage(
+            const L3DImageFormat &format,
+            unsigned int width,
+            unsigned int height,
+            unsigned int mipCount = 1);
+
         bool useMipmap() const { return m_useMipmap; }
         L3DImageMinFilter minFilter() const { return m_minFilter; }
         L3DImageMagFilter magFilter() const { return m_magFilter; }
@@ -0,0 +1,73 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DTEXTURECOOKER_H
+#define L3D_L3DTEXTURECOOKER_H
+#pragma once
+
+#include "leaf3d/types.h"
+#include "leaf3d/L3DTextureFile.h"
+
+namespace l3d
+{
+    struct L3DTextureCookOptions
+    {
+        // Filter mip levels in linear space, for sRGB encoded colors.
+        bool srgb;
+        bool generateMipmaps;
+        // L3D_BC1 or L3D_BC3, L3D_UNKNOWN keeps RGBA texels.
+        L3DImageFormat compression;
+
+        L3DTextureCookOptions() : srgb(true), generateMipmaps(true), compression(L3D_UNKNOWN) {}
+    };
+
+    // Converts decoded images to textures ready for upload: texels padded to
+    // RGBA, mip chain filtered on CPU and, optionally, block compressed.
+    class L3DTextureCooker
+    {
+    public:
+        static bool cook(
+            const unsigned char *pixels,
+            unsigned int width,
+            unsigned int height,
+            unsigned int comp,
+            const L3DTextureCookOptions &options,
+            L3DTextureImage &image);
+
+        // Halve an RGBA image with a 2x2 box filter.
+        static void downsample(
+            const unsigned char *src,
+            unsigned int width,
+            unsigned int height,
+            unsigned char *dst,
+            bool srgb = true);
+
+        // Encode an RGBA image as BC1 or BC3 blocks.
+        static void compress(
+            const unsigned char *src,
+            unsigned int width,
+            unsigned int height,
+            const L3DImageFormat &format,
+            unsigned char *dst);
+    };
+}
+
+#endif // L3D_L3DTEXTURECOOKER_H
@@ -0,0 +1,61 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DTEXTUREFILE_H
+#define L3D_L3DTEXTUREFILE_H
+#pragma once
+
+#include <string>
+#include <vector>
+#include "leaf3d/types.h"
+
+namespace l3d
+{
+    // Texture image ready to be uploaded, laid out as L3DTexture expects:
+    // for each face, for each mip level, the level image.
+    struct L3DTextureImage
+    {
+        L3DTextureType type;
+        L3DImageFormat format;
+        unsigned int width;
+        unsigned int height;
+        unsigned int mipCount;
+        std::vector<unsigned char> data;
+    };
+
+    // Loaders of GPU texture containers, with pre-built mip chains:
+    // KTX (version 1) and DDS (including the DX10 extended header).
+    // Supported formats are RGBA8 and BC1/BC3/BC4/BC5/BC7, in 2D textures
+    // and cube maps.
+    class L3DTextureFile
+    {
+    public:
+        static bool isContainer(const std::string &path);
+        static bool load(const std::string &path, L3DTextureImage &image);
+        static bool loadKTX(const unsigned char *data, unsigned int size, L3DTextureImage &image);
+        static bool loadDDS(const unsigned char *data, unsigned int size, L3DTextureImage &image);
+
+        // Write an image as a KTX file, mip chain included.
+        static bool writeKTX(const std::string &path, const L3DTextureImage &image);
+    };
+}
+
+#endif // L3D_L3DTEXTUREFILE_H
@@ -0,0 +1,118 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#ifndef L3D_L3DTRACE_H
+#define L3D_L3DTRACE_H
+#pragma once
+
+#include <atomic>
+#include <string>
+#include "leaf3d/types.h"
+
+// Events each thread can record during a trace; later ones are dropped.
+#define L3D_TRACE_BUFFER_SIZE 16384
+
+#define L3D_TRACE_NAME_SIZE 48
+
+#define L3D_TRACE_CONCAT_IMPL(a, b) a##b
+#define L3D_TRACE_CONCAT(a, b) L3D_TRACE_CONCAT_IMPL(a, b)
+
+// Trace the enclosing block.
+#define L3D_TRACE_SCOPE(name) \
+    l3d::L3DTraceScope L3D_TRACE_CONCAT(l3dTraceScope, __LINE__)(name)
+
+namespace l3d
+{
+    struct L3DTraceEvent
+    {
+        char name[L3D_TRACE_NAME_SIZE];
+        char phase;
+        // Microseconds since the trace started.
+        double time;
+    };
+
+    // Events of a single thread. Only the owner thread appends to it, and
+    // publishes each event by bumping the count, so no lock is needed. The
+    // owner also empties it when it first records in a new trace.
+    struct L3DTraceBuffer
+    {
+        unsigned int threadId;
+        std::string threadName;
+        // Trace the events belong to.
+        std::atomic<unsigned int> generation;
+        std::atomic<unsigned int> count;
+        std::atomic<unsigned int> dropped;
+        L3DTraceEvent events[L3D_TRACE_BUFFER_SIZE];
+    };
+
+    // Timeline recorder writing Chrome trace_event JSON files, which can be
+    // opened in Perfetto or chrome://tracing.
+    //
+    // Each thread gets its own event buffer the first time it records an
+    // event; the buffers are kept until the process exits, so the events of
+    // threads which are gone can still be written.
+    class L3DTrace
+    {
+    private:
+        static std::atomic<bool> s_enabled;
+
+    public:
+        // The only cost of a disabled trace.
+        static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+        // Start recording; the events are written to path by stop().
+        static bool start(const char *path);
+        static bool stop();
+
+        static void beginEvent(const char *name);
+        static void endEvent();
+
+        // Name of the calling thread in the trace.
+        static void setThreadName(const char *name);
+
+    protected:
+        static L3DTraceBuffer *threadBuffer();
+        static void record(const char *name, char phase);
+    };
+
+    // Event lasting until the end of the enclosing block.
+    class L3DTraceScope
+    {
+    private:
+        const char *m_name;
+
+    public:
+        explicit L3DTraceScope(const char *name)
+            : m_name(L3DTrace::isEnabled() ? name : L3D_NULLPTR)
+        {
+            if (m_name)
+                L3DTrace::beginEvent(m_name);
+        }
+
+        ~L3DTraceScope()
+        {
+            if (m_name)
+                L3DTrace::endEvent();
+        }
+    };
+}
+
+#endif // L3D_L3DTRACE_H
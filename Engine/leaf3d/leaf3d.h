@@ -25,11 +25,41 @@
 
 #include "leaf3d/types.h"
 
+namespace l3d
+{
+    class L3DContext;
+}
+
 using namespace l3d;
 
+/* Contexts *******************************************************************/
+
+// A context holds an independent scene: every call below works on the
+// context current on the calling thread. Several contexts can live in the
+// same process, each driven by its own thread (and OpenGL context).
+// Applications using a single scene can ignore contexts: l3dInit() creates
+// a default one when the calling thread has none, and l3dTerminate()
+// destroys it.
+L3D_API L3DContext *l3dCreateContext();
+
+L3D_API int l3dDestroyContext(L3DContext *context);
+
+L3D_API int l3dMakeCurrent(L3DContext *context);
+
+L3D_API L3DContext *l3dCurrentContext();
+
 /* Init & terminate ***********************************************************/
 
-L3D_API int l3dInit();
+// Initialize the renderer of the current context.
+// Worker threads used for frame preparation: -1 uses all the available
+// cores, 0 runs everything on the calling thread.
+//
+// The thread calling l3dInit() becomes the render thread. Any other thread
+// can call the API too: its calls are queued and executed, in order, at the
+// beginning of the next l3dRenderFrame(). Loads return their handle at once
+// (the resource is created later on), while getters block until the render
+// thread answers them.
+L3D_API int l3dInit(int workerCount = -1);
 
 L3D_API int l3dTerminate();
 
@@ -39,6 +69,82 @@ L3D_API void l3dRenderFrame(
     const L3DHandle &camera,
     const L3DHandle &renderQueue);
 
+// Pipelined rendering: l3dRenderFrame() snapshots the frame state and
+// returns, while a render thread submits the snapshot, so the application
+// can work on the next frame meanwhile. The OpenGL context must be released
+// by the calling thread first: acquireContext and releaseContext are run on
+// the render thread, presentFrame after each frame. Creating or deleting
+// resources is not allowed until l3dEndPipelinedRendering() (asserted in
+// debug builds). Calls queued by other threads, e.g. texture uploads, are
+// executed by the render thread once the queued frames are submitted, and
+// l3dRenderFrame() waits for them.
+L3D_API int l3dBeginPipelinedRendering(
+    L3DContextCallback acquireContext,
+    L3DContextCallback releaseContext,
+    L3DContextCallback presentFrame = L3D_NULLPTR,
+    void *userData = L3D_NULLPTR,
+    unsigned int queueDepth = 2);
+
+L3D_API int l3dEndPipelinedRendering();
+
+// Trade mesh detail for frame time: each unit of bias doubles the screen
+// error allowed when picking mesh levels of detail. Negative values refine.
+L3D_API void l3dSetLodBias(float bias);
+
+// Built-in profiler: CPU and GPU time of frame preparation, submission,
+// each render command and each render layer, as rolling averages. GPU
+// times need OpenGL 3.3 and lag a couple of frames behind.
+L3D_API void l3dEnableProfiler(bool enable = true);
+
+// Fill entries (in depth-first order) and return the count of profiled
+// scopes, which may exceed maxCount. Can be called from any thread.
+L3D_API unsigned int l3dGetProfile(
+    L3DProfileEntry *entries,
+    unsigned int maxCount);
+
+// Draw calls, binds, uploads... issued by the last frame, per render layer
+// and over the last frames. Counting is compiled out, and the counters
+// left to zero, when building without L3D_FRAME_STATS. Can be called from
+// any thread.
+L3D_API L3DFrameStats l3dGetFrameStats();
+
+// Estimated video memory used by textures (mip levels included), frame
+// buffer attachments and buffers.
+L3D_API L3DMemoryStats l3dGetMemoryStats();
+
+// Limit the video memory of sampled textures, in bytes (0, the default,
+// for none). Over budget, the least recently drawn 2D textures lose their
+// largest mip levels, restored as soon as they are drawn again. Textures
+// are never evicted while rendering is pipelined.
+L3D_API void l3dSetTextureBudget(unsigned long long bytes);
+
+// Whether buffers and textures loaded from now on keep a CPU copy of their
+// data once uploaded (L3D_RESIDENCY_KEEP, the default). Discarded copies
+// are fetched back when the engine needs them (e.g. to recompute tangents
+// or restore evicted mip levels) with L3D_RESIDENCY_RELOAD, from the
+// texture source if any, else from video memory.
+L3D_API void l3dSetResidencyPolicy(const L3DResidencyPolicy &policy);
+
+// Route the CPU memory of the engine (geometry, textures, shader sources,
+// render commands and loader data) through an application allocator, e.g.
+// to enforce a memory cap: refused allocations are reported on stderr and
+// leave the resource needing them without data. NULL restores malloc()
+// and free(). The allocator can only be
+// replaced while the engine holds no memory, e.g. before l3dInit().
+L3D_API int l3dSetAllocator(const L3DAllocator *allocator);
+
+// Live engine allocations per subsystem, from any thread. Blocks still
+// allocated when the default context terminates are reported as leaks.
+L3D_API L3DAllocationStats l3dGetAllocationStats();
+
+// Record a timeline of frame preparation and submission, render commands,
+// GPU uploads, shader compiles and asset loads from every thread, until
+// l3dTraceEnd() writes it to path as Chrome trace_event JSON (open it in
+// Perfetto or chrome://tracing). Tracing is process-wide and, when off,
+// costs a single branch per traced scope.
+L3D_API int l3dTraceBegin(const char *path);
+L3D_API int l3dTraceEnd();
+
 L3D_API L3DHandle l3dLoadForwardRenderQueue(
     unsigned int width,
     unsigned int height,
@@ -47,6 +153,8 @@ L3D_API L3DHandle l3dLoadForwardRenderQueue(
 
 /* Textures *******************************************************************/
 
+// Data holds mipCount levels per face (see L3DTexture::dataSize()). With a
+// single level, mipmaps are generated unless the format is compressed.
 L3D_API L3DHandle l3dLoadTexture(
     const L3DTextureType &type,
     const L3DImageFormat &format,
@@ -60,14 +168,74 @@ L3D_API L3DHandle l3dLoadTexture(
     const L3DImageMagFilter &magFilter = L3D_MAG_LINEAR,
     const L3DImageWrapMethod &wrapS = L3D_REPEAT,
     const L3DImageWrapMethod &wrapT = L3D_REPEAT,
-    const L3DImageWrapMethod &wrapR = L3D_REPEAT);
+    const L3DImageWrapMethod &wrapR = L3D_REPEAT,
+    unsigned int mipCount = 1);
+
+// Replace the image of a 2D texture, or of a face of a cube map (faces are
+// ordered as +X, -X, +Y, -Y, +Z, -Z). When updating several faces, mipmaps
+// can be regenerated by the last update only.
+L3D_API void l3dUpdateTexture(
+    const L3DHandle &texture,
+    const L3DImageFormat &format,
+    const unsigned char *data,
+    unsigned int width,
+    unsigned int height,
+    unsigned int face = 0,
+    bool updateMipmaps = true,
+    unsigned int mipCount = 1);
+
+// Estimated video memory used by a texture, in bytes.
+L3D_API unsigned int l3dGetTextureGpuSize(const L3DHandle &texture);
+
+// Like l3dLoadTexture(), but the engine takes ownership of data instead of
+// copying it, even when called off the render thread: release(data,
+// userData) is called once the data is no longer needed (right after
+// upload, unless keeping CPU copies, see l3dSetResidencyPolicy()).
+L3D_API L3DHandle l3dAdoptTexture(
+    const L3DTextureType &type,
+    const L3DImageFormat &format,
+    unsigned char *data,
+    unsigned int width,
+    unsigned int height,
+    unsigned int depth,
+    L3DReleaseCallback release,
+    void *userData = L3D_NULLPTR,
+    bool mipmap = true,
+    const L3DPixelFormat &pixelFormat = L3D_UNSIGNED_BYTE,
+    const L3DImageMinFilter &minFilter = L3D_MIN_NEAREST_MIPMAP_LINEAR,
+    const L3DImageMagFilter &magFilter = L3D_MAG_LINEAR,
+    const L3DImageWrapMethod &wrapS = L3D_REPEAT,
+    const L3DImageWrapMethod &wrapT = L3D_REPEAT,
+    const L3DImageWrapMethod &wrapR = L3D_REPEAT,
+    unsigned int mipCount = 1);
+
+// Override the residency of a texture (see l3dSetResidencyPolicy()): its
+// CPU copy is released at once unless kept.
+L3D_API void l3dSetTextureResidency(
+    const L3DHandle &texture,
+    const L3DResidencyPolicy &policy);
+
+// Where a texture with a discarded CPU copy reloads its image from, e.g.
+// its file. Reloadable textures can be evicted by the texture budget
+// whatever their residency.
+L3D_API void l3dSetTextureSource(
+    const L3DHandle &texture,
+    L3DReloadCallback source,
+    void *userData = L3D_NULLPTR);
 
 /* Shaders ********************************************************************/
 
+// Loading the same source twice returns the same shader.
 L3D_API L3DHandle l3dLoadShader(
     const L3DShaderType &type,
     const char *code);
 
+// Store linked programs in a directory, so that the next runs load them
+// instead of compiling their shaders. Binaries rejected by the driver (e.g.
+// after an update) are rebuilt from source. A null path disables the cache.
+// Requires OpenGL 4.1.
+L3D_API void l3dSetProgramCachePath(const char *path);
+
 L3D_API L3DHandle l3dLoadShaderProgram(
     const L3DHandle &vertexShader,
     const L3DHandle &fragmentShader,
@@ -210,6 +378,46 @@ L3D_API L3DHandle l3dLoadMesh(
     const L3DDrawPrimitive &drawPrimitive = L3D_DRAW_TRIANGLES,
     unsigned char renderLayer = L3D_OPAQUE_MESH_RENDERLAYER);
 
+// Like l3dLoadMesh(), but the engine takes ownership of vertices and
+// indices (see l3dAdoptTexture()), already laid out as in video memory:
+// L3DMesh::vertexSize() bytes per vertex (packed formats are not
+// supported) and indexType indices.
+L3D_API L3DHandle l3dAdoptMesh(
+    void *vertices,
+    unsigned int vertexCount,
+    void *indices,
+    unsigned int indexCount,
+    const L3DIndexType &indexType,
+    const L3DHandle &material,
+    const L3DVertexFormat &vertexFormat,
+    L3DReleaseCallback release,
+    void *userData = L3D_NULLPTR,
+    const L3DMat4 &transMatrix = L3DMat4(),
+    const L3DDrawType &drawType = L3D_DRAW_STATIC,
+    const L3DDrawPrimitive &drawPrimitive = L3D_DRAW_TRIANGLES,
+    unsigned char renderLayer = L3D_OPAQUE_MESH_RENDERLAYER);
+
+// Allocate the buffers of a mesh in video memory, for the application to
+// write its vertices and indices straight into (e.g. while decoding a
+// file), then create the mesh with l3dCommitMeshStorage(). Indices are
+// 16-bit when they can address all the vertices (see indexType). Packed
+// vertex formats are not supported. On failure, vertices is NULL. Off the
+// render thread, this waits for the render thread to allocate them.
+L3D_API L3DMeshStorage l3dAllocMeshStorage(
+    unsigned int vertexCount,
+    unsigned int indexCount,
+    const L3DVertexFormat &vertexFormat,
+    const L3DDrawType &drawType = L3D_DRAW_STATIC);
+
+// Once filled, the storage can't be written anymore. A storage which
+// failed is committed too: its buffers are then deleted.
+L3D_API L3DHandle l3dCommitMeshStorage(
+    const L3DMeshStorage &storage,
+    const L3DHandle &material,
+    const L3DMat4 &transMatrix = L3DMat4(),
+    const L3DDrawPrimitive &drawPrimitive = L3D_DRAW_TRIANGLES,
+    unsigned char renderLayer = L3D_OPAQUE_MESH_RENDERLAYER);
+
 L3D_API L3DHandle l3dLoadQuad(
     const L3DHandle &material,
     const L3DVec2 &texMulFactor = L3DVec2(1, 1),
@@ -266,6 +474,27 @@ L3D_API void l3dSetMeshInstances(
     unsigned int instanceCount,
     const L3DInstanceFormat &instanceFormat);
 
+// Levels of detail are ranges of the mesh indices, the first one being the
+// full mesh (see L3DMeshOptimizer::buildLods()).
+L3D_API void l3dSetMeshLods(
+    const L3DHandle &target,
+    const L3DMeshLod *lods,
+    unsigned int lodCount);
+
+// Levels of detail are selected from the distance to the mesh bounds,
+// computed from its vertices when they are kept in memory.
+L3D_API void l3dSetMeshBounds(
+    const L3DHandle &target,
+    const L3DVec3 &boundsMin,
+    const L3DVec3 &boundsMax);
+
+// Override the residency of the vertex, index and instance buffers of a
+// mesh (see l3dSetResidencyPolicy()): their CPU copies are released at
+// once unless kept.
+L3D_API void l3dSetMeshResidency(
+    const L3DHandle &target,
+    const L3DResidencyPolicy &policy);
+
 /* Lights *********************************************************************/
 
 L3D_API L3DHandle l3dLoadDirectionalLight(
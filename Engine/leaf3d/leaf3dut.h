@@ -43,8 +43,39 @@ L3D_API void l3dutPrintMat4(const L3DMat4 &mat);
 
 L3D_API int l3dutPrintFrameStats(double frameTime);
 
+// Print the scopes of the built-in profiler (see l3dEnableProfiler()).
+L3D_API void l3dutPrintProfile();
+
 /* Resource loading ***********************************************************/
 
+// Textures are read and decoded by a background pool: the loaders return a
+// white placeholder at once, which is replaced by the image on the next
+// l3dRenderFrame() after decoding. l3dutFinishLoading() waits for all the
+// pending loads and, on the render thread, uploads them immediately.
+// KTX and DDS files are uploaded as stored, block-compressed formats and
+// mip chains included (desiredFormat is ignored for them).
+L3D_API int l3dutFinishLoading();
+
+// Cook images to KTX textures written next to them ("x.png" -> "x.ktx"),
+// which are then loaded in their place while up to date. Texels are padded
+// to RGBA, the mip chain is filtered in linear space (unless srgb is false)
+// and compression can be L3D_BC1 or L3D_BC3. Files are cooked concurrently,
+// return how many succeeded.
+L3D_API int l3dutCookTextures(
+    const char **filenames,
+    unsigned int count,
+    const L3DImageFormat &compression = L3D_UNKNOWN,
+    bool srgb = true);
+
+// Loaded files are tracked per context: loading the same texture, shader,
+// shader program or model again returns the resources loaded the first time
+// (shaders are also matched by content). In particular, a model loaded twice
+// shares its meshes: use l3dSetMeshInstances() to draw it several times.
+// Releasing all the references makes the next load read the file again.
+L3D_API int l3dutReleaseAsset(const L3DHandle &handle);
+
+L3D_API unsigned int l3dutPrintAssetStats();
+
 L3D_API L3DHandle l3dutLoadTexture2D(
     const char *filename,
     const L3DImageFormat &desiredFormat = L3D_UNKNOWN);
@@ -58,6 +89,7 @@ L3D_API L3DHandle l3dutLoadTextureCube(
     const char *filenameFront,
     const L3DImageFormat &desiredFormat = L3D_UNKNOWN);
 
+// #include "name" directives are resolved next to the shader file.
 L3D_API L3DHandle l3dutLoadShader(
     const L3DShaderType &type,
     const char *filename);
@@ -67,10 +99,22 @@ L3D_API L3DHandle l3dutLoadShaderProgram(
     const char *fragmentShaderFilename,
     const char *geometryShaderFilename = 0);
 
+// Models are imported once, then cached in a binary file next to them
+// (e.g. "model.obj" -> "model.l3dm"), which is mapped and uploaded as is
+// by the next loads while it is newer than its source.
+// packVertices uploads the packed vertex formats (see L3D_VERTEX_PACKED),
+// about half the size of the float ones. The returned array is allocated
+// with malloc(): release it with free().
 L3D_API L3DHandle *l3dutLoadMeshes(
     const char *filename,
     const L3DHandle &shaderProgram,
     unsigned int *meshCount,
-    unsigned char renderLayer = L3D_OPAQUE_MESH_RENDERLAYER);
+    unsigned char renderLayer = L3D_OPAQUE_MESH_RENDERLAYER,
+    bool packVertices = false);
+
+// Write the binary mesh file of a model, by default next to it.
+L3D_API int l3dutConvertMeshes(
+    const char *filename,
+    const char *outputFilename = 0);
 
 #endif // L3D_LEAF3DUT_H
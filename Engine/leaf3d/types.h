@@ -47,6 +47,22 @@
 
 #define L3D_DEFAULT_LIGHT_RENDERLAYER_MASK L3D_BIT(L3D_OPAQUE_MESH_RENDERLAYER) | L3D_BIT(L3D_ALPHA_BLEND_MESH_RENDERLAYER)
 
+#define L3D_MAX_MESH_LODS 4
+
+// Lights looped over by a specialized shader variant, at most.
+#define L3D_SHADER_MAX_LIGHTS 16
+#define L3D_SHADER_LIGHT_SHIFT 8
+#define L3D_SHADER_LIGHT_MASK (0x7 << L3D_SHADER_LIGHT_SHIFT)
+
+#define L3D_PROFILE_NAME_SIZE 64
+
+// Render layers are identified by an unsigned char.
+#define L3D_MAX_RENDER_LAYERS 256
+#define L3D_FRAME_STATS_WINDOW 120
+
+// Textures over budget are never shrunk below this size, in texels.
+#define L3D_TEXTURE_MIN_EVICTED_SIZE 32
+
 #define GLSL(src) "#version 330 core\n" #src
 
 namespace l3d
@@ -93,7 +109,15 @@ namespace l3d
         L3D_VERTEX_POS3_NOR3_TAN3_UV2_UV2 = 13,
         L3D_VERTEX_POS3_NOR3_TAN3_UV2_UV2_UV2 = 15,
         L3D_VERTEX_POS3_NOR3_TAN3_UV2_UV2_UV2_UV2 = 17,
-        L3D_MAX_VERTEX_FORMAT
+        L3D_MAX_VERTEX_FORMAT,
+        // Packed variants, loaded from the vertices of the float format:
+        // 16-bit normalized positions relative to the mesh bounds,
+        // 10:10:10:2 normals and tangents, half-float UVs.
+        L3D_VERTEX_PACKED = 0x100,
+        L3D_VERTEX_PACKED_POS3_UV2 = L3D_VERTEX_PACKED | L3D_VERTEX_POS3_UV2,
+        L3D_VERTEX_PACKED_POS3_NOR3_UV2 = L3D_VERTEX_PACKED | L3D_VERTEX_POS3_NOR3_UV2,
+        L3D_VERTEX_PACKED_POS3_NOR3_TAN3_UV2 = L3D_VERTEX_PACKED | L3D_VERTEX_POS3_NOR3_TAN3_UV2,
+        L3D_VERTEX_PACKED_POS3_NOR3_TAN3_UV2_UV2 = L3D_VERTEX_PACKED | L3D_VERTEX_POS3_NOR3_TAN3_UV2_UV2
     };
 
     enum L3D_API L3DInstanceFormat
@@ -113,7 +137,13 @@ namespace l3d
         L3D_UNKNOWN = 0,
         L3D_RGB = 3,
         L3D_RGBA,
-        L3D_DEPTH24_STENCIL8
+        L3D_DEPTH24_STENCIL8,
+        // Block-compressed formats (4x4 pixels per block).
+        L3D_BC1, // RGB with 1-bit alpha, 8 bytes per block.
+        L3D_BC3, // RGBA, 16 bytes per block.
+        L3D_BC4, // R, 8 bytes per block.
+        L3D_BC5, // RG, 16 bytes per block.
+        L3D_BC7  // RGBA, 16 bytes per block.
     };
 
     enum L3D_API L3DPixelFormat
@@ -160,6 +190,129 @@ namespace l3d
         L3D_DRAW_TRIANGLES = 3
     };
 
+    // Features specializing the variants of a shader program: each one
+    // is injected as a L3D_VARIANT_* define (see L3DShaderPreprocessor).
+    enum L3D_API L3DShaderFeature
+    {
+        L3D_SHADER_DIFFUSE_MAP = L3D_BIT(0),
+        L3D_SHADER_SPECULAR_MAP = L3D_BIT(1),
+        L3D_SHADER_NORMAL_MAP = L3D_BIT(2),
+        L3D_SHADER_ALPHA_MAP = L3D_BIT(3),
+        L3D_SHADER_INSTANCING = L3D_BIT(4),
+        // Light count bucket, in bits L3D_SHADER_LIGHT_MASK.
+        // Set on draws whose program has variants.
+        L3D_SHADER_VARIANTS = L3D_BIT(15)
+    };
+
+    // Rolling averages of a profiler scope (see l3dGetProfile()).
+    struct L3D_API L3DProfileEntry
+    {
+        char name[L3D_PROFILE_NAME_SIZE];
+        unsigned int depth;
+        // Milliseconds per frame.
+        double cpuTime;
+        double gpuTime;
+        // Times the scope was entered in the last frame.
+        unsigned int calls;
+    };
+
+    // Work issued to OpenGL (see l3dGetFrameStats()).
+    struct L3D_API L3DRenderCounters
+    {
+        unsigned int drawCalls;
+        // Triangles, lines or points, instances included.
+        unsigned int primitives;
+        unsigned int programBinds;
+        unsigned int textureBinds;
+        unsigned int uniformUploads;
+        unsigned int frameBufferSwitches;
+        unsigned int clears;
+        // Depth, stencil, blend and cull state commands.
+        unsigned int stateChanges;
+        unsigned int renderCommands;
+    };
+
+    struct L3D_API L3DFrameStats
+    {
+        // Last frame, and per render layer.
+        L3DRenderCounters frame;
+        L3DRenderCounters layers[L3D_MAX_RENDER_LAYERS];
+        // Over the last frameCount frames (up to L3D_FRAME_STATS_WINDOW).
+        L3DRenderCounters min;
+        L3DRenderCounters average;
+        L3DRenderCounters max;
+        unsigned int frameCount;
+    };
+
+    // Estimated video memory, in bytes (see l3dGetMemoryStats()).
+    struct L3D_API L3DMemoryStats
+    {
+        // Sampled textures, mip levels included.
+        unsigned long long textures;
+        // Textures attached to frame buffers.
+        unsigned long long renderTargets;
+        unsigned long long vertexBuffers;
+        unsigned long long indexBuffers;
+        unsigned long long instanceBuffers;
+        unsigned long long total;
+        unsigned int textureCount;
+        unsigned int renderTargetCount;
+        unsigned int bufferCount;
+        // Textures whose largest mip levels are evicted.
+        unsigned int evictedTextureCount;
+        // Limit of sampled textures, or 0.
+        unsigned long long textureBudget;
+    };
+
+    // Engine subsystems owning CPU memory (see l3dSetAllocator()).
+    enum L3D_API L3DMemoryTag
+    {
+        // Vertex, index and instance data.
+        L3D_MEMORY_GEOMETRY = 0,
+        L3D_MEMORY_TEXTURES,
+        // Shader sources.
+        L3D_MEMORY_SHADERS,
+        // Render commands.
+        L3D_MEMORY_COMMANDS,
+        // Temporary data of loaders (e.g. decoded images).
+        L3D_MEMORY_LOADER,
+        L3D_MEMORY_TAG_COUNT
+    };
+
+    // Live CPU allocations (see l3dGetAllocationStats()).
+    struct L3D_API L3DAllocationStats
+    {
+        // Per L3DMemoryTag.
+        unsigned long long bytes[L3D_MEMORY_TAG_COUNT];
+        unsigned int counts[L3D_MEMORY_TAG_COUNT];
+        unsigned long long totalBytes;
+        unsigned int totalCount;
+        unsigned long long peakBytes;
+    };
+
+    // What happens to the CPU copy of buffer and texture data once it is
+    // uploaded to video memory.
+    enum L3D_API L3DResidencyPolicy
+    {
+        // Kept for the lifetime of the resource.
+        L3D_RESIDENCY_KEEP = 0,
+        // Never copied: resources are uploaded straight from the caller
+        // data, and features needing it (e.g. texture eviction) are off.
+        L3D_RESIDENCY_DISCARD,
+        // Like L3D_RESIDENCY_DISCARD, but fetched back when needed: from
+        // the resource source if any, else read back from video memory.
+        L3D_RESIDENCY_RELOAD
+    };
+
+    enum L3D_API L3DTangentMode
+    {
+        // Normalized face tangents summed per vertex.
+        L3D_TANGENTS_FAST = 0,
+        // Face tangents projected on the vertex normal plane and weighted
+        // by corner angle, as MikkTSpace does (without bitangent signs).
+        L3D_TANGENTS_MIKKTSPACE
+    };
+
     enum L3D_API L3DAttachmentType
     {
         L3D_DEPTH_STENCIL_ATTACHMENT,
@@ -201,11 +354,11 @@ namespace l3d
         int valueI;
         unsigned int valueUI;
         bool valueB;
-        float *valueVec2;
-        float *valueVec3;
-        float *valueVec4;
-        float *valueMat3;
-        float *valueMat4;
+        float valueVec2[2];
+        float valueVec3[3];
+        float valueVec4[4];
+        float valueMat3[9];
+        float valueMat4[16];
     };
 
     enum L3D_API L3DDepthFactor
@@ -260,6 +413,13 @@ namespace l3d
         L3D_BUFFER_INSTANCE
     };
 
+    // Index types, valued as their size in bytes.
+    enum L3D_API L3DIndexType
+    {
+        L3D_INDEX_UNSIGNED_SHORT = 2,
+        L3D_INDEX_UNSIGNED_INT = 4
+    };
+
     enum L3D_API L3DTextureType
     {
         L3D_TEXTURE_1D = 0,
@@ -294,6 +454,16 @@ namespace l3d
         float kq;
     };
 
+    // Level of detail of a mesh: a range of its index buffer, all levels
+    // sharing the same vertices. Error is the geometric deviation from the
+    // full mesh, in model units (0 for the first level).
+    struct L3D_API L3DMeshLod
+    {
+        unsigned int indexOffset;
+        unsigned int indexCount;
+        float error;
+    };
+
     // Almost-opaque resource handle:
     //
     // x-------------------- repr ---------------------X
@@ -317,6 +487,47 @@ namespace l3d
     } L3DHandle;
 
     L3D_API const L3DHandle L3D_INVALID_HANDLE = L3DHandle();
+
+    // Application hook invoked by the render thread (e.g. to make the
+    // OpenGL context current or to swap buffers).
+    typedef L3D_API void (*L3DContextCallback)(void *userData);
+
+    // Application allocator (see l3dSetAllocator()): allocate may return
+    // NULL to refuse an allocation, e.g. to enforce a memory cap.
+    typedef L3D_API void *(*L3DAllocateCallback)(size_t size, L3DMemoryTag tag, void *userData);
+    typedef L3D_API void (*L3DDeallocateCallback)(void *ptr, size_t size, L3DMemoryTag tag, void *userData);
+
+    struct L3D_API L3DAllocator
+    {
+        L3DAllocateCallback allocate;
+        L3DDeallocateCallback deallocate;
+        void *userData;
+    };
+
+    // Application source of discarded resource data (see
+    // l3dSetTextureSource()): fill size bytes laid out as the current
+    // image of the resource, or return false.
+    typedef L3D_API bool (*L3DReloadCallback)(const L3DHandle &resource, void *data, unsigned int size, void *userData);
+
+    // Release of data adopted by the engine (see l3dAdoptMesh()), called
+    // once the data is no longer needed.
+    typedef L3D_API void (*L3DReleaseCallback)(void *data, void *userData);
+
+    // Mesh buffers filled in place by the application (see
+    // l3dAllocMeshStorage()): vertices and indices point to video memory
+    // until the storage is committed.
+    struct L3D_API L3DMeshStorage
+    {
+        L3DHandle vertexBuffer;
+        L3DHandle indexBuffer;
+        void *vertices;
+        void *indices;
+        unsigned int vertexCount;
+        unsigned int indexCount;
+        L3DVertexFormat vertexFormat;
+        L3DIndexType indexType;
+        L3DDrawType drawType;
+    };
 }
 
 #endif // L3D_TYPES_H
@@ -20,14 +20,33 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <atomic>
+#include <memory>
 
 #include <leaf3d/leaf3d.h>
 #include <leaf3d/leaf3dut.h>
-
+#include <leaf3d/L3DContext.h>
+#include <leaf3d/L3DRenderer.h>
+#include <leaf3d/L3DMesh.h>
+#include <leaf3d/L3DAssetRegistry.h>
+#include <leaf3d/L3DMeshFile.h>
+#include <leaf3d/L3DMeshOptimizer.h>
+#include <leaf3d/L3DShaderPreprocessor.h>
+#include <leaf3d/L3DTextureFile.h>
+#include <leaf3d/L3DTextureCooker.h>
+#include <leaf3d/L3DTrace.h>
+#include <leaf3d/L3DMemory.h>
+
+// Decoded images are loader memory.
+#define STBI_MALLOC(size) l3d::L3DMemory::allocate(size, l3d::L3D_MEMORY_LOADER)
+#define STBI_REALLOC(ptr, size) l3d::L3DMemory::reallocate(ptr, size, l3d::L3D_MEMORY_LOADER)
+#define STBI_FREE(ptr) l3d::L3DMemory::deallocate(ptr)
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
@@ -37,19 +56,155 @@
 
 using namespace l3d;
 
-#ifdef __APPLE__
-static std::string s_defaultRootPath = "";
-#else
-static std::string s_defaultRootPath = "Resources/";
-#endif
+static std::string rootPath()
+{
+    L3DContext *context = l3dCurrentContext();
+
+    return context ? context->rootPath() : L3D_DEFAULT_ROOT_PATH;
+}
+
+// Path of a file derived from another one, e.g. "x.obj" -> "x.l3dm".
+static std::string replaceExtension(const std::string &path, const char *extension)
+{
+    std::string::size_type slash = path.find_last_of("/\\");
+    std::string::size_type dot = path.find_last_of('.');
+
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + extension;
+
+    return path.substr(0, dot) + extension;
+}
+
+// True if the file exists and its source doesn't or is older.
+static bool isUpToDate(const std::string &path, const std::string &sourcePath)
+{
+    struct stat info, sourceInfo;
+
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+
+    return stat(sourcePath.c_str(), &sourceInfo) != 0 || info.st_mtime >= sourceInfo.st_mtime;
+}
+
+struct L3DDecodedImage
+{
+    unsigned char *pixels;
+    int width;
+    int height;
+    int comp;
+    // Pre-built mip chain, read from KTX and DDS files.
+    L3DTextureImage container;
+
+    L3DDecodedImage() : pixels(L3D_NULLPTR), width(0), height(0), comp(0) {}
+    ~L3DDecodedImage() { stbi_image_free(pixels); }
+
+    bool isContainer() const { return !container.data.empty(); }
+    bool isValid() const { return pixels || isContainer(); }
+    L3DImageFormat format() const { return isContainer() ? container.format : (comp == 4 ? L3D_RGBA : L3D_RGB); }
+    const unsigned char *data() const { return isContainer() ? &container.data[0] : pixels; }
+    unsigned int mipCount() const { return isContainer() ? container.mipCount : 1; }
+    unsigned int size() const { return isContainer() ? container.data.size() : width * height * comp; }
+};
+
+typedef std::shared_ptr<L3DDecodedImage> L3DDecodedImagePtr;
+typedef std::vector<L3DDecodedImagePtr> L3DDecodedImageList;
+
+// Read and decode an image file: safe to call from any thread.
+static L3DDecodedImage *decodeImage(const std::string &path, const L3DImageFormat &desiredFormat)
+{
+    L3D_TRACE_SCOPE("Decode image");
+
+    L3DDecodedImage *image = new L3DDecodedImage();
+    std::string cookedPath = replaceExtension(path, ".ktx");
+
+    // Prefer the cooked texture, if any (see l3dutCookTextures()).
+    if (!L3DTextureFile::isContainer(path) && isUpToDate(cookedPath, path))
+    {
+        if (L3DTextureFile::load(cookedPath, image->container))
+        {
+            image->width = image->container.width;
+            image->height = image->container.height;
+
+            return image;
+        }
+
+        image->container.data.clear();
+    }
+
+    if (L3DTextureFile::isContainer(path))
+    {
+        if (L3DTextureFile::load(path, image->container))
+        {
+            image->width = image->container.width;
+            image->height = image->container.height;
+        }
+        else
+        {
+            image->container.data.clear();
+        }
+
+        return image;
+    }
+
+    image->pixels = stbi_load(path.c_str(), &image->width, &image->height, &image->comp, desiredFormat);
+
+    if (!image->pixels)
+        fprintf(stderr, "Failed to load image %s: %s\n", path.c_str(), stbi_failure_reason());
+    else if (desiredFormat != L3D_UNKNOWN)
+        image->comp = desiredFormat;
+
+    return image;
+}
+
+// Asset keys: resource kind, normalized path and loading options.
+static std::string assetKey(const char *kind, const std::string &path, unsigned int option)
+{
+    std::ostringstream key;
+    key << kind << ":" << L3DAssetRegistry::normalizePath(path) << ":" << option;
+
+    return key.str();
+}
+
+static bool acquireAsset(
+    L3DContext *context,
+    const std::string &key,
+    L3DHandle &handle,
+    unsigned long long hash = 0)
+{
+    L3DHandleList handles;
+
+    if (!context || !context->assets()->acquire(key, handles, hash) || handles.empty())
+        return false;
 
-static std::string s_rootPath = s_defaultRootPath;
+    handle = handles[0];
+
+    return true;
+}
+
+static void addAsset(
+    L3DContext *context,
+    const std::string &key,
+    const L3DHandle &handle,
+    unsigned int size = 0,
+    unsigned long long hash = 0)
+{
+    if (context && handle.repr != L3D_INVALID_HANDLE.repr)
+        context->assets()->add(key, L3DHandleList(1, handle), size, hash);
+}
 
 int l3dutInit(const char *rootPath)
 {
+    L3DContext *context = l3dCurrentContext();
+
+    if (context == L3D_NULLPTR)
+    {
+        fprintf(stderr, "l3dutInit: no current context, call l3dInit() first\n");
+        return -1;
+    }
+
     if (rootPath)
     {
-        s_rootPath = rootPath;
+        context->setRootPath(rootPath);
     }
 
     return L3D_TRUE;
@@ -57,7 +212,10 @@ int l3dutInit(const char *rootPath)
 
 int l3dutTerminate()
 {
-    s_rootPath = s_defaultRootPath;
+    L3DContext *context = l3dCurrentContext();
+
+    if (context)
+        context->setRootPath(L3D_DEFAULT_ROOT_PATH);
 
     return L3D_TRUE;
 }
@@ -136,20 +294,99 @@ int l3dutPrintFrameStats(double frameTime)
         printf("Frame time [ms]: %.2f (FPS: %d)\n", frameTime * 1000.0, fps);
     }
 
+    L3DFrameStats stats = l3dGetFrameStats();
+
+    if (stats.frameCount > 0)
+    {
+        printf("Draw calls: %u (avg %u, max %u), primitives: %u, program binds: %u, texture binds: %u, uniforms: %u, frame buffers: %u\n",
+               stats.frame.drawCalls,
+               stats.average.drawCalls,
+               stats.max.drawCalls,
+               stats.frame.primitives,
+               stats.frame.programBinds,
+               stats.frame.textureBinds,
+               stats.frame.uniformUploads,
+               stats.frame.frameBufferSwitches);
+    }
+
+    L3DMemoryStats memory = l3dGetMemoryStats();
+    const double mb = 1024.0 * 1024.0;
+
+    printf("Video memory [MB]: %.1f, textures: %.1f", memory.total / mb, memory.textures / mb);
+    if (memory.textureBudget)
+        printf(" (budget %.1f, %u evicted)", memory.textureBudget / mb, memory.evictedTextureCount);
+    printf(", render targets: %.1f, buffers: %.1f\n",
+           memory.renderTargets / mb,
+           (memory.vertexBuffers + memory.indexBuffers + memory.instanceBuffers) / mb);
+
     return fps;
 }
 
+void l3dutPrintProfile()
+{
+    std::vector<L3DProfileEntry> entries(l3dGetProfile(L3D_NULLPTR, 0));
+
+    if (entries.empty())
+        return;
+
+    // Scopes may be added meanwhile.
+    unsigned int count = l3dGetProfile(&entries[0], entries.size());
+    if (count < entries.size())
+        entries.resize(count);
+
+    printf("%-40s %10s %10s %6s\n", "Scope", "CPU [ms]", "GPU [ms]", "Calls");
+    for (unsigned int i = 0; i < entries.size(); ++i)
+    {
+        const L3DProfileEntry &entry = entries[i];
+        std::string name = std::string(entry.depth * 2, ' ') + entry.name;
+        printf("%-40s %10.3f %10.3f %6u\n", name.c_str(), entry.cpuTime, entry.gpuTime, entry.calls);
+    }
+}
+
 L3DHandle l3dutLoadTexture2D(
     const char *filename,
     const L3DImageFormat &desiredFormat)
 {
-    if (!filename)
+    L3DContext *context = l3dCurrentContext();
+
+    if (!filename || !context || !context->renderer())
         return L3D_INVALID_HANDLE;
 
-    int width, height, comp = 0;
-    unsigned char *img = stbi_load((s_rootPath + filename).c_str(), &width, &height, &comp, desiredFormat);
-    L3DHandle texture = l3dLoadTexture(L3D_TEXTURE_2D, comp == 4 ? L3D_RGBA : L3D_RGB, img, width, height, 0);
-    stbi_image_free(img);
+    std::string path = rootPath() + filename;
+    std::string key = assetKey("texture2D", path, desiredFormat);
+    L3DHandle texture;
+
+    if (acquireAsset(context, key, texture))
+        return texture;
+
+    // Show a placeholder until the image is decoded.
+    unsigned char placeholder[] = {255, 255, 255, 255};
+    texture = l3dLoadTexture(L3D_TEXTURE_2D, desiredFormat == L3D_RGBA ? L3D_RGBA : L3D_RGB, placeholder, 1, 1, 0);
+    addAsset(context, key, texture);
+
+    L3DRenderer *renderer = context->renderer();
+    L3DAssetRegistry *assets = context->assets();
+
+    L3DJob decode = [renderer, assets, texture, path, key, desiredFormat]() {
+        L3DDecodedImagePtr image(decodeImage(path, desiredFormat));
+
+        if (!image->isValid())
+            return;
+
+        if (image->isContainer() && image->container.type != L3D_TEXTURE_2D)
+        {
+            fprintf(stderr, "Failed to load texture %s: not a 2D texture\n", path.c_str());
+            return;
+        }
+
+        assets->setSize(key, image->size());
+
+        renderer->enqueueCall([texture, image]() {
+            l3dUpdateTexture(texture, image->format(), image->data(), image->width, image->height, 0, true, image->mipCount());
+        });
+    };
+
+    context->loader()->run(decode, context->pendingLoads());
 
     return texture;
 }
@@ -163,54 +400,182 @@ L3DHandle l3dutLoadTextureCube(
     const char *filenameFront,
     const L3DImageFormat &desiredFormat)
 {
+    L3DContext *context = l3dCurrentContext();
+
     if (!filenameRight || !filenameLeft || !filenameTop || !filenameBottom || !filenameBack || !filenameFront)
         return L3D_INVALID_HANDLE;
 
-    int width, height, comp, size = 0;
-    unsigned char *imgRight = stbi_load((s_rootPath + filenameRight).c_str(), &width, &height, &comp, desiredFormat);
-    size += width * height * comp;
-    unsigned char *imgLeft = stbi_load((s_rootPath + filenameLeft).c_str(), &width, &height, &comp, desiredFormat);
-    size += width * height * comp;
-    unsigned char *imgTop = stbi_load((s_rootPath + filenameTop).c_str(), &width, &height, &comp, desiredFormat);
-    size += width * height * comp;
-    unsigned char *imgBottom = stbi_load((s_rootPath + filenameBottom).c_str(), &width, &height, &comp, desiredFormat);
-    size += width * height * comp;
-    unsigned char *imgBack = stbi_load((s_rootPath + filenameBack).c_str(), &width, &height, &comp, desiredFormat);
-    size += width * height * comp;
-    unsigned char *imgFront = stbi_load((s_rootPath + filenameFront).c_str(), &width, &height, &comp, desiredFormat);
-    size += width * height * comp;
-
-    unsigned char *img = (unsigned char *)malloc(size);
-    unsigned int faceSize = size / 6;
-    memcpy(img, imgRight, faceSize);
-    memcpy(img + faceSize, imgLeft, faceSize);
-    memcpy(img + faceSize * 2, imgTop, faceSize);
-    memcpy(img + faceSize * 3, imgBottom, faceSize);
-    memcpy(img + faceSize * 4, imgBack, faceSize);
-    memcpy(img + faceSize * 5, imgFront, faceSize);
-
-    stbi_image_free(imgRight);
-    stbi_image_free(imgLeft);
-    stbi_image_free(imgTop);
-    stbi_image_free(imgBottom);
-    stbi_image_free(imgBack);
-    stbi_image_free(imgFront);
-
-    L3DHandle texture = l3dLoadTexture(L3D_TEXTURE_CUBE_MAP, comp == 4 ? L3D_RGBA : L3D_RGB, img, width, height, 0);
-
-    stbi_image_free(img);
+    if (!context || !context->renderer())
+        return L3D_INVALID_HANDLE;
+
+    const char *filenames[] = {filenameRight, filenameLeft, filenameTop, filenameBottom, filenameBack, filenameFront};
+    std::string facePaths;
+    for (unsigned int i = 0; i < 6; ++i)
+        facePaths += (i ? "|" : "") + L3DAssetRegistry::normalizePath(rootPath() + filenames[i]);
+
+    std::string key = assetKey("textureCube", facePaths, desiredFormat);
+    L3DHandle texture;
+
+    if (acquireAsset(context, key, texture))
+        return texture;
+
+    // Show a placeholder until all the faces are decoded.
+    unsigned char placeholder[6 * 4];
+    memset(placeholder, 255, sizeof(placeholder));
+    texture = l3dLoadTexture(L3D_TEXTURE_CUBE_MAP, desiredFormat == L3D_RGBA ? L3D_RGBA : L3D_RGB, placeholder, 1, 1, 0);
+    addAsset(context, key, texture);
+
+    L3DRenderer *renderer = context->renderer();
+    L3DAssetRegistry *assets = context->assets();
+    std::shared_ptr<L3DDecodedImageList> faces(new L3DDecodedImageList(6));
+    std::shared_ptr<std::atomic<unsigned int> > remaining(new std::atomic<unsigned int>(6));
+
+    // Faces are decoded concurrently: the last one schedules the upload.
+    for (unsigned int i = 0; i < 6; ++i)
+    {
+        std::string path = rootPath() + filenames[i];
+
+        L3DJob decode = [renderer, assets, texture, path, key, desiredFormat, faces, remaining, i]() {
+            (*faces)[i] = L3DDecodedImagePtr(decodeImage(path, desiredFormat));
+
+            if (--(*remaining) > 0)
+                return;
+
+            const L3DDecodedImage *first = (*faces)[0].get();
+
+            for (unsigned int f = 0; f < 6; ++f)
+            {
+                const L3DDecodedImage *face = (*faces)[f].get();
+
+                if (!face->isValid() || face->width != first->width || face->height != first->height ||
+                    face->format() != first->format() || face->mipCount() != first->mipCount() ||
+                    (face->isContainer() && face->container.type != L3D_TEXTURE_2D))
+                {
+                    fprintf(stderr, "Cube map faces are missing or have different sizes\n");
+                    return;
+                }
+            }
+
+            assets->setSize(key, 6 * first->size());
+
+            renderer->enqueueCall([texture, faces]() {
+                for (unsigned int f = 0; f < 6; ++f)
+                {
+                    const L3DDecodedImage *face = (*faces)[f].get();
+                    l3dUpdateTexture(texture, face->format(), face->data(), face->width, face->height, f, f == 5, face->mipCount());
+                }
+            });
+        };
+
+        context->loader()->run(decode, context->pendingLoads());
+    }
 
     return texture;
 }
 
+int l3dutFinishLoading()
+{
+    L3DContext *context = l3dCurrentContext();
+
+    if (!context || !context->renderer())
+        return -1;
+
+    context->finishLoads();
+
+    // Upload the decoded images right away.
+    if (context->renderer()->isRenderThread())
+        context->renderer()->executeCalls();
+
+    return L3D_TRUE;
+}
+
+int l3dutCookTextures(
+    const char **filenames,
+    unsigned int count,
+    const L3DImageFormat &compression,
+    bool srgb)
+{
+    L3DContext *context = l3dCurrentContext();
+
+    if (!filenames || !context)
+        return -1;
+
+    L3DTextureCookOptions options;
+    options.srgb = srgb;
+    options.compression = compression;
+
+    std::string root = rootPath();
+    std::atomic<unsigned int> cooked(0);
+    L3DJobCounter counter;
+
+    // Images are independent: cook them all concurrently.
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        if (!filenames[i])
+            continue;
+
+        std::string path = root + filenames[i];
+
+        L3DJob cook = [path, options, &cooked]() {
+            L3D_TRACE_SCOPE("Cook texture");
+
+            L3DTextureImage image;
+            int width = 0, height = 0, comp = 0;
+            unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &comp, 0);
+
+            if (!pixels)
+            {
+                fprintf(stderr, "Failed to load image %s: %s\n", path.c_str(), stbi_failure_reason());
+                return;
+            }
+
+            bool ok = L3DTextureCooker::cook(pixels, width, height, comp, options, image);
+            stbi_image_free(pixels);
+
+            if (ok && L3DTextureFile::writeKTX(replaceExtension(path, ".ktx"), image))
+                ++cooked;
+        };
+
+        context->loader()->run(cook, &counter);
+    }
+
+    context->loader()->wait(&counter);
+
+    return cooked;
+}
+
+// Included files are looked up next to the including shader.
+static bool loadShaderInclude(const char *name, std::string &source, void *userData)
+{
+    const std::string *directory = (const std::string *)userData;
+    std::ifstream file((*directory + name).c_str());
+
+    if (!file)
+        return false;
+
+    std::stringstream stream;
+    stream << file.rdbuf();
+    source = stream.str();
+
+    return true;
+}
+
 L3DHandle l3dutLoadShader(const L3DShaderType &type, const char *filename)
 {
     if (!filename)
         return L3D_INVALID_HANDLE;
 
+    L3DContext *context = l3dCurrentContext();
+    std::string path = rootPath() + filename;
+    std::string key = assetKey("shader", path, type);
+    L3DHandle shader;
+
+    if (acquireAsset(context, key, shader))
+        return shader;
+
     std::ifstream file;
 
-    file.open((s_rootPath + filename).c_str());
+    file.open(path.c_str());
 
     if (!file)
         return L3D_INVALID_HANDLE;
@@ -221,9 +586,26 @@ L3DHandle l3dutLoadShader(const L3DShaderType &type, const char *filename)
 
     file.close();
 
-    std::string out = stream.str();
+    std::string directory = path.substr(0, path.find_last_of('/') + 1);
+    std::string out;
 
-    return l3dLoadShader(type, out.c_str());
+    if (!L3DShaderPreprocessor::resolveIncludes(stream.str(), out, loadShaderInclude, &directory))
+    {
+        fprintf(stderr, "Shader file %s: include failed\n", path.c_str());
+        return L3D_INVALID_HANDLE;
+    }
+
+    // The same source may be found at another path.
+    std::string content = (char)type + out;
+    unsigned long long hash = L3DAssetRegistry::hash(content.data(), content.size());
+
+    if (acquireAsset(context, key, shader, hash))
+        return shader;
+
+    shader = l3dLoadShader(type, out.c_str());
+    addAsset(context, key, shader, out.size(), hash);
+
+    return shader;
 }
 
 L3DHandle l3dutLoadShaderProgram(
@@ -238,45 +620,142 @@ L3DHandle l3dutLoadShaderProgram(
     L3DHandle fragmentShader = l3dutLoadShader(L3D_SHADER_FRAGMENT, fragmentShaderFilename);
     L3DHandle geometryShader = l3dutLoadShader(L3D_SHADER_GEOMETRY, geometryShaderFilename);
 
-    return l3dLoadShaderProgram(vertexShader, fragmentShader, geometryShader);
+    // Same shaders, same program.
+    L3DContext *context = l3dCurrentContext();
+    std::ostringstream key;
+    key << "shaderProgram:" << vertexShader.repr << ":" << fragmentShader.repr << ":" << geometryShader.repr;
+    L3DHandle shaderProgram;
+
+    if (acquireAsset(context, key.str(), shaderProgram))
+        return shaderProgram;
+
+    shaderProgram = l3dLoadShaderProgram(vertexShader, fragmentShader, geometryShader);
+    addAsset(context, key.str(), shaderProgram);
+
+    return shaderProgram;
 }
 
-L3DHandle *l3dutLoadMeshes(
-    const char *filename,
-    const L3DHandle &shaderProgram,
-    unsigned int *meshCount,
-    unsigned char renderLayer)
+static void releaseMeshData(void *data, void *)
 {
-    if (!filename)
+    L3DMemory::deallocate(data);
+}
+
+static void copyIndices(void *dest, const unsigned int *indices, unsigned int indexCount, const L3DIndexType &indexType)
+{
+    for (unsigned int i = 0; i < indexCount; ++i)
     {
-        if (meshCount)
-            *meshCount = 0;
+        if (indexType == L3D_INDEX_UNSIGNED_SHORT)
+            ((unsigned short *)dest)[i] = (unsigned short)indices[i];
+        else
+            ((unsigned int *)dest)[i] = indices[i];
+    }
+}
 
-        return 0;
+// Geometry imported by Assimp, laid out as in the binary mesh format.
+struct L3DImportedScene
+{
+    L3DMeshFileMaterialList materials;
+    L3DMeshFileSourceList meshes;
+    std::vector<std::vector<float> > vertices;
+    std::vector<std::vector<unsigned int> > indices;
+};
+
+static void copyName(char *name, const char *value)
+{
+    strncpy(name, value, L3D_MESH_FILE_NAME_SIZE - 1);
+    name[L3D_MESH_FILE_NAME_SIZE - 1] = 0;
+}
+
+static void copyTextureName(
+    char *name,
+    const aiMaterial *material,
+    const aiTextureType &type)
+{
+    name[0] = 0;
+
+    if (material->GetTextureCount(type) > 0)
+    {
+        aiString textureFilename;
+        material->GetTexture(type, 0, &textureFilename);
+        copyName(name, textureFilename.C_Str());
     }
+}
 
-    std::vector<L3DHandle> meshes;
+static bool importScene(const std::string &path, L3DImportedScene &imported)
+{
+    L3D_TRACE_SCOPE("Import scene");
 
     Assimp::Importer importer;
-
-    const aiScene *scene = importer.ReadFile(s_rootPath + filename, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    const aiScene *scene = L3D_NULLPTR;
+    {
+        L3D_TRACE_SCOPE("Assimp import");
+        scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+    }
 
     if (!scene)
-    {
-        if (meshCount)
-            *meshCount = 0;
+        return false;
 
-        return 0;
+    imported.materials.resize(scene->mNumMaterials);
+
+    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+    {
+        const aiMaterial *mat = scene->mMaterials[i];
+        L3DMeshFileMaterial &material = imported.materials[i];
+
+        aiString materialName;
+        mat->Get(AI_MATKEY_NAME, materialName);
+        copyName(material.name, materialName.C_Str());
+
+        aiColor3D diffuse;
+        mat->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+
+        aiColor3D specular;
+        mat->Get(AI_MATKEY_COLOR_SPECULAR, specular);
+
+        aiColor3D ambient;
+        mat->Get(AI_MATKEY_COLOR_AMBIENT, ambient);
+
+        float shininess;
+        mat->Get(AI_MATKEY_SHININESS, shininess);
+
+        material.diffuse[0] = diffuse.r;
+        material.diffuse[1] = diffuse.g;
+        material.diffuse[2] = diffuse.b;
+        material.ambient[0] = ambient.r;
+        material.ambient[1] = ambient.g;
+        material.ambient[2] = ambient.b;
+        material.specular[0] = specular.r;
+        material.specular[1] = specular.g;
+        material.specular[2] = specular.b;
+        material.shininess = shininess;
+
+        copyTextureName(material.textures[L3D_MESH_FILE_DIFFUSE_MAP], mat, aiTextureType_DIFFUSE);
+        copyTextureName(material.textures[L3D_MESH_FILE_SPECULAR_MAP], mat, aiTextureType_SPECULAR);
+        copyTextureName(material.textures[L3D_MESH_FILE_ALPHA_MAP], mat, aiTextureType_OPACITY);
+        copyTextureName(material.textures[L3D_MESH_FILE_NORMAL_MAP], mat, aiTextureType_HEIGHT);
     }
 
+    imported.vertices.resize(scene->mNumMeshes);
+    imported.indices.resize(scene->mNumMeshes);
+
+    // Vertex cache statistics of the whole scene.
+    float missesBefore = 0.0f;
+    float missesAfter = 0.0f;
+    unsigned int vertexCountBefore = 0;
+    unsigned int vertexCountAfter = 0;
+    unsigned int triangleCount = 0;
+
     for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
     {
         const aiMesh *mesh = scene->mMeshes[i];
 
-        std::vector<float> vertices;
-        std::vector<unsigned int> indices;
+        std::vector<float> &vertices = imported.vertices[i];
+        std::vector<unsigned int> &indices = imported.indices[i];
         L3DVertexFormat vertexFormat = L3D_VERTEX_POS3_UV2;
 
+        // Tangents are computed below, once the whole mesh is known.
+        bool hasTangents = mesh->HasNormals() && mesh->HasTextureCoords(0);
+
         for (unsigned int j = 0; j < mesh->mNumVertices; ++j)
         {
             if (mesh->HasPositions())
@@ -295,11 +774,11 @@ L3DHandle *l3dutLoadMeshes(
                 vertexFormat = L3D_VERTEX_POS3_NOR3_UV2;
             }
 
-            if (mesh->HasTangentsAndBitangents())
+            if (hasTangents)
             {
-                vertices.push_back(mesh->mTangents[j].x);
-                vertices.push_back(mesh->mTangents[j].y);
-                vertices.push_back(mesh->mTangents[j].z);
+                vertices.push_back(0);
+                vertices.push_back(0);
+                vertices.push_back(0);
 
                 vertexFormat = L3D_VERTEX_POS3_NOR3_TAN3_UV2;
             }
@@ -330,81 +809,293 @@ L3DHandle *l3dutLoadMeshes(
             indices.push_back(mesh->mFaces[j].mIndices[2]);
         }
 
-        L3DHandle material;
-        if (mesh->mMaterialIndex >= 0)
+        if (vertices.size() != mesh->mNumVertices * vertexFormat)
         {
-            aiMaterial *mat = scene->mMaterials[mesh->mMaterialIndex];
+            fprintf(stderr, "%s: skipping mesh %d, unsupported vertex layout\n", path.c_str(), i);
+            continue;
+        }
 
-            aiString materialName;
-            mat->Get(AI_MATKEY_NAME, materialName);
+        L3D_TRACE_SCOPE("Optimize mesh");
+        L3DVertexCacheStats importedCache = L3DMeshOptimizer::analyzeVertexCache(indices, mesh->mNumVertices);
 
-            aiColor3D diffuse;
-            mat->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+        // Imported faces don't share vertices: weld them first, so that
+        // tangents are smoothed across faces and vertices still weld after.
+        if (hasTangents)
+        {
+            unsigned int vertexCount = L3DMeshOptimizer::weldVertices(vertices, indices, vertexFormat);
+            L3DMesh::computeTangents(vertices.data(), vertexCount, indices.data(), indices.size(), vertexFormat, L3D_TANGENTS_MIKKTSPACE);
+        }
 
-            aiColor3D specular;
-            mat->Get(AI_MATKEY_COLOR_SPECULAR, specular);
+        // Weld, reorder for the vertex cache and overdraw, then for fetch.
+        L3DMeshOptimizerStats stats = L3DMeshOptimizer::optimize(vertices, indices, vertexFormat);
+        stats.before = importedCache;
+        stats.vertexCountBefore = mesh->mNumVertices;
+        unsigned int triangles = indices.size() / 3;
+        missesBefore += stats.before.acmr * triangles;
+        missesAfter += stats.after.acmr * triangles;
+        vertexCountBefore += stats.vertexCountBefore;
+        vertexCountAfter += stats.vertexCountAfter;
+        triangleCount += triangles;
+
+        // Coarser levels of detail follow the full mesh in the indices.
+        L3DMeshLod lods[L3D_MAX_MESH_LODS];
+        unsigned int lodCount = L3DMeshOptimizer::buildLods(vertices, vertexFormat, indices, lods, L3D_MAX_MESH_LODS);
+
+        L3DMeshFileSource source;
+        source.info.vertexFormat = vertexFormat;
+        source.info.vertexCount = stats.vertexCountAfter;
+        source.info.indexCount = indices.size();
+        source.info.material = (mesh->mMaterialIndex < scene->mNumMaterials) ? (int)mesh->mMaterialIndex : -1;
+        source.info.lodCount = (lodCount > 1) ? lodCount : 0;
+        for (unsigned int l = 0; l < L3D_MAX_MESH_LODS; ++l)
+        {
+            source.info.lods[l].indexOffset = (l < lodCount) ? lods[l].indexOffset : 0;
+            source.info.lods[l].indexCount = (l < lodCount) ? lods[l].indexCount : 0;
+            source.info.lods[l].error = (l < lodCount) ? lods[l].error : 0.0f;
+        }
+        source.vertices = vertices.data();
+        source.indices = indices.data();
+        L3DMeshFile::computeBounds(source.info, source.vertices);
+
+        imported.meshes.push_back(source);
+    }
 
-            aiColor3D ambient;
-            mat->Get(AI_MATKEY_COLOR_AMBIENT, ambient);
+    if (triangleCount > 0)
+    {
+        printf("Optimize %s: %u -> %u vertices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+               path.c_str(),
+               vertexCountBefore,
+               vertexCountAfter,
+               missesBefore / triangleCount,
+               missesAfter / triangleCount,
+               missesBefore / vertexCountBefore,
+               missesAfter / vertexCountAfter);
+    }
 
-            float shininess;
-            mat->Get(AI_MATKEY_SHININESS, shininess);
+    return true;
+}
 
-            material = l3dLoadMaterial(
-                materialName.C_Str(),
-                shaderProgram,
-                L3DVec3(diffuse.r, diffuse.g, diffuse.b),
-                L3DVec3(ambient.r, ambient.g, ambient.b),
-                L3DVec3(specular.r, specular.g, specular.b),
-                shininess);
+static void createMeshes(
+    const L3DMeshFileMaterial *materials,
+    unsigned int materialCount,
+    const L3DMeshFileSourceList &sources,
+    const L3DHandle &shaderProgram,
+    unsigned char renderLayer,
+    bool packVertices,
+    L3DHandleList &meshes,
+    unsigned int &size)
+{
+    L3D_TRACE_SCOPE("Create meshes");
 
-            if (mat->GetTextureCount(aiTextureType_DIFFUSE) > 0)
-            {
-                aiString textureFilename;
-                mat->GetTexture(aiTextureType_DIFFUSE, 0, &textureFilename);
-                L3DHandle texture = l3dutLoadTexture2D(textureFilename.C_Str());
+    // Mesh storage is allocated by the render thread: other threads would
+    // wait for it, so they hand over a copy instead.
+    L3DContext *context = l3dCurrentContext();
+    bool renderThread = context && context->renderer() && context->renderer()->isRenderThread();
 
-                l3dAddTextureToMaterial(material, "diffuseMap", texture);
-            }
+    static const char *textureNames[L3D_MESH_FILE_TEXTURE_COUNT] = {"diffuseMap", "specularMap", "alphaMap", "normalMap"};
 
-            if (mat->GetTextureCount(aiTextureType_SPECULAR) > 0)
-            {
-                aiString textureFilename;
-                mat->GetTexture(aiTextureType_SPECULAR, 0, &textureFilename);
-                L3DHandle texture = l3dutLoadTexture2D(textureFilename.C_Str());
+    // Materials are loaded on first use, then shared by the meshes.
+    L3DHandleList loadedMaterials(materialCount, L3D_INVALID_HANDLE);
 
-                l3dAddTextureToMaterial(material, "specularMap", texture);
-            }
+    for (unsigned int i = 0; i < sources.size(); ++i)
+    {
+        const L3DMeshFileSource &source = sources[i];
+        L3DHandle material;
 
-            if (mat->GetTextureCount(aiTextureType_OPACITY) > 0)
+        if (source.info.material >= 0 && (unsigned int)source.info.material < materialCount)
+        {
+            const L3DMeshFileMaterial &mat = materials[source.info.material];
+            material = loadedMaterials[source.info.material];
+
+            if (!material.repr)
             {
-                aiString textureFilename;
-                mat->GetTexture(aiTextureType_OPACITY, 0, &textureFilename);
-                L3DHandle texture = l3dutLoadTexture2D(textureFilename.C_Str());
+                material = l3dLoadMaterial(
+                    mat.name,
+                    shaderProgram,
+                    L3DVec3(mat.diffuse[0], mat.diffuse[1], mat.diffuse[2]),
+                    L3DVec3(mat.ambient[0], mat.ambient[1], mat.ambient[2]),
+                    L3DVec3(mat.specular[0], mat.specular[1], mat.specular[2]),
+                    mat.shininess);
+
+                for (unsigned int t = 0; t < L3D_MESH_FILE_TEXTURE_COUNT; ++t)
+                {
+                    if (mat.textures[t][0])
+                        l3dAddTextureToMaterial(material, textureNames[t], l3dutLoadTexture2D(mat.textures[t]));
+                }
 
-                l3dAddTextureToMaterial(material, "alphaMap", texture);
+                loadedMaterials[source.info.material] = material;
             }
+        }
 
-            if (mat->GetTextureCount(aiTextureType_HEIGHT) > 0)
-            {
-                aiString textureFilename;
-                mat->GetTexture(aiTextureType_HEIGHT, 0, &textureFilename);
-                L3DHandle texture = l3dutLoadTexture2D(textureFilename.C_Str());
+        L3DVertexFormat vertexFormat = (L3DVertexFormat)source.info.vertexFormat;
+        L3DVertexFormat packedFormat = (L3DVertexFormat)(L3D_VERTEX_PACKED | vertexFormat);
+
+        if (packVertices && L3DMesh::isPacked(packedFormat))
+            vertexFormat = packedFormat;
 
-                l3dAddTextureToMaterial(material, "normalMap", texture);
+        L3DHandle loadedMesh = L3D_INVALID_HANDLE;
+        bool uploadAsIs = !L3DMesh::isPacked(vertexFormat) && source.info.vertexCount;
+        unsigned int vertexBytes = source.info.vertexCount * L3DMesh::vertexSize(vertexFormat);
+        // 16-bit whenever they can address all the vertices, as in
+        // l3dAllocMeshStorage().
+        L3DIndexType indexType = (source.info.vertexCount <= 0x10000) ? L3D_INDEX_UNSIGNED_SHORT : L3D_INDEX_UNSIGNED_INT;
+
+        // Unpacked vertices are uploaded as they are: copy them straight
+        // to video memory.
+        L3DMeshStorage storage = L3DMeshStorage();
+        if (uploadAsIs && renderThread)
+            storage = l3dAllocMeshStorage(source.info.vertexCount, source.info.indexCount, vertexFormat);
+
+        if (uploadAsIs && !renderThread)
+        {
+            void *vertices = L3DMemory::allocate(vertexBytes, L3D_MEMORY_GEOMETRY);
+            void *indices = source.info.indexCount ? L3DMemory::allocate(source.info.indexCount * indexType, L3D_MEMORY_GEOMETRY) : L3D_NULLPTR;
+
+            if (vertices && (indices || !source.info.indexCount))
+            {
+                memcpy(vertices, source.vertices, vertexBytes);
+                copyIndices(indices, source.indices, source.info.indexCount, indexType);
+
+                loadedMesh = l3dAdoptMesh(
+                    vertices, source.info.vertexCount,
+                    indices, source.info.indexCount, indexType,
+                    material,
+                    vertexFormat,
+                    releaseMeshData, L3D_NULLPTR,
+                    L3DMat4(), L3D_DRAW_STATIC, L3D_DRAW_TRIANGLES,
+                    renderLayer);
             }
+            else
+            {
+                L3DMemory::deallocate(vertices);
+                L3DMemory::deallocate(indices);
+            }
+        }
+
+        if (storage.vertices)
+        {
+            memcpy(storage.vertices, source.vertices, vertexBytes);
+            copyIndices(storage.indices, source.indices, source.info.indexCount, storage.indexType);
+
+            loadedMesh = l3dCommitMeshStorage(storage, material, L3DMat4(), L3D_DRAW_TRIANGLES, renderLayer);
         }
+        else if (!loadedMesh.repr)
+        {
+            // Unmap and delete what could be allocated.
+            if (storage.vertexBuffer.repr)
+                l3dCommitMeshStorage(storage, material);
+
+            loadedMesh = l3dLoadMesh(
+                (float *)source.vertices, source.info.vertexCount,
+                (unsigned int *)source.indices, source.info.indexCount,
+                material,
+                vertexFormat,
+                L3DMat4(), L3D_DRAW_STATIC, L3D_DRAW_TRIANGLES,
+                renderLayer);
+        }
+
+        if (loadedMesh.repr && source.info.lodCount)
+        {
+            L3DMeshLod lods[L3D_MAX_MESH_LODS];
+            for (unsigned int l = 0; l < source.info.lodCount; ++l)
+            {
+                lods[l].indexOffset = source.info.lods[l].indexOffset;
+                lods[l].indexCount = source.info.lods[l].indexCount;
+                lods[l].error = source.info.lods[l].error;
+            }
 
-        L3DHandle loadedMesh = l3dLoadMesh(
-            vertices.data(), mesh->mNumVertices,
-            indices.data(), mesh->mNumFaces * 3,
-            material,
-            vertexFormat,
-            L3DMat4(), L3D_DRAW_STATIC, L3D_DRAW_TRIANGLES,
-            renderLayer);
+            l3dSetMeshLods(loadedMesh, lods, source.info.lodCount);
+            l3dSetMeshBounds(
+                loadedMesh,
+                L3DVec3(source.info.boundsMin[0], source.info.boundsMin[1], source.info.boundsMin[2]),
+                L3DVec3(source.info.boundsMax[0], source.info.boundsMax[1], source.info.boundsMax[2]));
+        }
 
         if (loadedMesh.repr)
+        {
             meshes.push_back(loadedMesh);
+            size += vertexBytes;
+            size += source.info.indexCount * indexType;
+        }
+    }
+}
+
+// Cached binary meshes live next to their source: "model.obj" -> "model.l3dm".
+static bool importMeshes(
+    const std::string &path,
+    const L3DHandle &shaderProgram,
+    unsigned char renderLayer,
+    bool packVertices,
+    L3DHandleList &meshes,
+    unsigned int &size)
+{
+    std::string cachePath = replaceExtension(path, ".l3dm");
+
+    // Upload straight from the mapped cache.
+    if (isUpToDate(cachePath, path))
+    {
+        L3D_TRACE_SCOPE("Map mesh file");
+
+        L3DMeshFile file;
+
+        if (file.open(cachePath))
+        {
+            L3DMeshFileSourceList sources(file.meshCount());
+
+            for (unsigned int i = 0; i < file.meshCount(); ++i)
+            {
+                sources[i].info = file.meshes()[i];
+                sources[i].vertices = file.vertices(i);
+                sources[i].indices = file.indices(i);
+            }
+
+            createMeshes(file.materials(), file.materialCount(), sources, shaderProgram, renderLayer, packVertices, meshes, size);
+
+            return true;
+        }
+    }
+
+    L3DImportedScene imported;
+
+    if (!importScene(path, imported))
+        return false;
+
+    createMeshes(imported.materials.data(), imported.materials.size(), imported.meshes, shaderProgram, renderLayer, packVertices, meshes, size);
+
+    // Speed up the next loads.
+    L3DMeshFile::write(cachePath, imported.materials, imported.meshes);
+
+    return true;
+}
+
+L3DHandle *l3dutLoadMeshes(
+    const char *filename,
+    const L3DHandle &shaderProgram,
+    unsigned int *meshCount,
+    unsigned char renderLayer,
+    bool packVertices)
+{
+    if (meshCount)
+        *meshCount = 0;
+
+    if (!filename)
+        return 0;
+
+    L3DContext *context = l3dCurrentContext();
+    std::string path = rootPath() + filename;
+    std::ostringstream key;
+    key << assetKey("meshes", path, renderLayer) << ":" << shaderProgram.repr << ":" << packVertices;
+    L3DHandleList meshes;
+
+    if (!context || !context->assets()->acquire(key.str(), meshes))
+    {
+        unsigned int size = 0;
+
+        if (!importMeshes(path, shaderProgram, renderLayer, packVertices, meshes, size))
+            return 0;
+
+        if (context)
+            context->assets()->add(key.str(), meshes, size);
     }
 
     if (meshCount)
@@ -416,3 +1107,47 @@ L3DHandle *l3dutLoadMeshes(
 
     return (L3DHandle *)retPtr;
 }
+
+int l3dutReleaseAsset(const L3DHandle &handle)
+{
+    L3DContext *context = l3dCurrentContext();
+
+    if (!context || !context->assets()->release(handle))
+        return -1;
+
+    return L3D_TRUE;
+}
+
+unsigned int l3dutPrintAssetStats()
+{
+    L3DContext *context = l3dCurrentContext();
+
+    if (!context)
+        return 0;
+
+    L3DAssetStats stats = context->assets()->stats();
+    printf("Assets: %u (reused: %u, saved: %.2f MB)\n", stats.assetCount, stats.hitCount, stats.bytesSaved / (1024.0 * 1024.0));
+
+    return stats.hitCount;
+}
+
+int l3dutConvertMeshes(const char *filename, const char *outputFilename)
+{
+    if (!filename)
+        return -1;
+
+    std::string path = rootPath() + filename;
+    std::string outputPath = outputFilename ? rootPath() + outputFilename : replaceExtension(path, ".l3dm");
+    L3DImportedScene imported;
+
+    if (!importScene(path, imported))
+    {
+        fprintf(stderr, "Failed to import %s\n", path.c_str());
+        return -1;
+    }
+
+    if (!L3DMeshFile::write(outputPath, imported.materials, imported.meshes))
+        return -1;
+
+    return L3D_TRUE;
+}
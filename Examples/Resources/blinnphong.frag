@@ -13,15 +13,7 @@ struct Material {
     float   shininess;
 };
 
-struct Light {
-    int     type;
-    vec3    position;
-    vec3    direction;
-    vec4    color;
-    float   kc;
-    float   kl;
-    float   kq;
-};
+#include "lighting.glsl"
 
 /* INPUTS *********************************************************************/
 
@@ -36,10 +28,34 @@ in VertexData {
 
 /* UNIFORMS *******************************************************************/
 
-// Flags.
+// Flags: variants are specialized for their maps and light count, the
+// generic program tests them at runtime.
+#ifdef L3D_VARIANT_MAX_LIGHTS
+#ifdef L3D_VARIANT_SPECULAR_MAP
+#define SPECULAR_MAP_ENABLED true
+#else
+#define SPECULAR_MAP_ENABLED false
+#endif
+#ifdef L3D_VARIANT_NORMAL_MAP
+#define NORMAL_MAP_ENABLED true
+#else
+#define NORMAL_MAP_ENABLED false
+#endif
+#ifdef L3D_VARIANT_ALPHA_MAP
+#define ALPHA_MAP_ENABLED true
+#else
+#define ALPHA_MAP_ENABLED false
+#endif
+#define MAX_LIGHTS L3D_VARIANT_MAX_LIGHTS
+#else
 uniform bool        u_specularMapEnabled;
 uniform bool        u_normalMapEnabled;
 uniform bool        u_alphaMapEnabled;
+#define SPECULAR_MAP_ENABLED u_specularMapEnabled
+#define NORMAL_MAP_ENABLED u_normalMapEnabled
+#define ALPHA_MAP_ENABLED u_alphaMapEnabled
+#define MAX_LIGHTS NR_MAX_LIGHTS
+#endif
 
 // Maps.
 uniform sampler2D   u_diffuseMap;
@@ -64,49 +80,6 @@ vec3 ambientLighting()
    return u_material.ambient * u_ambientColor.xyz * u_ambientColor.w;
 }
 
-// Returns intensity of diffuse reflection.
-vec3 diffuseLighting(
-    in vec3 diffuse,
-    in vec4 color,
-    in vec3 normalDirection,
-    in vec3 surfaceToLightDirection
-)
-{
-   // Calculation as for Lambertian reflection.
-   float diffuseTerm = clamp(dot(normalDirection, surfaceToLightDirection), 0, 1) ;
-   return diffuse * color.rgb * color.a * diffuseTerm;
-}
-
-// Returns intensity of specular reflection.
-vec3 specularLighting(
-    in vec3 specular,
-    in float shininess,
-    in vec4 color,
-    in vec3 normalDirection,
-    in vec3 surfaceToLightDirection,
-    in vec3 surfaceToCameraDirection
-)
-{
-    vec3 halfVector = normalize(surfaceToLightDirection + surfaceToCameraDirection);
-    float dotProduct = dot(normalDirection, halfVector);
-    float specularTerm = 0;
-    // Avoid specular reflections on back faces.
-    if (dotProduct > 0)
-        specularTerm = pow(dotProduct, shininess);
-    return specular * (color.rgb * color.a * specularTerm);
-}
-
-// Returns light attenuation based on distance.
-float lightingAttenuation(
-    in float kc,
-    in float kl,
-    in float kq,
-    in float surfaceToLightDistance
-)
-{
-    return 1.0f / (kc + kl * surfaceToLightDistance + kq * (surfaceToLightDistance * surfaceToLightDistance));
-}
-
 /* MAIN ***********************************************************************/
 
 void main()
@@ -116,7 +89,7 @@ void main()
     vec4 specular = diffuse;
 
     // Alpha mapping.
-    if (u_alphaMapEnabled)
+    if (ALPHA_MAP_ENABLED)
         diffuse.a *= texture(u_alphaMap, fs_in.texcoord0).x;
 
     // Discard if alpha is very low.
@@ -124,11 +97,11 @@ void main()
         discard;
 
     // Specular mapping.
-    if (u_specularMapEnabled)
+    if (SPECULAR_MAP_ENABLED)
         specular = texture(u_specularMap, fs_in.texcoord0);
 
     // Normal mapping.
-    if (u_normalMapEnabled)
+    if (NORMAL_MAP_ENABLED)
     {
         // Calculate fragment bump normal using TBN matrix.
         mat3 TBN = mat3(fs_in.tangent, fs_in.bitangent, fs_in.normal);
@@ -142,7 +115,7 @@ void main()
     vec3 Ispe = vec3(0);
 
     // Iterate over all lights.
-    for (int i = 0; i < min(u_lightNr, NR_MAX_LIGHTS); i++)
+    for (int i = 0; i < min(u_lightNr, MAX_LIGHTS); i++)
     {
         vec3    surfaceToLight = u_light[i].position - fs_in.position;
         float   attenuation = 1.0f;
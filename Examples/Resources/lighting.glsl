@@ -0,0 +1,54 @@
+// Blinn-Phong lighting terms shared by the lit shaders.
+
+struct Light {
+    int     type;
+    vec3    position;
+    vec3    direction;
+    vec4    color;
+    float   kc;
+    float   kl;
+    float   kq;
+};
+
+// Returns intensity of diffuse reflection.
+vec3 diffuseLighting(
+    in vec3 diffuse,
+    in vec4 color,
+    in vec3 normalDirection,
+    in vec3 surfaceToLightDirection
+)
+{
+   // Calculation as for Lambertian reflection.
+   float diffuseTerm = clamp(dot(normalDirection, surfaceToLightDirection), 0, 1) ;
+   return diffuse * color.rgb * color.a * diffuseTerm;
+}
+
+// Returns intensity of specular reflection.
+vec3 specularLighting(
+    in vec3 specular,
+    in float shininess,
+    in vec4 color,
+    in vec3 normalDirection,
+    in vec3 surfaceToLightDirection,
+    in vec3 surfaceToCameraDirection
+)
+{
+    vec3 halfVector = normalize(surfaceToLightDirection + surfaceToCameraDirection);
+    float dotProduct = dot(normalDirection, halfVector);
+    float specularTerm = 0;
+    // Avoid specular reflections on back faces.
+    if (dotProduct > 0)
+        specularTerm = pow(dotProduct, shininess);
+    return specular * (color.rgb * color.a * specularTerm);
+}
+
+// Returns light attenuation based on distance.
+float lightingAttenuation(
+    in float kc,
+    in float kl,
+    in float kq,
+    in float surfaceToLightDistance
+)
+{
+    return 1.0f / (kc + kl * surfaceToLightDistance + kq * (surfaceToLightDistance * surfaceToLightDistance));
+}
@@ -0,0 +1,424 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <leaf3d/L3DAssetRegistry.h>
+#include <leaf3d/L3DMeshFile.h>
+#include <leaf3d/L3DTexture.h>
+#include <leaf3d/L3DTextureFile.h>
+#include <leaf3d/L3DTextureCooker.h>
+#include <leaf3d/L3DMemory.h>
+#include <leaf3d/L3DProgramCache.h>
+#include <leaf3d/L3DRenderer.h>
+#include <leaf3d/L3DShader.h>
+#include <leaf3d/L3DShaderPreprocessor.h>
+#include <catch/catch.hpp>
+
+#ifdef L3D_PLATFORM_WIN
+#include <direct.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+using namespace l3d;
+
+TEST_CASE("Test L3DAssetRegistry::normalizePath", "[leaf3d][assets][normalizePath]")
+{
+    REQUIRE(L3DAssetRegistry::normalizePath("a/b/c.png") == "a/b/c.png");
+    REQUIRE(L3DAssetRegistry::normalizePath("a\\b//./c.png") == "a/b/c.png");
+    REQUIRE(L3DAssetRegistry::normalizePath("a/x/../b/c.png") == "a/b/c.png");
+    REQUIRE(L3DAssetRegistry::normalizePath("../a/./c.png") == "../a/c.png");
+    REQUIRE(L3DAssetRegistry::normalizePath("/a/../../c.png") == "/c.png");
+}
+
+TEST_CASE("Test L3DAssetRegistry references", "[leaf3d][assets][L3DAssetRegistry]")
+{
+    L3DAssetRegistry assets;
+    L3DHandleList handles;
+    L3DHandle texture;
+    texture.repr = 42;
+
+    const char source[] = "void main() {}";
+    unsigned long long hash = L3DAssetRegistry::hash(source, sizeof(source));
+
+    REQUIRE(!assets.acquire("texture2D:a.png:0", handles));
+
+    assets.add("texture2D:a.png:0", L3DHandleList(1, texture), 1024, hash);
+
+    // By key and by content.
+    REQUIRE(assets.acquire("texture2D:a.png:0", handles));
+    REQUIRE(handles[0].repr == texture.repr);
+    REQUIRE(assets.acquire("texture2D:b.png:0", handles, hash));
+    REQUIRE(assets.refCount("texture2D:a.png:0") == 3);
+
+    L3DAssetStats stats = assets.stats();
+    REQUIRE(stats.assetCount == 1);
+    REQUIRE(stats.hitCount == 2);
+    REQUIRE(stats.bytesSaved == 2048);
+
+    REQUIRE(assets.release(texture));
+    REQUIRE(assets.release(texture));
+    REQUIRE(assets.release(texture));
+    REQUIRE(!assets.release(texture));
+    REQUIRE(!assets.acquire("texture2D:b.png:0", handles, hash));
+}
+
+TEST_CASE("Test L3DMeshFile round trip", "[leaf3d][assets][L3DMeshFile]")
+{
+    const float vertices[] = {
+        -1.0f, 0.0f, 2.0f, 0.0f, 0.0f,
+        1.0f, 3.0f, -2.0f, 1.0f, 0.0f,
+        0.0f, -1.0f, 0.0f, 0.5f, 1.0f};
+    const unsigned int indices[] = {0, 1, 2};
+
+    L3DMeshFileMaterialList materials(1);
+    strcpy(materials[0].name, "crate");
+    strcpy(materials[0].textures[L3D_MESH_FILE_DIFFUSE_MAP], "crate.jpg");
+    materials[0].shininess = 32.0f;
+
+    L3DMeshFileSourceList meshes(1);
+    meshes[0].info.vertexFormat = L3D_VERTEX_POS3_UV2;
+    meshes[0].info.vertexCount = 3;
+    meshes[0].info.indexCount = 3;
+    meshes[0].info.material = 0;
+    meshes[0].vertices = vertices;
+    meshes[0].indices = indices;
+    L3DMeshFile::computeBounds(meshes[0].info, vertices);
+
+    REQUIRE(L3DMeshFile::write("test.l3dm", materials, meshes));
+
+    L3DMeshFile file;
+    REQUIRE(file.open("test.l3dm"));
+    REQUIRE(file.materialCount() == 1);
+    REQUIRE(file.meshCount() == 1);
+    REQUIRE(strcmp(file.materials()[0].textures[L3D_MESH_FILE_DIFFUSE_MAP], "crate.jpg") == 0);
+    REQUIRE(file.meshes()[0].boundsMin[1] == -1.0f);
+    REQUIRE(file.meshes()[0].boundsMax[0] == 1.0f);
+    REQUIRE(memcmp(file.vertices(0), vertices, sizeof(vertices)) == 0);
+    REQUIRE(memcmp(file.indices(0), indices, sizeof(indices)) == 0);
+    file.close();
+
+    // Truncated files are rejected.
+    char header[sizeof(L3DMeshFileHeader) + sizeof(L3DMeshFileMaterial)];
+    FILE *stream = fopen("test.l3dm", "rb");
+    REQUIRE(fread(header, sizeof(header), 1, stream) == 1);
+    fclose(stream);
+
+    stream = fopen("test.l3dm", "wb");
+    fwrite(header, sizeof(header), 1, stream);
+    fclose(stream);
+
+    REQUIRE(!file.open("test.l3dm"));
+
+    // So are corrupt ones.
+    const unsigned int badIndices[] = {0, 1, 3};
+    SECTION("Unterminated name")
+    {
+        memset(materials[0].textures[L3D_MESH_FILE_NORMAL_MAP], 'a', L3D_MESH_FILE_NAME_SIZE);
+    }
+    SECTION("Negative material")
+    {
+        meshes[0].info.material = -2;
+    }
+    SECTION("Index out of range")
+    {
+        meshes[0].indices = badIndices;
+    }
+
+    REQUIRE(L3DMeshFile::write("test.l3dm", materials, meshes));
+    REQUIRE(!file.open("test.l3dm"));
+
+    remove("test.l3dm");
+}
+
+TEST_CASE("Test L3DTextureFile KTX and DDS", "[leaf3d][assets][L3DTextureFile]")
+{
+    // 8x8 BC1 chain: 8x8, 4x4, 2x2 and 1x1 levels take one block at least.
+    REQUIRE(L3DTexture::levelSize(L3D_BC1, 8, 8) == 32);
+    REQUIRE(L3DTexture::levelSize(L3D_BC7, 8, 8, 3) == 16);
+    REQUIRE(L3DTexture::dataSize(L3D_TEXTURE_2D, L3D_BC1, 8, 8, 0, 4) == 32 + 8 + 8 + 8);
+    REQUIRE(L3DTexture::dataSize(L3D_TEXTURE_CUBE_MAP, L3D_BC3, 4, 4, 0, 3) == 6 * 48);
+
+    SECTION("DDS")
+    {
+        std::vector<unsigned char> file(128 + 56, 0);
+        unsigned int header[32] = {0};
+        header[0] = 0x20534444;      // "DDS "
+        header[1] = 124;             // size
+        header[2] = 0x20000;         // DDSD_MIPMAPCOUNT
+        header[3] = 8;               // height
+        header[4] = 8;               // width
+        header[7] = 4;               // mipMapCount
+        header[19] = 32;             // pixelFormat.size
+        header[20] = 0x4;            // DDPF_FOURCC
+        header[21] = 0x31545844;     // "DXT1"
+        memcpy(&file[0], header, sizeof(header));
+        file[128] = 7;
+
+        L3DTextureImage image;
+        REQUIRE(L3DTextureFile::loadDDS(&file[0], file.size(), image));
+        REQUIRE(image.type == L3D_TEXTURE_2D);
+        REQUIRE(image.format == L3D_BC1);
+        REQUIRE(image.mipCount == 4);
+        REQUIRE(image.data.size() == 56);
+        REQUIRE(image.data[0] == 7);
+
+        REQUIRE(!L3DTextureFile::loadDDS(&file[0], file.size() - 1, image));
+
+        // More levels than the full chain.
+        header[7] = 5;
+        memcpy(&file[0], header, sizeof(header));
+        REQUIRE(!L3DTextureFile::loadDDS(&file[0], file.size(), image));
+
+        // Sizes overflowing 32 bits are not wrapped around.
+        header[3] = header[4] = 0x20000;
+        header[7] = 1;
+        memcpy(&file[0], header, sizeof(header));
+        REQUIRE(!L3DTextureFile::loadDDS(&file[0], file.size(), image));
+    }
+
+    SECTION("KTX cube map")
+    {
+        // 1x1 RGBA8 cube map, 1 level: faces are stored inside the level.
+        const unsigned char identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+        unsigned int header[13] = {0x04030201, 0x1401, 1, 0x1908, 0x8058, 0x1908, 1, 1, 0, 0, 6, 1, 0};
+        std::vector<unsigned char> file(12 + sizeof(header) + 4 + 6 * 4, 0);
+        memcpy(&file[0], identifier, 12);
+        memcpy(&file[12], header, sizeof(header));
+        for (unsigned int face = 0; face < 6; ++face)
+            file[12 + sizeof(header) + 4 + face * 4] = face;
+
+        L3DTextureImage image;
+        REQUIRE(L3DTextureFile::loadKTX(&file[0], file.size(), image));
+        REQUIRE(image.type == L3D_TEXTURE_CUBE_MAP);
+        REQUIRE(image.format == L3D_RGBA);
+        REQUIRE(image.mipCount == 1);
+        REQUIRE(image.data.size() == 24);
+        REQUIRE(image.data[20] == 5);
+
+        // A 1x1 image has a single level.
+        header[11] = 0xffffffff;
+        memcpy(&file[12], header, sizeof(header));
+        REQUIRE(!L3DTextureFile::loadKTX(&file[0], file.size(), image));
+
+        // Truncated image.
+        header[6] = header[7] = 0x8000;
+        header[11] = 1;
+        memcpy(&file[12], header, sizeof(header));
+        REQUIRE(!L3DTextureFile::loadKTX(&file[0], file.size(), image));
+
+        file[0] = 0;
+        REQUIRE(!L3DTextureFile::loadKTX(&file[0], file.size(), image));
+    }
+}
+
+TEST_CASE("Test L3DTextureCooker", "[leaf3d][assets][L3DTextureCooker]")
+{
+    // 4x2 RGB image: a black and a white 2x2 square.
+    unsigned char pixels[4 * 2 * 3];
+    for (unsigned int i = 0; i < 8; ++i)
+        memset(pixels + i * 3, (i % 4) < 2 ? 0 : 255, 3);
+
+    L3DTextureCookOptions options;
+    L3DTextureImage image;
+    REQUIRE(L3DTextureCooker::cook(pixels, 4, 2, 3, options, image));
+    REQUIRE(image.format == L3D_RGBA);
+    REQUIRE(image.mipCount == 3);
+    REQUIRE(image.data.size() == (8 + 2 + 1) * 4);
+    REQUIRE(image.data[3] == 255);
+
+    // Level 1 keeps both squares, level 2 averages them in linear space.
+    REQUIRE(image.data[32] == 0);
+    REQUIRE(image.data[36] == 255);
+    REQUIRE(image.data[40] == 188);
+
+    options.srgb = false;
+    REQUIRE(L3DTextureCooker::cook(pixels, 4, 2, 3, options, image));
+    REQUIRE(image.data[40] == 128);
+
+    SECTION("Compression")
+    {
+        options.compression = L3D_BC3;
+        REQUIRE(L3DTextureCooker::cook(pixels, 4, 2, 3, options, image));
+        REQUIRE(image.format == L3D_BC3);
+        REQUIRE(image.data.size() == 3 * 16);
+
+        options.compression = L3D_BC7;
+        REQUIRE(!L3DTextureCooker::cook(pixels, 4, 2, 3, options, image));
+    }
+
+    SECTION("KTX round trip")
+    {
+        L3DTextureImage loaded;
+        REQUIRE(L3DTextureFile::writeKTX("test.ktx", image));
+        REQUIRE(L3DTextureFile::load("test.ktx", loaded));
+        REQUIRE(loaded.mipCount == 3);
+        REQUIRE(loaded.data == image.data);
+
+        remove("test.ktx");
+    }
+}
+
+TEST_CASE("Test L3DTexture evicted levels", "[leaf3d][assets][L3DTexture]")
+{
+    L3DTexture texture(L3D_NULLPTR, L3D_TEXTURE_2D, L3D_RGBA, L3D_NULLPTR, 256, 128);
+
+    REQUIRE(texture.levelCount() == 9);
+    unsigned int fullSize = texture.gpuSize();
+
+    // The largest level takes three quarters of the chain.
+    texture.setEvictedLevels(1);
+    REQUIRE(texture.gpuSize() == fullSize - 256 * 128 * 4);
+    texture.setEvictedLevels(2);
+    REQUIRE(texture.gpuSize() == fullSize - (256 * 128 + 128 * 64) * 4);
+    REQUIRE(texture.gpuSize(0) == fullSize);
+    REQUIRE(texture.gpuSize(1) == fullSize - 256 * 128 * 4);
+
+    // The smallest level is always kept.
+    texture.setEvictedLevels(20);
+    REQUIRE(texture.gpuSize() == 4);
+
+    // A new image is fully resident.
+    texture.setImage(L3D_RGBA, 64, 64);
+    REQUIRE(texture.evictedLevels() == 0);
+    REQUIRE(texture.levelCount() == 7);
+}
+
+TEST_CASE("Test L3DTexture residency", "[leaf3d][assets][L3DTexture]")
+{
+    unsigned char pixels[16] = {0};
+    L3DTexture texture(L3D_NULLPTR, L3D_TEXTURE_2D, L3D_RGBA, pixels, 2, 2);
+
+    // Without a renderer, the copy is always kept.
+    REQUIRE(texture.residency() == L3D_RESIDENCY_KEEP);
+    REQUIRE(texture.data() != L3D_NULLPTR);
+    REQUIRE(texture.data() != pixels);
+
+    unsigned long long textureBytes = L3DMemory::stats().bytes[L3D_MEMORY_TEXTURES];
+    texture.discardData();
+    REQUIRE(texture.data() == L3D_NULLPTR);
+    REQUIRE(L3DMemory::stats().bytes[L3D_MEMORY_TEXTURES] == textureBytes - 16);
+
+    // Reloaded data is owned by the texture.
+    texture.setData((unsigned char *)L3DMemory::allocate(16, L3D_MEMORY_TEXTURES));
+    REQUIRE(L3DMemory::stats().bytes[L3D_MEMORY_TEXTURES] == textureBytes);
+}
+
+TEST_CASE("Test L3DProgramCache", "[leaf3d][assets][L3DProgramCache]")
+{
+    L3DProgramCache cache;
+    unsigned int format = 0;
+    std::vector<unsigned char> binary;
+
+    // Disabled without a path.
+    REQUIRE(!cache.isEnabled());
+    REQUIRE(!cache.load(1, format, binary));
+
+    REQUIRE(cache.setPath("test_programs"));
+    REQUIRE(cache.filename(0x2a) == "test_programs/000000000000002a.bin");
+
+    std::vector<unsigned char> stored(100, 7);
+    REQUIRE(cache.store(0x2a, 0x1234, stored));
+    REQUIRE(cache.load(0x2a, format, binary));
+    REQUIRE(format == 0x1234);
+    REQUIRE(binary == stored);
+
+    cache.remove(0x2a);
+    REQUIRE(!cache.load(0x2a, format, binary));
+
+    rmdir("test_programs");
+}
+
+TEST_CASE("Test L3DRenderer shader deduplication", "[leaf3d][assets][L3DShader]")
+{
+    L3DRenderer renderer;
+    L3DShader *shader = new L3DShader(&renderer, L3D_SHADER_VERTEX, "void main() {}");
+
+    REQUIRE(renderer.findShader(L3D_SHADER_VERTEX, "void main() {}") == shader);
+    REQUIRE(renderer.findShader(L3D_SHADER_FRAGMENT, "void main() {}") == L3D_NULLPTR);
+    REQUIRE(renderer.findShader(L3D_SHADER_VERTEX, "void main() { }") == L3D_NULLPTR);
+
+    // A handle reserved for the same source resolves to the existing shader.
+    L3DHandle handle = shader->handle();
+    L3DHandle alias = renderer.reserveHandle(L3D_SHADER);
+    REQUIRE(renderer.aliasResource(handle, alias));
+    REQUIRE(renderer.getShader(alias) == shader);
+    REQUIRE(renderer.getShader(handle) == shader);
+
+    // A rebound shader is still found by its source.
+    L3DHandle reserved = renderer.reserveHandle(L3D_SHADER);
+    REQUIRE(renderer.rebindResource(handle, reserved));
+    REQUIRE(renderer.getShader(reserved) == shader);
+    REQUIRE(renderer.findShader(L3D_SHADER_VERTEX, "void main() {}") == shader);
+}
+
+static bool loadTestInclude(const char *name, std::string &source, void *)
+{
+    if (strcmp(name, "light.glsl") == 0)
+        source = "#include \"common.glsl\"\nfloat light;\n";
+    else if (strcmp(name, "common.glsl") == 0)
+        source = "float common;\n";
+    else
+        return false;
+
+    return true;
+}
+
+TEST_CASE("Test L3DShaderPreprocessor", "[leaf3d][assets][L3DShaderPreprocessor]")
+{
+    std::string result;
+
+    // Includes are expanded once, with line markers.
+    REQUIRE(L3DShaderPreprocessor::resolveIncludes(
+        "#version 330 core\n#include \"light.glsl\"\n#include \"common.glsl\"\nvoid main() {}\n",
+        result,
+        loadTestInclude));
+    REQUIRE(result == "#version 330 core\n"
+                      "#line 1 1\n"
+                      "#line 1 2\n"
+                      "float common;\n"
+                      "#line 2 1\n"
+                      "float light;\n"
+                      "#line 3 0\n"
+                      "\n"
+                      "void main() {}\n");
+    REQUIRE(!L3DShaderPreprocessor::resolveIncludes("#include \"missing.glsl\"\n", result, loadTestInclude));
+
+    // Defines follow the version.
+    L3DShaderDefineList defines;
+    L3DShaderPreprocessor::variantDefines(L3D_SHADER_NORMAL_MAP | L3DShaderPreprocessor::lightFeatures(3), defines);
+    REQUIRE(defines.size() == 2);
+    REQUIRE(defines[0] == "L3D_VARIANT_NORMAL_MAP");
+    REQUIRE(defines[1] == "L3D_VARIANT_MAX_LIGHTS 4");
+    REQUIRE(L3DShaderPreprocessor::addDefines("#version 330 core\nvoid main() {}\n", defines) ==
+            "#version 330 core\n#define L3D_VARIANT_NORMAL_MAP\n#define L3D_VARIANT_MAX_LIGHTS 4\n#line 2\nvoid main() {}\n");
+
+    // Light count buckets.
+    REQUIRE(L3DShaderPreprocessor::maxLights(L3DShaderPreprocessor::lightFeatures(0)) == 0);
+    REQUIRE(L3DShaderPreprocessor::maxLights(L3DShaderPreprocessor::lightFeatures(1)) == 1);
+    REQUIRE(L3DShaderPreprocessor::maxLights(L3DShaderPreprocessor::lightFeatures(5)) == 8);
+    REQUIRE(L3DShaderPreprocessor::maxLights(L3DShaderPreprocessor::lightFeatures(100)) == L3D_SHADER_MAX_LIGHTS);
+
+    REQUIRE(L3DShaderPreprocessor::hasVariants("#ifdef L3D_VARIANT_NORMAL_MAP\n#endif\n"));
+    REQUIRE(!L3DShaderPreprocessor::hasVariants("void main() {}"));
+}
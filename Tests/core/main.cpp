@@ -19,7 +19,20 @@
  * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
 #include <leaf3d/types.h>
+#include <leaf3d/L3DContext.h>
+#include <leaf3d/L3DProfiler.h>
+#include <leaf3d/L3DRenderStats.h>
+#include <leaf3d/L3DTrace.h>
+#include <leaf3d/L3DMemory.h>
 #include <catch/catch.hpp>
 
 using namespace l3d;
@@ -50,3 +63,228 @@ TEST_CASE("Test L3D_TEST_BIT", "[leaf3d][core][L3D_BIT][L3D_TEST_BIT]")
     REQUIRE(L3D_TEST_BIT(1, 1) == false); // 0...FT
     REQUIRE(L3D_TEST_BIT(3, 1) == true);  // 0...TT
 }
+
+TEST_CASE("Test L3DContext::current", "[leaf3d][core][L3DContext]")
+{
+    L3DContext first;
+    L3DContext second;
+    L3DContext *seen = L3D_NULLPTR;
+
+    L3DContext::makeCurrent(&first);
+
+    // Each thread has its own current context.
+    std::thread other([&second, &seen]() {
+        L3DContext::makeCurrent(&second);
+        seen = L3DContext::current();
+    });
+    other.join();
+
+    REQUIRE(seen == &second);
+    REQUIRE(L3DContext::current() == &first);
+
+    first.setRootPath("Scenes/");
+    REQUIRE(first.rootPath() == "Scenes/");
+    REQUIRE(second.rootPath() == L3D_DEFAULT_ROOT_PATH);
+
+    L3DContext::makeCurrent(L3D_NULLPTR);
+}
+
+TEST_CASE("Test L3DContext loader", "[leaf3d][core][L3DContext]")
+{
+    L3DContext *first = new L3DContext();
+    L3DContext second;
+
+    // Contexts share one loader pool.
+    L3DJobSystem *loader = first->loader();
+    REQUIRE(second.loader() == loader);
+
+    // It outlives the contexts still using it.
+    std::atomic<int> done(0);
+    delete first;
+    second.loader()->run([&done]() { ++done; }, second.pendingLoads());
+    second.finishLoads();
+    REQUIRE(done == 1);
+}
+
+TEST_CASE("Test L3DProfiler scopes", "[leaf3d][core][L3DProfiler]")
+{
+    L3DProfiler profiler;
+    L3DProfileEntry entries[4];
+
+    // Disabled profilers record nothing.
+    {
+        L3DProfileScope scope(&profiler, "Ignored");
+    }
+    REQUIRE(profiler.profile(entries, 4) == 0);
+
+    profiler.setEnabled(true);
+    for (unsigned int frame = 0; frame < 2; ++frame)
+    {
+        L3DProfileScope scope(&profiler, "Frame");
+        {
+            L3DProfileScope draw(&profiler, "Draw");
+        }
+        {
+            L3DProfileScope draw(&profiler, "Draw");
+        }
+        L3DProfileScope post(&profiler, "Post");
+    }
+    profiler.endFrame();
+
+    REQUIRE(profiler.profile(L3D_NULLPTR, 0) == 3);
+    REQUIRE(profiler.profile(entries, 4) == 3);
+    REQUIRE(strcmp(entries[0].name, "Frame") == 0);
+    REQUIRE(entries[0].depth == 0);
+    REQUIRE(entries[0].calls == 2);
+    REQUIRE(strcmp(entries[1].name, "Draw") == 0);
+    REQUIRE(entries[1].depth == 1);
+    REQUIRE(entries[1].calls == 4);
+    REQUIRE(strcmp(entries[2].name, "Post") == 0);
+    REQUIRE(entries[0].cpuTime >= entries[1].cpuTime);
+    REQUIRE(entries[0].gpuTime == 0.0);
+}
+
+TEST_CASE("Test L3DRenderStats window", "[leaf3d][core][L3DRenderStats]")
+{
+    L3DRenderStats renderStats;
+
+    REQUIRE(renderStats.stats().frameCount == 0);
+
+    // Frames with 10, 20 and 30 draw calls.
+    for (unsigned int frame = 1; frame <= 3; ++frame)
+    {
+        renderStats.beginLayer(1);
+        renderStats.add(&L3DRenderCounters::drawCalls, frame * 10);
+        renderStats.endLayer();
+        renderStats.add(&L3DRenderCounters::clears, 1);
+        renderStats.endFrame();
+    }
+
+    L3DFrameStats stats = renderStats.stats();
+    REQUIRE(stats.frameCount == 3);
+    REQUIRE(stats.frame.drawCalls == 30);
+    REQUIRE(stats.frame.clears == 1);
+    REQUIRE(stats.min.drawCalls == 10);
+    REQUIRE(stats.average.drawCalls == 20);
+    REQUIRE(stats.max.drawCalls == 30);
+#ifdef L3D_ENABLE_FRAME_STATS
+    REQUIRE(stats.layers[1].drawCalls == 30);
+    REQUIRE(stats.layers[1].clears == 0);
+#endif
+
+    // The window slides.
+    for (unsigned int frame = 0; frame < L3D_FRAME_STATS_WINDOW; ++frame)
+        renderStats.endFrame();
+    stats = renderStats.stats();
+    REQUIRE(stats.frameCount == L3D_FRAME_STATS_WINDOW);
+    REQUIRE(stats.max.drawCalls == 0);
+}
+
+TEST_CASE("Test L3DTrace events", "[leaf3d][core][L3DTrace]")
+{
+    const char *path = "l3d_test_trace.json";
+
+    REQUIRE(!L3DTrace::isEnabled());
+    {
+        // Not recorded.
+        L3D_TRACE_SCOPE("Before");
+    }
+
+    REQUIRE(L3DTrace::start(path));
+    REQUIRE(!L3DTrace::start(path));
+    L3DTrace::setThreadName("Test \"main\"");
+    {
+        L3D_TRACE_SCOPE("Frame");
+        std::thread worker([]() {
+            L3D_TRACE_SCOPE("Upload");
+        });
+        worker.join();
+    }
+    REQUIRE(L3DTrace::stop());
+    REQUIRE(!L3DTrace::stop());
+
+    std::ifstream file(path);
+    std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    remove(path);
+
+    REQUIRE(json.find("\"traceEvents\"") != std::string::npos);
+    REQUIRE(json.find("\"Frame\"") != std::string::npos);
+    REQUIRE(json.find("\"Upload\"") != std::string::npos);
+    REQUIRE(json.find("\"Test \\\"main\\\"\"") != std::string::npos);
+    REQUIRE(json.find("Before") == std::string::npos);
+    REQUIRE(json.find("\"ph\":\"E\"") != std::string::npos);
+
+    // A new trace only has its own events, even from threads which are gone.
+    REQUIRE(L3DTrace::start(path));
+    {
+        L3D_TRACE_SCOPE("Second");
+    }
+    REQUIRE(L3DTrace::stop());
+
+    file.open(path);
+    json.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    remove(path);
+
+    REQUIRE(json.find("\"Second\"") != std::string::npos);
+    REQUIRE(json.find("\"Frame\"") == std::string::npos);
+    REQUIRE(json.find("\"Upload\"") == std::string::npos);
+}
+
+// Refuses allocations over a cap.
+struct L3DTestAllocator
+{
+    size_t cap;
+    size_t bytes;
+};
+
+static void *testAllocate(size_t size, L3DMemoryTag, void *userData)
+{
+    L3DTestAllocator *allocator = (L3DTestAllocator *)userData;
+
+    if (allocator->bytes + size > allocator->cap)
+        return L3D_NULLPTR;
+
+    allocator->bytes += size;
+    return malloc(size);
+}
+
+static void testDeallocate(void *ptr, size_t size, L3DMemoryTag, void *userData)
+{
+    ((L3DTestAllocator *)userData)->bytes -= size;
+    free(ptr);
+}
+
+TEST_CASE("Test L3DMemory allocator", "[leaf3d][core][L3DMemory]")
+{
+    L3DTestAllocator counter = {256, 0};
+    L3DAllocator allocator = {testAllocate, testDeallocate, &counter};
+
+    REQUIRE(L3DMemory::stats().totalCount == 0);
+    REQUIRE(L3DMemory::setAllocator(&allocator));
+
+    char *data = (char *)L3DMemory::duplicate("leaf3d", 7, L3D_MEMORY_GEOMETRY);
+    REQUIRE(data != L3D_NULLPTR);
+    REQUIRE(counter.bytes > 7);
+
+    // Can't be replaced while memory is allocated.
+    REQUIRE(!L3DMemory::setAllocator(L3D_NULLPTR));
+
+    data = (char *)L3DMemory::reallocate(data, 100, L3D_MEMORY_LOADER);
+    REQUIRE(strcmp(data, "leaf3d") == 0);
+    REQUIRE(L3DMemory::allocate(200, L3D_MEMORY_TEXTURES) == L3D_NULLPTR);
+
+    L3DAllocationStats stats = L3DMemory::stats();
+    REQUIRE(stats.bytes[L3D_MEMORY_GEOMETRY] == 0);
+    REQUIRE(stats.bytes[L3D_MEMORY_LOADER] == 100);
+    REQUIRE(stats.counts[L3D_MEMORY_LOADER] == 1);
+    REQUIRE(stats.totalCount == 1);
+    REQUIRE(stats.peakBytes >= 107);
+    REQUIRE(L3DMemory::reportLeaks() == 1);
+
+    L3DMemory::deallocate(data);
+    REQUIRE(counter.bytes == 0);
+    REQUIRE(L3DMemory::reportLeaks() == 0);
+    REQUIRE(L3DMemory::setAllocator(L3D_NULLPTR));
+}
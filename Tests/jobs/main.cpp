@@ -0,0 +1,185 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <thread>
+#include <vector>
+#include <leaf3d/L3DJobSystem.h>
+#include <leaf3d/L3DCallQueue.h>
+#include <leaf3d/L3DRenderQueue.h>
+#include <leaf3d/L3DRenderer.h>
+#include <catch/catch.hpp>
+
+using namespace l3d;
+
+TEST_CASE("Test L3DJobSystem::parallelFor", "[leaf3d][jobs][parallelFor]")
+{
+    for (unsigned int workers = 0; workers < 4; workers += 3)
+    {
+        L3DJobSystem jobSystem(workers);
+        std::vector<unsigned int> values(1000, 0);
+
+        REQUIRE(jobSystem.workerCount() == workers);
+
+        jobSystem.parallelFor(values.size(), 16, [&values](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; ++i)
+                values[i] += i;
+        });
+
+        bool ok = true;
+        for (unsigned int i = 0; i < values.size(); ++i)
+            ok = ok && (values[i] == i);
+
+        REQUIRE(ok);
+    }
+}
+
+TEST_CASE("Test L3DJobSystem dependencies", "[leaf3d][jobs][L3DJobCounter]")
+{
+    L3DJobSystem jobSystem(3);
+    L3DJobCounter produced;
+    L3DJobCounter consumed;
+    std::atomic<unsigned int> sum(0);
+    unsigned int result = 0;
+
+    for (unsigned int i = 1; i <= 100; ++i)
+        jobSystem.run([&sum, i]() { sum += i; }, &produced);
+
+    // Runs only when all the producers are done.
+    jobSystem.run([&sum, &result]() { result = sum; }, &consumed, &produced);
+
+    jobSystem.wait(&consumed);
+
+    REQUIRE(produced.isDone());
+    REQUIRE(result == 5050);
+}
+
+TEST_CASE("Test L3DCallQueue producers", "[leaf3d][jobs][L3DCallQueue]")
+{
+    // Small ring: producers have to wait for the consumer.
+    L3DCallQueue calls(60);
+    std::vector<std::thread> producers;
+    std::atomic<unsigned int> produced(0);
+    unsigned int sum = 0;
+    unsigned int executed = 0;
+
+    REQUIRE(calls.capacity() == 64);
+
+    for (unsigned int p = 0; p < 4; ++p)
+    {
+        producers.push_back(std::thread([&calls, &sum, &produced]() {
+            for (unsigned int i = 1; i <= 1000; ++i)
+            {
+                calls.push([&sum, i]() { sum += i; });
+                produced++;
+            }
+        }));
+    }
+
+    while (produced < 4000 || executed < 4000)
+        executed += calls.drain();
+
+    for (unsigned int p = 0; p < producers.size(); ++p)
+        producers[p].join();
+
+    REQUIRE(executed == 4000);
+    REQUIRE(sum == 4 * 500500);
+}
+
+struct PipelineEvents
+{
+    std::atomic<unsigned int> acquired;
+    std::atomic<unsigned int> released;
+    std::atomic<unsigned int> presented;
+    std::thread::id thread;
+};
+
+static void onAcquire(void *userData)
+{
+    static_cast<PipelineEvents *>(userData)->acquired++;
+    static_cast<PipelineEvents *>(userData)->thread = std::this_thread::get_id();
+}
+
+static void onRelease(void *userData) { static_cast<PipelineEvents *>(userData)->released++; }
+static void onPresent(void *userData) { static_cast<PipelineEvents *>(userData)->presented++; }
+
+TEST_CASE("Test L3DRenderer pipelined rendering", "[leaf3d][jobs][L3DRenderPipeline]")
+{
+    PipelineEvents events;
+    events.acquired = 0;
+    events.released = 0;
+    events.presented = 0;
+
+    L3DRenderer renderer;
+    L3DRenderQueue *renderQueue = new L3DRenderQueue(&renderer, "Empty");
+
+    REQUIRE(renderer.beginPipelinedRendering(2, onAcquire, onRelease, onPresent, &events) == L3D_TRUE);
+    REQUIRE(renderer.isPipelined());
+
+    for (unsigned int i = 0; i < 10; ++i)
+        renderer.renderFrame(L3D_NULLPTR, renderQueue);
+
+    renderer.endPipelinedRendering();
+
+    REQUIRE(!renderer.isPipelined());
+    REQUIRE(events.acquired == 1);
+    REQUIRE(events.released == 1);
+    REQUIRE(events.presented == 10);
+}
+
+TEST_CASE("Test L3DRenderer deferred calls while pipelined", "[leaf3d][jobs][L3DRenderPipeline]")
+{
+    PipelineEvents events;
+    events.acquired = 0;
+    events.released = 0;
+    events.presented = 0;
+
+    L3DRenderer renderer;
+    L3DRenderQueue *renderQueue = new L3DRenderQueue(&renderer, "Empty");
+
+    REQUIRE(renderer.beginPipelinedRendering(2, onAcquire, onRelease, onPresent, &events) == L3D_TRUE);
+
+    for (unsigned int i = 0; i < 3; ++i)
+        renderer.renderFrame(L3D_NULLPTR, renderQueue);
+
+    // Like the upload of an asynchronously decoded texture, deferred by a
+    // loader thread: it needs the OpenGL context.
+    std::thread::id callThread;
+    bool onRenderThread = false;
+    std::thread loader([&renderer, &callThread, &onRenderThread]() {
+        renderer.enqueueCall([&renderer, &callThread, &onRenderThread]() {
+            callThread = std::this_thread::get_id();
+            onRenderThread = renderer.isRenderThread();
+        });
+    });
+    loader.join();
+
+    renderer.renderFrame(L3D_NULLPTR, renderQueue);
+
+    // Executed after the queued frames, before the new one.
+    REQUIRE(events.presented >= 3);
+    REQUIRE(onRenderThread);
+    REQUIRE(renderer.isRenderThread());
+
+    renderer.endPipelinedRendering();
+
+    REQUIRE(callThread == events.thread);
+    REQUIRE(events.presented == 4);
+}
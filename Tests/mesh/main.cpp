@@ -19,7 +19,252 @@
  * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
  */
 
+#include <string.h>
 #include <leaf3d/L3DMesh.h>
+#include <leaf3d/L3DBuffer.h>
+#include <leaf3d/L3DMeshOptimizer.h>
+#include <leaf3d/L3DJobSystem.h>
 #include <catch/catch.hpp>
 
 using namespace l3d;
+
+TEST_CASE("Test L3DMesh::packVertices", "[leaf3d][mesh][packVertices]")
+{
+    REQUIRE(L3DMesh::vertexSize(L3D_VERTEX_POS3_NOR3_TAN3_UV2) == 44);
+    REQUIRE(L3DMesh::vertexSize(L3D_VERTEX_PACKED_POS3_NOR3_TAN3_UV2) == 20);
+    REQUIRE(L3DMesh::vertexSize(L3D_VERTEX_PACKED_POS3_NOR3_UV2) == 16);
+    REQUIRE(!L3DMesh::isPacked(L3D_VERTEX_POS3_NOR3_UV2));
+    REQUIRE(L3DMesh::unpackedFormat(L3D_VERTEX_PACKED_POS3_UV2) == L3D_VERTEX_POS3_UV2);
+
+    float vertices[] = {
+        -2, 0, 10, 0, 0, 1, 0.5f, 0.25f,
+        2, 4, 10, 0, 1, 0, 1, 0};
+    unsigned char packed[2 * 16];
+    L3DMat4 decodeMatrix;
+    L3DMesh::packVertices(vertices, 2, L3D_VERTEX_PACKED_POS3_NOR3_UV2, packed, decodeMatrix);
+
+    // Positions are normalized to the bounds: the decode matrix maps them back.
+    short position[4];
+    memcpy(position, packed + 16, sizeof(position));
+    L3DVec4 decoded = decodeMatrix * L3DVec4(position[0] / 32767.0f, position[1] / 32767.0f, position[2] / 32767.0f, 1);
+    REQUIRE(decoded.x == Approx(2));
+    REQUIRE(decoded.y == Approx(4));
+    REQUIRE(decoded.z == Approx(10));
+
+    // Normal z = 1 is 511 in the third 10-bit field.
+    unsigned int normal;
+    memcpy(&normal, packed + 8, sizeof(normal));
+    REQUIRE(normal == (511u << 20));
+
+    // Half-float 0.5.
+    unsigned short uv[2];
+    memcpy(uv, packed + 12, sizeof(uv));
+    REQUIRE(uv[0] == 0x3800);
+}
+
+TEST_CASE("Test L3DMesh index types", "[leaf3d][mesh][indexType]")
+{
+    float vertices[3 * 3] = {0};
+    unsigned int indices[] = {0, 1, 2};
+
+    L3DMesh mesh(L3D_NULLPTR, vertices, 3, indices, 3, L3D_NULLPTR, L3D_VERTEX_POS3);
+    REQUIRE(mesh.indexBuffer()->indexType() == L3D_INDEX_UNSIGNED_SHORT);
+    REQUIRE(mesh.indexBuffer()->size() == 3 * sizeof(unsigned short));
+    REQUIRE(mesh.indexCount() == 3);
+    REQUIRE(mesh.index(2) == 2);
+
+    // Indices past 16 bits keep 32-bit storage.
+    indices[2] = 70000;
+    L3DMesh bigMesh(L3D_NULLPTR, vertices, 3, indices, 3, L3D_NULLPTR, L3D_VERTEX_POS3);
+    REQUIRE(bigMesh.indexBuffer()->indexType() == L3D_INDEX_UNSIGNED_INT);
+    REQUIRE(bigMesh.index(2) == 70000);
+}
+
+static void countRelease(void *, void *userData)
+{
+    ++*(int *)userData;
+}
+
+TEST_CASE("Test L3DBuffer adoption", "[leaf3d][mesh][L3DBuffer]")
+{
+    unsigned short indices[] = {0, 1, 2};
+    int releases = 0;
+
+    {
+        // Adopted data is used in place, not copied.
+        L3DBuffer buffer(L3D_NULLPTR, L3D_BUFFER_INDEX, indices, sizeof(indices), sizeof(unsigned short), L3D_DRAW_STATIC, countRelease, &releases);
+        REQUIRE(buffer.data() == indices);
+        REQUIRE(buffer.count() == 3);
+        REQUIRE(releases == 0);
+    }
+
+    REQUIRE(releases == 1);
+
+    // Discarded data is released once.
+    L3DBuffer buffer(L3D_NULLPTR, L3D_BUFFER_INDEX, indices, sizeof(indices), sizeof(unsigned short), L3D_DRAW_STATIC, countRelease, &releases);
+    buffer.discardData();
+    buffer.discardData();
+    REQUIRE(buffer.data() == L3D_NULLPTR);
+    REQUIRE(releases == 2);
+}
+
+TEST_CASE("Test L3DMeshOptimizer", "[leaf3d][mesh][optimizer]")
+{
+    // A quad made of two triangles with unshared vertices.
+    float quad[] = {
+        0, 0, 0, 1, 0, 0, 1, 1, 0,
+        0, 0, 0, 1, 1, 0, 0, 1, 0};
+    std::vector<float> vertices(quad, quad + 18);
+    std::vector<unsigned int> indices;
+    for (unsigned int i = 0; i < 6; ++i)
+        indices.push_back(i);
+
+    REQUIRE(L3DMeshOptimizer::weldVertices(vertices, indices, 3) == 4);
+    REQUIRE(vertices.size() == 12);
+    REQUIRE(indices[3] == 0);
+    REQUIRE(indices[4] == 2);
+
+    // A grid with its triangles in a cache-hostile order.
+    const unsigned int size = 16;
+    std::vector<float> grid;
+    for (unsigned int y = 0; y <= size; ++y)
+        for (unsigned int x = 0; x <= size; ++x)
+        {
+            grid.push_back((float)x);
+            grid.push_back((float)y);
+            grid.push_back(0);
+        }
+
+    std::vector<unsigned int> gridIndices;
+    for (unsigned int x = 0; x < size; ++x)
+        for (unsigned int y = 0; y < size; ++y)
+        {
+            unsigned int v = y * (size + 1) + x;
+            unsigned int quadIndices[] = {v, v + 1, v + size + 2, v, v + size + 2, v + size + 1};
+            gridIndices.insert(gridIndices.end(), quadIndices, quadIndices + 6);
+        }
+    std::swap_ranges(gridIndices.begin(), gridIndices.begin() + gridIndices.size() / 2, gridIndices.begin() + gridIndices.size() / 2);
+
+    L3DMeshOptimizerStats stats = L3DMeshOptimizer::optimize(grid, gridIndices, 3);
+    REQUIRE(stats.vertexCountAfter == (size + 1) * (size + 1));
+    REQUIRE(gridIndices.size() == size * size * 6);
+    REQUIRE(stats.after.acmr < stats.before.acmr);
+    REQUIRE(stats.after.atvr >= 1.0f);
+
+    // Vertices are stored in the order they are first used.
+    REQUIRE(gridIndices[0] == 0);
+}
+
+TEST_CASE("Test L3DMesh levels of detail", "[leaf3d][mesh][lod]")
+{
+    // A flat grid simplifies with no error, keeping its border.
+    const unsigned int size = 16;
+    std::vector<float> vertices;
+    for (unsigned int y = 0; y <= size; ++y)
+        for (unsigned int x = 0; x <= size; ++x)
+        {
+            vertices.push_back((float)x);
+            vertices.push_back((float)y);
+            vertices.push_back(0);
+        }
+
+    std::vector<unsigned int> indices;
+    for (unsigned int y = 0; y < size; ++y)
+        for (unsigned int x = 0; x < size; ++x)
+        {
+            unsigned int v = y * (size + 1) + x;
+            unsigned int quadIndices[] = {v, v + 1, v + size + 2, v, v + size + 2, v + size + 1};
+            indices.insert(indices.end(), quadIndices, quadIndices + 6);
+        }
+
+    std::vector<unsigned int> simplified;
+    float error = L3DMeshOptimizer::simplify(vertices, 3, indices, indices.size() / 2, simplified);
+    REQUIRE(simplified.size() <= indices.size() / 2);
+    REQUIRE(simplified.size() % 3 == 0);
+    REQUIRE(error < 1e-3f);
+
+    L3DMeshLod lods[L3D_MAX_MESH_LODS];
+    unsigned int fullCount = indices.size();
+    unsigned int lodCount = L3DMeshOptimizer::buildLods(vertices, 3, indices, lods, L3D_MAX_MESH_LODS);
+    REQUIRE(lodCount > 1);
+    REQUIRE(lods[0].indexCount == fullCount);
+    REQUIRE(lods[1].indexOffset == fullCount);
+    REQUIRE(lods[lodCount - 1].indexOffset + lods[lodCount - 1].indexCount == indices.size());
+
+    // Selection switches levels past a margin around the error threshold.
+    float triangle[3 * 3] = {0};
+    unsigned int triangleIndices[] = {0, 1, 2, 0, 1, 2};
+    L3DMeshLod triangleLods[] = {{0, 3, 0.0f}, {3, 3, 1.0f}};
+
+    L3DMesh mesh(L3D_NULLPTR, triangle, 3, triangleIndices, 6, L3D_NULLPTR, L3D_VERTEX_POS3);
+    REQUIRE(mesh.setLods(triangleLods, 2));
+    REQUIRE(mesh.indexCount() == 3);
+    REQUIRE(mesh.selectLod(L3DVec3(0, 0, 1000), 1.0f, 0.01f) == 1);
+    REQUIRE(mesh.selectLod(L3DVec3(0, 0, 120), 1.0f, 0.01f) == 1);
+    REQUIRE(mesh.selectLod(L3DVec3(0, 0, 50), 1.0f, 0.01f) == 0);
+    REQUIRE(mesh.selectLod(L3DVec3(0, 0, 120), 1.0f, 0.01f) == 0);
+
+    // Distances are measured to the bounds: next to the surface of a
+    // large mesh, far from its origin, the full mesh is drawn.
+    mesh.setBounds(L3DVec3(-100.0f), L3DVec3(100.0f));
+    REQUIRE(mesh.selectLod(L3DVec3(0, 0, 1000), 1.0f, 0.01f) == 1);
+    REQUIRE(mesh.selectLod(L3DVec3(0, 0, 150), 1.0f, 0.01f) == 0);
+
+    L3DMeshLod outOfRange = {3, 6, 1.0f};
+    REQUIRE(!mesh.setLods(&outOfRange, 1));
+}
+
+TEST_CASE("Test L3DMesh tangents", "[leaf3d][mesh][tangents]")
+{
+    // A quad in the XY plane, with U along X and two UV sets.
+    float vertices[] = {
+        0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 5, 5,
+        1, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 5, 5,
+        1, 1, 0, 0, 0, 1, 0, 0, 0, 1, 1, 5, 5,
+        0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 1, 5, 5};
+    unsigned int indices[] = {0, 1, 2, 0, 2, 3};
+    L3DJobSystem jobSystem(2);
+
+    REQUIRE(L3DMesh::computeTangents(vertices, 4, indices, 6, L3D_VERTEX_POS3_NOR3_TAN3_UV2_UV2, L3D_TANGENTS_MIKKTSPACE, &jobSystem));
+    for (unsigned int v = 0; v < 4; ++v)
+    {
+        REQUIRE(vertices[v * 13 + 6] == Approx(1));
+        REQUIRE(vertices[v * 13 + 7] == Approx(0));
+        REQUIRE(vertices[v * 13 + 8] == Approx(0));
+    }
+
+    REQUIRE(L3DMesh::computeTangents(vertices, 4, indices, 6, L3D_VERTEX_POS3_NOR3_TAN3_UV2_UV2));
+    REQUIRE(vertices[2 * 13 + 6] == Approx(1));
+    REQUIRE(!L3DMesh::computeTangents(vertices, 4, indices, 6, L3D_VERTEX_POS3_NOR3_UV2));
+}
+
+TEST_CASE("Test L3DMesh tangents of welded vertices", "[leaf3d][mesh][tangents]")
+{
+    // Two faces sharing the (1, 0)-(0, 1) edge, with tangents (1, 0, 0)
+    // and (2, -1, 0) / sqrt(5), imported without shared vertices.
+    float face[] = {
+        0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,
+        1, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0,
+        0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 1,
+        1, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0,
+        1, 1, 0, 0, 0, 1, 0, 0, 0, 0, 2,
+        0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    std::vector<float> vertices(face, face + 6 * 11);
+    std::vector<unsigned int> indices;
+    for (unsigned int i = 0; i < 6; ++i)
+        indices.push_back(i);
+
+    // Welded first, shared vertices blend both faces.
+    unsigned int vertexCount = L3DMeshOptimizer::weldVertices(vertices, indices, L3D_VERTEX_POS3_NOR3_TAN3_UV2);
+    REQUIRE(vertexCount == 4);
+    REQUIRE(L3DMesh::computeTangents(&vertices[0], vertexCount, &indices[0], indices.size(), L3D_VERTEX_POS3_NOR3_TAN3_UV2, L3D_TANGENTS_MIKKTSPACE));
+
+    float *shared = &vertices[indices[1] * 11];
+    REQUIRE(shared[6] > 0.9f);
+    REQUIRE(shared[7] < -0.01f);
+    REQUIRE(shared[7] > -0.44f);
+    REQUIRE(vertices[indices[0] * 11 + 7] == Approx(0));
+
+    // Tangents don't prevent welding anymore.
+    REQUIRE(L3DMeshOptimizer::weldVertices(vertices, indices, L3D_VERTEX_POS3_NOR3_TAN3_UV2) == 4);
+}
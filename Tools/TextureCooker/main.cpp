@@ -0,0 +1,79 @@
+/*
+ * This file is part of the leaf3d project.
+ *
+ * Copyright 2014-2015 Emanuele Bertoldi. All rights reserved.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * You should have received a copy of the modified BSD License along with this
+ * program. If not, see <http://www.opensource.org/licenses/bsd-license.php>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <leaf3d/leaf3d.h>
+#include <leaf3d/leaf3dut.h>
+
+using namespace l3d;
+
+static void printUsage()
+{
+    printf("Usage: TextureCooker [--bc1 | --bc3] [--linear] image...\n");
+    printf("Cook images to KTX textures with mip chains, written next to them.\n");
+    printf("  --bc1     compress to BC1 (opaque or 1-bit alpha)\n");
+    printf("  --bc3     compress to BC3 (with alpha)\n");
+    printf("  --linear  filter mip levels of non-color data (e.g. normal maps)\n");
+}
+
+int main(int argc, char **argv)
+{
+    L3DImageFormat compression = L3D_UNKNOWN;
+    bool srgb = true;
+    std::vector<const char *> filenames;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--bc1") == 0)
+            compression = L3D_BC1;
+        else if (strcmp(argv[i], "--bc3") == 0)
+            compression = L3D_BC3;
+        else if (strcmp(argv[i], "--linear") == 0)
+            srgb = false;
+        else if (argv[i][0] == '-')
+        {
+            printUsage();
+            return -1;
+        }
+        else
+            filenames.push_back(argv[i]);
+    }
+
+    if (filenames.empty())
+    {
+        printUsage();
+        return -1;
+    }
+
+    // No renderer is needed: a bare context provides the worker pool.
+    L3DContext *context = l3dCreateContext();
+    l3dMakeCurrent(context);
+    l3dutInit("");
+
+    int cooked = l3dutCookTextures(&filenames[0], filenames.size(), compression, srgb);
+    printf("Cooked %d of %d textures\n", cooked, (int)filenames.size());
+
+    l3dDestroyContext(context);
+
+    return cooked == (int)filenames.size() ? 0 : -2;
+}